@@ -0,0 +1,95 @@
+#pragma once
+
+#include "TcpSocket.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <expected>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+struct PoolOptions {
+    // Connections open to one backend at most, idle or checked out.
+    size_t maxConnections = 16;
+    // Idle connections kept per backend. 0 closes every connection after one request.
+    size_t maxIdle = 16;
+    // Idle connections older than this are closed instead of reused.
+    std::chrono::milliseconds idleTimeout { 30000 };
+    // How long checkout waits when maxConnections are checked out.
+    std::chrono::milliseconds checkoutTimeout { 1000 };
+};
+
+// Keep-alive connections to the backends, so a request does not pay for a TCP
+// handshake and leave a socket in TIME_WAIT behind. Thread safe.
+class ConnectionPool {
+public:
+    // A checked out connection. Goes back to the pool when destroyed, unless discarded.
+    class Lease {
+    public:
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&&) = delete;
+        ~Lease();
+
+        TcpSocket& socket() { return *socket_; }
+        // Whether the connection served an earlier request, so the backend may have
+        // closed it in the meantime.
+        bool reused() const { return reused_; }
+        // Closes the connection instead of returning it, as after an error it is in an
+        // unknown state.
+        void discard();
+
+    private:
+        friend class ConnectionPool;
+        Lease(ConnectionPool& pool, int port, TcpSocket socket, bool reused);
+
+        ConnectionPool* pool_;
+        int port_;
+        std::optional<TcpSocket> socket_;
+        bool reused_;
+    };
+
+    explicit ConnectionPool(PoolOptions options = {});
+
+    // The most recently returned idle connection to the backend, or a new one.
+    // Fails if the backend cannot be connected to, or if maxConnections stay checked
+    // out for checkoutTimeout.
+    std::expected<Lease, std::string> checkout(int port);
+    // Like checkout, but without blocking: fails right away if maxConnections are
+    // checked out, and a new connection is non-blocking and may still be connecting.
+    // A pool hands out connections with either checkout or tryCheckout, not both.
+    std::expected<Lease, std::string> tryCheckout(int port);
+
+    size_t idleConnections(int port) const;
+    size_t openConnections(int port) const;
+
+private:
+    struct IdleConnection {
+        TcpSocket socket;
+        std::chrono::steady_clock::time_point since;
+    };
+    struct Backend {
+        // The oldest first.
+        std::deque<IdleConnection> idle {};
+        size_t open {};
+    };
+
+    enum class Reservation {
+        Idle,
+        New,
+        Full
+    };
+
+    // With the lock held: sets idle to an idle connection that is still usable, or
+    // counts a new one if the cap allows.
+    Reservation reserve(Backend& backend, std::optional<TcpSocket>& idle);
+    void release(int port, std::optional<TcpSocket> socket);
+
+    PoolOptions options_;
+    mutable std::mutex mutex_ {};
+    std::condition_variable released_ {};
+    std::map<int, Backend> backends_ {};
+};
@@ -1,10 +1,9 @@
 #pragma once
 
+#include <poll.h>
 #include <string_view>
 #include <vector>
 
-struct pollfd;
-
 enum class ClientState {
     Connected,
     Disconnected
@@ -1,71 +1,154 @@
 #pragma once
 
+#include "ConnectionPool.h"
+#include "Splicer.h"
+#include "StreamBuffer.h"
+#include "Strategy.h"
+#include "TcpSocket.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <expected>
-#include <future>
-#include <map>
+#include <memory>
 #include <mutex>
 #include <optional>
-#include <poll.h>
+#include <string>
 #include <string_view>
 #include <thread>
+#include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vector>
 
-struct Client {
-    Client() = default;
-    // TODO: Read/Write locks perhaps
-    mutable std::mutex mutex {};
-    pollfd pollFd {};
-
-    Client(const Client& other)
-    {
-        pollFd = other.pollFd;
-        std::lock(mutex, other.mutex);
-        std::lock_guard<std::mutex> lhs_lk(mutex, std::adopt_lock);
-        std::lock_guard<std::mutex> rhs_lk(other.mutex, std::adopt_lock);
-    }
-
-    Client& operator=(const Client& other)
-    {
-        if (this != &other) {
-            pollFd = other.pollFd;
-            std::lock(mutex, other.mutex);
-            std::lock_guard<std::mutex> lhs_lk(mutex, std::adopt_lock);
-            std::lock_guard<std::mutex> rhs_lk(other.mutex, std::adopt_lock);
-        }
+enum class ForwardMode {
+    // Every client gets a backend connection of its own as it connects, and the bytes
+    // of both directions are streamed through a buffer per direction until both sides
+    // are done. Backend connections are not reused.
+    Stream,
+    // For backends that answer every message with a single reply, such as the echo
+    // server: a message read from the client goes to the next backend over a pooled
+    // connection, and the reply goes back before the client is read again. A message
+    // or reply is whatever one read returns.
+    Messages,
+    // Like Stream, but the bytes are spliced through kernel pipes and never copied to
+    // user space.
+    Splice
+};
 
-        return *this;
-    }
+// Both directions of a client connected to its backend.
+template <typename Direction>
+struct Relay {
+    Direction toBackend;
+    Direction toClient;
 };
 
-enum class ForwardResult {
-    Success,
-    Failure
+// A client connection and what it has in flight. Only the reactor thread uses it.
+struct Client {
+    enum class State {
+        // Waiting for a message from the client.
+        Reading,
+        // No backend is available yet; tried again a bit later.
+        WaitingForBackend,
+        // A new backend connection is being established.
+        Connecting,
+        // Sending the message to the backend.
+        Forwarding,
+        // Waiting for the reply of the backend.
+        AwaitingReply,
+        // Sending the reply to the client.
+        Replying,
+        // Streaming or splicing both directions.
+        Relaying,
+        Closed
+    };
+
+    uint64_t id {};
+    int fd { -1 };
+    State state { State::Reading };
+    // The message while it is forwarded, then the reply while it is sent back.
+    std::string buffer {};
+    size_t sent {};
+    // The backend picked for the current message, or the connection in stream and
+    // splice mode, when it was picked and whether it answered since.
+    BackendStats* picked {};
+    std::chrono::steady_clock::time_point pickedAt {};
+    bool answered {};
+    // Waits for a backend and failed new backend connections for the current message,
+    // to give up on it.
+    int tries {};
+    int failures {};
+    // A pooled backend connection in message mode, or one of the client's own in
+    // stream and splice mode, as it is never reused.
+    std::optional<ConnectionPool::Lease> backend {};
+    std::optional<TcpSocket> connection {};
+    // In stream and splice mode, once connected to the backend.
+    std::variant<std::monostate, Relay<StreamBuffer>, Relay<Splicer>> relay {};
+    // What epoll watches for on either socket.
+    uint32_t clientEvents {};
+    uint32_t backendEvents {};
 };
 
 class LoadBalancer {
 public:
-    LoadBalancer();
+    explicit LoadBalancer(PoolOptions poolOptions = {}, ForwardMode mode = ForwardMode::Stream,
+        std::unique_ptr<Strategy> strategy = makeStrategy(StrategyKind::RoundRobin));
     ~LoadBalancer();
+    // Proxies clients connecting to port to the backends with one epoll reactor on the
+    // calling thread: no socket is ever waited on, so a slow backend holds up only the
+    // clients whose messages it has. Never returns.
     void start(const std::string_view port);
 
-    static std::pair<ForwardResult, int> forwardToBackend(Client& client, std::string data, int port);
-    std::optional<std::future<std::pair<ForwardResult, int>>> handleClient(Client& client);
-    void registerFileDescriptor(int fd, short flags);
-
-    void addBackend(int port);
+    // Before start(), as the reactor reads the backends without a lock. Throws
+    // std::invalid_argument for a weight of 0.
+    void addBackend(int port, unsigned weight = 1);
 
 private:
-    std::expected<int, std::string_view> getNextPort();
-    bool isReady_ = false;
-    int getNextPortIndex();
+    // The backend the strategy picks among those that are up, without waiting.
+    std::expected<BackendStats*, std::string_view> pickBackend();
+    // The backend answered the client for the first time since it was picked.
+    void backendAnswered(Client& client);
     void checkAllBackends();
     void startHealthChecker();
-    std::thread healthCheckerThread;
 
-    std::map<int, Client> clients_ {};
-    std::vector<pollfd> fds_ {};
+    void acceptClients(int listener);
+    void onClientEvent(Client& client, uint32_t events);
+    void onBackendEvent(Client& client, uint32_t events);
+    // Picks a backend for the client and checks out a connection.
+    void dispatch(Client& client);
+    // The backend connection is ready to use.
+    void onBackendConnected(Client& client);
+    void startRelay(Client& client);
+    void relay(Client& client, uint32_t clientEvents, uint32_t backendEvents);
+    void sendMessage(Client& client);
+    void receiveReply(Client& client);
+    void sendReply(Client& client);
+    // The backend connection failed; tries another one or gives up on the client.
+    void backendFailed(Client& client);
+    void waitForBackend(Client& client);
+    void retryWaitingClients();
+    void releaseBackend(Client& client, bool reusable);
+    void closeClient(Client& client);
+    // Milliseconds until the next client waiting for a backend is due, -1 if none.
+    int nextTimeout() const;
+    void watchClient(Client& client, uint32_t events);
+    void watchBackend(Client& client, uint32_t events);
 
-    int numForwards {};
-    std::mutex beMutex {};
-    std::vector<std::pair<int, bool>> backendServers {};
-};
\ No newline at end of file
+    int epollFd_ { -1 };
+    uint64_t nextClientId_ {};
+    std::unordered_map<uint64_t, Client> clients_ {};
+    // The clients waiting for a backend and when to try again, the earliest first.
+    std::deque<std::pair<std::chrono::steady_clock::time_point, uint64_t>> waiting_ {};
+    ConnectionPool pool_;
+    ForwardMode mode_;
+    // Messages and replies are read into it in message mode.
+    std::vector<char> readBuffer_;
+
+    std::unique_ptr<Strategy> strategy_;
+    Backends backends_ {};
+    // Only for adding backends while the health checker reads them.
+    std::mutex backendsMutex_ {};
+    // Last, as it uses the backends as soon as it starts.
+    std::thread healthCheckerThread;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <expected>
+#include <string>
+
+// One direction of an L4 connection: moves the bytes read from one socket to another
+// through a kernel pipe with splice(), so they are never copied to user space. The
+// sockets must be non-blocking. Once the source is at its end and the pipe is drained,
+// the destination is shut down for writing, so the peer sees the half-close.
+class Splicer {
+public:
+    static std::expected<Splicer, std::string> create();
+    Splicer(const Splicer&) = delete;
+    Splicer& operator=(const Splicer&) = delete;
+    Splicer(Splicer&& other) noexcept;
+    Splicer& operator=(Splicer&&) = delete;
+    ~Splicer();
+
+    // Moves what it can from from to to without blocking and returns how many bytes
+    // were written to to. Fails with errno if either socket fails.
+    std::expected<size_t, int> pump(int from, int to);
+
+    // Whether the next pump needs from to be readable.
+    bool wantsRead() const { return !eof_ && !stalled_ && pending_ < capacity_; }
+    // Whether the next pump needs to to be writable.
+    bool wantsWrite() const { return pending_ > 0; }
+    // Everything was moved and to shut down.
+    bool done() const { return shutDown_; }
+
+private:
+    Splicer(int readFd, int writeFd, size_t capacity);
+
+    int readFd_;
+    int writeFd_;
+    size_t capacity_;
+    // Bytes in the pipe.
+    size_t pending_ {};
+    // Reading failed with bytes in the pipe; not tried again before some are written.
+    bool stalled_ {};
+    bool eof_ {};
+    bool shutDown_ {};
+};
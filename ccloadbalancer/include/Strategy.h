@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// What the strategies know of a backend. Updated by the reactor and the health
+// checker, and read when picking, all without locks: concurrent updates may make the
+// latency estimate a little off, never torn.
+class BackendStats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Throws std::invalid_argument for a weight of 0.
+    explicit BackendStats(int port, unsigned weight = 1);
+
+    int port() const { return port_; }
+    // Its share of the traffic relative to the other backends.
+    unsigned weight() const { return weight_; }
+
+    bool alive() const { return alive_.load(std::memory_order_relaxed); }
+    void setAlive(bool alive) { alive_.store(alive, std::memory_order_relaxed); }
+
+    // A message, or a connection in stream and splice mode, went to the backend.
+    void begin() { outstanding_.fetch_add(1, std::memory_order_relaxed); }
+    // It is over, answered or not.
+    void end() { outstanding_.fetch_sub(1, std::memory_order_relaxed); }
+    unsigned outstanding() const { return outstanding_.load(std::memory_order_relaxed); }
+
+    // The backend answered after latency. A slower answer than the estimate replaces
+    // it at once, faster ones bring it down gradually.
+    void observe(std::chrono::nanoseconds latency, Clock::time_point now);
+    // The peak EWMA of the latency in nanoseconds, decayed for the time since the last
+    // answer so that a backend left alone gets tried again. 0 before any answer.
+    double latency(Clock::time_point now) const;
+
+private:
+    const int port_;
+    const unsigned weight_;
+    std::atomic<bool> alive_ { true };
+    std::atomic<unsigned> outstanding_ {};
+    std::atomic<double> latency_ {};
+    // When latency_ was last updated, in ticks of Clock.
+    std::atomic<Clock::rep> observed_ {};
+};
+
+using Backends = std::vector<std::unique_ptr<BackendStats>>;
+
+// How the next backend is picked.
+class Strategy {
+public:
+    virtual ~Strategy() = default;
+    // One of the backends that are alive, or nullptr if none is. May be called from
+    // several threads at once.
+    virtual BackendStats* pick(const Backends& backends, BackendStats::Clock::time_point now) = 0;
+};
+
+enum class StrategyKind {
+    // Every backend that is alive in turn.
+    RoundRobin,
+    // In turn, as often as their weights say, interleaved.
+    WeightedRoundRobin,
+    // The one with the fewest outstanding messages or connections for its weight.
+    LeastOutstanding,
+    // The one with the lowest peak EWMA latency times outstanding messages or
+    // connections, for its weight.
+    PeakEwma,
+    // The less loaded of two picked at random, by outstanding messages or connections
+    // for their weights.
+    PowerOfTwoChoices
+};
+
+constexpr std::array<StrategyKind, 5> allStrategies { StrategyKind::RoundRobin, StrategyKind::WeightedRoundRobin,
+    StrategyKind::LeastOutstanding, StrategyKind::PeakEwma, StrategyKind::PowerOfTwoChoices };
+
+std::unique_ptr<Strategy> makeStrategy(StrategyKind kind);
+// The names used on the command line: round-robin, weighted-round-robin,
+// least-outstanding, peak-ewma and p2c.
+std::string_view strategyName(StrategyKind kind);
+std::optional<StrategyKind> parseStrategy(std::string_view name);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <expected>
+#include <vector>
+
+// One direction of a streamed connection: copies the bytes read from one socket to
+// another through a buffer of its own. Reading stops while the buffer is full, so a
+// slow reader holds back a fast writer instead of the buffer growing. The sockets must
+// be non-blocking. Once the source is at its end and the buffer is drained, the
+// destination is shut down for writing, so the peer sees the half-close.
+class StreamBuffer {
+public:
+    static constexpr size_t defaultCapacity = 64 * 1024;
+
+    explicit StreamBuffer(size_t capacity = defaultCapacity);
+
+    // Moves what it can from from to to without blocking and returns how many bytes
+    // were written to to. Fails with errno if either socket fails.
+    std::expected<size_t, int> pump(int from, int to);
+
+    // Whether the next pump needs from to be readable.
+    bool wantsRead() const { return !eof_ && end_ < buffer_.size(); }
+    // Whether the next pump needs to to be writable.
+    bool wantsWrite() const { return begin_ < end_; }
+    // Everything was moved and to shut down.
+    bool done() const { return shutDown_; }
+
+private:
+    std::vector<char> buffer_;
+    // The bytes read and not written yet.
+    size_t begin_ {};
+    size_t end_ {};
+    bool eof_ {};
+    bool shutDown_ {};
+};
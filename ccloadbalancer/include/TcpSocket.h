@@ -1,24 +1,43 @@
 #pragma once
 
-#include <array>
 #include <expected>
+#include <string>
 #include <string_view>
+#include <utility>
 
 class TcpSocket {
 public:
     TcpSocket() = default;
     TcpSocket(int port);
+    // A non-blocking socket connecting to port. The connection may still be in
+    // progress; it is done once the socket is writable.
+    static TcpSocket connecting(int port);
+    TcpSocket(const TcpSocket&) = delete;
+    TcpSocket& operator=(const TcpSocket&) = delete;
+    TcpSocket(TcpSocket&& other) noexcept;
+    TcpSocket& operator=(TcpSocket&& other) noexcept;
     ~TcpSocket();
 
     int send(std::string_view data) const noexcept;
 
-    using RecvValue = std::pair<std::array<char, 1024>, int>;
+    // The bytes of a single recv(), as many as are available up to 64 KB.
+    using RecvValue = std::pair<std::string, int>;
     RecvValue recv();
+    // Fails with 0 once the peer closed, -1 on an error.
     std::expected<RecvValue, int> recvWithError();
+    // Fails with errno, EAGAIN if nothing is available.
     std::expected<RecvValue, int> recvNonBlocking();
 
     int getFd() const noexcept;
+    // Whether the connection is still open with nothing left to read, so a new
+    // request can be sent on it.
+    bool isReusable() const noexcept;
+    // The error of a connection that was in progress, 0 if it succeeded.
+    int pendingError() const noexcept;
 
 private:
-    int clientFd {};
+    // Fails with 0 once the peer closed, errno on an error.
+    std::expected<RecvValue, int> receive(int flags);
+
+    int clientFd { -1 };
 };
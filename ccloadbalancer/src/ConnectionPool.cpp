@@ -0,0 +1,150 @@
+#include "ConnectionPool.h"
+
+#include "TcpSocket.h"
+
+#include <chrono>
+#include <cstddef>
+#include <expected>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+ConnectionPool::Lease::Lease(ConnectionPool& pool, const int port, TcpSocket socket, const bool reused)
+    : pool_ { &pool }
+    , port_ { port }
+    , socket_ { std::move(socket) }
+    , reused_ { reused }
+{
+}
+
+ConnectionPool::Lease::Lease(Lease&& other) noexcept
+    : pool_ { std::exchange(other.pool_, nullptr) }
+    , port_ { other.port_ }
+    , socket_ { std::move(other.socket_) }
+    , reused_ { other.reused_ }
+{
+}
+
+ConnectionPool::Lease::~Lease()
+{
+    if (pool_ != nullptr) {
+        pool_->release(port_, std::move(socket_));
+    }
+}
+
+void ConnectionPool::Lease::discard()
+{
+    socket_.reset();
+}
+
+ConnectionPool::ConnectionPool(const PoolOptions options)
+    : options_ { options }
+{
+}
+
+ConnectionPool::Reservation ConnectionPool::reserve(Backend& backend, std::optional<TcpSocket>& idle)
+{
+    const auto now = std::chrono::steady_clock::now();
+    while (!backend.idle.empty() && now - backend.idle.front().since > options_.idleTimeout) {
+        backend.idle.pop_front();
+        --backend.open;
+    }
+    while (!backend.idle.empty()) {
+        idle.emplace(std::move(backend.idle.back().socket));
+        backend.idle.pop_back();
+        if (idle->isReusable()) {
+            return Reservation::Idle;
+        }
+        // Closed by the backend, or a reply was left unread.
+        idle.reset();
+        --backend.open;
+    }
+    if (backend.open < options_.maxConnections) {
+        ++backend.open;
+        return Reservation::New;
+    }
+    return Reservation::Full;
+}
+
+std::expected<ConnectionPool::Lease, std::string> ConnectionPool::checkout(const int port)
+{
+    const auto deadline = std::chrono::steady_clock::now() + options_.checkoutTimeout;
+    std::unique_lock lock { mutex_ };
+    auto& backend = backends_[port];
+    std::optional<TcpSocket> idle {};
+    auto reservation = reserve(backend, idle);
+    while (reservation == Reservation::Full) {
+        if (released_.wait_until(lock, deadline) == std::cv_status::timeout) {
+            std::string error { "No connection to backend " };
+            error.append(std::to_string(port)).append(" available");
+            return std::unexpected { std::move(error) };
+        }
+        reservation = reserve(backend, idle);
+    }
+    if (reservation == Reservation::Idle) {
+        return Lease { *this, port, std::move(idle.value()), true };
+    }
+
+    lock.unlock();
+    try {
+        return Lease { *this, port, TcpSocket { port }, false };
+    } catch (const std::invalid_argument& e) {
+        release(port, std::nullopt);
+        return std::unexpected { e.what() };
+    }
+}
+
+std::expected<ConnectionPool::Lease, std::string> ConnectionPool::tryCheckout(const int port)
+{
+    std::unique_lock lock { mutex_ };
+    std::optional<TcpSocket> idle {};
+    switch (reserve(backends_[port], idle)) {
+    case Reservation::Idle:
+        return Lease { *this, port, std::move(idle.value()), true };
+    case Reservation::Full: {
+        std::string error { "No connection to backend " };
+        error.append(std::to_string(port)).append(" available");
+        return std::unexpected { std::move(error) };
+    }
+    case Reservation::New:
+        break;
+    }
+
+    lock.unlock();
+    try {
+        return Lease { *this, port, TcpSocket::connecting(port), false };
+    } catch (const std::invalid_argument& e) {
+        release(port, std::nullopt);
+        return std::unexpected { e.what() };
+    }
+}
+
+void ConnectionPool::release(const int port, std::optional<TcpSocket> socket)
+{
+    {
+        std::lock_guard lock { mutex_ };
+        auto& backend = backends_[port];
+        if (socket.has_value() && backend.idle.size() < options_.maxIdle) {
+            backend.idle.push_back(IdleConnection { std::move(socket.value()), std::chrono::steady_clock::now() });
+        } else {
+            --backend.open;
+        }
+    }
+    released_.notify_one();
+}
+
+size_t ConnectionPool::idleConnections(const int port) const
+{
+    std::lock_guard lock { mutex_ };
+    const auto found = backends_.find(port);
+    return found == backends_.end() ? 0 : found->second.idle.size();
+}
+
+size_t ConnectionPool::openConnections(const int port) const
+{
+    std::lock_guard lock { mutex_ };
+    const auto found = backends_.find(port);
+    return found == backends_.end() ? 0 : found->second.open;
+}
@@ -16,6 +16,7 @@
 #include <sys/signal.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <unistd.h>
 #include <vector>
 
 #define PORT "8081"
@@ -147,23 +148,34 @@ void EchoServer::start(const std::string_view port)
             exit(1);
         }
 
-        for (const auto pollFd : fds_) {
+        // Clients accepted below are polled from the next round on.
+        const auto polled = fds_.size();
+        std::vector<int> disconnected {};
+        for (size_t i = 0; i < polled; ++i) {
+            const auto pollFd = fds_[i];
             if (pollFd.revents & POLL_IN) {
                 if (pollFd.fd == listener) {
                     int clientFd = detail::acceptNewClient(listener);
+                    if (clientFd == -1) {
+                        perror("accept");
+                        continue;
+                    }
                     detail::logInfo("Client connected. Fd= " + std::to_string(clientFd));
                     fds_.emplace_back(pollfd { .fd = clientFd, .events = POLL_IN, .revents = 0 });
                 } else {
                     const auto state = handleClient(pollFd.fd);
                     if (state == ClientState::Disconnected) {
-                        auto fdToRemove = pollFd.fd;
-                        fds_.erase(std::remove_if(fds_.begin(), fds_.end(), [fdToRemove](pollfd fdElem) {
-                            return fdElem.fd == fdToRemove;
-                        }),
-                            fds_.end());
+                        disconnected.push_back(pollFd.fd);
                     }
                 }
             }
         }
+        for (const auto fdToRemove : disconnected) {
+            close(fdToRemove);
+            fds_.erase(std::remove_if(fds_.begin(), fds_.end(), [fdToRemove](pollfd fdElem) {
+                return fdElem.fd == fdToRemove;
+            }),
+                fds_.end());
+        }
     }
 }
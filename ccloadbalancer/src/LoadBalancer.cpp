@@ -9,24 +9,26 @@
 #include <cstdlib>
 #include <cstring>
 #include <expected>
-#include <future>
+#include <fcntl.h>
 #include <iostream>
-#include <iterator>
 #include <memory>
 #include <mutex>
 #include <netdb.h>
 #include <optional>
-#include <poll.h>
 #include <stdexcept>
 #include <string>
 #include <string_view>
-#include <sys/poll.h>
+#include <sys/epoll.h>
 #include <sys/signal.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <unistd.h>
+#include <utility>
 #include <vector>
 
 #include <thread>
+#include <type_traits>
+#include <variant>
 
 #include "TcpSocket.h"
 
@@ -97,8 +99,57 @@ void sendData(int clientFd, const std::vector<char> &buffer)
     }
 }
 
-LoadBalancer::LoadBalancer()
-    : healthCheckerThread{[this]() { this->startHealthChecker(); }}
+namespace
+{
+// In message mode, what one read of a message or reply may return at most.
+constexpr size_t maxMessageSize = 64 * 1024;
+// How often, and how long, a client waits for a backend to come up.
+constexpr auto retryInterval = std::chrono::milliseconds(100);
+constexpr int maxTries = 100;
+// New backend connections that may fail for one message, or client when
+// relaying.
+constexpr int maxFailures = 3;
+
+// The epoll data of the listener, and of the sockets of a client.
+constexpr uint64_t listenerTag = UINT64_MAX;
+uint64_t clientTag(const Client &client) { return client.id << 1; }
+uint64_t backendTag(const Client &client) { return client.id << 1 | 1; }
+
+bool hasBackend(const Client &client)
+{
+    return client.backend.has_value() || client.connection.has_value();
+}
+
+TcpSocket &backendSocket(Client &client)
+{
+    return client.connection.has_value() ? *client.connection
+                                         : client.backend->socket();
+}
+
+int backendFd(Client &client) { return backendSocket(client).getFd(); }
+
+bool wouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK; }
+
+uint32_t interest(bool read, bool write)
+{
+    uint32_t events = 0;
+    if (read)
+    {
+        events |= EPOLLIN;
+    }
+    if (write)
+    {
+        events |= EPOLLOUT;
+    }
+    return events;
+}
+} // namespace
+
+LoadBalancer::LoadBalancer(const PoolOptions poolOptions, ForwardMode mode,
+                           std::unique_ptr<Strategy> strategy)
+    : pool_{poolOptions}, mode_{mode}, readBuffer_(maxMessageSize),
+      strategy_{std::move(strategy)},
+      healthCheckerThread{[this]() { this->startHealthChecker(); }}
 {
 }
 
@@ -107,209 +158,528 @@ LoadBalancer::~LoadBalancer()
     healthCheckerThread.join();
 }
 
-// TODO: Error handling
-
-int LoadBalancer::getNextPortIndex()
+std::expected<BackendStats *, std::string_view> LoadBalancer::pickBackend()
 {
-    std::lock_guard<std::mutex> lock{beMutex};
-    int nextPortIndex = 0;
-    std::string nextString{std::to_string(nextPortIndex)};
-    logInfo("Next port " + nextString);
-    nextPortIndex = numForwards % backendServers.size();
-    ++numForwards;
-    return nextPortIndex;
+    auto *backend =
+        strategy_->pick(backends_, std::chrono::steady_clock::now());
+    if (backend == nullptr)
+    {
+        return std::unexpected{"No backend available"};
+    }
+    return backend;
 }
 
-std::expected<int, std::string_view> LoadBalancer::getNextPort()
+void LoadBalancer::backendAnswered(Client &client)
 {
-    int nextPortIndex = 0;
-    int maxTries = 100;
-    while (!backendServers[nextPortIndex].second && maxTries > 0)
+    if (client.answered)
     {
-        --maxTries;
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        nextPortIndex = getNextPortIndex();
+        return;
     }
+    client.answered = true;
+    const auto now = std::chrono::steady_clock::now();
+    client.picked->observe(now - client.pickedAt, now);
+}
 
-    if (maxTries <= 0)
+void LoadBalancer::watchClient(Client &client, uint32_t events)
+{
+    if (client.clientEvents == events)
     {
-        return std::unexpected{"No backend available"};
+        return;
     }
+    epoll_event event{.events = events, .data = {.u64 = clientTag(client)}};
+    if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, client.fd, &event) == -1)
+    {
+        perror("epoll_ctl");
+    }
+    client.clientEvents = events;
+}
 
-    return std::expected<int, std::string_view>{
-        backendServers[nextPortIndex].first};
+void LoadBalancer::watchBackend(Client &client, uint32_t events)
+{
+    if (client.backendEvents == events)
+    {
+        return;
+    }
+    epoll_event event{.events = events, .data = {.u64 = backendTag(client)}};
+    if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, backendFd(client), &event) == -1)
+    {
+        perror("epoll_ctl");
+    }
+    client.backendEvents = events;
 }
 
-std::pair<ForwardResult, int>
-LoadBalancer::forwardToBackend(Client &client, const std::string data, int port)
+void LoadBalancer::acceptClients(int listener)
 {
-    std::lock_guard<std::mutex> lock(client.mutex);
-    int maxRetries = 3;
     while (true)
     {
+        struct sockaddr_storage their_addr;
+        socklen_t addr_size = sizeof their_addr;
+        int clientFd = accept4(listener, (struct sockaddr *)&their_addr,
+                               &addr_size, SOCK_NONBLOCK);
+        if (clientFd == -1)
+        {
+            if (!wouldBlock())
+            {
+                perror("accept");
+            }
+            return;
+        }
+        logInfo("Client connected. Fd= " + std::to_string(clientFd));
+
+        const auto id = nextClientId_++;
+        auto &client = clients_[id];
+        client.id = id;
+        client.fd = clientFd;
+        // Unless in message mode, the client is read once connected to its
+        // backend.
+        client.clientEvents =
+            interest(mode_ == ForwardMode::Messages, false);
+        epoll_event event{.events = client.clientEvents,
+                          .data = {.u64 = clientTag(client)}};
+        if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, clientFd, &event) == -1)
+        {
+            perror("epoll_ctl");
+            closeClient(client);
+        }
+        else if (mode_ != ForwardMode::Messages)
+        {
+            dispatch(client);
+        }
+        if (client.state == Client::State::Closed)
+        {
+            clients_.erase(id);
+        }
+    }
+}
+
+void LoadBalancer::onClientEvent(Client &client, uint32_t events)
+{
+    if (client.state == Client::State::Relaying)
+    {
+        relay(client, events, 0);
+        return;
+    }
+    if (client.state == Client::State::Replying && (events & EPOLLOUT))
+    {
+        sendReply(client);
+        return;
+    }
+    if (client.state != Client::State::Reading)
+    {
+        if (events & (EPOLLERR | EPOLLHUP))
+        {
+            closeClient(client);
+        }
+        return;
+    }
+
+    const auto n =
+        recv(client.fd, readBuffer_.data(), readBuffer_.size(), 0);
+    if (n < 0 && wouldBlock())
+    {
+        return;
+    }
+    if (n <= 0)
+    {
+        closeClient(client);
+        return;
+    }
+    client.buffer.assign(readBuffer_.data(), n);
+    client.sent = 0;
+    client.tries = 0;
+    client.failures = 0;
+    // Not read again until the reply is sent.
+    watchClient(client, 0);
+    dispatch(client);
+}
+
+void LoadBalancer::dispatch(Client &client)
+{
+    const auto picked = pickBackend();
+    if (!picked.has_value())
+    {
+        waitForBackend(client);
+        return;
+    }
+
+    const auto port = picked.value()->port();
+    if (mode_ != ForwardMode::Messages)
+    {
+        // Not pooled, so there are as many as there are clients.
         try
         {
-            TcpSocket backend{port};
+            client.connection.emplace(TcpSocket::connecting(port));
+        }
+        catch (const std::invalid_argument &e)
+        {
+            logInfo(e.what());
+            waitForBackend(client);
+            return;
+        }
+    }
+    else
+    {
+        auto backend = pool_.tryCheckout(port);
+        if (!backend.has_value())
+        {
+            logInfo(backend.error());
+            waitForBackend(client);
+            return;
+        }
+        client.backend.emplace(std::move(backend.value()));
+    }
+    client.picked = picked.value();
+    client.picked->begin();
+    client.pickedAt = std::chrono::steady_clock::now();
+    client.answered = false;
+    const auto reused = client.backend.has_value() && client.backend->reused();
+    client.state =
+        reused ? Client::State::Forwarding : Client::State::Connecting;
+    client.backendEvents = reused ? EPOLLIN : EPOLLOUT;
+    epoll_event event{.events = client.backendEvents,
+                      .data = {.u64 = backendTag(client)}};
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, backendFd(client), &event) == -1)
+    {
+        perror("epoll_ctl");
+        client.backendEvents = 0;
+        if (client.backend.has_value())
+        {
+            client.backend->discard();
+            client.backend.reset();
+        }
+        client.connection.reset();
+        client.picked->end();
+        closeClient(client);
+        return;
+    }
+    if (reused)
+    {
+        onBackendConnected(client);
+    }
+}
+
+void LoadBalancer::onBackendConnected(Client &client)
+{
+    if (mode_ != ForwardMode::Messages)
+    {
+        startRelay(client);
+        return;
+    }
+    client.state = Client::State::Forwarding;
+    sendMessage(client);
+}
 
-            logInfo("Forwarding FD: " + std::to_string(backend.getFd()));
-            auto sendRes = backend.send(data);
-            if (sendRes < 0)
+void LoadBalancer::startRelay(Client &client)
+{
+    if (mode_ == ForwardMode::Splice)
+    {
+        auto toBackend = Splicer::create();
+        auto toClient = Splicer::create();
+        if (!toBackend.has_value() || !toClient.has_value())
+        {
+            logInfo(toBackend.has_value() ? toClient.error()
+                                          : toBackend.error());
+            closeClient(client);
+            return;
+        }
+        client.relay.emplace<Relay<Splicer>>(std::move(toBackend.value()),
+                                             std::move(toClient.value()));
+    }
+    else
+    {
+        client.relay.emplace<Relay<StreamBuffer>>();
+    }
+    client.state = Client::State::Relaying;
+    relay(client, 0, 0);
+}
+
+void LoadBalancer::relay(Client &client, uint32_t clientEvents,
+                         uint32_t backendEvents)
+{
+    auto relayBoth = [&](auto &relay)
+    {
+        auto &[toBackend, toClient] = relay;
+        // A socket that hung up before it was shut down for writing was reset.
+        if (((clientEvents | backendEvents) & EPOLLERR) ||
+            ((clientEvents & EPOLLHUP) && !toClient.done()) ||
+            ((backendEvents & EPOLLHUP) && !toBackend.done()))
+        {
+            closeClient(client);
+            return;
+        }
+        const auto backend = backendFd(client);
+        auto pumped = toBackend.pump(client.fd, backend);
+        if (pumped.has_value())
+        {
+            pumped = toClient.pump(backend, client.fd);
+        }
+        if (!pumped.has_value())
+        {
+            logInfo("Relay failed. errno: " + std::to_string(pumped.error()));
+            closeClient(client);
+            return;
+        }
+        // The first bytes to the client time the backend.
+        if (pumped.value() > 0)
+        {
+            backendAnswered(client);
+        }
+        if (toBackend.done() && toClient.done())
+        {
+            closeClient(client);
+            return;
+        }
+        // Backpressure: a side is read only while the buffer towards the other
+        // one has room.
+        watchClient(client,
+                    interest(toBackend.wantsRead(), toClient.wantsWrite()));
+        watchBackend(client,
+                     interest(toClient.wantsRead(), toBackend.wantsWrite()));
+    };
+    std::visit(
+        [&](auto &relay)
+        {
+            if constexpr (!std::is_same_v<std::decay_t<decltype(relay)>,
+                                          std::monostate>)
             {
-                return {ForwardResult::Failure, client.pollFd.fd};
+                relayBoth(relay);
             }
-            const auto response = backend.recvWithError();
-            if (!response.has_value())
+        },
+        client.relay);
+}
+
+void LoadBalancer::onBackendEvent(Client &client, uint32_t events)
+{
+    if (!hasBackend(client))
+    {
+        return;
+    }
+    switch (client.state)
+    {
+        case Client::State::Connecting:
+        {
+            if (backendSocket(client).pendingError() != 0)
             {
-                return {ForwardResult::Failure, client.pollFd.fd};
+                backendFailed(client);
+                return;
             }
-            auto sendBackToClientRes =
-                ::send(client.pollFd.fd, response.value().first.data(),
-                       response.value().first.size(), 0);
-            if (sendBackToClientRes < 0)
+            onBackendConnected(client);
+            break;
+        }
+        case Client::State::Forwarding:
+        {
+            if (events & EPOLLERR)
             {
-                return {ForwardResult::Failure, client.pollFd.fd};
+                backendFailed(client);
+                return;
             }
-            return {ForwardResult::Success, client.pollFd.fd};
+            sendMessage(client);
+            break;
         }
-        catch (const std::invalid_argument &e)
+        case Client::State::AwaitingReply:
         {
-            logInfo(e.what());
-            maxRetries--;
-            if (maxRetries == 0)
+            receiveReply(client);
+            break;
+        }
+        case Client::State::Relaying:
+        {
+            relay(client, 0, events);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void LoadBalancer::sendMessage(Client &client)
+{
+    while (client.sent < client.buffer.size())
+    {
+        const auto n = send(backendFd(client), client.buffer.data() + client.sent,
+                            client.buffer.size() - client.sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (wouldBlock())
             {
-                return {ForwardResult::Failure, client.pollFd.fd};
+                watchBackend(client, EPOLLOUT);
             }
+            else
+            {
+                backendFailed(client);
+            }
+            return;
         }
+        client.sent += n;
     }
-    // Unreachable code
-    return {ForwardResult::Failure, client.pollFd.fd};
+    client.state = Client::State::AwaitingReply;
+    watchBackend(client, EPOLLIN);
 }
 
-// TODO: std::expected perhaps
-std::optional<std::future<std::pair<ForwardResult, int>>>
-LoadBalancer::handleClient(Client &client)
+void LoadBalancer::receiveReply(Client &client)
 {
-    std::array<char, 1024> buf{};
-    std::lock_guard<std::mutex> lock(client.mutex);
-    const auto clientFd = client.pollFd.fd;
-
-    int n = recv(clientFd, buf.data(), 1024, 0);
-    if (n < 0)
+    const auto n =
+        recv(backendFd(client), readBuffer_.data(), readBuffer_.size(), 0);
+    if (n < 0 && wouldBlock())
     {
-        logInfo("Received " + std::to_string(n) + " . There is an error");
-        logInfo("errno: " + std::to_string(errno));
-        // Remove client.
-        client.pollFd.fd = -1;
-        return std::nullopt;
+        return;
     }
-    logInfo("Received " + std::to_string(n) + " amount of bytes");
-    logInfo("Received msg: " + std::string{buf.data(), static_cast<size_t>(n)});
-
-    const auto nextPort = getNextPort();
-
-    if (!nextPort.has_value())
+    if (n <= 0)
     {
-        logInfo("Failed to get next port: " + std::string{nextPort.error()});
-        // Remove client.
-        client.pollFd.fd = -1;
-        return std::nullopt;
+        backendFailed(client);
+        return;
     }
-
-    // To avoid copies the data could be moved to a unique_ptr/shared_ptr
-    return std::async(forwardToBackend, std::ref(client),
-                      std::string{buf.data(), static_cast<size_t>(n)},
-                      nextPort.value());
+    backendAnswered(client);
+    releaseBackend(client, true);
+    client.buffer.assign(readBuffer_.data(), n);
+    client.sent = 0;
+    client.state = Client::State::Replying;
+    sendReply(client);
 }
 
-int acceptNewClient(int listener)
+void LoadBalancer::sendReply(Client &client)
 {
-    struct sockaddr_storage their_addr;
-    socklen_t addr_size = sizeof their_addr;
-    int clientFd = accept(listener, (struct sockaddr *)&their_addr, &addr_size);
-    return clientFd;
+    while (client.sent < client.buffer.size())
+    {
+        const auto n = send(client.fd, client.buffer.data() + client.sent,
+                            client.buffer.size() - client.sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (wouldBlock())
+            {
+                watchClient(client, EPOLLOUT);
+            }
+            else
+            {
+                closeClient(client);
+            }
+            return;
+        }
+        client.sent += n;
+    }
+    client.buffer.clear();
+    client.sent = 0;
+    client.state = Client::State::Reading;
+    watchClient(client, EPOLLIN);
 }
 
-void LoadBalancer::registerFileDescriptor(int fd, short flags)
+void LoadBalancer::backendFailed(Client &client)
 {
-    Client client{};
-    client.pollFd = pollfd{.fd = fd, .events = flags, .revents = 0};
-    clients_[fd] = client;
-    fds_.push_back(client.pollFd);
+    // The backend may have closed a pooled connection while it was idle, before
+    // it saw the message; that does not count as a failure.
+    const auto reused = client.backend.has_value() && client.backend->reused();
+    releaseBackend(client, false);
+    client.sent = 0;
+    if (!reused && ++client.failures == maxFailures)
+    {
+        logInfo("Failure during forward request");
+        closeClient(client);
+        return;
+    }
+    dispatch(client);
 }
 
-namespace
+void LoadBalancer::waitForBackend(Client &client)
 {
-void purgeInvalidFds(std::vector<pollfd> &clients)
-{
-
-    clients.erase(std::remove_if(clients.begin(), clients.end(),
-                                 [](const pollfd client)
-                                 { return client.fd == -1; }),
-                  clients.end());
+    if (++client.tries >= maxTries)
+    {
+        logInfo("No backend available");
+        // Streamed clients are not read before a backend is found. Closing with their
+        // bytes unread would reset the connection instead of ending it; one read,
+        // so that a client that keeps sending does not hold up the reactor.
+        recv(client.fd, readBuffer_.data(), readBuffer_.size(), MSG_DONTWAIT);
+        closeClient(client);
+        return;
+    }
+    client.state = Client::State::WaitingForBackend;
+    waiting_.emplace_back(std::chrono::steady_clock::now() + retryInterval,
+                          client.id);
 }
-void purgeInvalidClients(std::map<int, Client> &clients)
-{
 
-    auto itr = clients.begin();
-    while (itr != clients.end())
+void LoadBalancer::retryWaitingClients()
+{
+    const auto now = std::chrono::steady_clock::now();
+    while (!waiting_.empty() && waiting_.front().first <= now)
     {
-        if ((*itr).second.pollFd.fd == -1)
+        const auto id = waiting_.front().second;
+        waiting_.pop_front();
+        const auto found = clients_.find(id);
+        if (found == clients_.end() ||
+            found->second.state != Client::State::WaitingForBackend)
         {
-            itr = clients.erase(itr);
+            continue;
         }
-        else
+        dispatch(found->second);
+        if (found->second.state == Client::State::Closed)
         {
-            itr++;
+            clients_.erase(found);
         }
     }
 }
 
-void markFdsForRemoval(std::vector<pollfd> &fds,
-                       const std::map<int, Client> &clients)
+int LoadBalancer::nextTimeout() const
 {
-    for (auto &[fd, client] : clients)
+    if (waiting_.empty())
     {
-        std::lock_guard<std::mutex> lock(client.mutex);
-        if (client.pollFd.fd == -1)
-        {
-            auto iter = std::find_if(fds.begin(), fds.end(),
-                                     [fd](pollfd pfd) { return fd == pfd.fd; });
-            if (iter == fds.end())
-            {
-                continue;
-            }
-            iter->fd = -1;
-        }
+        return -1;
     }
+    const auto wait = std::chrono::ceil<std::chrono::milliseconds>(
+        waiting_.front().first - std::chrono::steady_clock::now());
+    return std::max<int>(0, wait.count());
 }
-void purgeFutures(
-    const std::vector<int> &futsToRemove,
-    std::map<int, std::future<std::pair<ForwardResult, int>>> &futures)
+
+void LoadBalancer::releaseBackend(Client &client, bool reusable)
 {
-    for (auto &futToRemove : futsToRemove)
+    if (epoll_ctl(epollFd_, EPOLL_CTL_DEL, backendFd(client), nullptr) == -1)
+    {
+        perror("epoll_ctl");
+        reusable = false;
+    }
+    client.backendEvents = 0;
+    if (!reusable && client.backend.has_value())
     {
-        futures.erase(futToRemove);
+        client.backend->discard();
     }
+    client.backend.reset();
+    client.connection.reset();
+    client.picked->end();
+}
+
+void LoadBalancer::closeClient(Client &client)
+{
+    if (hasBackend(client))
+    {
+        releaseBackend(client, false);
+    }
+    logInfo("Client disconnected. Fd= " + std::to_string(client.fd));
+    close(client.fd);
+    client.state = Client::State::Closed;
 }
-} // namespace
 
 void LoadBalancer::checkAllBackends()
 {
-    std::lock_guard<std::mutex> lock{beMutex};
-    for (auto &port : backendServers)
+    std::vector<BackendStats *> backends{};
+    {
+        std::lock_guard<std::mutex> lock{backendsMutex_};
+        for (const auto &backend : backends_)
+        {
+            backends.push_back(backend.get());
+        }
+    }
+
+    for (auto *backend : backends)
     {
         // Try all ports, if port succeeds we mark it as alive,
         // otherwise we mark port as dead.
         try
         {
-            TcpSocket socket{port.first};
-            port.second = true;
+            TcpSocket socket{backend->port()};
+            backend->setAlive(true);
         }
         catch (const std::invalid_argument &e)
         {
-            logInfo("Server " + std::to_string(port.first) +
+            logInfo("Server " + std::to_string(backend->port()) +
                     " is down. Error: " + e.what());
-            port.second = false;
+            backend->setAlive(false);
         }
     }
 }
@@ -346,108 +716,71 @@ void LoadBalancer::start(const std::string_view port)
         perror("listen");
         exit(1);
     }
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
 
-    registerFileDescriptor(listener, POLL_IN);
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd_ == -1)
+    {
+        perror("epoll_create1");
+        exit(1);
+    }
+    epoll_event listenerEvent{.events = EPOLLIN, .data = {.u64 = listenerTag}};
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, listener, &listenerEvent) == -1)
+    {
+        perror("epoll_ctl");
+        exit(1);
+    }
 
+    std::array<epoll_event, 64> events{};
     while (true)
     {
-        logInfo("Waiting for poll...");
-        int pollCount = ::poll(fds_.data(), fds_.size(), -1);
-        logInfo("Polled: " + std::to_string(pollCount));
-        if (pollCount == -1)
+        int eventCount =
+            epoll_wait(epollFd_, events.data(), events.size(), nextTimeout());
+        if (eventCount == -1)
         {
-            perror("poll");
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait");
             exit(1);
         }
 
-        std::map<int, std::future<std::pair<ForwardResult, int>>> futureResults;
-        std::vector<int> fdsToRegister{};
-
-        for (const auto &pollFd : fds_)
+        for (int i = 0; i < eventCount; ++i)
         {
-            if (pollFd.revents & POLL_IN)
+            const auto data = events[i].data.u64;
+            if (data == listenerTag)
             {
-                if (pollFd.fd == listener)
-                {
-                    auto fd =
-                        fdsToRegister.emplace_back(acceptNewClient(listener));
-                    logInfo("Client connected. Fd= " + std::to_string(fd));
-                }
-                else
-                {
-                    logInfo("Got pollin for fd=" + std::to_string(pollFd.fd));
-                    int n = recv(pollFd.fd, nullptr, 1024, MSG_PEEK);
-                    if (n == 0)
-                    {
-                        // client disconnected - mark as
-                        // invalid
-                        std::lock_guard<std::mutex> lock(
-                            clients_.at(pollFd.fd).mutex);
-                        clients_.at(pollFd.fd).pollFd.fd = -1;
-                        continue;
-                    }
-                    auto res = handleClient(clients_.at(pollFd.fd));
-                    if (res)
-                    {
-                        futureResults.emplace(pollFd.fd,
-                                              std::move(res.value()));
-                    }
-                    else
-                    {
-                        close(pollFd.fd);
-                    }
-                }
+                acceptClients(listener);
+                continue;
             }
-            else if (pollFd.revents & POLL_OUT)
+            // The client may have been closed by an earlier event.
+            const auto found = clients_.find(data >> 1);
+            if (found == clients_.end())
             {
-                logInfo("Got revent pollout for: " + std::to_string(pollFd.fd));
+                continue;
             }
-            else if (pollFd.events & POLL_OUT)
+            if (data & 1)
             {
-                logInfo("Got event pollout for: " + std::to_string(pollFd.fd));
+                onBackendEvent(found->second, events[i].events);
             }
-        }
-
-        for (const auto fd : fdsToRegister)
-        {
-            registerFileDescriptor(fd, POLL_IN);
-        }
-
-        std::vector<int> futsToRemove{};
-
-        for (auto &[fd, fut] : futureResults)
-        {
-            if (fut.valid())
+            else
             {
-                auto res = fut.get();
-                switch (res.first)
-                {
-                    case ForwardResult::Failure:
-                    {
-                        close(res.second);
-                        clients_[res.second].pollFd.fd = -1;
-                        logInfo("Failure during forward request");
-                        futsToRemove.push_back(res.second);
-                        break;
-                    }
-                    case ForwardResult::Success:
-                    {
-                        futsToRemove.push_back(res.second);
-                        break;
-                    }
-                }
+                onClientEvent(found->second, events[i].events);
+            }
+            if (found->second.state == Client::State::Closed)
+            {
+                clients_.erase(found);
             }
         }
-
-        markFdsForRemoval(fds_, clients_);
-        purgeInvalidFds(fds_);
-        purgeInvalidClients(clients_);
-        purgeFutures(futsToRemove, futureResults);
+        retryWaitingClients();
     }
 }
 
-void LoadBalancer::addBackend(int port)
+void LoadBalancer::addBackend(int port, unsigned weight)
 {
+    auto backend = std::make_unique<BackendStats>(port, weight);
+    std::lock_guard<std::mutex> lock{backendsMutex_};
     // Assume port is alive as default
-    backendServers.emplace_back(port, true);
+    backends_.push_back(std::move(backend));
 }
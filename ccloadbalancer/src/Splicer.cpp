@@ -0,0 +1,103 @@
+#include "Splicer.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <expected>
+#include <fcntl.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+// Larger pipes move more per splice(); the kernel may not allow it.
+constexpr int preferredPipeSize = 1 << 20;
+
+bool wouldBlock()
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+}
+
+std::expected<Splicer, std::string> Splicer::create()
+{
+    int fds[2];
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) == -1) {
+        std::string error { "pipe2 failed. errno: " };
+        error.append(std::to_string(errno));
+        return std::unexpected { std::move(error) };
+    }
+    fcntl(fds[1], F_SETPIPE_SZ, preferredPipeSize);
+    const auto capacity = fcntl(fds[1], F_GETPIPE_SZ);
+    return Splicer { fds[0], fds[1], static_cast<size_t>(capacity > 0 ? capacity : 1 << 16) };
+}
+
+Splicer::Splicer(const int readFd, const int writeFd, const size_t capacity)
+    : readFd_ { readFd }
+    , writeFd_ { writeFd }
+    , capacity_ { capacity }
+{
+}
+
+Splicer::Splicer(Splicer&& other) noexcept
+    : readFd_ { std::exchange(other.readFd_, -1) }
+    , writeFd_ { std::exchange(other.writeFd_, -1) }
+    , capacity_ { other.capacity_ }
+    , pending_ { other.pending_ }
+    , stalled_ { other.stalled_ }
+    , eof_ { other.eof_ }
+    , shutDown_ { other.shutDown_ }
+{
+}
+
+Splicer::~Splicer()
+{
+    if (readFd_ >= 0) {
+        close(readFd_);
+    }
+    if (writeFd_ >= 0) {
+        close(writeFd_);
+    }
+}
+
+std::expected<size_t, int> Splicer::pump(const int from, const int to)
+{
+    size_t written = 0;
+    while (true) {
+        auto moved = false;
+        if (wantsRead()) {
+            const auto n = splice(from, nullptr, writeFd_, nullptr, capacity_ - pending_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                pending_ += n;
+                moved = true;
+            } else if (n == 0) {
+                eof_ = true;
+            } else if (!wouldBlock()) {
+                return std::unexpected { errno };
+            } else if (pending_ > 0) {
+                // The socket may be empty, or the pipe out of slots, which are used
+                // per packet rather than per byte. Wait for a write either way.
+                stalled_ = true;
+            }
+        }
+        if (wantsWrite()) {
+            const auto n = splice(readFd_, nullptr, to, nullptr, pending_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                pending_ -= n;
+                written += n;
+                stalled_ = false;
+                moved = true;
+            } else if (n < 0 && !wouldBlock()) {
+                return std::unexpected { errno };
+            }
+        }
+        if (!moved) {
+            break;
+        }
+    }
+    if (eof_ && pending_ == 0 && !shutDown_) {
+        shutdown(to, SHUT_WR);
+        shutDown_ = true;
+    }
+    return written;
+}
@@ -0,0 +1,230 @@
+#include "Strategy.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+namespace {
+// How long the latency estimate takes to forget about 63% of what it knew.
+constexpr std::chrono::duration<double, std::nano> decayTime = std::chrono::seconds(1);
+// The latency taken for a backend that has outstanding messages or connections and
+// never answered yet, so that it is not flooded before its first answer.
+constexpr double unknownLatency = 1e12;
+
+// How much of the estimate survives the time since it was last updated.
+double decay(const BackendStats::Clock::rep since, const BackendStats::Clock::time_point now)
+{
+    const auto elapsed = now.time_since_epoch() - BackendStats::Clock::duration { since };
+    return elapsed.count() > 0 ? std::exp(-elapsed / decayTime) : 1.0;
+}
+
+class RoundRobin : public Strategy {
+public:
+    BackendStats* pick(const Backends& backends, BackendStats::Clock::time_point) override
+    {
+        for (size_t i = 0; i < backends.size(); ++i) {
+            const auto& backend = backends[next_.fetch_add(1, std::memory_order_relaxed) % backends.size()];
+            if (backend->alive()) {
+                return backend.get();
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    std::atomic<size_t> next_ {};
+};
+
+// Interleaved: every round goes over all backends, and round r takes those whose
+// weight is above r modulo the largest weight, so a heavy backend is picked in more
+// rounds rather than many times in a row.
+class WeightedRoundRobin : public Strategy {
+public:
+    BackendStats* pick(const Backends& backends, BackendStats::Clock::time_point) override
+    {
+        unsigned maxWeight = 0;
+        for (const auto& backend : backends) {
+            if (backend->alive() && backend->weight() > maxWeight) {
+                maxWeight = backend->weight();
+            }
+        }
+        for (size_t i = 0; i < backends.size() * maxWeight; ++i) {
+            const auto ticket = next_.fetch_add(1, std::memory_order_relaxed);
+            const auto& backend = backends[ticket % backends.size()];
+            if (backend->alive() && (ticket / backends.size()) % maxWeight < backend->weight()) {
+                return backend.get();
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    std::atomic<size_t> next_ {};
+};
+
+// Scans all backends for the lowest cost, starting at the next one each time so that
+// ties go round robin.
+class LowestCost : public Strategy {
+public:
+    using Cost = double (*)(const BackendStats&, BackendStats::Clock::time_point);
+
+    explicit LowestCost(const Cost cost)
+        : cost_ { cost }
+    {
+    }
+
+    BackendStats* pick(const Backends& backends, BackendStats::Clock::time_point now) override
+    {
+        const auto start = next_.fetch_add(1, std::memory_order_relaxed);
+        BackendStats* best = nullptr;
+        double bestCost = 0;
+        for (size_t i = 0; i < backends.size(); ++i) {
+            auto& backend = *backends[(start + i) % backends.size()];
+            if (!backend.alive()) {
+                continue;
+            }
+            const auto cost = cost_(backend, now);
+            if (best == nullptr || cost < bestCost) {
+                best = &backend;
+                bestCost = cost;
+            }
+        }
+        return best;
+    }
+
+private:
+    Cost cost_;
+    std::atomic<size_t> next_ {};
+};
+
+double outstandingCost(const BackendStats& backend, BackendStats::Clock::time_point)
+{
+    return static_cast<double>(backend.outstanding()) / backend.weight();
+}
+
+double peakEwmaCost(const BackendStats& backend, const BackendStats::Clock::time_point now)
+{
+    const auto latency = backend.latency(now);
+    const auto outstanding = backend.outstanding();
+    if (latency == 0 && outstanding > 0) {
+        return unknownLatency + outstanding;
+    }
+    return latency * (outstanding + 1) / backend.weight();
+}
+
+class PowerOfTwoChoices : public Strategy {
+public:
+    BackendStats* pick(const Backends& backends, BackendStats::Clock::time_point now) override
+    {
+        if (backends.size() < 2) {
+            return fallback_.pick(backends, now);
+        }
+        const auto first = random() % backends.size();
+        auto second = random() % (backends.size() - 1);
+        if (second >= first) {
+            ++second;
+        }
+        auto* a = backends[first].get();
+        auto* b = backends[second].get();
+        if (!a->alive() || !b->alive()) {
+            // Rather than drawing again, possibly for long when most are down.
+            return fallback_.pick(backends, now);
+        }
+        return outstandingCost(*b, now) < outstandingCost(*a, now) ? b : a;
+    }
+
+private:
+    // splitmix64 over a shared counter: lock-free, and the same sequence every run.
+    uint64_t random()
+    {
+        auto z = state_.fetch_add(0x9e3779b97f4a7c15, std::memory_order_relaxed) + 0x9e3779b97f4a7c15;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    std::atomic<uint64_t> state_ {};
+    LowestCost fallback_ { &outstandingCost };
+};
+
+constexpr std::array<std::pair<StrategyKind, std::string_view>, 5> names { {
+    { StrategyKind::RoundRobin, "round-robin" },
+    { StrategyKind::WeightedRoundRobin, "weighted-round-robin" },
+    { StrategyKind::LeastOutstanding, "least-outstanding" },
+    { StrategyKind::PeakEwma, "peak-ewma" },
+    { StrategyKind::PowerOfTwoChoices, "p2c" },
+} };
+}
+
+BackendStats::BackendStats(const int port, const unsigned weight)
+    : port_ { port }
+    , weight_ { weight }
+{
+    if (weight == 0) {
+        throw std::invalid_argument { "A backend needs a weight of at least 1" };
+    }
+}
+
+void BackendStats::observe(const std::chrono::nanoseconds latency, const Clock::time_point now)
+{
+    const auto sample = static_cast<double>(latency.count());
+    const auto weight = decay(observed_.load(std::memory_order_relaxed), now);
+    auto current = latency_.load(std::memory_order_relaxed);
+    auto next = [&]() {
+        const auto decayed = current * weight;
+        return sample > decayed ? sample : decayed + sample * (1 - weight);
+    };
+    while (!latency_.compare_exchange_weak(current, next(), std::memory_order_relaxed)) {
+    }
+    observed_.store(now.time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+double BackendStats::latency(const Clock::time_point now) const
+{
+    return latency_.load(std::memory_order_relaxed) * decay(observed_.load(std::memory_order_relaxed), now);
+}
+
+std::unique_ptr<Strategy> makeStrategy(const StrategyKind kind)
+{
+    switch (kind) {
+    case StrategyKind::RoundRobin:
+        return std::make_unique<RoundRobin>();
+    case StrategyKind::WeightedRoundRobin:
+        return std::make_unique<WeightedRoundRobin>();
+    case StrategyKind::LeastOutstanding:
+        return std::make_unique<LowestCost>(&outstandingCost);
+    case StrategyKind::PeakEwma:
+        return std::make_unique<LowestCost>(&peakEwmaCost);
+    case StrategyKind::PowerOfTwoChoices:
+        return std::make_unique<PowerOfTwoChoices>();
+    }
+    return nullptr;
+}
+
+std::string_view strategyName(const StrategyKind kind)
+{
+    for (const auto& [candidate, name] : names) {
+        if (candidate == kind) {
+            return name;
+        }
+    }
+    return {};
+}
+
+std::optional<StrategyKind> parseStrategy(const std::string_view name)
+{
+    for (const auto& [kind, candidate] : names) {
+        if (candidate == name) {
+            return kind;
+        }
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,64 @@
+#include "StreamBuffer.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <expected>
+#include <sys/socket.h>
+
+namespace {
+bool wouldBlock()
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+}
+
+StreamBuffer::StreamBuffer(const size_t capacity)
+    : buffer_(capacity)
+{
+}
+
+std::expected<size_t, int> StreamBuffer::pump(const int from, const int to)
+{
+    size_t written = 0;
+    while (true) {
+        auto moved = false;
+        if (end_ == buffer_.size() && begin_ > 0) {
+            std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        if (wantsRead()) {
+            const auto n = recv(from, buffer_.data() + end_, buffer_.size() - end_, 0);
+            if (n > 0) {
+                end_ += n;
+                moved = true;
+            } else if (n == 0) {
+                eof_ = true;
+            } else if (!wouldBlock()) {
+                return std::unexpected { errno };
+            }
+        }
+        if (wantsWrite()) {
+            const auto n = send(to, buffer_.data() + begin_, end_ - begin_, MSG_NOSIGNAL);
+            if (n > 0) {
+                begin_ += n;
+                written += n;
+                moved = true;
+                if (begin_ == end_) {
+                    begin_ = end_ = 0;
+                }
+            } else if (n < 0 && !wouldBlock()) {
+                return std::unexpected { errno };
+            }
+        }
+        if (!moved) {
+            break;
+        }
+    }
+    if (eof_ && !wantsWrite() && !shutDown_) {
+        shutdown(to, SHUT_WR);
+        shutDown_ = true;
+    }
+    return written;
+}
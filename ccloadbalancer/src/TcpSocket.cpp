@@ -14,16 +14,20 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <utility>
 
 #include <arpa/inet.h>
 
 #include <array>
 #include <iostream>
 
-TcpSocket::TcpSocket(int port)
+namespace {
+// A socket of type connected to port, or still connecting if type is non-blocking.
+int connectSocket(int port, int type)
 {
     struct sockaddr_in serv_addr;
-    if ((clientFd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+    int clientFd = socket(AF_INET, type, 0);
+    if (clientFd < 0) {
         throw std::invalid_argument { "Socket creation error " + std::to_string(errno) };
     }
 
@@ -34,61 +38,92 @@ TcpSocket::TcpSocket(int port)
     // form
     if (inet_pton(AF_INET, "127.0.0.1", &serv_addr.sin_addr)
         <= 0) {
+        close(clientFd);
         throw std::invalid_argument { "Invalid address/ Address not supported" + std::to_string(errno) };
     }
 
     if ((::connect(clientFd, (struct sockaddr*)&serv_addr,
             sizeof(serv_addr)))
-        < 0) {
-        throw std::invalid_argument { "Connection Failed. errno: " + std::to_string(errno) };
+            < 0
+        && !((type & SOCK_NONBLOCK) && errno == EINPROGRESS)) {
+        const auto error = errno;
+        close(clientFd);
+        throw std::invalid_argument { "Connection Failed. errno: " + std::to_string(error) };
     }
+    return clientFd;
+}
 }
 
-int TcpSocket::send(const std::string_view data) const noexcept
+TcpSocket::TcpSocket(int port)
+    : clientFd { connectSocket(port, SOCK_STREAM) }
 {
-    return ::send(clientFd, data.data(), data.length(), 0);
 }
 
-TcpSocket::RecvValue TcpSocket::recv()
+TcpSocket TcpSocket::connecting(int port)
 {
-    std::array<char, 1024> buffer { 0 };
-    auto bytesRead = ::recv(clientFd, buffer.data(),
-        buffer.size() - 1, 0); // subtract 1 for the null
-                               // terminator at the end
-    std::cout << "Read " << bytesRead << " number of bytes\n";
-    buffer[bytesRead] = '\0';
-    std::cout << "received: " << buffer.data() << '\n';
-    return RecvValue { buffer, clientFd };
+    TcpSocket socket {};
+    socket.clientFd = connectSocket(port, SOCK_STREAM | SOCK_NONBLOCK);
+    return socket;
 }
 
-std::expected<TcpSocket::RecvValue, int> TcpSocket::recvNonBlocking()
+TcpSocket::TcpSocket(TcpSocket&& other) noexcept
+    : clientFd { std::exchange(other.clientFd, -1) }
+{
+}
+
+TcpSocket& TcpSocket::operator=(TcpSocket&& other) noexcept
+{
+    if (this != &other) {
+        if (clientFd >= 0) {
+            close(clientFd);
+        }
+        clientFd = std::exchange(other.clientFd, -1);
+    }
+    return *this;
+}
+
+int TcpSocket::send(const std::string_view data) const noexcept
 {
-    std::array<char, 1024> buffer { 0 };
-    auto bytesRead = ::recv(clientFd, buffer.data(),
-        buffer.size() - 1, MSG_DONTWAIT); // subtract 1 for the null
-                                          // terminator at the end
+    // A pooled connection may have been closed by the backend; fail instead of
+    // raising SIGPIPE.
+    return ::send(clientFd, data.data(), data.length(), MSG_NOSIGNAL);
+}
+
+namespace {
+// What one recv() may return at most; a message is whatever a single recv() returns.
+constexpr size_t maxRecvSize = 64 * 1024;
+}
+
+std::expected<TcpSocket::RecvValue, int> TcpSocket::receive(int flags)
+{
+    std::string buffer(maxRecvSize, '\0');
+    auto bytesRead = ::recv(clientFd, buffer.data(), buffer.size(), flags);
     if (bytesRead <= 0) {
-        return std::unexpected { errno };
+        return std::unexpected { bytesRead == 0 ? 0 : errno };
     }
     std::cout << "Read " << bytesRead << " number of bytes\n";
-    buffer[bytesRead] = '\0';
-    std::cout << "received: " << buffer.data() << '\n';
-    return RecvValue { buffer, clientFd };
+    buffer.resize(bytesRead);
+    return RecvValue { std::move(buffer), clientFd };
+}
+
+TcpSocket::RecvValue TcpSocket::recv()
+{
+    auto received = receive(0);
+    return received.has_value() ? std::move(received.value()) : RecvValue { std::string {}, clientFd };
+}
+
+std::expected<TcpSocket::RecvValue, int> TcpSocket::recvNonBlocking()
+{
+    return receive(MSG_DONTWAIT);
 }
 
 std::expected<TcpSocket::RecvValue, int> TcpSocket::recvWithError()
 {
-    std::array<char, 1024> buffer { 0 };
-    auto bytesRead = ::recv(clientFd, buffer.data(),
-        buffer.size() - 1, 0); // subtract 1 for the null
-                               // terminator at the end
-    std::cout << "Read " << bytesRead << " number of bytes\n";
-    if (bytesRead <= 0) {
-        return std::unexpected { bytesRead };
+    auto received = receive(0);
+    if (!received.has_value() && received.error() != 0) {
+        return std::unexpected { -1 };
     }
-    buffer[bytesRead] = '\0';
-    std::cout << "received: " << buffer.data() << '\n';
-    return RecvValue { buffer, clientFd };
+    return received;
 }
 
 int TcpSocket::getFd() const noexcept
@@ -96,7 +131,26 @@ int TcpSocket::getFd() const noexcept
     return clientFd;
 }
 
+bool TcpSocket::isReusable() const noexcept
+{
+    char byte {};
+    const auto n = ::recv(clientFd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+int TcpSocket::pendingError() const noexcept
+{
+    int error = 0;
+    socklen_t length = sizeof error;
+    if (getsockopt(clientFd, SOL_SOCKET, SO_ERROR, &error, &length) < 0) {
+        return errno;
+    }
+    return error;
+}
+
 TcpSocket::~TcpSocket()
 {
-    close(clientFd);
+    if (clientFd >= 0) {
+        close(clientFd);
+    }
 }
\ No newline at end of file
@@ -1,8 +1,33 @@
 #include "LoadBalancer.h"
+#include "Strategy.h"
 
-int main()
+#include <cstdio>
+#include <string_view>
+
+int main(int argc, char* argv[])
 {
-    LoadBalancer server {};
+    // Streams by default. --splice splices the bytes between client and backend
+    // instead, --messages forwards every message over pooled connections.
+    // --strategy picks how backends are chosen, round robin by default.
+    auto mode = ForwardMode::Stream;
+    auto strategy = StrategyKind::RoundRobin;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view flag { argv[i] };
+        if (flag == "--splice") {
+            mode = ForwardMode::Splice;
+        } else if (flag == "--messages") {
+            mode = ForwardMode::Messages;
+        } else if (flag == "--strategy" && i + 1 < argc && parseStrategy(argv[i + 1]).has_value()) {
+            strategy = parseStrategy(argv[++i]).value();
+        } else {
+            fprintf(stderr,
+                "Usage: %s [--splice | --messages] [--strategy round-robin | weighted-round-robin | "
+                "least-outstanding | peak-ewma | p2c]\n",
+                argv[0]);
+            return 1;
+        }
+    }
+    LoadBalancer server { PoolOptions {}, mode, makeStrategy(strategy) };
     server.addBackend(8081);
     server.addBackend(8082);
     server.start("8080");
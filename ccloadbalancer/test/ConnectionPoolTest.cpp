@@ -0,0 +1,131 @@
+#include "ConnectionPool.h"
+#include "EchoServer/EchoServer.h"
+#include "TcpSocket.h"
+
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+using namespace std::chrono_literals;
+
+namespace {
+constexpr int echoPort = 8083;
+// Nothing listens here.
+constexpr int closedPort = 8089;
+
+void startEchoServer()
+{
+    static std::once_flag started {};
+    std::call_once(started, []() {
+        std::thread { []() {
+            EchoServer echoserver {};
+            echoserver.start(std::to_string(echoPort));
+        } }.detach();
+        while (true) {
+            try {
+                TcpSocket test { echoPort };
+                return;
+            } catch (std::invalid_argument&) {
+                std::this_thread::sleep_for(10ms);
+            }
+        }
+    });
+}
+
+std::string echo(TcpSocket& socket, const std::string& msg)
+{
+    EXPECT_EQ(static_cast<int>(msg.size()), socket.send(msg));
+    const auto res = socket.recvWithError();
+    return res.has_value() ? std::string { res.value().first.data() } : std::string {};
+}
+
+class ConnectionPoolTest : public testing::Test {
+protected:
+    void SetUp() override { startEchoServer(); }
+};
+}
+
+TEST_F(ConnectionPoolTest, ReusesReturnedConnection)
+{
+    ConnectionPool pool {};
+    int fd = -1;
+    {
+        auto lease = pool.checkout(echoPort);
+        ASSERT_TRUE(lease.has_value());
+        EXPECT_FALSE(lease->reused());
+        fd = lease->socket().getFd();
+        EXPECT_EQ("first", echo(lease->socket(), "first"));
+    }
+    EXPECT_EQ(1u, pool.idleConnections(echoPort));
+
+    auto lease = pool.checkout(echoPort);
+    ASSERT_TRUE(lease.has_value());
+    EXPECT_TRUE(lease->reused());
+    EXPECT_EQ(fd, lease->socket().getFd());
+    EXPECT_EQ("second", echo(lease->socket(), "second"));
+    EXPECT_EQ(0u, pool.idleConnections(echoPort));
+    EXPECT_EQ(1u, pool.openConnections(echoPort));
+}
+
+TEST_F(ConnectionPoolTest, CapsOpenConnections)
+{
+    ConnectionPool pool { PoolOptions { .maxConnections = 1, .checkoutTimeout = 50ms } };
+    auto first = pool.checkout(echoPort);
+    ASSERT_TRUE(first.has_value());
+    EXPECT_FALSE(pool.checkout(echoPort).has_value());
+
+    std::thread returner { [lease = std::move(first.value())]() mutable {
+        std::this_thread::sleep_for(10ms);
+        lease.discard();
+    } };
+    // Waits for the connection to be given back.
+    auto second = pool.checkout(echoPort);
+    returner.join();
+    ASSERT_TRUE(second.has_value());
+    EXPECT_FALSE(second->reused());
+    EXPECT_EQ(1u, pool.openConnections(echoPort));
+}
+
+TEST_F(ConnectionPoolTest, ClosesIdleConnections)
+{
+    ConnectionPool pool { PoolOptions { .idleTimeout = 10ms } };
+    ASSERT_TRUE(pool.checkout(echoPort).has_value());
+    EXPECT_EQ(1u, pool.idleConnections(echoPort));
+    std::this_thread::sleep_for(20ms);
+    auto lease = pool.checkout(echoPort);
+    ASSERT_TRUE(lease.has_value());
+    EXPECT_FALSE(lease->reused());
+    EXPECT_EQ(1u, pool.openConnections(echoPort));
+
+    // Nothing is kept without idle connections.
+    ConnectionPool unpooled { PoolOptions { .maxIdle = 0 } };
+    ASSERT_TRUE(unpooled.checkout(echoPort).has_value());
+    EXPECT_EQ(0u, unpooled.openConnections(echoPort));
+}
+
+TEST_F(ConnectionPoolTest, DropsConnectionsWithUnreadData)
+{
+    ConnectionPool pool {};
+    {
+        auto lease = pool.checkout(echoPort);
+        ASSERT_TRUE(lease.has_value());
+        lease->socket().send("unread reply");
+        std::this_thread::sleep_for(20ms);
+    }
+    auto lease = pool.checkout(echoPort);
+    ASSERT_TRUE(lease.has_value());
+    EXPECT_FALSE(lease->reused());
+    EXPECT_EQ(1u, pool.openConnections(echoPort));
+}
+
+TEST_F(ConnectionPoolTest, FailedConnectDoesNotCount)
+{
+    ConnectionPool pool { PoolOptions { .maxConnections = 1, .checkoutTimeout = 50ms } };
+    EXPECT_FALSE(pool.checkout(closedPort).has_value());
+    EXPECT_EQ(0u, pool.openConnections(closedPort));
+    EXPECT_FALSE(pool.checkout(closedPort).has_value());
+}
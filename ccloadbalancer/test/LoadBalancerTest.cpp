@@ -1,8 +1,17 @@
 #include "LoadBalancer.h"
 #include "EchoServer/EchoServer.h"
 #include "TcpSocket.h"
+#include <arpa/inet.h>
+#include <array>
+#include <chrono>
+#include <netinet/in.h>
+#include <poll.h>
 #include <stdexcept>
+#include <string>
+#include <sys/socket.h>
 #include <thread>
+#include <unistd.h>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -19,12 +28,13 @@ protected:
 };
 
 struct LoadBalancerThread {
-    LoadBalancerThread()
-        : lbthread_ { []() {
-            LoadBalancer lb {};
-            lb.addBackend(8081);
-            lb.addBackend(8082);
-            lb.start("8080");
+    LoadBalancerThread(int port = 8080, std::vector<int> backends = { 8081, 8082 }, ForwardMode mode = ForwardMode::Stream)
+        : lbthread_ { [port, backends, mode]() {
+            LoadBalancer lb { PoolOptions {}, mode };
+            for (const auto backend : backends) {
+                lb.addBackend(backend);
+            }
+            lb.start(std::to_string(port));
         } }
     {
         lbthread_.detach();
@@ -44,6 +54,42 @@ struct EchoServerThread {
     std::thread echoServer_;
 };
 
+// Echoes every message after a delay, with a thread per connection.
+struct SlowServerThread {
+    SlowServerThread(int port, std::chrono::milliseconds delay)
+        : server_ { [port, delay]() {
+            const int listener = socket(AF_INET, SOCK_STREAM, 0);
+            constexpr int yes = 1;
+            setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes);
+            sockaddr_in addr {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == -1 || listen(listener, 16) == -1) {
+                return;
+            }
+            while (true) {
+                const int fd = accept(listener, nullptr, nullptr);
+                if (fd == -1) {
+                    return;
+                }
+                std::thread { [fd, delay]() {
+                    std::array<char, 1024> buf {};
+                    ssize_t n = 0;
+                    while ((n = recv(fd, buf.data(), buf.size(), 0)) > 0) {
+                        std::this_thread::sleep_for(delay);
+                        send(fd, buf.data(), n, MSG_NOSIGNAL);
+                    }
+                    close(fd);
+                } }.detach();
+            }
+        } }
+    {
+        server_.detach();
+    }
+    std::thread server_;
+};
+
 namespace {
 void waitForServer(int port)
 {
@@ -107,4 +153,165 @@ TEST_F(LoadBalancerTest, ResultNotAvailableAtFirst)
     auto res = client.socket_.recv();
 
     EXPECT_EQ(std::string { res.first.data() }, msg);
-}
\ No newline at end of file
+}
+
+TEST_F(LoadBalancerTest, SlowBackendDoesNotDelayOtherClients)
+{
+    using namespace std::chrono_literals;
+    SlowServerThread slowBackend { 8085, 2000ms };
+    waitForServer(8085);
+    EchoServerThread fastBackend { "8086" };
+    waitForServer(8086);
+
+    LoadBalancerThread lb { 8084, { 8085, 8086 } };
+    waitForServer(8084);
+
+    // Round robin sends one client to each backend, whichever goes where.
+    TestClient first { 8084 };
+    TestClient second { 8084 };
+    const auto start = std::chrono::steady_clock::now();
+    first.socket_.send("first");
+    second.socket_.send("second");
+
+    std::array<pollfd, 2> fds { { { first.socket_.getFd(), POLLIN, 0 }, { second.socket_.getFd(), POLLIN, 0 } } };
+    ASSERT_EQ(1, poll(fds.data(), fds.size(), 1000));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 1000ms);
+    const auto firstIsFast = (fds[0].revents & POLLIN) != 0;
+    auto& fast = firstIsFast ? first : second;
+    auto& slow = firstIsFast ? second : first;
+
+    EXPECT_EQ(fast.socket_.recv().first, firstIsFast ? "first" : "second");
+    EXPECT_EQ(slow.socket_.recv().first, firstIsFast ? "second" : "first");
+}
+
+namespace {
+// Sends a payload larger than any single buffer and half-closes, then expects it all
+// echoed back followed by the end of the stream.
+void expectLargeEcho(TcpSocket& socket)
+{
+    std::string payload(200000, 'x');
+    for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<char>('a' + i % 26);
+    }
+    ASSERT_EQ(static_cast<int>(payload.size()), socket.send(payload));
+    shutdown(socket.getFd(), SHUT_WR);
+    std::string echoed {};
+    std::array<char, 4096> buf {};
+    ssize_t n = 0;
+    while ((n = ::recv(socket.getFd(), buf.data(), buf.size(), 0)) > 0) {
+        echoed.append(buf.data(), n);
+    }
+    EXPECT_EQ(0, n);
+    EXPECT_EQ(payload, echoed);
+}
+}
+
+TEST_F(LoadBalancerTest, SpliceRelaysBothDirections)
+{
+    EchoServerThread backend { "8088" };
+    waitForServer(8088);
+    LoadBalancerThread lb { 8087, { 8088 }, ForwardMode::Splice };
+    waitForServer(8087);
+
+    TestClient client { 8087 };
+    constexpr auto msg = "hello from client";
+    client.socket_.send(msg);
+    auto res = client.socket_.recv();
+    EXPECT_EQ(std::string { res.first.data() }, msg);
+
+    expectLargeEcho(client.socket_);
+}
+
+namespace {
+// Holds more clients open at once than a connection pool allows per backend, and
+// expects every one of them relayed.
+void expectManyClientsRelayed(int port)
+{
+    constexpr int clients = 24;
+    std::vector<TestClient> open {};
+    for (int i = 0; i < clients; ++i) {
+        open.emplace_back(port);
+    }
+    for (int i = 0; i < clients; ++i) {
+        const auto msg = "client " + std::to_string(i);
+        open[i].socket_.send(msg);
+        pollfd fd { open[i].socket_.getFd(), POLLIN, 0 };
+        ASSERT_EQ(1, poll(&fd, 1, 2000)) << msg;
+        EXPECT_EQ(msg, open[i].socket_.recv().first);
+    }
+}
+}
+
+TEST_F(LoadBalancerTest, SpliceDoesNotCapClientsPerBackend)
+{
+    EchoServerThread backend { "8095" };
+    waitForServer(8095);
+    LoadBalancerThread lb { 8094, { 8095 }, ForwardMode::Splice };
+    waitForServer(8094);
+
+    expectManyClientsRelayed(8094);
+}
+
+TEST_F(LoadBalancerTest, StreamRelaysBothDirections)
+{
+    EchoServerThread backend { "8091" };
+    waitForServer(8091);
+    LoadBalancerThread lb { 8090, { 8091 } };
+    waitForServer(8090);
+
+    TestClient client { 8090 };
+    expectLargeEcho(client.socket_);
+}
+
+TEST_F(LoadBalancerTest, StreamDoesNotCapClientsPerBackend)
+{
+    EchoServerThread backend { "8097" };
+    waitForServer(8097);
+    LoadBalancerThread lb { 8096, { 8097 } };
+    waitForServer(8096);
+
+    expectManyClientsRelayed(8096);
+}
+
+TEST_F(LoadBalancerTest, StreamRelaysDownloadToTheEnd)
+{
+    // Sends a file far larger than the relay's buffers as soon as a client connects,
+    // then closes.
+    constexpr size_t fileSize = 5 << 20;
+    std::thread { []() {
+        const int listener = socket(AF_INET, SOCK_STREAM, 0);
+        constexpr int yes = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes);
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(8093);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == -1 || listen(listener, 16) == -1) {
+            return;
+        }
+        const std::string file(fileSize, 'f');
+        while (true) {
+            const int fd = accept(listener, nullptr, nullptr);
+            if (fd == -1) {
+                return;
+            }
+            send(fd, file.data(), file.size(), MSG_NOSIGNAL);
+            close(fd);
+        }
+    } }.detach();
+    waitForServer(8093);
+    LoadBalancerThread lb { 8092, { 8093 } };
+    waitForServer(8092);
+
+    TestClient client { 8092 };
+    // Read slowly at first so the relay has to hold the backend back.
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    size_t received = 0;
+    std::array<char, 65536> buf {};
+    ssize_t n = 0;
+    while ((n = ::recv(client.socket_.getFd(), buf.data(), buf.size(), 0)) > 0) {
+        received += n;
+    }
+    EXPECT_EQ(0, n);
+    EXPECT_EQ(fileSize, received);
+}
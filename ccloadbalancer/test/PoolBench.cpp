@@ -0,0 +1,180 @@
+// Requests per second through the load balancer in message mode with and without
+// pooled backend connections. Starts two echo servers and two load balancers in
+// process, one keeping idle backend connections and one closing them after every
+// request, then every client thread keeps one connection to a load balancer and sends
+// a message, waits for the echo and repeats.
+//
+//   ./pool_bench --clients 4 --seconds 5
+
+#include "ConnectionPool.h"
+#include "EchoServer/EchoServer.h"
+#include "LoadBalancer.h"
+#include "TcpSocket.h"
+
+#include <arpa/inet.h>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+struct BenchConfig {
+    unsigned clients { 4 };
+    unsigned seconds { 5 };
+};
+
+constexpr std::array backendPorts { 9081, 9082 };
+constexpr int pooledPort = 9080;
+constexpr int unpooledPort = 9090;
+constexpr std::string_view message { "hello from the pool benchmark" };
+
+void waitForServer(int port)
+{
+    while (true) {
+        try {
+            TcpSocket test { port };
+            return;
+        } catch (std::invalid_argument&) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+}
+
+void startEchoServer(int port)
+{
+    std::thread { [port]() {
+        EchoServer server {};
+        server.start(std::to_string(port));
+    } }.detach();
+    waitForServer(port);
+}
+
+void startLoadBalancer(int port, PoolOptions options)
+{
+    std::thread { [port, options]() {
+        LoadBalancer lb { options, ForwardMode::Messages };
+        for (const auto backend : backendPorts) {
+            lb.addBackend(backend);
+        }
+        lb.start(std::to_string(port));
+    } }.detach();
+    waitForServer(port);
+}
+
+int connectTo(int port)
+{
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == -1) {
+        perror("connect");
+        exit(1);
+    }
+    constexpr int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof yes);
+    return fd;
+}
+
+// One message and its echo.
+bool roundTrip(int fd)
+{
+    if (send(fd, message.data(), message.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(message.size())) {
+        return false;
+    }
+    std::array<char, 4096> buffer {};
+    size_t received = 0;
+    while (received < message.size()) {
+        const auto n = recv(fd, buffer.data(), buffer.size(), 0);
+        if (n <= 0) {
+            return false;
+        }
+        received += n;
+    }
+    return true;
+}
+
+double requestsPerSecond(int port, const BenchConfig& config)
+{
+    std::atomic<bool> running { true };
+    std::atomic<size_t> requests { 0 };
+    std::vector<std::thread> clients {};
+    for (unsigned i = 0; i < config.clients; ++i) {
+        clients.emplace_back([port, &running, &requests]() {
+            const int fd = connectTo(port);
+            size_t done = 0;
+            while (running.load(std::memory_order_relaxed) && roundTrip(fd)) {
+                ++done;
+            }
+            requests += done;
+            close(fd);
+        });
+    }
+    const auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(config.seconds));
+    running = false;
+    for (auto& client : clients) {
+        client.join();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return requests.load() / elapsed.count();
+}
+
+unsigned parseUnsigned(const std::string_view value)
+{
+    unsigned result {};
+    const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (error != std::errc {} || end != value.data() + value.size()) {
+        fprintf(stderr, "Invalid number: %s\n", value.data());
+        exit(1);
+    }
+    return result;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    BenchConfig config {};
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string_view flag { argv[i] };
+        if (flag == "--clients") {
+            config.clients = parseUnsigned(argv[i + 1]);
+        } else if (flag == "--seconds") {
+            config.seconds = parseUnsigned(argv[i + 1]);
+        } else {
+            fprintf(stderr, "Usage: %s [--clients n] [--seconds n]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // The servers log every message.
+    std::cout.setstate(std::ios_base::badbit);
+
+    for (const auto port : backendPorts) {
+        startEchoServer(port);
+    }
+    startLoadBalancer(pooledPort, PoolOptions {});
+    startLoadBalancer(unpooledPort, PoolOptions { .maxIdle = 0 });
+
+    const auto unpooled = requestsPerSecond(unpooledPort, config);
+    const auto pooled = requestsPerSecond(pooledPort, config);
+    printf("clients: %u, seconds: %u\n", config.clients, config.seconds);
+    printf("without pooling: %10.0f req/s\n", unpooled);
+    printf("with pooling:    %10.0f req/s (%.2fx)\n", pooled, pooled / unpooled);
+    fflush(stdout);
+    // The load balancers and echo servers never return.
+    _exit(0);
+}
@@ -0,0 +1,222 @@
+// Throughput of large transfers through the load balancer in splice and stream mode,
+// and the CPU time the load balancer spends per GB. Each load balancer runs in a child
+// process so only its own CPU time is counted; a backend in this process sends as many
+// bytes as a client asks for and closes. Transfers straight from the backend are the
+// baseline.
+//
+//   ./splice_bench --total-mb 200
+
+#include "ConnectionPool.h"
+#include "LoadBalancer.h"
+#include "TcpSocket.h"
+
+#include <arpa/inet.h>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <initializer_list>
+#include <iterator>
+#include <netinet/in.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+constexpr int backendPort = 9181;
+constexpr int splicePort = 9180;
+constexpr int streamPort = 9190;
+constexpr size_t megabyte = 1 << 20;
+constexpr std::array transferSizes { 1 * megabyte, 10 * megabyte, 100 * megabyte };
+
+int listenOn(int port)
+{
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    constexpr int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == -1 || listen(fd, 64) == -1) {
+        perror("listen");
+        exit(1);
+    }
+    return fd;
+}
+
+// Reads the size a client asks for, up to a new line, and sends that many bytes.
+void serveTransfer(int fd)
+{
+    std::string request {};
+    std::array<char, 64> buf {};
+    while (request.find('\n') == std::string::npos) {
+        const auto n = recv(fd, buf.data(), buf.size(), 0);
+        if (n <= 0) {
+            close(fd);
+            return;
+        }
+        request.append(buf.data(), n);
+    }
+    size_t remaining = std::stoull(request);
+    static const std::vector<char> chunk(megabyte, 'x');
+    while (remaining > 0) {
+        const auto n = send(fd, chunk.data(), std::min(remaining, chunk.size()), MSG_NOSIGNAL);
+        if (n <= 0) {
+            break;
+        }
+        remaining -= n;
+    }
+    close(fd);
+}
+
+void runBackend(int listener)
+{
+    std::thread { [listener]() {
+        while (true) {
+            const int fd = accept(listener, nullptr, nullptr);
+            if (fd == -1) {
+                return;
+            }
+            std::thread { serveTransfer, fd }.detach();
+        }
+    } }.detach();
+}
+
+// Returns false if fewer bytes came back.
+bool transfer(int port, size_t size)
+{
+    TcpSocket socket { port };
+    const auto request = std::to_string(size) + "\n";
+    socket.send(request);
+    std::vector<char> buf(megabyte);
+    size_t received = 0;
+    ssize_t n = 0;
+    while ((n = recv(socket.getFd(), buf.data(), buf.size(), 0)) > 0) {
+        received += n;
+    }
+    return received == size;
+}
+
+// User and system time of a process.
+double cpuSeconds(pid_t pid)
+{
+    std::string path { "/proc/" };
+    path.append(std::to_string(pid)).append("/stat");
+    std::ifstream file { path };
+    std::string stat { std::istreambuf_iterator<char> { file }, {} };
+    // The fields after the command name, which may contain spaces, start with the state.
+    std::istringstream fields { stat.substr(stat.rfind(')') + 2) };
+    std::string field {};
+    double ticks = 0;
+    for (int i = 3; i <= 15 && fields >> field; ++i) {
+        if (i >= 14) {
+            ticks += std::stod(field);
+        }
+    }
+    return ticks / sysconf(_SC_CLK_TCK);
+}
+
+void waitForServer(int port)
+{
+    while (true) {
+        try {
+            TcpSocket test { port };
+            return;
+        } catch (std::invalid_argument&) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+}
+
+void measure(const char* name, int port, size_t size, size_t totalBytes, pid_t lb)
+{
+    const auto repetitions = std::max<size_t>(1, totalBytes / size);
+    const auto cpuBefore = lb > 0 ? cpuSeconds(lb) : 0.0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repetitions; ++i) {
+        if (!transfer(port, size)) {
+            fprintf(stderr, "%s: transfer of %zu bytes was cut short\n", name, size);
+            exit(1);
+        }
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    const double gigabytes = static_cast<double>(repetitions * size) / (1 << 30);
+    printf("%-8s %4zu MB x %-4zu %8.0f MB/s", name, size / megabyte, repetitions, gigabytes * 1024 / elapsed.count());
+    if (lb > 0) {
+        printf("   lb cpu %6.3f s/GB", (cpuSeconds(lb) - cpuBefore) / gigabytes);
+    }
+    printf("\n");
+}
+
+pid_t startLoadBalancer(ForwardMode mode, int port, int backendListener)
+{
+    const pid_t pid = fork();
+    if (pid == 0) {
+        close(backendListener);
+        // The load balancer logs every connection.
+        if (freopen("/dev/null", "w", stdout) == nullptr) {
+            _exit(1);
+        }
+        LoadBalancer server { PoolOptions {}, mode };
+        server.addBackend(backendPort);
+        server.start(std::to_string(port));
+        _exit(0);
+    }
+    return pid;
+}
+
+size_t parseSize(const std::string_view value)
+{
+    size_t result {};
+    const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (error != std::errc {} || end != value.data() + value.size() || result == 0) {
+        fprintf(stderr, "Invalid number: %s\n", value.data());
+        exit(1);
+    }
+    return result;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    size_t totalBytes = 200 * megabyte;
+    if (argc == 3 && std::string_view { argv[1] } == "--total-mb") {
+        totalBytes = parseSize(argv[2]) * megabyte;
+    } else if (argc != 1) {
+        fprintf(stderr, "Usage: %s [--total-mb n]\n", argv[0]);
+        return 1;
+    }
+
+    // Listening before the forks, so the first health check finds the backend up.
+    const int backendListener = listenOn(backendPort);
+    const pid_t splice = startLoadBalancer(ForwardMode::Splice, splicePort, backendListener);
+    const pid_t stream = startLoadBalancer(ForwardMode::Stream, streamPort, backendListener);
+    runBackend(backendListener);
+    waitForServer(splicePort);
+    waitForServer(streamPort);
+
+    printf("%zu MB per size\n", totalBytes / megabyte);
+    for (const auto size : transferSizes) {
+        measure("direct", backendPort, size, totalBytes, 0);
+        measure("splice", splicePort, size, totalBytes, splice);
+        measure("stream", streamPort, size, totalBytes, stream);
+    }
+    fflush(stdout);
+    for (const auto lb : { splice, stream }) {
+        kill(lb, SIGTERM);
+        waitpid(lb, nullptr, 0);
+    }
+    // The backend threads never return.
+    _exit(0);
+}
@@ -0,0 +1,180 @@
+// Tail latency of the balancing strategies, simulated: backends of unequal speed serve
+// a few requests at a time each from a queue, with exponentially distributed service
+// times, and requests arrive at random at a share of their total capacity. Every
+// strategy sees the same arrivals and service times, and the same stats as it would
+// in the load balancer: outstanding requests, and latencies including the queueing.
+// Runs once with weights matching the backends' capacities and once with all weights
+// left at 1, as when the sizes of the backends are not known.
+//
+//   ./strategy_bench --requests 200000 --load 70
+
+#include "Strategy.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+namespace {
+struct BenchConfig {
+    unsigned requests { 200000 };
+    // Percent of the total capacity of the backends.
+    unsigned load { 70 };
+};
+
+struct BackendModel {
+    double meanServiceMs;
+    // Requests served at once.
+    unsigned slots;
+    unsigned weight;
+};
+
+// Three backends five times faster than the fourth.
+const std::vector<BackendModel> models {
+    { 2, 4, 5 },
+    { 2, 4, 5 },
+    { 2, 4, 5 },
+    { 10, 4, 1 },
+};
+constexpr size_t slowBackend = 3;
+constexpr uint64_t seed = 42;
+
+struct Result {
+    std::vector<int64_t> latencies {};
+    size_t toSlowBackend {};
+};
+
+BackendStats::Clock::time_point at(int64_t nanos)
+{
+    return BackendStats::Clock::time_point { std::chrono::duration_cast<BackendStats::Clock::duration>(std::chrono::nanoseconds { nanos }) };
+}
+
+Result simulate(StrategyKind kind, bool weighted, const BenchConfig& config)
+{
+    Backends backends {};
+    double capacity = 0;
+    for (size_t i = 0; i < models.size(); ++i) {
+        backends.push_back(std::make_unique<BackendStats>(static_cast<int>(i + 1), weighted ? models[i].weight : 1));
+        capacity += models[i].slots / (models[i].meanServiceMs * 1e6);
+    }
+    auto strategy = makeStrategy(kind);
+
+    // Separate streams, so that the arrivals and every backend's service times are
+    // the same whatever the strategy.
+    std::mt19937_64 arrivals { seed };
+    std::exponential_distribution<double> interarrival { capacity * config.load / 100 };
+    std::vector<std::mt19937_64> serviceRandom {};
+    std::vector<std::exponential_distribution<double>> service {};
+    std::vector<std::deque<int64_t>> queues(models.size());
+    std::vector<unsigned> busy(models.size());
+    for (size_t i = 0; i < models.size(); ++i) {
+        serviceRandom.emplace_back(seed + i + 1);
+        service.emplace_back(1 / (models[i].meanServiceMs * 1e6));
+    }
+
+    // When a request is done, on which backend, and when it arrived.
+    using Completion = std::tuple<int64_t, size_t, int64_t>;
+    std::priority_queue<Completion, std::vector<Completion>, std::greater<>> completions {};
+    auto serve = [&](size_t backend, int64_t now, int64_t arrived) {
+        ++busy[backend];
+        completions.emplace(now + static_cast<int64_t>(service[backend](serviceRandom[backend])), backend, arrived);
+    };
+
+    Result result {};
+    result.latencies.reserve(config.requests);
+    auto complete = [&]() {
+        const auto [now, backend, arrived] = completions.top();
+        completions.pop();
+        result.latencies.push_back(now - arrived);
+        backends[backend]->end();
+        backends[backend]->observe(std::chrono::nanoseconds { now - arrived }, at(now));
+        --busy[backend];
+        if (!queues[backend].empty()) {
+            serve(backend, now, queues[backend].front());
+            queues[backend].pop_front();
+        }
+    };
+
+    int64_t now = 0;
+    for (unsigned i = 0; i < config.requests; ++i) {
+        now += static_cast<int64_t>(interarrival(arrivals));
+        while (!completions.empty() && std::get<0>(completions.top()) <= now) {
+            complete();
+        }
+        auto* picked = strategy->pick(backends, at(now));
+        const auto backend = static_cast<size_t>(picked->port() - 1);
+        picked->begin();
+        if (backend == slowBackend) {
+            ++result.toSlowBackend;
+        }
+        if (busy[backend] < models[backend].slots) {
+            serve(backend, now, now);
+        } else {
+            queues[backend].push_back(now);
+        }
+    }
+    while (!completions.empty()) {
+        complete();
+    }
+    return result;
+}
+
+double percentileMs(const std::vector<int64_t>& sorted, double percentile)
+{
+    const auto index = static_cast<size_t>(percentile / 100 * (sorted.size() - 1));
+    return sorted[index] / 1e6;
+}
+
+unsigned parseUnsigned(const std::string_view value)
+{
+    unsigned result {};
+    const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (error != std::errc {} || end != value.data() + value.size() || result == 0) {
+        fprintf(stderr, "Invalid number: %s\n", value.data());
+        exit(1);
+    }
+    return result;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    BenchConfig config {};
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string_view flag { argv[i] };
+        if (flag == "--requests") {
+            config.requests = parseUnsigned(argv[i + 1]);
+        } else if (flag == "--load") {
+            config.load = parseUnsigned(argv[i + 1]);
+        } else {
+            fprintf(stderr, "Usage: %s [--requests n] [--load percent]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("3 backends at 2 ms and 1 at 10 ms, 4 requests at a time each, %u%% load, %u requests\n", config.load,
+        config.requests);
+    for (const auto weighted : { true, false }) {
+        printf("\n%s\n", weighted ? "weights 5, 5, 5, 1" : "weights all 1");
+        printf("%-22s %9s %9s %9s %9s %9s %6s\n", "strategy", "p50 ms", "p90 ms", "p99 ms", "p99.9 ms", "max ms",
+            "slow");
+        for (const auto kind : allStrategies) {
+            auto result = simulate(kind, weighted, config);
+            std::sort(result.latencies.begin(), result.latencies.end());
+            printf("%-22.*s %9.2f %9.2f %9.2f %9.2f %9.2f %5.1f%%\n", static_cast<int>(strategyName(kind).size()),
+                strategyName(kind).data(), percentileMs(result.latencies, 50), percentileMs(result.latencies, 90),
+                percentileMs(result.latencies, 99), percentileMs(result.latencies, 99.9),
+                percentileMs(result.latencies, 100), 100.0 * result.toSlowBackend / config.requests);
+        }
+    }
+}
@@ -0,0 +1,169 @@
+#include "Strategy.h"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace std::chrono_literals;
+
+namespace {
+// Backends on ports 1, 2, ... with the given weights.
+Backends makeBackends(const std::vector<unsigned>& weights)
+{
+    Backends backends {};
+    for (size_t i = 0; i < weights.size(); ++i) {
+        backends.push_back(std::make_unique<BackendStats>(static_cast<int>(i + 1), weights[i]));
+    }
+    return backends;
+}
+
+// How often every port is picked in count picks.
+std::map<int, int> picks(Strategy& strategy, const Backends& backends, int count)
+{
+    std::map<int, int> result {};
+    for (int i = 0; i < count; ++i) {
+        const auto* backend = strategy.pick(backends, BackendStats::Clock::now());
+        ++result[backend == nullptr ? 0 : backend->port()];
+    }
+    return result;
+}
+}
+
+TEST(StrategyTest, NothingIsPickedWhenAllBackendsAreDown)
+{
+    auto backends = makeBackends({ 1, 2 });
+    for (auto& backend : backends) {
+        backend->setAlive(false);
+    }
+    for (const auto kind : allStrategies) {
+        EXPECT_EQ(nullptr, makeStrategy(kind)->pick(backends, BackendStats::Clock::now())) << strategyName(kind);
+        EXPECT_EQ(nullptr, makeStrategy(kind)->pick({}, BackendStats::Clock::now())) << strategyName(kind);
+    }
+}
+
+TEST(StrategyTest, DeadBackendsAreSkipped)
+{
+    auto backends = makeBackends({ 1, 1, 1 });
+    backends[1]->setAlive(false);
+    for (const auto kind : allStrategies) {
+        auto strategy = makeStrategy(kind);
+        EXPECT_EQ(0, picks(*strategy, backends, 100)[2]) << strategyName(kind);
+    }
+}
+
+TEST(StrategyTest, RoundRobinTakesTurns)
+{
+    const auto backends = makeBackends({ 1, 1, 1 });
+    auto strategy = makeStrategy(StrategyKind::RoundRobin);
+    for (int i = 0; i < 6; ++i) {
+        EXPECT_EQ(i % 3 + 1, strategy->pick(backends, BackendStats::Clock::now())->port());
+    }
+}
+
+TEST(StrategyTest, WeightedRoundRobinInterleavesByWeight)
+{
+    const auto backends = makeBackends({ 3, 1 });
+    auto strategy = makeStrategy(StrategyKind::WeightedRoundRobin);
+    std::vector<int> order {};
+    for (int i = 0; i < 4; ++i) {
+        order.push_back(strategy->pick(backends, BackendStats::Clock::now())->port());
+    }
+    EXPECT_EQ((std::vector<int> { 1, 2, 1, 1 }), order);
+
+    const auto counts = picks(*strategy, backends, 400);
+    EXPECT_EQ(300, counts.at(1));
+    EXPECT_EQ(100, counts.at(2));
+}
+
+TEST(StrategyTest, LeastOutstandingCountsWeights)
+{
+    const auto backends = makeBackends({ 1, 1, 4 });
+    auto strategy = makeStrategy(StrategyKind::LeastOutstanding);
+    backends[0]->begin();
+    EXPECT_NE(1, strategy->pick(backends, BackendStats::Clock::now())->port());
+
+    backends[1]->begin();
+    backends[2]->begin();
+    backends[2]->begin();
+    // 1 of 1, 1 of 1 and 2 of 4.
+    EXPECT_EQ(3, strategy->pick(backends, BackendStats::Clock::now())->port());
+
+    backends[0]->end();
+    EXPECT_EQ(1, strategy->pick(backends, BackendStats::Clock::now())->port());
+}
+
+TEST(StrategyTest, PeakEwmaTakesPeaksAtOnceAndForgetsThemSlowly)
+{
+    BackendStats backend { 1 };
+    const auto start = BackendStats::Clock::now();
+    EXPECT_EQ(0, backend.latency(start));
+
+    backend.observe(1ms, start);
+    EXPECT_DOUBLE_EQ(1e6, backend.latency(start));
+    backend.observe(10ms, start + 1ms);
+    EXPECT_DOUBLE_EQ(1e7, backend.latency(start + 1ms));
+
+    // Faster answers bring it down only gradually.
+    backend.observe(1ms, start + 2ms);
+    EXPECT_GT(backend.latency(start + 2ms), 9e6);
+    // Left alone, it is forgotten.
+    EXPECT_LT(backend.latency(start + 10s), 1e3);
+}
+
+TEST(StrategyTest, PeakEwmaWeighsLatencyAgainstLoad)
+{
+    const auto backends = makeBackends({ 1, 1 });
+    auto strategy = makeStrategy(StrategyKind::PeakEwma);
+    const auto now = BackendStats::Clock::now();
+    backends[0]->observe(1ms, now);
+    backends[1]->observe(10ms, now);
+    EXPECT_EQ(1, strategy->pick(backends, now)->port());
+
+    // 10 outstanding at 1 ms cost more than none at 10 ms.
+    for (int i = 0; i < 10; ++i) {
+        backends[0]->begin();
+    }
+    EXPECT_EQ(2, strategy->pick(backends, now)->port());
+}
+
+TEST(StrategyTest, PeakEwmaWaitsForTheFirstAnswer)
+{
+    const auto backends = makeBackends({ 1, 1 });
+    auto strategy = makeStrategy(StrategyKind::PeakEwma);
+    const auto now = BackendStats::Clock::now();
+    backends[0]->observe(100ms, now);
+    backends[0]->begin();
+    backends[1]->begin();
+    // The new backend has not answered its first message yet.
+    EXPECT_EQ(1, strategy->pick(backends, now)->port());
+}
+
+TEST(StrategyTest, PowerOfTwoChoicesNeverPicksTheMostLoaded)
+{
+    const auto backends = makeBackends({ 1, 1, 1 });
+    auto strategy = makeStrategy(StrategyKind::PowerOfTwoChoices);
+    backends[0]->begin();
+    backends[0]->begin();
+    backends[1]->begin();
+    const auto counts = picks(*strategy, backends, 300);
+    EXPECT_EQ(0, counts.contains(1) ? counts.at(1) : 0);
+    // The idle one wins both pairs it is drawn in.
+    EXPECT_GT(counts.at(3), counts.at(2));
+}
+
+TEST(StrategyTest, NamesRoundTrip)
+{
+    for (const auto kind : allStrategies) {
+        EXPECT_EQ(kind, parseStrategy(strategyName(kind)));
+    }
+    EXPECT_FALSE(parseStrategy("random").has_value());
+}
+
+TEST(StrategyTest, WeightMustBePositive)
+{
+    EXPECT_THROW(BackendStats(1, 0), std::invalid_argument);
+}
@@ -0,0 +1,18 @@
+#!/bin/bash
+# Measures how throughput scales with the number of reactor threads.
+# Usage: ./benchmark.sh <build dir> [command] [clients]
+
+BUILD_DIR=${1:-build}
+COMMAND=${2:-set}
+CLIENTS=${3:-64}
+PORT=6390
+
+for THREADS in 1 2 4 8; do
+    "$BUILD_DIR"/server --port $PORT --threads $THREADS > /dev/null &
+    SERVER_PID=$!
+    sleep 1
+    echo -n "threads=$THREADS "
+    "$BUILD_DIR"/throughput_bench --port $PORT --clients "$CLIENTS" --seconds 5 --command "$COMMAND"
+    kill $SERVER_PID
+    wait $SERVER_PID 2> /dev/null
+done
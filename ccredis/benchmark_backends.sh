@@ -0,0 +1,20 @@
+#!/bin/bash
+# Compares the epoll and io_uring backends: throughput and round trip latency
+# percentiles for the same load.
+# Usage: ./benchmark_backends.sh <build dir> [command] [clients] [threads]
+
+BUILD_DIR=${1:-build}
+COMMAND=${2:-set}
+CLIENTS=${3:-64}
+THREADS=${4:-1}
+PORT=6391
+
+for BACKEND in epoll io_uring; do
+    "$BUILD_DIR"/server --port $PORT --threads "$THREADS" --io-backend $BACKEND > /dev/null &
+    SERVER_PID=$!
+    sleep 1
+    echo -n "$BACKEND "
+    "$BUILD_DIR"/throughput_bench --port $PORT --clients "$CLIENTS" --seconds 5 --command "$COMMAND"
+    kill $SERVER_PID
+    wait $SERVER_PID 2> /dev/null
+done
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "Commands.h"
+#include "Config.h"
+#include "Database.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <span>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Logs every write to the keyspace as RESP commands, so the keyspace can be rebuilt by
+// replaying the file. String writes are logged as SET with an absolute PXAT expiry, the
+// state the key was left in, and deletes as DEL. Updates of hashes, lists and sets are
+// logged as the command that made them (HSET, LPUSH, RPUSH, SADD), since logging the
+// whole collection would cost as much as the collection. A push is not idempotent, so a
+// rewrite must not see a write both in the keyspace and in the writes made meanwhile: it
+// copies the keyspace one shard at a time and only collects the writes to the shards it
+// has already copied.
+//
+// Writers append to a buffer in memory. A flusher thread writes the buffer out with one
+// write per batch and fsyncs it according to the policy, so concurrent writers share the
+// cost of a write and an fsync (group commit).
+class AppendOnlyFile {
+public:
+    static std::expected<std::shared_ptr<AppendOnlyFile>, std::string> open(const std::string& path, FsyncPolicy policy);
+
+    ~AppendOnlyFile();
+
+    AppendOnlyFile(const AppendOnlyFile&) = delete;
+    AppendOnlyFile& operator=(const AppendOnlyFile&) = delete;
+
+    // Thread safe. Use as the write hook of the Db.
+    void logWrite(KeyT key, const ValueType* value, std::span<const std::string_view> command);
+    // Thread safe. Appends one RESP encoded command that writes to key.
+    void append(KeyT key, std::string_view command);
+
+    // With the always policy, blocks until everything appended so far is on disk; the
+    // reactors call it before sending replies. A no-op with the other policies.
+    void awaitFsync();
+
+    // Rewrites the log in the background as one SET per string of db, and HSET, RPUSH or
+    // SADD commands for the collections. Returns false if a
+    // rewrite is already running.
+    bool startRewrite(const std::shared_ptr<const Db>& db);
+    bool rewriteInProgress() const { return rewriting_.load(); }
+    bool lastRewriteSucceeded() const { return lastRewriteOk_.load(); }
+    // Size of the file including what is still buffered.
+    uint64_t size() const { return size_.load(); }
+
+private:
+    AppendOnlyFile(std::string path, int fd, FsyncPolicy policy, uint64_t size);
+
+    void flushLoop(std::stop_token stop);
+    void rewrite(const std::shared_ptr<const Db>& db);
+
+    const std::string path_ {};
+    const FsyncPolicy policy_ {};
+
+    // Guards the file descriptor. Taken before mutex_ by the flusher and the rewrite, so
+    // the rewrite cannot replace the file while a batch taken from buffer_ is in flight.
+    std::mutex fileMutex_ {};
+    int fd_ {};
+
+    std::mutex mutex_ {};
+    std::condition_variable_any appended_ {};
+    std::condition_variable flushed_ {};
+    std::string buffer_ {};
+    // While a rewrite runs, appends to the shards it has copied are also collected here
+    // and added to the new file.
+    std::string rewriteBuffer_ {};
+    // The shards below this one have been copied by the rewrite.
+    size_t rewrittenShards_ {};
+    // Byte offsets in the stream of appended commands.
+    uint64_t appendedOffset_ {};
+    uint64_t syncedOffset_ {};
+
+    std::atomic<uint64_t> size_ {};
+    std::atomic<bool> rewriting_ {};
+    std::atomic<bool> lastRewriteOk_ { true };
+
+    // Declared last so they stop before the members they use are destroyed.
+    std::jthread rewriter_ {};
+    std::jthread flusher_ {};
+};
+
+// Encodes a write as passed to the write hook of the Db into the command that is logged,
+// and sent to followers: SET with PXAT, DEL, or the command of a collection update.
+void encodeWrite(std::string& out, KeyT key, const ValueType* value, std::span<const std::string_view> command);
+
+// Applies a command encoded by encodeWrite to db. Returns false if the command is not one
+// encodeWrite makes.
+bool applyWrite(Db& db, const CommandVariant& command);
+
+struct ReplayStats {
+    size_t commands_ {};
+    size_t bytes_ {};
+    std::chrono::nanoseconds elapsed_ {};
+};
+
+// Replays the append only file at path into db with the RespDecoder. A command cut short
+// at the end of the file, as left by a crash, is truncated away. A missing file replays
+// nothing.
+std::expected<ReplayStats, std::string> replayAppendOnlyFile(Db& db, const std::string& path);
@@ -0,0 +1,512 @@
+#pragma once
+
+#include "FlatHashMap.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+
+// The hash, list and set values. A small collection is kept packed in one buffer, like a
+// Redis listpack, which is one allocation however many elements it has and is scanned in
+// consecutive memory. Past the thresholds below a hash or set moves to a FlatHashMap and
+// a list to a chain of packed nodes (a quicklist), so operations on large collections
+// stay cheap.
+
+// A hash or set stays packed up to this many fields or members...
+constexpr size_t maxPackedEntries = 128;
+// ... as long as none of its strings is longer than this.
+constexpr size_t maxPackedStringSize = 64;
+// Size of a packed list, and of every node of a quicklist.
+constexpr size_t maxPackedListBytes = 8 * 1024;
+
+// Heap bytes taken by a std::string of this capacity; short strings live in the object.
+inline size_t stringHeapBytes(const size_t capacity)
+{
+    return capacity > std::string {}.capacity() ? capacity + 1 : 0;
+}
+
+// Strings stored back to back in one buffer: a u32 count, then per element its length
+// as a varint followed by its bytes.
+class PackedList {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = std::string_view;
+
+        Iterator() = default;
+        explicit Iterator(const char* pos)
+            : pos_(pos)
+        {
+        }
+
+        std::string_view operator*() const
+        {
+            const auto [length, header] = readLength(pos_);
+            return { pos_ + header, length };
+        }
+        Iterator& operator++()
+        {
+            const auto [length, header] = readLength(pos_);
+            pos_ += header + length;
+            return *this;
+        }
+        Iterator operator++(int)
+        {
+            auto copy = *this;
+            ++*this;
+            return copy;
+        }
+        friend bool operator==(const Iterator&, const Iterator&) = default;
+
+    private:
+        friend class PackedList;
+        const char* pos_ {};
+    };
+
+    Iterator begin() const { return Iterator { bytes_.empty() ? nullptr : bytes_.data() + headerSize }; }
+    Iterator end() const { return Iterator { bytes_.empty() ? nullptr : bytes_.data() + bytes_.size() }; }
+
+    size_t size() const
+    {
+        uint32_t count = 0;
+        if (!bytes_.empty()) {
+            std::memcpy(&count, bytes_.data(), sizeof count);
+        }
+        return count;
+    }
+    bool empty() const { return size() == 0; }
+    // Bytes taken by the buffer, header included.
+    size_t bytes() const { return bytes_.size(); }
+    // Heap bytes taken by the buffer.
+    size_t memoryUsage() const { return stringHeapBytes(bytes_.capacity()); }
+    // Bytes an element of this length takes in the buffer.
+    static size_t entrySize(const size_t length) { return varintSize(length) + length; }
+
+    void pushBack(const std::string_view value) { insert(bytes_.empty() ? headerSize : bytes_.size(), value); }
+    void pushFront(const std::string_view value) { insert(headerSize, value); }
+
+    // Replaces the element at it with value. Invalidates the iterators.
+    void replace(const Iterator it, const std::string_view value)
+    {
+        const auto offset = static_cast<size_t>(it.pos_ - bytes_.data());
+        const auto [length, header] = readLength(it.pos_);
+        char newHeader[maxVarintSize];
+        const auto newHeaderSize = writeLength(newHeader, value.size());
+        bytes_.replace(offset + header, length, value);
+        bytes_.replace(offset, header, newHeader, newHeaderSize);
+    }
+
+    friend bool operator==(const PackedList&, const PackedList&) = default;
+
+private:
+    static constexpr size_t headerSize = sizeof(uint32_t);
+    static constexpr size_t maxVarintSize = 10;
+
+    static size_t varintSize(size_t length)
+    {
+        size_t size = 1;
+        while (length >= 0x80) {
+            length >>= 7;
+            ++size;
+        }
+        return size;
+    }
+
+    static size_t writeLength(char* out, size_t length)
+    {
+        size_t i = 0;
+        while (length >= 0x80) {
+            out[i++] = static_cast<char>((length & 0x7F) | 0x80);
+            length >>= 7;
+        }
+        out[i++] = static_cast<char>(length);
+        return i;
+    }
+
+    // The length of the element at pos and the size of its varint.
+    static std::pair<size_t, size_t> readLength(const char* pos)
+    {
+        size_t length = 0;
+        size_t i = 0;
+        for (int shift = 0;; shift += 7) {
+            const auto byte = static_cast<uint8_t>(pos[i++]);
+            length |= static_cast<size_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return { length, i };
+            }
+        }
+    }
+
+    void insert(const size_t offset, const std::string_view value)
+    {
+        if (bytes_.empty()) {
+            bytes_.assign(headerSize, '\0');
+        }
+        char header[maxVarintSize];
+        const auto headerLength = writeLength(header, value.size());
+        // One move of the tail for both pieces.
+        bytes_.insert(offset, headerLength + value.size(), '\0');
+        std::memcpy(bytes_.data() + offset, header, headerLength);
+        std::memcpy(bytes_.data() + offset + headerLength, value.data(), value.size());
+        const auto count = static_cast<uint32_t>(size() + 1);
+        std::memcpy(bytes_.data(), &count, sizeof count);
+    }
+
+    std::string bytes_ {};
+};
+
+// Field/value pairs, packed as alternating fields and values while small.
+class HashValue {
+public:
+    using Table = FlatHashMap<std::string>;
+
+    HashValue() = default;
+    HashValue(const HashValue& other)
+        : packed_(other.packed_)
+        , table_(other.table_ ? std::make_unique<Table>(*other.table_) : nullptr)
+        , tableStringBytes_(other.tableStringBytes_)
+    {
+    }
+    HashValue(HashValue&&) noexcept = default;
+    HashValue& operator=(HashValue other) noexcept
+    {
+        std::swap(packed_, other.packed_);
+        std::swap(table_, other.table_);
+        std::swap(tableStringBytes_, other.tableStringBytes_);
+        return *this;
+    }
+
+    // Returns true if the field is new.
+    bool set(const std::string_view field, const std::string_view value)
+    {
+        if (!table_) {
+            for (auto it = packed_.begin(); it != packed_.end(); ++it) {
+                if (*it++ == field) {
+                    packed_.replace(it, value);
+                    return false;
+                }
+            }
+            if (size() < maxPackedEntries && field.size() <= maxPackedStringSize && value.size() <= maxPackedStringSize) {
+                packed_.pushBack(field);
+                packed_.pushBack(value);
+                return true;
+            }
+            convertToTable();
+        }
+        auto [stored, inserted] = table_->tryEmplace(field, Table::hash(field));
+        tableStringBytes_ -= inserted ? 0 : stringHeapBytes(stored->capacity());
+        stored->assign(value);
+        tableStringBytes_ += stringHeapBytes(stored->capacity()) + (inserted ? stringHeapBytes(field.size()) : 0);
+        return inserted;
+    }
+
+    std::optional<std::string_view> get(const std::string_view field) const
+    {
+        if (table_) {
+            const auto* value = table_->find(field, Table::hash(field));
+            return value == nullptr ? std::nullopt : std::optional<std::string_view> { *value };
+        }
+        for (auto it = packed_.begin(); it != packed_.end(); ++it) {
+            if (*it++ == field) {
+                return *it;
+            }
+        }
+        return std::nullopt;
+    }
+
+    size_t size() const { return table_ ? table_->size() : packed_.size() / 2; }
+    bool isPacked() const { return !table_; }
+    // Heap bytes taken by the hash, estimated without walking it.
+    size_t memoryUsage() const
+    {
+        return table_ ? table_->capacity() * (sizeof(Table::Entry) + 1) + tableStringBytes_ : packed_.memoryUsage();
+    }
+
+    // Calls f(field, value) for every field.
+    template <typename F>
+    void forEach(F&& f) const
+    {
+        if (table_) {
+            table_->forEach([&f](const std::string& field, const std::string& value) { f(field, value); });
+            return;
+        }
+        for (auto it = packed_.begin(); it != packed_.end(); ++it) {
+            const auto field = *it++;
+            f(field, *it);
+        }
+    }
+
+    friend bool operator==(const HashValue& lhs, const HashValue& rhs)
+    {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        bool equal = true;
+        lhs.forEach([&rhs, &equal](const std::string_view field, const std::string_view value) {
+            equal = equal && rhs.get(field) == value;
+        });
+        return equal;
+    }
+
+private:
+    void convertToTable()
+    {
+        auto table = std::make_unique<Table>();
+        table->reserve(size() + 1);
+        size_t stringBytes = 0;
+        forEach([&table, &stringBytes](const std::string_view field, const std::string_view value) {
+            table->tryEmplace(field, Table::hash(field)).first->assign(value);
+            stringBytes += stringHeapBytes(field.size()) + stringHeapBytes(value.size());
+        });
+        table_ = std::move(table);
+        tableStringBytes_ = stringBytes;
+        packed_ = PackedList {};
+    }
+
+    PackedList packed_ {};
+    std::unique_ptr<Table> table_ {};
+    // Heap bytes of the strings in table_.
+    size_t tableStringBytes_ {};
+};
+
+// Unique members, packed while small.
+class SetValue {
+public:
+    using Table = FlatHashMap<std::monostate>;
+
+    SetValue() = default;
+    SetValue(const SetValue& other)
+        : packed_(other.packed_)
+        , table_(other.table_ ? std::make_unique<Table>(*other.table_) : nullptr)
+        , tableStringBytes_(other.tableStringBytes_)
+    {
+    }
+    SetValue(SetValue&&) noexcept = default;
+    SetValue& operator=(SetValue other) noexcept
+    {
+        std::swap(packed_, other.packed_);
+        std::swap(table_, other.table_);
+        std::swap(tableStringBytes_, other.tableStringBytes_);
+        return *this;
+    }
+
+    // Returns true if the member is new.
+    bool add(const std::string_view member)
+    {
+        if (!table_) {
+            if (contains(member)) {
+                return false;
+            }
+            if (packed_.size() < maxPackedEntries && member.size() <= maxPackedStringSize) {
+                packed_.pushBack(member);
+                return true;
+            }
+            convertToTable();
+        }
+        const bool inserted = table_->tryEmplace(member, Table::hash(member)).second;
+        tableStringBytes_ += inserted ? stringHeapBytes(member.size()) : 0;
+        return inserted;
+    }
+
+    bool contains(const std::string_view member) const
+    {
+        if (table_) {
+            return table_->find(member, Table::hash(member)) != nullptr;
+        }
+        return std::find(packed_.begin(), packed_.end(), member) != packed_.end();
+    }
+
+    size_t size() const { return table_ ? table_->size() : packed_.size(); }
+    bool isPacked() const { return !table_; }
+    // Heap bytes taken by the set, estimated without walking it.
+    size_t memoryUsage() const
+    {
+        return table_ ? table_->capacity() * (sizeof(Table::Entry) + 1) + tableStringBytes_ : packed_.memoryUsage();
+    }
+
+    template <typename F>
+    void forEach(F&& f) const
+    {
+        if (table_) {
+            table_->forEach([&f](const std::string& member, std::monostate) { f(member); });
+            return;
+        }
+        for (const auto member : packed_) {
+            f(member);
+        }
+    }
+
+    friend bool operator==(const SetValue& lhs, const SetValue& rhs)
+    {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        bool equal = true;
+        lhs.forEach([&rhs, &equal](const std::string_view member) { equal = equal && rhs.contains(member); });
+        return equal;
+    }
+
+private:
+    void convertToTable()
+    {
+        table_ = std::make_unique<Table>();
+        table_->reserve(packed_.size() + 1);
+        for (const auto member : packed_) {
+            table_->tryEmplace(member, Table::hash(member));
+            tableStringBytes_ += stringHeapBytes(member.size());
+        }
+        packed_ = PackedList {};
+    }
+
+    PackedList packed_ {};
+    std::unique_ptr<Table> table_ {};
+    // Heap bytes of the strings in table_.
+    size_t tableStringBytes_ {};
+};
+
+// A list, packed while small and a quicklist of packed nodes once it outgrows one node.
+class ListValue {
+public:
+    ListValue() = default;
+    ListValue(const ListValue& other)
+        : packed_(other.packed_)
+        , quicklist_(other.quicklist_ ? std::make_unique<Quicklist>(*other.quicklist_) : nullptr)
+    {
+    }
+    ListValue(ListValue&&) noexcept = default;
+    ListValue& operator=(ListValue other) noexcept
+    {
+        std::swap(packed_, other.packed_);
+        std::swap(quicklist_, other.quicklist_);
+        return *this;
+    }
+
+    void pushFront(const std::string_view value)
+    {
+        if (!quicklist_ && packed_.bytes() + PackedList::entrySize(value.size()) <= maxPackedListBytes) {
+            packed_.pushFront(value);
+            return;
+        }
+        auto& nodes = toQuicklist().nodes_;
+        if (nodes.front().bytes() + PackedList::entrySize(value.size()) > maxPackedListBytes) {
+            nodes.emplace_front();
+            quicklist_->memoryUsage_ += sizeof(PackedList);
+        }
+        quicklist_->memoryUsage_ -= nodes.front().memoryUsage();
+        nodes.front().pushFront(value);
+        quicklist_->memoryUsage_ += nodes.front().memoryUsage();
+        ++quicklist_->size_;
+    }
+
+    void pushBack(const std::string_view value)
+    {
+        if (!quicklist_ && packed_.bytes() + PackedList::entrySize(value.size()) <= maxPackedListBytes) {
+            packed_.pushBack(value);
+            return;
+        }
+        auto& nodes = toQuicklist().nodes_;
+        if (nodes.back().bytes() + PackedList::entrySize(value.size()) > maxPackedListBytes) {
+            nodes.emplace_back();
+            quicklist_->memoryUsage_ += sizeof(PackedList);
+        }
+        quicklist_->memoryUsage_ -= nodes.back().memoryUsage();
+        nodes.back().pushBack(value);
+        quicklist_->memoryUsage_ += nodes.back().memoryUsage();
+        ++quicklist_->size_;
+    }
+
+    size_t size() const { return quicklist_ ? quicklist_->size_ : packed_.size(); }
+    bool isPacked() const { return !quicklist_; }
+    // Heap bytes taken by the list, estimated without walking it.
+    size_t memoryUsage() const { return quicklist_ ? sizeof(Quicklist) + quicklist_->memoryUsage_ : packed_.memoryUsage(); }
+
+    // Calls f for the elements from index start to stop, both included and in range.
+    template <typename F>
+    void forRange(size_t start, const size_t stop, F&& f) const
+    {
+        size_t remaining = stop - start + 1;
+        const auto visit = [&](const PackedList& node) {
+            for (auto it = node.begin(); it != node.end() && remaining > 0; ++it) {
+                if (start > 0) {
+                    --start;
+                    continue;
+                }
+                f(*it);
+                --remaining;
+            }
+        };
+        if (!quicklist_) {
+            visit(packed_);
+            return;
+        }
+        for (const auto& node : quicklist_->nodes_) {
+            if (remaining == 0) {
+                break;
+            }
+            // Whole nodes before the range are skipped by their count.
+            if (start >= node.size()) {
+                start -= node.size();
+                continue;
+            }
+            visit(node);
+        }
+    }
+
+    template <typename F>
+    void forEach(F&& f) const
+    {
+        if (size() > 0) {
+            forRange(0, size() - 1, f);
+        }
+    }
+
+    friend bool operator==(const ListValue& lhs, const ListValue& rhs)
+    {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        std::deque<std::string_view> elements {};
+        lhs.forEach([&elements](const std::string_view element) { elements.push_back(element); });
+        bool equal = true;
+        rhs.forEach([&elements, &equal](const std::string_view element) {
+            equal = equal && elements.front() == element;
+            elements.pop_front();
+        });
+        return equal;
+    }
+
+private:
+    struct Quicklist {
+        std::deque<PackedList> nodes_ {};
+        size_t size_ {};
+        // The nodes and their buffers.
+        size_t memoryUsage_ {};
+    };
+
+    Quicklist& toQuicklist()
+    {
+        if (!quicklist_) {
+            quicklist_ = std::make_unique<Quicklist>();
+            quicklist_->size_ = packed_.size();
+            quicklist_->memoryUsage_ = sizeof(PackedList) + packed_.memoryUsage();
+            quicklist_->nodes_.push_back(std::exchange(packed_, PackedList {}));
+        }
+        return *quicklist_;
+    }
+
+    PackedList packed_ {};
+    std::unique_ptr<Quicklist> quicklist_ {};
+};
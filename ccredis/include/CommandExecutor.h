@@ -0,0 +1,91 @@
+#pragma once
+
+#include "CommandHandler.h"
+#include "CommandStats.h"
+#include "PubSub.h"
+#include "Resp.h"
+#include "RespDecoder.h"
+#include "RespEncoder.h"
+#include "ServerContext.h"
+#include "Transaction.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+enum class ClientState {
+    Disconnected,
+    Connected,
+    // Sent PSYNC; the connection is handed over to replication.
+    Follower
+};
+
+// Executes what the clients of a reactor send, whichever I/O backend the reactor uses:
+// decodes frames, runs the commands and collects the replies in the encoder until the
+// reactor sends them.
+class CommandExecutor {
+public:
+    // A client that sends more than this without completing a frame is disconnected.
+    static constexpr size_t maxQueryBufferSize = 512 * 1024 * 1024;
+    // A client that leaves more than this of its replies unread is disconnected.
+    static constexpr size_t maxOutputBufferSize = 512 * 1024 * 1024;
+    // The periodic work runs ten times a second, like the default hz of Redis.
+    static constexpr long tickIntervalNs = 100'000'000;
+
+    // wake is called from other threads when messages were published for the clients of
+    // the reactor; the reactor then takes them with takePublications.
+    explicit CommandExecutor(const ServerContext& context, std::function<void()> wake = {});
+
+    // Executes every complete frame at the start of input, sent by client, and sets
+    // consumed to their length. Stops after a PSYNC, whose request is stored in
+    // followerRequest. client identifies the connection to pub/sub until onDisconnect.
+    ClientState execute(uint64_t client, std::string_view input, size_t& consumed,
+        std::optional<CommandHandler::FollowerRequest>& followerRequest);
+    // With appendfsync always, waits until the writes the collected replies acknowledge
+    // are on disk.
+    void awaitDurability();
+    // The periodic work, e.g. the active key expiry.
+    void onTick();
+    // Hands fd over to replication, which sends the stream to it from now on.
+    void attachFollower(int fd, CommandHandler::FollowerRequest&& request);
+
+    // The messages published for the subscribers of the reactor since the last call, and
+    // the clients each of them goes to.
+    std::vector<Publication> takePublications();
+    std::span<const uint64_t> subscribers(const Publication& publication) const;
+    // How many bytes of replies and messages the client may leave unread before it is
+    // disconnected. Lower for subscribers, which only read.
+    size_t outputLimit(uint64_t client) const;
+    // Drops the subscriptions and the transaction of a client that went away.
+    void onDisconnect(uint64_t client);
+
+    RespEncoder& encoder() { return respEncoder_; }
+
+private:
+    // Counts a command that took ticks, and logs it if it was slow.
+    void record(size_t command, uint64_t ticks);
+    // Queues a command the client sent after MULTI, decoded from frame, and replies
+    // QUEUED; or replies with an error and makes EXEC fail.
+    void queue(uint64_t client, const CommandVariant& command, std::string_view frame);
+
+    RespDecoder respDecoder_ {};
+    // Tokens of the frame being executed. Frames are executed one at a time, so all
+    // connections of the reactor share one arena.
+    RespTokenArena tokens_ {};
+    RespEncoder respEncoder_ {};
+    // Null when pub/sub is disabled.
+    std::unique_ptr<Subscriptions> subscriptions_ {};
+    Transactions transactions_ {};
+    CommandHandler commandHandler_;
+    std::shared_ptr<Db> db_ {};
+    std::shared_ptr<AppendOnlyFile> aof_ {};
+    std::shared_ptr<Replication> replication_ {};
+    std::shared_ptr<CommandMetrics> metrics_ {};
+    // What this reactor records into; null when commands are not timed.
+    CommandStats* stats_ {};
+};
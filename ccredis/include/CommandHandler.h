@@ -1,8 +1,17 @@
 #pragma once
 
 #include "RespEncoder.h"
+#include "ServerContext.h"
 
+#include <cstddef>
+#include <cstdint>
+#include <expected>
 #include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
 
 class Db;
 struct CommandUnknown;
@@ -11,28 +20,162 @@ struct CommandPing;
 struct CommandHello;
 struct CommandSet;
 struct CommandGet;
+struct CommandMget;
+struct CommandMset;
 struct CommandExists;
+struct CommandDel;
 struct CommandIncr;
+struct CommandIncrBy;
+struct CommandDecr;
+struct CommandDecrBy;
+struct CommandHset;
+struct CommandHget;
+struct CommandHgetall;
+struct CommandLpush;
+struct CommandRpush;
+struct CommandLrange;
+struct CommandSadd;
+struct CommandSmembers;
+struct CommandSismember;
+struct CommandInfo;
+struct CommandSave;
+struct CommandBgsave;
+struct CommandLastsave;
+struct CommandBgrewriteaof;
+struct CommandReplicaof;
+struct CommandPsync;
+struct CommandSlowlog;
+struct CommandLatency;
+struct CommandSubscribe;
+struct CommandUnsubscribe;
+struct CommandPsubscribe;
+struct CommandPunsubscribe;
+struct CommandPublish;
+struct CommandMulti;
+struct CommandExec;
+struct CommandDiscard;
+struct CommandWatch;
+struct CommandUnwatch;
+struct CommandEval;
+struct CommandEvalsha;
+struct CommandScript;
+class AppendOnlyFile;
+class CommandMetrics;
+class Replication;
+class Script;
+class ScriptCache;
+class Snapshotter;
+class Subscriptions;
+class Transactions;
 
 class CommandHandler {
 public:
     CommandHandler() = default;
-    CommandHandler(RespEncoder* enc, const std::shared_ptr<Db>& db)
+    // Pub/sub commands need the subscriptions of the reactor and transactions its
+    // transactions; without them they fail.
+    CommandHandler(RespEncoder* enc, const ServerContext& context, Subscriptions* subscriptions = nullptr,
+        Transactions* transactions = nullptr)
         : encoder_(enc)
-        , db_(db)
+        , db_(context.db_)
+        , snapshotter_(context.snapshotter_)
+        , aof_(context.aof_)
+        , replication_(context.replication_)
+        , metrics_(context.metrics_)
+        , scripts_(context.scripts_)
+        , subscriptions_(subscriptions)
+        , transactions_(transactions)
     {
     }
 
+    // The client whose commands are handled next, which pub/sub commands subscribe and
+    // whose transaction MULTI and friends act on.
+    void setClient(const uint64_t client) { client_ = client; }
+
     void operator()(const CommandUnknown&);
     void operator()(const CommandInvalid&);
     void operator()(const CommandPing&);
     void operator()(const CommandHello&);
     void operator()(const CommandSet&);
     void operator()(const CommandGet&);
+    void operator()(const CommandMget&);
+    void operator()(const CommandMset&);
     void operator()(const CommandExists&);
+    void operator()(const CommandDel&);
     void operator()(const CommandIncr&);
+    void operator()(const CommandIncrBy&);
+    void operator()(const CommandDecr&);
+    void operator()(const CommandDecrBy&);
+    void operator()(const CommandHset&);
+    void operator()(const CommandHget&);
+    void operator()(const CommandHgetall&);
+    void operator()(const CommandLpush&);
+    void operator()(const CommandRpush&);
+    void operator()(const CommandLrange&);
+    void operator()(const CommandSadd&);
+    void operator()(const CommandSmembers&);
+    void operator()(const CommandSismember&);
+    void operator()(const CommandInfo&);
+    void operator()(const CommandSave&);
+    void operator()(const CommandBgsave&);
+    void operator()(const CommandLastsave&);
+    void operator()(const CommandBgrewriteaof&);
+    void operator()(const CommandReplicaof&);
+    void operator()(const CommandPsync&);
+    void operator()(const CommandSlowlog&);
+    void operator()(const CommandLatency&);
+    void operator()(const CommandSubscribe&);
+    void operator()(const CommandUnsubscribe&);
+    void operator()(const CommandPsubscribe&);
+    void operator()(const CommandPunsubscribe&);
+    void operator()(const CommandPublish&);
+    void operator()(const CommandMulti&);
+    void operator()(const CommandExec&);
+    void operator()(const CommandDiscard&);
+    void operator()(const CommandWatch&);
+    void operator()(const CommandUnwatch&);
+    void operator()(const CommandEval&);
+    void operator()(const CommandEvalsha&);
+    void operator()(const CommandScript&);
+
+    // A connection that sent PSYNC asks to become a follower. The reactor hands it over
+    // to replication once the replies before it are sent.
+    struct FollowerRequest {
+        std::string replid_ {};
+        int64_t offset_ {};
+    };
+    std::optional<FollowerRequest> takeFollowerRequest() { return std::exchange(followerRequest_, std::nullopt); }
 
 private:
+    void incrementBy(std::string_view key, int64_t delta);
+    // Replies with an error and returns false on a follower, whose keyspace only its
+    // leader writes to.
+    bool writable();
+    // Evicts keys before a write that may grow the keyspace. Replies with an error and
+    // returns false if the write does not fit under maxmemory.
+    bool freeMemory();
+    // Replies with the count, or the error.
+    void appendResult(const std::expected<size_t, std::string>& result);
+    // (P)SUBSCRIBE and (P)UNSUBSCRIBE, which reply once per channel or pattern.
+    void subscribe(std::span<const std::string_view> targets, bool pattern);
+    void unsubscribe(std::span<const std::string_view> targets, bool pattern);
+    // EVAL and EVALSHA.
+    void run(const Script& script, std::span<const std::string_view> keys, std::span<const std::string_view> args);
+
     RespEncoder* encoder_;
     std::shared_ptr<Db> db_;
+    // Null when persistence is disabled.
+    std::shared_ptr<Snapshotter> snapshotter_;
+    std::shared_ptr<AppendOnlyFile> aof_;
+    // Null in tests that do not replicate.
+    std::shared_ptr<Replication> replication_;
+    // Null when commands are not timed.
+    std::shared_ptr<CommandMetrics> metrics_;
+    // Null when scripting is disabled.
+    std::shared_ptr<ScriptCache> scripts_;
+    // Null when pub/sub is disabled.
+    Subscriptions* subscriptions_ {};
+    // Null when transactions are not available, e.g. without a connection.
+    Transactions* transactions_ {};
+    uint64_t client_ {};
+    std::optional<FollowerRequest> followerRequest_ {};
 };
\ No newline at end of file
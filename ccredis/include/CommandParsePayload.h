@@ -2,6 +2,7 @@
 
 #include "Commands.h"
 #include <expected>
+#include <span>
 
 struct CommandUnknown;
 struct CommandInvalid;
@@ -9,19 +10,59 @@ struct CommandPing;
 struct CommandHello;
 struct CommandSet;
 struct CommandGet;
+struct CommandMget;
+struct CommandMset;
 struct CommandExists;
+struct CommandDel;
+struct CommandIncr;
+struct CommandIncrBy;
+struct CommandDecr;
+struct CommandDecrBy;
+struct CommandHset;
+struct CommandHget;
+struct CommandHgetall;
+struct CommandLpush;
+struct CommandRpush;
+struct CommandLrange;
+struct CommandSadd;
+struct CommandSmembers;
+struct CommandSismember;
+struct CommandInfo;
+struct CommandSave;
+struct CommandBgsave;
+struct CommandLastsave;
+struct CommandBgrewriteaof;
+struct CommandReplicaof;
+struct CommandPsync;
+struct CommandSlowlog;
+struct CommandLatency;
+struct CommandSubscribe;
+struct CommandUnsubscribe;
+struct CommandPsubscribe;
+struct CommandPunsubscribe;
+struct CommandPublish;
+struct CommandMulti;
+struct CommandExec;
+struct CommandDiscard;
+struct CommandWatch;
+struct CommandUnwatch;
+struct CommandEval;
+struct CommandEvalsha;
+struct CommandScript;
 
-struct RedisRespRes;
+struct RespToken;
 class RespEncoder;
 
 struct ParseSuccessful;
 
+// Fills a command from its arguments (the tokens after the command name) in one pass.
+// The number of arguments has already been checked against the arity of the command.
 struct ParsePayload {
-    ParsePayload(const RedisRespRes& resp)
-        : resp_(resp)
+    ParsePayload(std::span<const RespToken> args)
+        : args_(args)
     {
     }
-    const RedisRespRes& resp_;
+    std::span<const RespToken> args_;
 
     ParsePayload(const ParsePayload&) = delete;
     ParsePayload operator=(const ParsePayload&) = delete;
@@ -32,6 +73,43 @@ struct ParsePayload {
     std::expected<ParseSuccessful, CommandInvalid> operator()(CommandHello&);
     std::expected<ParseSuccessful, CommandInvalid> operator()(CommandSet&);
     std::expected<ParseSuccessful, CommandInvalid> operator()(CommandGet&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandMget&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandMset&);
     std::expected<ParseSuccessful, CommandInvalid> operator()(CommandExists&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandDel&);
     std::expected<ParseSuccessful, CommandInvalid> operator()(CommandIncr&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandIncrBy&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandDecr&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandDecrBy&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandHset&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandHget&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandHgetall&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandLpush&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandRpush&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandLrange&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandSadd&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandSmembers&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandSismember&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandInfo&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandSave&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandBgsave&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandLastsave&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandBgrewriteaof&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandReplicaof&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandPsync&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandSlowlog&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandLatency&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandSubscribe&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandUnsubscribe&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandPsubscribe&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandPunsubscribe&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandPublish&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandMulti&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandExec&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandDiscard&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandWatch&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandUnwatch&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandEval&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandEvalsha&);
+    std::expected<ParseSuccessful, CommandInvalid> operator()(CommandScript&);
 };
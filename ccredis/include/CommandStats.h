@@ -0,0 +1,182 @@
+#pragma once
+
+#include "Commands.h"
+#include "Resp.h"
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <span>
+#include <string>
+#include <variant>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// A clock cheap enough to time every command: the time stamp counter on x86-64, which
+// rdtsc reads in a few nanoseconds, and the steady clock elsewhere.
+inline uint64_t readTicks()
+{
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+// Measured against the steady clock the first time it is called, which takes 10 ms.
+double ticksPerMicrosecond();
+
+// Counts values in buckets the way HdrHistogram does: values below 16 have a bucket each,
+// and every power of two above is split into 16 linear buckets, so a bucket is at most
+// 1/16 of its values wide. Values of 2^maxValueBits and more are counted in the last bucket.
+//
+// One thread records, any thread may read. The counters are atomics so reading is not a
+// data race, but recording loads and stores them instead of a locked increment, which
+// keeps it to a few plain instructions.
+class LatencyHistogram {
+public:
+    static constexpr unsigned subBucketBits = 4;
+    static constexpr uint64_t subBuckets = uint64_t { 1 } << subBucketBits;
+    // About 27 s in ticks of a 2.5 GHz counter.
+    static constexpr unsigned maxValueBits = 36;
+    static constexpr size_t numBuckets = (maxValueBits - subBucketBits + 1) * subBuckets;
+
+    static constexpr size_t bucketOf(const uint64_t value)
+    {
+        if (value < subBuckets) {
+            return value;
+        }
+        const auto exponent = static_cast<unsigned>(std::bit_width(value)) - 1;
+        if (exponent >= maxValueBits) {
+            return numBuckets - 1;
+        }
+        const auto shift = exponent - subBucketBits;
+        return (shift + 1) * subBuckets + ((value >> shift) & (subBuckets - 1));
+    }
+    // The smallest value counted in bucket.
+    static constexpr uint64_t lowerBound(const size_t bucket)
+    {
+        if (bucket < subBuckets) {
+            return bucket;
+        }
+        const auto shift = bucket / subBuckets - 1;
+        return (subBuckets + bucket % subBuckets) << shift;
+    }
+
+    void record(const uint64_t value)
+    {
+        auto& count = counts_[bucketOf(value)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    uint64_t count(const size_t bucket) const { return counts_[bucket].load(std::memory_order_relaxed); }
+
+private:
+    std::array<std::atomic<uint64_t>, numBuckets> counts_ {};
+};
+
+// The calls, total time and latency histogram of every command one reactor executed,
+// indexed like CommandVariant and counted in ticks.
+class CommandStats {
+public:
+    static constexpr size_t numCommands = std::variant_size_v<CommandVariant>;
+
+    struct Entry {
+        std::atomic<uint64_t> calls_ {};
+        std::atomic<uint64_t> ticks_ {};
+        LatencyHistogram histogram_ {};
+    };
+
+    void record(const size_t command, const uint64_t ticks)
+    {
+        auto& entry = entries_[command];
+        entry.calls_.store(entry.calls_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        entry.ticks_.store(entry.ticks_.load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+        entry.histogram_.record(ticks);
+    }
+    const Entry& entry(const size_t command) const { return entries_[command]; }
+
+private:
+    std::array<Entry, numCommands> entries_ {};
+};
+
+// A command that took longer than the slow log threshold.
+struct SlowLogEntry {
+    uint64_t id_ {};
+    // Unix time in seconds at which it completed.
+    int64_t time_ {};
+    uint64_t microseconds_ {};
+    std::vector<std::string> args_ {};
+};
+
+// The most recent slow commands, newest first. Thread safe; only commands over the
+// threshold take its lock.
+class SlowLog {
+public:
+    // Like Redis, at most this many arguments of this many bytes are kept per entry.
+    static constexpr size_t maxArgs = 32;
+    static constexpr size_t maxArgLength = 128;
+
+    explicit SlowLog(size_t maxLength)
+        : maxLength_(maxLength)
+    {
+    }
+
+    // Adds the command of frame, a decoded request.
+    void add(std::span<const RespToken> frame, uint64_t microseconds);
+    // The count newest entries, all of them for a negative count.
+    std::vector<SlowLogEntry> newest(int64_t count) const;
+    size_t size() const;
+    void reset();
+
+private:
+    const size_t maxLength_ {};
+    mutable std::mutex mutex_ {};
+    uint64_t nextId_ {};
+    std::deque<SlowLogEntry> entries_ {};
+};
+
+// The command statistics of all reactors of a server and its slow log.
+class CommandMetrics {
+public:
+    // Commands that take longer than slowerThanMicroseconds are logged, none if it is
+    // negative.
+    CommandMetrics(int64_t slowerThanMicroseconds, size_t slowLogLength);
+
+    // Stats for one more reactor, which records into them until the server exits.
+    CommandStats& addReactor();
+
+    // Whether a command that took ticks goes to the slow log.
+    bool isSlow(const uint64_t ticks) const { return ticks > slowThreshold_; }
+    double toMicroseconds(const uint64_t ticks) const { return static_cast<double>(ticks) / ticksPerMicrosecond_; }
+    SlowLog& slowLog() { return slowLog_; }
+
+    struct Summary {
+        uint64_t calls_ {};
+        uint64_t ticks_ {};
+        // The latency histogram, over all reactors.
+        std::vector<uint64_t> counts_ {};
+
+        // The ticks within which fraction of the calls completed, as the highest value of
+        // the bucket it falls in.
+        uint64_t percentile(double fraction) const;
+    };
+    // The stats of command summed over the reactors.
+    Summary summary(size_t command) const;
+
+private:
+    const double ticksPerMicrosecond_ {};
+    const uint64_t slowThreshold_ {};
+    SlowLog slowLog_;
+    mutable std::mutex mutex_ {};
+    // A list so the stats of a reactor never move.
+    std::list<CommandStats> reactors_ {};
+};
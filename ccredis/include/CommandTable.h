@@ -0,0 +1,184 @@
+#pragma once
+
+#include "CommandParsePayload.h"
+#include "Commands.h"
+#include "Resp.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <variant>
+
+struct CommandSpec {
+    std::string_view name_ {};
+    int arity_ {};
+    // The alternative of CommandVariant the command is.
+    size_t index_ {};
+    // Builds the command from its arguments, the tokens after the name, in one pass.
+    CommandVariant (*parse_)(std::span<const RespToken> args) {};
+
+    constexpr bool acceptsArgc(const size_t argc) const
+    {
+        return arity_ >= 0 ? argc == static_cast<size_t>(arity_) : argc >= static_cast<size_t>(-arity_);
+    }
+};
+
+constexpr char toUpper(const char c)
+{
+    return c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c;
+}
+
+constexpr bool equalsIgnoreCase(const std::string_view lhs, const std::string_view rhs)
+{
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        if (toUpper(lhs[i]) != toUpper(rhs[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+namespace detail {
+template <typename Cmd>
+concept NamedCommand = requires {
+    Cmd::name;
+    Cmd::arity;
+};
+
+template <typename Cmd>
+CommandVariant parseCommand(std::span<const RespToken> args)
+{
+    Cmd cmd {};
+    const std::expected<ParseSuccessful, CommandInvalid> result = ParsePayload { args }(cmd);
+    if (!result.has_value()) {
+        return result.error();
+    }
+    return cmd;
+}
+
+template <typename Variant>
+struct CommandSpecs;
+
+template <typename Cmd>
+constexpr std::string_view nameOf()
+{
+    if constexpr (NamedCommand<Cmd>) {
+        return Cmd::name;
+    } else {
+        return {};
+    }
+}
+
+template <typename Variant>
+struct CommandNames;
+
+template <typename... Cmds>
+struct CommandNames<std::variant<Cmds...>> {
+    static constexpr std::array<std::string_view, sizeof...(Cmds)> names { nameOf<Cmds>()... };
+};
+
+// One spec for every alternative of CommandVariant that declares a name.
+template <typename... Cmds>
+struct CommandSpecs<std::variant<Cmds...>> {
+    static constexpr size_t count = (size_t { NamedCommand<Cmds> } + ...);
+
+    static constexpr std::array<CommandSpec, count> make()
+    {
+        std::array<CommandSpec, count> specs {};
+        size_t i = 0;
+        size_t index = 0;
+        (
+            [&]() {
+                if constexpr (NamedCommand<Cmds>) {
+                    specs[i++] = CommandSpec { Cmds::name, Cmds::arity, index, &parseCommand<Cmds> };
+                }
+                ++index;
+            }(),
+            ...);
+        return specs;
+    }
+};
+
+// Mixes the length and four characters of the name instead of every byte, which is
+// enough to tell the command names apart and costs a few cycles. Bit 5 is cleared to
+// upper case letters without a branch so clients may send commands in any case. Names
+// that share a hash with a command are rejected by the compare after the lookup, and
+// the seed search below fails to compile if two command names ever collide.
+constexpr uint32_t hashName(const std::string_view name, const uint32_t seed)
+{
+    if (name.empty()) {
+        return 0;
+    }
+    const auto at = [name](const size_t i) { return static_cast<uint32_t>(static_cast<uint8_t>(name[i])); };
+    const uint32_t chars = at(0) | at(std::min<size_t>(1, name.size() - 1)) << 8
+        | at(name.size() / 2) << 16 | at(name.size() - 1) << 24;
+    const uint64_t mixed = (static_cast<uint64_t>(chars & 0xDFDFDFDFu) << 8 | name.size()) * (0x9E3779B97F4A7C15ull + 2 * uint64_t { seed });
+    return static_cast<uint32_t>(mixed >> 32);
+}
+
+constexpr auto commandSpecs = CommandSpecs<CommandVariant>::make();
+// A sparse table keeps the seed search short at compile time.
+constexpr size_t tableSize = std::bit_ceil(commandSpecs.size() * 4);
+constexpr uint8_t emptySlot = std::numeric_limits<uint8_t>::max();
+static_assert(commandSpecs.size() < emptySlot);
+
+// Searches for a seed under which no two command names share a slot.
+constexpr uint32_t findSeed()
+{
+    for (uint32_t seed = 0; seed < 100000; ++seed) {
+        std::array<bool, tableSize> used {};
+        bool collision = false;
+        for (const auto& spec : commandSpecs) {
+            auto& slot = used[hashName(spec.name_, seed) & (tableSize - 1)];
+            collision = collision || slot;
+            slot = true;
+        }
+        if (!collision) {
+            return seed;
+        }
+    }
+    return std::numeric_limits<uint32_t>::max();
+}
+
+constexpr uint32_t seed = findSeed();
+static_assert(seed != std::numeric_limits<uint32_t>::max(), "No perfect hash seed for the command names");
+
+constexpr std::array<uint8_t, tableSize> makeSlots()
+{
+    std::array<uint8_t, tableSize> slots {};
+    slots.fill(emptySlot);
+    for (size_t i = 0; i < commandSpecs.size(); ++i) {
+        slots[hashName(commandSpecs[i].name_, seed) & (tableSize - 1)] = static_cast<uint8_t>(i);
+    }
+    return slots;
+}
+
+constexpr auto slots = makeSlots();
+} // namespace detail
+
+// Finds a command by name, ignoring case, with one hash and one compare whatever the
+// number of commands. Returns nullptr for unknown commands.
+constexpr const CommandSpec* findCommand(const std::string_view name)
+{
+    const auto index = detail::slots[detail::hashName(name, detail::seed) & (detail::tableSize - 1)];
+    if (index == detail::emptySlot || !equalsIgnoreCase(name, detail::commandSpecs[index].name_)) {
+        return nullptr;
+    }
+    return &detail::commandSpecs[index];
+}
+
+// The name of the command at index of CommandVariant, empty for the alternatives that
+// are not commands.
+constexpr std::string_view commandName(const size_t index)
+{
+    return detail::CommandNames<CommandVariant>::names[index];
+}
@@ -2,13 +2,19 @@
 
 #include "Database.h"
 #include <chrono>
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <variant>
+#include <vector>
 
 struct ParseSuccessful { };
 
+// Commands that can be sent by a client declare their name and arity and are found by
+// name through the table in CommandTable.h. Arity counts the command name; a negative
+// arity -N means at least N tokens, as in Redis.
 template <typename Cmd>
 struct CommandBase {
     constexpr bool isValid() { return isValid_; }
@@ -20,14 +26,16 @@ struct CommandBase {
 struct CommandUnknown : CommandBase<CommandUnknown> { };
 struct CommandInvalid : CommandBase<CommandInvalid> { };
 struct CommandPing : CommandBase<CommandPing> {
+    static constexpr std::string_view name = "PING";
+    static constexpr int arity = -1;
     std::string_view value_ {};
 };
 struct CommandHello : CommandBase<CommandHello> {
+    static constexpr std::string_view name = "HELLO";
+    static constexpr int arity = -1;
     constexpr CommandHello() = default;
     std::string_view version_ {};
 };
-enum class CommandState { WaitingForValue,
-    Done };
 enum class ExpireTimeResolution {
     Seconds,
     Milliseconds,
@@ -35,23 +43,275 @@ enum class ExpireTimeResolution {
     UnixMilliseconds
 };
 struct CommandSet : CommandBase<CommandSet> {
+    static constexpr std::string_view name = "SET";
+    static constexpr int arity = -3;
     std::string_view key_;
-    std::string_view value_ {}; // TODO: Allow multiple values
+    std::string_view value_ {};
     using TimePoint = std::chrono::time_point<std::chrono::system_clock>;
     std::optional<TimePoint> expire {};
-    CommandState state_;
     ExpireTimeResolution resolution_;
 };
 struct CommandGet : CommandBase<CommandGet> {
+    static constexpr std::string_view name = "GET";
+    static constexpr int arity = 2;
     std::string_view key_;
 };
+struct CommandMget : CommandBase<CommandMget> {
+    static constexpr std::string_view name = "MGET";
+    static constexpr int arity = -2;
+    std::vector<std::string_view> keys_ {};
+};
+struct CommandMset : CommandBase<CommandMset> {
+    static constexpr std::string_view name = "MSET";
+    static constexpr int arity = -3;
+    std::vector<std::pair<std::string_view, std::string_view>> entries_ {};
+};
 struct CommandExists : CommandBase<CommandExists> {
-    std::string_view key_;
+    static constexpr std::string_view name = "EXISTS";
+    static constexpr int arity = -2;
+    std::vector<std::string_view> keys_ {};
+};
+struct CommandDel : CommandBase<CommandDel> {
+    static constexpr std::string_view name = "DEL";
+    static constexpr int arity = -2;
+    std::vector<std::string_view> keys_ {};
 };
 
 struct CommandIncr : CommandBase<CommandIncr> {
+    static constexpr std::string_view name = "INCR";
+    static constexpr int arity = 2;
+    std::string_view key_;
+};
+struct CommandIncrBy : CommandBase<CommandIncrBy> {
+    static constexpr std::string_view name = "INCRBY";
+    static constexpr int arity = 3;
+    std::string_view key_;
+    int64_t increment_ {};
+};
+struct CommandDecr : CommandBase<CommandDecr> {
+    static constexpr std::string_view name = "DECR";
+    static constexpr int arity = 2;
+    std::string_view key_;
+};
+struct CommandDecrBy : CommandBase<CommandDecrBy> {
+    static constexpr std::string_view name = "DECRBY";
+    static constexpr int arity = 3;
+    std::string_view key_;
+    int64_t decrement_ {};
+};
+
+struct CommandHset : CommandBase<CommandHset> {
+    static constexpr std::string_view name = "HSET";
+    static constexpr int arity = -4;
+    std::string_view key_;
+    std::vector<std::pair<std::string_view, std::string_view>> fields_ {};
+};
+struct CommandHget : CommandBase<CommandHget> {
+    static constexpr std::string_view name = "HGET";
+    static constexpr int arity = 3;
     std::string_view key_;
+    std::string_view field_ {};
+};
+struct CommandHgetall : CommandBase<CommandHgetall> {
+    static constexpr std::string_view name = "HGETALL";
+    static constexpr int arity = 2;
+    std::string_view key_;
+};
+struct CommandLpush : CommandBase<CommandLpush> {
+    static constexpr std::string_view name = "LPUSH";
+    static constexpr int arity = -3;
+    std::string_view key_;
+    std::vector<std::string_view> values_ {};
+};
+struct CommandRpush : CommandBase<CommandRpush> {
+    static constexpr std::string_view name = "RPUSH";
+    static constexpr int arity = -3;
+    std::string_view key_;
+    std::vector<std::string_view> values_ {};
+};
+struct CommandLrange : CommandBase<CommandLrange> {
+    static constexpr std::string_view name = "LRANGE";
+    static constexpr int arity = 4;
+    std::string_view key_;
+    int64_t start_ {};
+    int64_t stop_ {};
+};
+struct CommandSadd : CommandBase<CommandSadd> {
+    static constexpr std::string_view name = "SADD";
+    static constexpr int arity = -3;
+    std::string_view key_;
+    std::vector<std::string_view> members_ {};
+};
+struct CommandSmembers : CommandBase<CommandSmembers> {
+    static constexpr std::string_view name = "SMEMBERS";
+    static constexpr int arity = 2;
+    std::string_view key_;
+};
+struct CommandSismember : CommandBase<CommandSismember> {
+    static constexpr std::string_view name = "SISMEMBER";
+    static constexpr int arity = 3;
+    std::string_view key_;
+    std::string_view member_ {};
+};
+
+struct CommandInfo : CommandBase<CommandInfo> {
+    static constexpr std::string_view name = "INFO";
+    static constexpr int arity = -1;
+    // Empty for all sections.
+    std::string_view section_ {};
+};
+
+struct CommandSave : CommandBase<CommandSave> {
+    static constexpr std::string_view name = "SAVE";
+    static constexpr int arity = 1;
+};
+
+struct CommandBgsave : CommandBase<CommandBgsave> {
+    static constexpr std::string_view name = "BGSAVE";
+    static constexpr int arity = 1;
+};
+
+struct CommandLastsave : CommandBase<CommandLastsave> {
+    static constexpr std::string_view name = "LASTSAVE";
+    static constexpr int arity = 1;
+};
+
+struct CommandBgrewriteaof : CommandBase<CommandBgrewriteaof> {
+    static constexpr std::string_view name = "BGREWRITEAOF";
+    static constexpr int arity = 1;
+};
+
+// REPLICAOF host port makes the server a follower of host:port, REPLICAOF NO ONE
+// makes it a leader again.
+struct CommandReplicaof : CommandBase<CommandReplicaof> {
+    static constexpr std::string_view name = "REPLICAOF";
+    static constexpr int arity = 3;
+    // Empty for NO ONE.
+    std::string_view host_ {};
+    std::string_view port_ {};
+};
+
+// Sent by a follower to start receiving the replication stream at offset, the replid
+// being the id of the stream it was following. "?" and -1 ask for a full sync.
+struct CommandPsync : CommandBase<CommandPsync> {
+    static constexpr std::string_view name = "PSYNC";
+    static constexpr int arity = 3;
+    std::string_view replid_ {};
+    int64_t offset_ {};
+};
+
+// SLOWLOG GET [count], SLOWLOG LEN and SLOWLOG RESET.
+struct CommandSlowlog : CommandBase<CommandSlowlog> {
+    static constexpr std::string_view name = "SLOWLOG";
+    static constexpr int arity = -2;
+    enum class Subcommand {
+        Get,
+        Len,
+        Reset
+    };
+    Subcommand subcommand_ {};
+    // The number of entries GET returns, all of them if negative.
+    int64_t count_ { 10 };
+};
+
+// LATENCY HISTOGRAM [command ...] replies with the latency histogram of the commands,
+// of every command that ran if none is given.
+struct CommandLatency : CommandBase<CommandLatency> {
+    static constexpr std::string_view name = "LATENCY";
+    static constexpr int arity = -2;
+    std::vector<std::string_view> commands_ {};
+};
+
+// SUBSCRIBE channel [channel ...] and PSUBSCRIBE pattern [pattern ...] put the client
+// in subscribed mode, in which it receives what is published to the channels and
+// channels matching the patterns. UNSUBSCRIBE and PUNSUBSCRIBE without arguments leave
+// all of them.
+struct CommandSubscribe : CommandBase<CommandSubscribe> {
+    static constexpr std::string_view name = "SUBSCRIBE";
+    static constexpr int arity = -2;
+    std::vector<std::string_view> channels_ {};
+};
+struct CommandUnsubscribe : CommandBase<CommandUnsubscribe> {
+    static constexpr std::string_view name = "UNSUBSCRIBE";
+    static constexpr int arity = -1;
+    std::vector<std::string_view> channels_ {};
+};
+struct CommandPsubscribe : CommandBase<CommandPsubscribe> {
+    static constexpr std::string_view name = "PSUBSCRIBE";
+    static constexpr int arity = -2;
+    std::vector<std::string_view> patterns_ {};
+};
+struct CommandPunsubscribe : CommandBase<CommandPunsubscribe> {
+    static constexpr std::string_view name = "PUNSUBSCRIBE";
+    static constexpr int arity = -1;
+    std::vector<std::string_view> patterns_ {};
+};
+struct CommandPublish : CommandBase<CommandPublish> {
+    static constexpr std::string_view name = "PUBLISH";
+    static constexpr int arity = 3;
+    std::string_view channel_ {};
+    std::string_view message_ {};
+};
+
+// MULTI starts queueing the commands of the client, which EXEC then runs as one unit
+// and DISCARD drops. EXEC fails if a key the client WATCHes changed in between.
+struct CommandMulti : CommandBase<CommandMulti> {
+    static constexpr std::string_view name = "MULTI";
+    static constexpr int arity = 1;
+};
+struct CommandExec : CommandBase<CommandExec> {
+    static constexpr std::string_view name = "EXEC";
+    static constexpr int arity = 1;
+};
+struct CommandDiscard : CommandBase<CommandDiscard> {
+    static constexpr std::string_view name = "DISCARD";
+    static constexpr int arity = 1;
+};
+struct CommandWatch : CommandBase<CommandWatch> {
+    static constexpr std::string_view name = "WATCH";
+    static constexpr int arity = -2;
+    std::vector<std::string_view> keys_ {};
+};
+struct CommandUnwatch : CommandBase<CommandUnwatch> {
+    static constexpr std::string_view name = "UNWATCH";
+    static constexpr int arity = 1;
+};
+// EVAL script numkeys [key ...] [arg ...] compiles a script, caches it and runs it;
+// EVALSHA sha1 numkeys [key ...] [arg ...] runs a cached one by the SHA1 of its source.
+// SCRIPT LOAD script only caches it and replies with the SHA1, SCRIPT EXISTS sha1
+// [sha1 ...] tells which are cached and SCRIPT FLUSH drops them all. Script.h describes
+// what a script looks like.
+struct CommandEval : CommandBase<CommandEval> {
+    static constexpr std::string_view name = "EVAL";
+    static constexpr int arity = -3;
+    std::string_view script_ {};
+    std::vector<std::string_view> keys_ {};
+    std::vector<std::string_view> args_ {};
+};
+struct CommandEvalsha : CommandBase<CommandEvalsha> {
+    static constexpr std::string_view name = "EVALSHA";
+    static constexpr int arity = -3;
+    std::string_view sha_ {};
+    std::vector<std::string_view> keys_ {};
+    std::vector<std::string_view> args_ {};
+};
+struct CommandScript : CommandBase<CommandScript> {
+    static constexpr std::string_view name = "SCRIPT";
+    static constexpr int arity = -2;
+    enum class Subcommand {
+        Load,
+        Exists,
+        Flush
+    };
+    Subcommand subcommand_ {};
+    std::vector<std::string_view> args_ {};
 };
 
 using CommandVariant = std::variant<CommandUnknown, CommandInvalid, CommandPing, CommandHello,
-    CommandSet, CommandGet, CommandExists, CommandIncr>;
\ No newline at end of file
+    CommandSet, CommandGet, CommandMget, CommandMset, CommandExists, CommandDel, CommandIncr,
+    CommandIncrBy, CommandDecr, CommandDecrBy, CommandHset, CommandHget, CommandHgetall,
+    CommandLpush, CommandRpush, CommandLrange, CommandSadd, CommandSmembers, CommandSismember,
+    CommandInfo, CommandSave, CommandBgsave, CommandLastsave, CommandBgrewriteaof, CommandReplicaof,
+    CommandPsync, CommandSlowlog, CommandLatency, CommandSubscribe, CommandUnsubscribe,
+    CommandPsubscribe, CommandPunsubscribe, CommandPublish, CommandMulti, CommandExec, CommandDiscard,
+    CommandWatch, CommandUnwatch, CommandEval, CommandEvalsha, CommandScript>;
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Log.h"
+
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+#include <string_view>
+
+// When the append only file is fsynced: after every batch of writes before the replies
+// are sent, once a second in the background, or when the kernel decides.
+enum class FsyncPolicy {
+    Always,
+    EverySecond,
+    No
+};
+
+// Which keys are evicted once the keyspace outgrows maxmemory: none, so writes fail;
+// the least recently or least frequently used of all keys; or the keys with a TTL that
+// expire the soonest.
+enum class EvictionPolicy {
+    NoEviction,
+    AllKeysLru,
+    AllKeysLfu,
+    VolatileTtl
+};
+
+// How the reactors do their socket I/O: readiness through epoll and a syscall per read
+// and write, or completions through io_uring.
+enum class IoBackend {
+    Epoll,
+    IoUring
+};
+
+struct ServerConfig {
+    std::string port_ { "6379" };
+    unsigned threads_ { 1 };
+    // io_uring falls back to epoll when the kernel does not support what it needs.
+    IoBackend ioBackend_ { IoBackend::Epoll };
+    // Where SAVE and BGSAVE write the snapshot and where it is loaded from on startup.
+    std::string dbFilename_ { "dump.ccrdb" };
+    // With the append only file enabled it is replayed on startup instead of loading the snapshot.
+    bool appendOnly_ { false };
+    std::string appendFilename_ { "appendonly.aof" };
+    FsyncPolicy appendFsync_ { FsyncPolicy::EverySecond };
+    // Bytes the keyspace may take before keys are evicted, 0 for no limit.
+    uint64_t maxMemory_ {};
+    EvictionPolicy maxMemoryPolicy_ { EvictionPolicy::NoEviction };
+    // Keys sampled per eviction; more samples evict closer to the exact policy.
+    unsigned maxMemorySamples_ { 5 };
+    // The leader to follow on startup, empty to start as a leader.
+    std::string replicaOfHost_ {};
+    std::string replicaOfPort_ {};
+    // Bytes of the replication stream kept for followers to resume from after a short
+    // disconnect. A follower that falls further behind needs a full sync.
+    uint64_t replBacklogSize_ { uint64_t { 1 } << 20 };
+    // Commands that take longer than this many microseconds go to the slow log, none if
+    // it is negative.
+    int64_t slowlogSlowerThan_ { 10000 };
+    // Entries the slow log keeps; the oldest are dropped.
+    unsigned slowlogMaxLen_ { 128 };
+    // Bytes of messages and replies a pub/sub subscriber may leave unread before it is
+    // disconnected, 0 to disconnect it as soon as it falls behind.
+    uint64_t pubsubOutputLimit_ { uint64_t { 32 } << 20 };
+    // Lines below this level are not logged. Debug lines are only there when the server
+    // is built with them, see Log.h.
+    LogLevel logLevel_ { LogLevel::Info };
+};
+
+// The name of policy in the configuration and INFO, eg: allkeys-lru
+std::string_view evictionPolicyName(EvictionPolicy policy);
+
+// Parses the server command line, eg: server --port 6380 --threads 4
+std::expected<ServerConfig, std::string> parseArgs(std::span<const char* const> args);
@@ -1,93 +1,1152 @@
 #pragma once
 
+#include "Collections.h"
+#include "Config.h"
+#include "FlatHashMap.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <charconv>
 #include <chrono>
-#include <iostream>
-#include <map>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <limits>
+#include <mutex>
 #include <optional>
+#include <queue>
+#include <random>
+#include <shared_mutex>
+#include <span>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
 
 using KeyT = std::string_view;
 using TimePoint = std::chrono::time_point<std::chrono::system_clock>;
-struct ValueType {
+
+// The integer str is the decimal form of, if it is in the canonical form: no sign but a
+// leading '-', no leading zeros and within the range of int64_t. Only such strings are
+// kept as integers, so turning the integer back into a string gives the same bytes.
+inline std::optional<int64_t> parseCanonicalInteger(const std::string_view str)
+{
+    // "-9223372036854775808" is the longest.
+    if (str.empty() || str.size() > 20 || (str[0] == '0' && str.size() > 1) || str == "-" || str.starts_with("-0")) {
+        return std::nullopt;
+    }
+    int64_t value {};
+    const auto [end, error] = std::from_chars(str.data(), str.data() + str.size(), value);
+    if (error != std::errc {} || end != str.data() + str.size()) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+// When a value was last used, or how often it is used, for the eviction policy. Readers
+// update it while holding the shard lock shared, so it is only accessed atomically.
+class AccessClock {
+public:
+    AccessClock() = default;
+    AccessClock(const AccessClock& other)
+        : value_(other.load())
+    {
+    }
+    AccessClock& operator=(const AccessClock& other)
+    {
+        store(other.load());
+        return *this;
+    }
+
+    uint32_t load() const { return std::atomic_ref { value_ }.load(std::memory_order_relaxed); }
+    void store(const uint32_t value) const { std::atomic_ref { value_ }.store(value, std::memory_order_relaxed); }
+
+private:
+    alignas(std::atomic_ref<uint32_t>::required_alignment) mutable uint32_t value_ {};
+};
+
+// A string, hash, list or set value. Strings that are the canonical form of an integer
+// are stored as the integer, like the int encoding of Redis, so INCR and friends update
+// them in place and the string is only formed when the value is read.
+class ValueType {
+public:
+    // Holds the digits of an integer value while it is viewed as a string.
+    using IntChars = std::array<char, 20>;
+
     ValueType() = default;
     explicit ValueType(const std::string_view value)
-        : value_(std::string { value.data(), value.length() })
     {
+        assign(value);
     }
     ValueType(const std::string_view value, const TimePoint& expire)
-        : value_(std::string { value.data(), value.length() })
-        , expire_(expire)
+        : expire_(expire)
     {
+        assign(value);
     }
-    std::string value_ {};
-    std::optional<TimePoint> expire_ {};
 
-    operator std::string_view() { return value_; }
-    operator std::string_view() const { return value_; }
+    void assign(const std::string_view value)
+    {
+        if (const auto integer = parseCanonicalInteger(value); integer.has_value()) {
+            value_ = integer.value();
+        } else if (auto* str = std::get_if<std::string>(&value_)) {
+            // Reuses the capacity of the old string.
+            str->assign(value);
+        } else {
+            value_.emplace<std::string>(value);
+        }
+    }
+    void assign(const int64_t value) { value_ = value; }
+
+    bool isString() const { return value_.index() <= 1; }
+    bool isInteger() const { return std::holds_alternative<int64_t>(value_); }
+    // The collection if the value is a T (HashValue, ListValue or SetValue), else null.
+    template <typename T>
+    T* as() { return std::get_if<T>(&value_); }
+    template <typename T>
+    const T* as() const { return std::get_if<T>(&value_); }
+    // Replaces the value with an empty collection.
+    template <typename T>
+    T& emplace() { return value_.emplace<T>(); }
+    // Set if the value is an integer.
+    std::optional<int64_t> integer() const
+    {
+        const auto* integer = std::get_if<int64_t>(&value_);
+        return integer == nullptr ? std::nullopt : std::optional { *integer };
+    }
+
+    // The value as a string, which it must be. The digits of an integer are written to
+    // chars, which must outlive the view.
+    std::string_view view(IntChars& chars) const
+    {
+        if (const auto* integer = std::get_if<int64_t>(&value_)) {
+            const auto end = std::to_chars(chars.data(), chars.data() + chars.size(), *integer).ptr;
+            return { chars.data(), end };
+        }
+        return std::get<std::string>(value_);
+    }
+    std::string str() const&
+    {
+        IntChars chars {};
+        return std::string { view(chars) };
+    }
+    std::string str() &&
+    {
+        if (auto* str = std::get_if<std::string>(&value_)) {
+            return std::move(*str);
+        }
+        return std::as_const(*this).str();
+    }
+    // Length of a string, or the total length of the strings in a collection.
+    size_t size() const
+    {
+        size_t size = 0;
+        const auto add = [&size](const std::string_view str) { size += str.size(); };
+        if (const auto* hash = as<HashValue>()) {
+            hash->forEach([&add](const std::string_view field, const std::string_view value) {
+                add(field);
+                add(value);
+            });
+        } else if (const auto* list = as<ListValue>()) {
+            list->forEach(add);
+        } else if (const auto* set = as<SetValue>()) {
+            set->forEach(add);
+        } else {
+            IntChars chars {};
+            size = view(chars).size();
+        }
+        return size;
+    }
+
+    // Heap bytes taken by the value, estimated without walking a collection.
+    size_t memoryUsage() const
+    {
+        if (const auto* str = std::get_if<std::string>(&value_)) {
+            return stringHeapBytes(str->capacity());
+        }
+        if (const auto* hash = as<HashValue>()) {
+            return hash->memoryUsage();
+        }
+        if (const auto* list = as<ListValue>()) {
+            return list->memoryUsage();
+        }
+        if (const auto* set = as<SetValue>()) {
+            return set->memoryUsage();
+        }
+        return 0;
+    }
+
+    std::optional<TimePoint> expire_ {};
+    AccessClock access_ {};
+    // Stamped from the write counter of the shard by every write, so WATCH can tell
+    // whether the key changed.
+    uint64_t version_ {};
 
     friend bool operator==(const ValueType& lhs, const ValueType& rhs)
     {
         return lhs.value_ == rhs.value_;
     }
+
+private:
+    std::variant<std::string, int64_t, HashValue, ListValue, SetValue> value_ {};
+};
+
+struct DbStats {
+    size_t keys_ {};
+    // Keys removed because their TTL passed, on access or by the expiry cycle.
+    uint64_t expiredKeys_ {};
+    // Key and value bytes freed by removing expired keys.
+    uint64_t expiredBytes_ {};
+    // Keys removed to stay under maxmemory.
+    uint64_t evictedKeys_ {};
+    // Estimated bytes taken by the keys and values.
+    size_t usedMemory_ {};
+};
+
+// What WATCH remembers of a key. A key that exists has its version; a missing one has
+// the number of keys removed from its shard, so it still compares unequal once it was
+// created and removed again. Removing another key of the shard makes a missing key look
+// changed too, which only costs an EXEC that did not need to fail.
+struct KeyVersion {
+    uint64_t version_ {};
+    uint64_t removals_ {};
+
+    friend bool operator==(const KeyVersion&, const KeyVersion&) = default;
+};
+
+// A key to insert with Db::insertBulk. The views only need to live until the call returns.
+struct BulkEntry {
+    KeyT key_ {};
+    std::string_view value_ {};
+    std::optional<TimePoint> expire_ {};
 };
 
+// The keyspace is split into shards, each one an open addressing hash table behind its
+// own reader/writer lock. A key is hashed once; the hash picks the shard and is then
+// reused for the lookup inside it, so reactors working on different keys rarely contend.
 class Db {
 public:
-    Db() { std::cout << "[INFO]: New Db is created.\n"; }
+    static constexpr size_t numShards = 64;
+
+    static_assert(numShards <= 64, "Multi-key commands keep the shards they lock in a 64-bit mask");
+    static constexpr uint64_t allShards = numShards == 64 ? ~uint64_t { 0 } : (uint64_t { 1 } << numShards) - 1;
+
+    // Called with the new state of a key after every write, while the shard lock is
+    // still held, so writes to one key reach the hook in the order they were applied.
+    // value is null when the key was deleted. An update of a collection also passes the
+    // command that made it, for example RPUSH key a b, since logging the whole collection
+    // would cost as much as the collection; command is empty for other writes. Used to log
+    // writes to the append only file.
+    using WriteHook = std::function<void(KeyT key, const ValueType* value, std::span<const std::string_view> command)>;
+
+    static constexpr std::string_view wrongTypeError = "WRONGTYPE Operation against a key holding the wrong kind of value";
+
+    Db() { LOG_DEBUG("New Db is created."); }
+
+    // Not thread safe, configure the limit before the Db is shared. maxMemory 0 means no
+    // limit. samples is the number of keys sampled per eviction.
+    void setMaxMemory(const uint64_t maxMemory, const EvictionPolicy policy, const unsigned samples = 5)
+    {
+        maxMemory_ = maxMemory;
+        policy_ = policy;
+        evictionSamples_ = samples;
+    }
+    uint64_t maxMemory() const { return maxMemory_; }
+    EvictionPolicy evictionPolicy() const { return policy_; }
+
+    // Not thread safe, install the hook before the Db is shared. insertBulk does not
+    // call it.
+    void setWriteHook(WriteHook hook) { writeHook_ = std::move(hook); }
+
     void set(const KeyT key, const std::string_view& value)
     {
-        std::cout << "[INFO]: Storing key: " << key << " val: " << value << "\n";
-        const auto key_ = std::string { key.data(), key.length() };
-        const auto val_ = ValueType { value };
-        map_[key_] = val_;
+        LOG_DEBUG("Storing key: ", key, " val: ", value);
+        const auto hash = Map::hash(key);
+        auto& shard = shardFor(hash);
+        const auto lock = lockExclusive(shard);
+        const auto* stored = update(shard, key, hash, [value](ValueType& stored) {
+            stored.assign(value);
+            // An entry left in the expiry heap no longer matches and is dropped when it is due.
+            stored.expire_.reset();
+        });
+        notifyWrite(key, stored);
     }
-    void set(const KeyT key, const ValueType& value)
+    void set(const KeyT key, ValueType value)
     {
-        const auto key_ = std::string { key.data(), key.length() };
-        map_[key_] = value;
+        const auto hash = Map::hash(key);
+        auto& shard = shardFor(hash);
+        const auto lock = lockExclusive(shard);
+        bool reschedule = false;
+        const auto* stored = update(shard, key, hash, [&value, &reschedule](ValueType& stored) {
+            reschedule = value.expire_.has_value() && stored.expire_ != value.expire_;
+            stored = std::move(value);
+        });
+        if (reschedule) {
+            scheduleExpiry(shard, key, stored->expire_.value());
+        }
+        notifyWrite(key, stored);
     }
     void set(const KeyT key, const std::string_view& value,
         const TimePoint& expire)
     {
-        using namespace std::chrono;
-        const auto now = std::chrono::system_clock::now();
-        std::cout << "[INFO]: Storing key: " << key << " val: " << value
-                  << " Expires in: "
-                  << std::chrono::duration_cast<std::chrono::seconds>(
-                         expire.time_since_epoch() - now.time_since_epoch())
-                  << "\n";
-        const auto key_ = std::string { key.data(), key.length() };
-        const auto val_ = ValueType { value, expire };
-        map_[key_] = val_;
+        LOG_DEBUG("Storing key: ", key, " val: ", value, " Expires in: ",
+            std::chrono::duration_cast<std::chrono::seconds>(expire - std::chrono::system_clock::now()).count(), "s");
+        const auto hash = Map::hash(key);
+        auto& shard = shardFor(hash);
+        const auto lock = lockExclusive(shard);
+        bool reschedule = false;
+        const auto* stored = update(shard, key, hash, [value, &expire, &reschedule](ValueType& stored) {
+            stored.assign(value);
+            reschedule = stored.expire_ != expire;
+            stored.expire_ = expire;
+        });
+        if (reschedule) {
+            scheduleExpiry(shard, key, expire);
+        }
+        notifyWrite(key, stored);
     }
+    // Expired keys are deleted when they are read, so a key that is never read again
+    // is left to the expiry cycle.
     std::optional<ValueType> get(const KeyT& key)
     {
-        std::cout << "[INFO]: Fetching key: " << key << "\n";
-        const auto key_ = std::string { key.data(), key.length() };
-
-        if (map_.contains(key_)) {
-            const auto& value_ = map_[key_];
-            if (value_.expire_.has_value()) {
-
-                const auto now = std::chrono::system_clock::now();
-                const auto expires = value_.expire_.value();
-                // std::cout << "[INFO]: Key expires in: " << std::to_string(expires -
-                // now)
-                //           << "\n";
-                using Ms = std::chrono::milliseconds;
-                const auto timeElapsed = std::chrono::duration_cast<Ms>(expires - now);
-                if (timeElapsed < Ms { 0 }) {
-                    std::cout << "[INFO]: Key expired\n";
-                    return std::nullopt;
+        LOG_DEBUG("Fetching key: ", key);
+        return read(key, [](const ValueType* value) -> std::optional<ValueType> {
+            if (value == nullptr) {
+                return std::nullopt;
+            }
+            return *value;
+        });
+    }
+
+    // Adds delta to the integer at key, in place under the shard lock, and returns the
+    // result. A missing or expired key counts as 0; the TTL of an existing key is kept.
+    std::expected<int64_t, std::string> incrementBy(const KeyT key, const int64_t delta)
+    {
+        const auto hash = Map::hash(key);
+        auto& shard = shardFor(hash);
+        const auto lock = lockExclusive(shard);
+        auto* stored = shard.map_.find(key, hash);
+        if (stored != nullptr && stored->expire_.has_value() && isExpired(*stored, std::chrono::system_clock::now())) {
+            removeExpired(shard, key, hash, *stored);
+            stored = nullptr;
+        }
+        int64_t result = delta;
+        if (stored != nullptr) {
+            if (!stored->isString()) {
+                return std::unexpected { std::string { wrongTypeError } };
+            }
+            const auto current = stored->integer();
+            if (!current.has_value()) {
+                return std::unexpected { "ERR value is not an integer or out of range" };
+            }
+            if (__builtin_add_overflow(current.value(), delta, &result)) {
+                return std::unexpected { "ERR increment or decrement would overflow" };
+            }
+            // An integer takes no heap bytes, so the memory estimate stays the same.
+            stored->assign(result);
+            stored->version_ = ++shard.versions_;
+            touch(*stored);
+        } else {
+            stored = update(shard, key, hash, [result](ValueType& stored) { stored.assign(result); });
+        }
+        notifyWrite(key, stored);
+        return result;
+    }
+
+    // Calls f(value) with the value at key while holding the shard lock shared and returns
+    // what f returns. value is null when the key does not exist. An expired key is
+    // deleted first, with the lock taken again exclusively. f must not call back into
+    // the Db.
+    template <typename F>
+    std::invoke_result_t<F, const ValueType*> read(const KeyT key, F&& f)
+    {
+        const auto hash = Map::hash(key);
+        auto& shard = shardFor(hash);
+        {
+            const auto lock = lockShared(shard);
+            const auto* value = shard.map_.find(key, hash);
+            if (value == nullptr) {
+                return f(nullptr);
+            }
+            if (!isExpired(*value, std::chrono::system_clock::now())) {
+                touch(*value);
+                return f(value);
+            }
+        }
+        const auto lock = lockExclusive(shard);
+        // The key may have been set again while no lock was held.
+        const auto* value = shard.map_.find(key, hash);
+        if (value != nullptr && isExpired(*value, std::chrono::system_clock::now())) {
+            removeExpired(shard, key, hash, *value);
+            value = nullptr;
+        }
+        if (value != nullptr) {
+            touch(*value);
+        }
+        return f(value);
+    }
+
+    // The version of key for WATCH, taken under the shard lock shared.
+    KeyVersion version(const KeyT key) const
+    {
+        const auto hash = Map::hash(key);
+        const auto& shard = shardFor(hash);
+        const auto lock = lockShared(shard);
+        const auto* value = shard.map_.find(key, hash);
+        if (value == nullptr || isExpired(*value, std::chrono::system_clock::now())) {
+            return KeyVersion { .version_ = 0, .removals_ = shard.removals_ };
+        }
+        return KeyVersion { .version_ = value->version_, .removals_ = 0 };
+    }
+
+    class LockedShards;
+
+    // Locks the shards in mask exclusively for the calling thread until the result is
+    // destroyed, so a transaction can run its commands through the usual calls without
+    // another client seeing it half done. Meanwhile the calls of this thread do not lock
+    // those shards again; they must not touch any other shard, which could deadlock, so
+    // mask has to cover every key the transaction uses. Not reentrant.
+    [[nodiscard]] LockedShards lockShards(uint64_t mask);
+
+    // Sets the fields of the hash at key, creating it if needed. Returns the number of
+    // fields that are new.
+    std::expected<size_t, std::string> hashSet(const KeyT key, const std::span<const std::pair<std::string_view, std::string_view>> fields)
+    {
+        return updateCollection<HashValue>(key, [&](HashValue& hash, ValueType& stored) {
+            size_t added = 0;
+            for (const auto& [field, value] : fields) {
+                added += hash.set(field, value);
+            }
+            if (writeHook_) {
+                auto& command = commandBuffer("HSET", key);
+                for (const auto& [field, value] : fields) {
+                    command.push_back(field);
+                    command.push_back(value);
+                }
+                writeHook_(key, &stored, command);
+            }
+            return added;
+        });
+    }
+
+    enum class ListEnd {
+        Front,
+        Back
+    };
+
+    // Pushes values one by one to an end of the list at key, creating it if needed.
+    // Returns the length of the list.
+    std::expected<size_t, std::string> listPush(const KeyT key, const std::span<const std::string_view> values, const ListEnd end)
+    {
+        return updateCollection<ListValue>(key, [&](ListValue& list, ValueType& stored) {
+            for (const auto value : values) {
+                end == ListEnd::Front ? list.pushFront(value) : list.pushBack(value);
+            }
+            if (writeHook_) {
+                auto& command = commandBuffer(end == ListEnd::Front ? "LPUSH" : "RPUSH", key);
+                command.insert(command.end(), values.begin(), values.end());
+                writeHook_(key, &stored, command);
+            }
+            return list.size();
+        });
+    }
+
+    // Adds members to the set at key, creating it if needed. Returns the number of members
+    // that are new.
+    std::expected<size_t, std::string> setAdd(const KeyT key, const std::span<const std::string_view> members)
+    {
+        return updateCollection<SetValue>(key, [&](SetValue& set, ValueType& stored) {
+            size_t added = 0;
+            for (const auto member : members) {
+                added += set.add(member);
+            }
+            if (writeHook_ && added > 0) {
+                auto& command = commandBuffer("SADD", key);
+                command.insert(command.end(), members.begin(), members.end());
+                writeHook_(key, &stored, command);
+            }
+            return added;
+        });
+    }
+
+    // The multi-key commands hash every key first and lock all the shards they touch, so
+    // the command is atomic like in Redis. The lookups then run with the slot of the key
+    // prefetchDistance ahead already on its way into the cache, so their misses overlap
+    // instead of being paid one after the other.
+
+    // Calls f(index, value) for every key in order, value being null for a missing or
+    // expired key. f runs under the shard locks and must not call back into the Db. The
+    // expired keys are deleted afterwards, with their shards locked exclusively.
+    template <typename F>
+    void getMany(const std::span<const KeyT> keys, F&& f)
+    {
+        const auto& hashes = hashKeys(keys);
+        thread_local std::vector<size_t> expired {};
+        expired.clear();
+        {
+            const ShardLocks<false> locks { shards_, shardMask(hashes) & ~heldShards() };
+            const auto now = std::chrono::system_clock::now();
+            for (size_t i = 0; i < keys.size(); ++i) {
+                if (i + prefetchDistance < keys.size()) {
+                    shardFor(hashes[i + prefetchDistance]).map_.prefetch(hashes[i + prefetchDistance]);
+                }
+                const auto* value = shardFor(hashes[i]).map_.find(keys[i], hashes[i]);
+                if (value != nullptr && !isExpired(*value, now)) {
+                    touch(*value);
+                    f(i, value);
+                } else {
+                    if (value != nullptr) {
+                        expired.push_back(i);
+                    }
+                    f(i, nullptr);
                 }
             }
-            return map_[key_];
         }
-        std::cout << "[INFO]: Key not found\n";
+        if (expired.empty()) {
+            return;
+        }
+        uint64_t mask = 0;
+        for (const auto i : expired) {
+            mask |= uint64_t { 1 } << shardIndex(hashes[i]);
+        }
+        const ShardLocks<true> locks { shards_, mask & ~heldShards() };
+        const auto now = std::chrono::system_clock::now();
+        for (const auto i : expired) {
+            auto& shard = shardFor(hashes[i]);
+            // The key may have been set again, or be given twice.
+            const auto* value = shard.map_.find(keys[i], hashes[i]);
+            if (value != nullptr && isExpired(*value, now)) {
+                removeExpired(shard, keys[i], hashes[i], *value);
+            }
+        }
+    }
+
+    // The number of keys that exist; a key given twice counts twice.
+    size_t countExisting(const std::span<const KeyT> keys)
+    {
+        size_t count = 0;
+        getMany(keys, [&count](size_t, const ValueType* value) { count += value != nullptr; });
+        return count;
+    }
+
+    // Sets every key to its value without a TTL. A later pair wins over an earlier one
+    // with the same key.
+    void setMany(const std::span<const std::pair<KeyT, std::string_view>> entries)
+    {
+        thread_local std::vector<KeyT> keys {};
+        keys.clear();
+        for (const auto& entry : entries) {
+            keys.push_back(entry.first);
+        }
+        const auto& hashes = hashKeys(keys);
+        const ShardLocks<true> locks { shards_, shardMask(hashes) & ~heldShards() };
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (i + prefetchDistance < entries.size()) {
+                shardFor(hashes[i + prefetchDistance]).map_.prefetch(hashes[i + prefetchDistance]);
+            }
+            const auto* stored = update(shardFor(hashes[i]), keys[i], hashes[i], [&entries, i](ValueType& stored) {
+                stored.assign(entries[i].second);
+                stored.expire_.reset();
+            });
+            notifyWrite(keys[i], stored);
+        }
+    }
+
+    // Deletes the keys and returns how many existed.
+    size_t removeMany(const std::span<const KeyT> keys)
+    {
+        const auto& hashes = hashKeys(keys);
+        const ShardLocks<true> locks { shards_, shardMask(hashes) & ~heldShards() };
+        const auto now = std::chrono::system_clock::now();
+        size_t removed = 0;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (i + prefetchDistance < keys.size()) {
+                shardFor(hashes[i + prefetchDistance]).map_.prefetch(hashes[i + prefetchDistance]);
+            }
+            auto& shard = shardFor(hashes[i]);
+            const auto* value = shard.map_.find(keys[i], hashes[i]);
+            if (value == nullptr) {
+                continue;
+            }
+            if (isExpired(*value, now)) {
+                removeExpired(shard, keys[i], hashes[i], *value);
+                continue;
+            }
+            erase(shard, keys[i], hashes[i], *value);
+            notifyWrite(keys[i], nullptr);
+            ++removed;
+        }
+        return removed;
+    }
+
+    // One step of the active expiry cycle. Visits the shards round robin and removes due
+    // keys from their expiry heaps, examining at most maxChecks heap entries so a tick has
+    // a bounded cost however many keys expire at once. Returns the number of keys removed.
+    size_t expireCycle(const size_t maxChecks, const TimePoint now = std::chrono::system_clock::now())
+    {
+        size_t checks = 0;
+        size_t removed = 0;
+        for (size_t visited = 0; visited < numShards && checks < maxChecks; ++visited) {
+            auto& shard = shards_[expireCursor_.fetch_add(1, std::memory_order_relaxed) % numShards];
+            const auto lock = lockExclusive(shard);
+            auto& heap = shard.expiries_;
+            while (!heap.empty() && heap.top().at_ <= now && checks < maxChecks) {
+                ++checks;
+                const auto hash = Map::hash(heap.top().key_);
+                const auto* value_ = shard.map_.find(heap.top().key_, hash);
+                // Entries of keys that were overwritten or removed since are stale.
+                if (value_ != nullptr && value_->expire_ == heap.top().at_) {
+                    removeExpired(shard, heap.top().key_, hash, *value_);
+                    ++removed;
+                }
+                heap.pop();
+            }
+        }
+        return removed;
+    }
+
+    // Inserts many keys at once, e.g. when a snapshot is loaded. The entries are grouped
+    // by shard so every shard is locked and grown once, and nothing is logged per key.
+    void insertBulk(const std::span<const BulkEntry> entries)
+    {
+        std::vector<size_t> hashes(entries.size());
+        std::array<size_t, numShards + 1> offsets {};
+        for (size_t i = 0; i < entries.size(); ++i) {
+            hashes[i] = Map::hash(entries[i].key_);
+            ++offsets[shardIndex(hashes[i]) + 1];
+        }
+        for (size_t shard = 0; shard < numShards; ++shard) {
+            offsets[shard + 1] += offsets[shard];
+        }
+        // Counting sort of the entries by shard.
+        std::vector<size_t> order(entries.size());
+        auto next = offsets;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            order[next[shardIndex(hashes[i])]++] = i;
+        }
+
+        for (size_t index = 0; index < numShards; ++index) {
+            if (offsets[index] == offsets[index + 1]) {
+                continue;
+            }
+            auto& shard = shards_[index];
+            const auto lock = lockExclusive(shard);
+            shard.map_.reserve(shard.map_.size() + offsets[index + 1] - offsets[index]);
+            for (size_t i = offsets[index]; i < offsets[index + 1]; ++i) {
+                if (i + prefetchDistance < offsets[index + 1]) {
+                    shard.map_.prefetch(hashes[order[i + prefetchDistance]]);
+                }
+                const auto& entry = entries[order[i]];
+                update(shard, entry.key_, hashes[order[i]], [&entry](ValueType& stored) {
+                    stored.assign(entry.value_);
+                    stored.expire_ = entry.expire_;
+                });
+                if (entry.expire_.has_value()) {
+                    scheduleExpiry(shard, entry.key_, entry.expire_.value());
+                }
+            }
+        }
+    }
+
+    // Makes room for numKeys keys spread evenly over the shards, so a bulk load does not
+    // rehash the tables while they grow.
+    void reserve(const size_t numKeys)
+    {
+        // A little slack as the keys do not spread exactly evenly.
+        const auto perShard = numKeys / numShards + numKeys / numShards / 8 + 1;
+        for (auto& shard : shards_) {
+            const auto lock = lockExclusive(shard);
+            shard.map_.reserve(perShard);
+        }
+    }
+
+    // Deletes every key, e.g. before a follower loads the snapshot of its leader. The write
+    // hook is not called.
+    void clear()
+    {
+        for (auto& shard : shards_) {
+            const auto lock = lockExclusive(shard);
+            size_t freed = 0;
+            shard.map_.forEach([&freed](const std::string_view key, const ValueType& value) { freed += entryMemory(key, value); });
+            usedMemory_.fetch_sub(freed, std::memory_order_relaxed);
+            shard.map_ = Map {};
+            shard.expiries_ = ExpiryHeap {};
+            ++shard.removals_;
+        }
+    }
+
+    // Calls f(key, value) for every key of one shard while holding its lock shared, so
+    // writers to that shard wait but the other shards stay available. Then calls done()
+    // before the lock is released: a write to the shard is either seen by f or made
+    // after done() returned.
+    template <typename F, typename Done>
+    void forEachInShard(const size_t index, F&& f, Done&& done) const
+    {
+        const auto& shard = shards_[index];
+        const auto lock = lockShared(shard);
+        shard.map_.forEach(f);
+        done();
+    }
+    template <typename F>
+    void forEachInShard(const size_t index, F&& f) const
+    {
+        forEachInShard(index, std::forward<F>(f), [] {});
+    }
+
+    // The shard key belongs to.
+    static size_t shardOf(const KeyT key) { return shardIndex(Map::hash(key)); }
+
+    // Evicts keys by the policy until the keyspace fits in maxmemory again. Call before a
+    // write that may grow the keyspace, without holding any lock of the Db. Returns false
+    // if the keyspace does not fit and nothing can be evicted, in which case the write
+    // should be refused.
+    //
+    // Like Redis it approximates the policy instead of keeping the keys ordered by it:
+    // a few keys are sampled from a random shard into a small pool of the best candidates
+    // seen so far, and the best one is evicted. The pool carries over between evictions,
+    // so the choice improves on what one sample would give.
+    bool freeMemoryIfNeeded()
+    {
+        if (maxMemory_ == 0 || usedMemory() <= maxMemory_) {
+            return true;
+        }
+        if (policy_ == EvictionPolicy::NoEviction) {
+            return false;
+        }
+        // Evicting locks shards a transaction of this thread may not hold; EXEC frees
+        // memory before it locks.
+        if (heldShards() != 0) {
+            return false;
+        }
+        std::lock_guard lock { evictionMutex_ };
+        while (usedMemory() > maxMemory_) {
+            if (!evictOne()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Estimated bytes taken by the keys and values.
+    size_t usedMemory() const { return usedMemory_.load(std::memory_order_relaxed); }
+
+    DbStats stats() const
+    {
+        return DbStats {
+            .keys_ = size(),
+            .expiredKeys_ = expiredKeys_.load(std::memory_order_relaxed),
+            .expiredBytes_ = expiredBytes_.load(std::memory_order_relaxed),
+            .evictedKeys_ = evictedKeys_.load(std::memory_order_relaxed),
+            .usedMemory_ = usedMemory(),
+        };
+    }
+
+    size_t size() const
+    {
+        size_t total = 0;
+        for (const auto& shard : shards_) {
+            const auto lock = lockShared(shard);
+            total += shard.map_.size();
+        }
+        return total;
+    }
+
+private:
+    using Map = FlatHashMap<ValueType>;
+
+    // How many entries ahead insertBulk prefetches the slot of.
+    static constexpr size_t prefetchDistance = 8;
+
+    // The best eviction candidates seen so far, and how many times the keyspace is sampled
+    // for one eviction before giving up, eg. when every sampled key is deleted meanwhile.
+    static constexpr size_t evictionPoolSize = 16;
+    static constexpr size_t maxEvictionRounds = 16;
+
+    // The LFU access clock is laid out like in Redis: the minute the counter was last
+    // decayed in the high 16 bits and a logarithmic access counter in the low 8 bits. The
+    // counter decays by one per minute; a new key starts at lfuInitialCount so it is not
+    // evicted right away, and a count c grows with probability 1 / ((c - 5) * 10 + 1),
+    // so 255 takes about a million accesses.
+    static constexpr uint32_t lfuInitialCount = 5;
+    static constexpr uint32_t lfuLogFactor = 10;
+
+    struct EvictionCandidate {
+        // Higher is evicted first.
+        uint64_t score_ {};
+        size_t shard_ {};
+        std::string key_ {};
+    };
+
+    struct Expiry {
+        TimePoint at_ {};
+        std::string key_ {};
+
+        friend bool operator>(const Expiry& lhs, const Expiry& rhs) { return lhs.at_ > rhs.at_; }
+    };
+    using ExpiryHeap = std::priority_queue<Expiry, std::vector<Expiry>, std::greater<>>;
+
+    // Aligned to a cache line so that locking one shard does not invalidate its neighbours.
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex_ {};
+        Map map_ {};
+        // A min-heap on the expiry time of the keys with a TTL. Overwriting a key leaves
+        // its old entry behind; such entries are recognised and dropped when popped.
+        ExpiryHeap expiries_ {};
+        // Writes and removals so far, for KeyVersion.
+        uint64_t versions_ {};
+        uint64_t removals_ {};
+    };
+
+    // Holds the locks of every shard in mask, taken in ascending order so that commands
+    // locking several shards cannot deadlock.
+    template <bool Exclusive>
+    class ShardLocks {
+    public:
+        ShardLocks(const std::array<Shard, numShards>& shards, const uint64_t mask)
+            : shards_(shards)
+            , mask_(mask)
+        {
+            for (auto bits = mask_; bits != 0; bits &= bits - 1) {
+                auto& mutex = shards_[std::countr_zero(bits)].mutex_;
+                Exclusive ? mutex.lock() : mutex.lock_shared();
+            }
+        }
+        ~ShardLocks()
+        {
+            for (auto bits = mask_; bits != 0; bits &= bits - 1) {
+                auto& mutex = shards_[std::countr_zero(bits)].mutex_;
+                Exclusive ? mutex.unlock() : mutex.unlock_shared();
+            }
+        }
+        ShardLocks(const ShardLocks&) = delete;
+        ShardLocks& operator=(const ShardLocks&) = delete;
+
+    private:
+        const std::array<Shard, numShards>& shards_;
+        uint64_t mask_ {};
+    };
+
+    // The shards a thread locked with lockShards, and of which Db. Zero initialized, as
+    // a thread_local.
+    struct HeldShards {
+        const Db* db_;
+        uint64_t mask_;
+    };
+    static inline thread_local HeldShards held_;
+
+    uint64_t heldShards() const { return held_.db_ == this ? held_.mask_ : 0; }
+
+    // The lock of a shard, or none if the thread holds the shard through lockShards.
+    std::unique_lock<std::shared_mutex> lockExclusive(const Shard& shard) const
+    {
+        if ((heldShards() & shardBit(shard)) != 0) {
+            return {};
+        }
+        return std::unique_lock { shard.mutex_ };
+    }
+    std::shared_lock<std::shared_mutex> lockShared(const Shard& shard) const
+    {
+        if ((heldShards() & shardBit(shard)) != 0) {
+            return {};
+        }
+        return std::shared_lock { shard.mutex_ };
+    }
+    uint64_t shardBit(const Shard& shard) const { return uint64_t { 1 } << (&shard - shards_.data()); }
+
+    // The hashes of keys, in a buffer every thread reuses.
+    static const std::vector<size_t>& hashKeys(const std::span<const KeyT> keys)
+    {
+        thread_local std::vector<size_t> hashes {};
+        hashes.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            hashes[i] = Map::hash(keys[i]);
+        }
+        return hashes;
+    }
+
+    static uint64_t shardMask(const std::span<const size_t> hashes)
+    {
+        uint64_t mask = 0;
+        for (const auto hash : hashes) {
+            mask |= uint64_t { 1 } << shardIndex(hash);
+        }
+        return mask;
+    }
+
+    void notifyWrite(const KeyT key, const ValueType* value) const
+    {
+        if (writeHook_) {
+            writeHook_(key, value, {});
+        }
+    }
+
+    // A buffer every thread reuses for the command passed to the write hook, holding the
+    // command name and the key.
+    static std::vector<std::string_view>& commandBuffer(const std::string_view name, const KeyT key)
+    {
+        thread_local std::vector<std::string_view> command {};
+        command.assign({ name, key });
+        return command;
+    }
+
+    // Runs f(collection, value) on the collection of type T at key under the exclusive
+    // shard lock, creating an empty one if the key does not exist, and returns what f
+    // returns. Fails without calling f if the key holds another type.
+    template <typename T, typename F>
+    std::expected<size_t, std::string> updateCollection(const KeyT key, F&& f)
+    {
+        const auto hash = Map::hash(key);
+        auto& shard = shardFor(hash);
+        const auto lock = lockExclusive(shard);
+        auto* stored = shard.map_.find(key, hash);
+        if (stored != nullptr && stored->expire_.has_value() && isExpired(*stored, std::chrono::system_clock::now())) {
+            removeExpired(shard, key, hash, *stored);
+            stored = nullptr;
+        }
+        if (stored != nullptr && stored->template as<T>() == nullptr) {
+            return std::unexpected { std::string { wrongTypeError } };
+        }
+        std::expected<size_t, std::string> result {};
+        update(shard, key, hash, [&f, &result](ValueType& stored) {
+            auto* collection = stored.template as<T>();
+            result = f(collection != nullptr ? *collection : stored.template emplace<T>(), stored);
+        });
+        return result;
+    }
+
+    static bool isExpired(const ValueType& value, const TimePoint now)
+    {
+        return value.expire_.has_value() && value.expire_.value() <= now;
+    }
+
+    // Must hold the shard lock exclusively.
+    void scheduleExpiry(Shard& shard, const KeyT key, const TimePoint expire)
+    {
+        auto& heap = shard.expiries_;
+        // Keys whose TTL keeps being pushed out leave stale entries behind; drop them
+        // once they outnumber the keys of the shard.
+        if (heap.size() > 2 * shard.map_.size() + 64) {
+            std::vector<Expiry> live {};
+            while (!heap.empty()) {
+                const auto* value_ = shard.map_.find(heap.top().key_, Map::hash(heap.top().key_));
+                if (value_ != nullptr && value_->expire_ == heap.top().at_) {
+                    live.push_back(heap.top());
+                }
+                heap.pop();
+            }
+            heap = ExpiryHeap { std::greater<> {}, std::move(live) };
+        }
+        heap.push(Expiry { .at_ = expire, .key_ = std::string { key } });
+    }
+
+    // Must hold the shard lock exclusively.
+    void removeExpired(Shard& shard, const KeyT key, const size_t hash, const ValueType& value)
+    {
+        expiredKeys_.fetch_add(1, std::memory_order_relaxed);
+        expiredBytes_.fetch_add(key.size() + value.size(), std::memory_order_relaxed);
+        erase(shard, key, hash, value);
+    }
+
+    // The bytes an entry takes, estimated: its slot, the heap bytes of the key and those of
+    // the value.
+    static size_t entryMemory(const KeyT key, const ValueType& value)
+    {
+        return sizeof(Map::Entry) + 1 + stringHeapBytes(key.size()) + value.memoryUsage();
+    }
+
+    // Creates or updates the entry of key with f(value), then updates the memory estimate
+    // and the access clock. Must hold the shard lock exclusively.
+    template <typename F>
+    ValueType* update(Shard& shard, const KeyT key, const size_t hash, F&& f)
+    {
+        auto [stored, inserted] = shard.map_.tryEmplace(key, hash);
+        const auto before = inserted ? 0 : entryMemory(key, *stored);
+        f(*stored);
+        stored->version_ = ++shard.versions_;
+        // Wraps around to a subtraction when the entry shrank.
+        usedMemory_.fetch_add(entryMemory(key, *stored) - before, std::memory_order_relaxed);
+        touch(*stored, inserted);
+        return stored;
+    }
+
+    // Must hold the shard lock exclusively. value is invalid afterwards.
+    void erase(Shard& shard, const KeyT key, const size_t hash, const ValueType& value)
+    {
+        usedMemory_.fetch_sub(entryMemory(key, value), std::memory_order_relaxed);
+        shard.map_.erase(key, hash);
+        ++shard.removals_;
+    }
+
+    // Milliseconds of a steady clock, the LRU access clock. Wraps around after 49 days,
+    // after which a key not used since looks recently used.
+    static uint32_t lruClock()
+    {
+        using namespace std::chrono;
+        return static_cast<uint32_t>(duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count());
+    }
+    static uint32_t lfuMinutes()
+    {
+        using namespace std::chrono;
+        return static_cast<uint32_t>(duration_cast<minutes>(steady_clock::now().time_since_epoch()).count()) & 0xFFFF;
+    }
+    // The LFU counter of clock after its decay.
+    static uint32_t lfuCount(const uint32_t clock)
+    {
+        const auto elapsed = (lfuMinutes() - (clock >> 8)) & 0xFFFF;
+        const auto count = clock & 0xFF;
+        return elapsed >= count ? 0 : count - elapsed;
+    }
+
+    // Records an access to value in its access clock. Safe under the shared lock.
+    void touch(const ValueType& value, const bool created = false) const
+    {
+        if (policy_ == EvictionPolicy::AllKeysLru) {
+            value.access_.store(lruClock());
+        } else if (policy_ == EvictionPolicy::AllKeysLfu) {
+            auto count = created ? lfuInitialCount : lfuCount(value.access_.load());
+            if (!created && count < 0xFF) {
+                thread_local std::minstd_rand random { std::random_device {}() };
+                const auto base = count > lfuInitialCount ? count - lfuInitialCount : 0;
+                count += std::uniform_int_distribution<uint32_t> { 0, base * lfuLogFactor }(random) == 0;
+            }
+            value.access_.store(lfuMinutes() << 8 | count);
+        }
+    }
+
+    // The eviction score of a key, or nothing if the policy does not evict it.
+    std::optional<uint64_t> evictionScore(const ValueType& value) const
+    {
+        switch (policy_) {
+        case EvictionPolicy::AllKeysLru:
+            // Milliseconds since the last access.
+            return static_cast<uint32_t>(lruClock() - value.access_.load());
+        case EvictionPolicy::AllKeysLfu:
+            return 0xFF - lfuCount(value.access_.load());
+        case EvictionPolicy::VolatileTtl:
+            if (!value.expire_.has_value()) {
+                return std::nullopt;
+            }
+            return std::numeric_limits<uint64_t>::max()
+                - static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(value.expire_->time_since_epoch()).count());
+        case EvictionPolicy::NoEviction:
+            break;
+        }
         return std::nullopt;
     }
 
+    // Must hold evictionMutex_. Samples evictionSamples_ candidates into the pool, which
+    // stays sorted by score, the best candidate last. The shards are sampled in turn from a
+    // random one until enough candidates are found, so a small keyspace spread thin over
+    // the shards is sampled as well as a large one. Returns false if there are none.
+    bool sampleEvictionCandidates()
+    {
+        const auto first = evictionRandom_();
+        size_t found = 0;
+        for (size_t i = 0; i < numShards && found < evictionSamples_; ++i) {
+            const auto index = (first + i) % numShards;
+            const auto& shard = shards_[index];
+            const auto lock = lockShared(shard);
+            shard.map_.sample(evictionRandom_(), evictionSamples_ - found, [this, index, &found](const std::string& key, const ValueType& value) {
+                const auto score = evictionScore(value);
+                if (score.has_value()) {
+                    ++found;
+                    addEvictionCandidate(key, index, score.value());
+                }
+            });
+        }
+        return found > 0;
+    }
+
+    // Must hold evictionMutex_.
+    void addEvictionCandidate(const std::string_view key, const size_t index, const uint64_t score)
+    {
+        auto& pool = evictionPool_;
+        const auto same = std::ranges::find(pool, key, &EvictionCandidate::key_);
+        if (same != pool.end()) {
+            pool.erase(same);
+        }
+        if (pool.size() == evictionPoolSize && score <= pool.front().score_) {
+            return;
+        }
+        const auto at = std::ranges::upper_bound(pool, score, {}, &EvictionCandidate::score_);
+        pool.insert(at, EvictionCandidate { .score_ = score, .shard_ = index, .key_ = std::string { key } });
+        if (pool.size() > evictionPoolSize) {
+            pool.erase(pool.begin());
+        }
+    }
+
+    // Must hold evictionMutex_. Evicts the best candidate that still exists.
+    bool evictOne()
+    {
+        for (size_t round = 0; round < maxEvictionRounds; ++round) {
+            if (!sampleEvictionCandidates() && evictionPool_.empty()) {
+                return false;
+            }
+            while (!evictionPool_.empty()) {
+                const auto candidate = std::move(evictionPool_.back());
+                evictionPool_.pop_back();
+                auto& shard = shards_[candidate.shard_];
+                const auto hash = Map::hash(candidate.key_);
+                const auto lock = lockExclusive(shard);
+                const auto* value = shard.map_.find(candidate.key_, hash);
+                // The key may have been deleted, or lost its TTL, since it was sampled.
+                if (value == nullptr || !evictionScore(*value).has_value()) {
+                    continue;
+                }
+                erase(shard, candidate.key_, hash, *value);
+                evictedKeys_.fetch_add(1, std::memory_order_relaxed);
+                notifyWrite(candidate.key_, nullptr);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The low bits of the hash select the slot and the top 7 bits are the slot tag,
+    // so the shard is taken from bits in between.
+    static size_t shardIndex(const size_t hash) { return (hash >> 40) % numShards; }
+    Shard& shardFor(const size_t hash) { return shards_[shardIndex(hash)]; }
+    const Shard& shardFor(const size_t hash) const { return shards_[shardIndex(hash)]; }
+
+    std::array<Shard, numShards> shards_ {};
+    WriteHook writeHook_ {};
+    std::atomic<size_t> expireCursor_ {};
+    std::atomic<uint64_t> expiredKeys_ {};
+    std::atomic<uint64_t> expiredBytes_ {};
+    std::atomic<uint64_t> evictedKeys_ {};
+    std::atomic<size_t> usedMemory_ {};
+
+    uint64_t maxMemory_ {};
+    EvictionPolicy policy_ { EvictionPolicy::NoEviction };
+    unsigned evictionSamples_ { 5 };
+    // One thread evicts at a time; the others wait and then find the keyspace fits.
+    std::mutex evictionMutex_ {};
+    std::vector<EvictionCandidate> evictionPool_ {};
+    std::minstd_rand evictionRandom_ {};
+};
+
+class Db::LockedShards {
+public:
+    LockedShards(const Db& db, const uint64_t mask)
+        : locks_(db.shards_, mask)
+    {
+        held_ = HeldShards { .db_ = &db, .mask_ = mask };
+    }
+    ~LockedShards() { held_ = HeldShards {}; }
+    LockedShards(const LockedShards&) = delete;
+    LockedShards& operator=(const LockedShards&) = delete;
+
 private:
-    std::map<std::string, ValueType> map_ {};
-};
\ No newline at end of file
+    ShardLocks<true> locks_;
+};
+
+inline Db::LockedShards Db::lockShards(const uint64_t mask)
+{
+    return LockedShards { *this, mask };
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+// What the server runs on every thread: a reactor over one of the I/O backends.
+class EventLoop {
+public:
+    virtual ~EventLoop() = default;
+
+    // Serves the clients of the reactor until the process exits.
+    virtual void run() = 0;
+};
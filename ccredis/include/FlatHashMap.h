@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Open addressing hash map with linear probing, keyed by std::string.
+// Every lookup takes a std::string_view together with the hash of the key. The
+// caller hashes once (eg. to pick a shard) and no temporary std::string is built.
+template <typename Value>
+class FlatHashMap {
+public:
+    struct Entry {
+        std::string key_ {};
+        Value value_ {};
+    };
+
+    static size_t hash(const std::string_view key)
+    {
+        return std::hash<std::string_view> {}(key);
+    }
+
+    Value* find(const std::string_view key, const size_t hash)
+    {
+        const auto index = findIndex(key, hash);
+        return index == npos ? nullptr : &entries_[index].value_;
+    }
+
+    const Value* find(const std::string_view key, const size_t hash) const
+    {
+        const auto index = findIndex(key, hash);
+        return index == npos ? nullptr : &entries_[index].value_;
+    }
+
+    // Returns the value stored for key and true if it was inserted. A newly
+    // inserted value is default constructed.
+    std::pair<Value*, bool> tryEmplace(const std::string_view key, const size_t hash)
+    {
+        if ((size_ + tombstones_ + 1) * 8 > capacity() * 7) {
+            // Grow when the live entries need it, otherwise rebuild in place to drop tombstones.
+            const auto newCapacity = capacity() == 0 ? minCapacity
+                : (size_ + 1) * 2 > capacity()    ? capacity() * 2
+                                                  : capacity();
+            rehash(newCapacity);
+        }
+
+        const auto tag = tagOf(hash);
+        auto insertAt = npos;
+        for (auto i = hash & mask_;; i = (i + 1) & mask_) {
+            const auto ctrl = ctrl_[i];
+            if (ctrl == empty) {
+                if (insertAt == npos) {
+                    insertAt = i;
+                }
+                break;
+            }
+            if (ctrl == tombstone) {
+                if (insertAt == npos) {
+                    insertAt = i;
+                }
+            } else if (ctrl == tag && entries_[i].key_ == key) {
+                return { &entries_[i].value_, false };
+            }
+        }
+
+        if (ctrl_[insertAt] == tombstone) {
+            --tombstones_;
+        }
+        ctrl_[insertAt] = tag;
+        entries_[insertAt].key_.assign(key);
+        // Rebuilt in place rather than assigned from a temporary, which costs a move of
+        // every alternative of a variant value.
+        std::destroy_at(&entries_[insertAt].value_);
+        std::construct_at(&entries_[insertAt].value_);
+        ++size_;
+        return { &entries_[insertAt].value_, true };
+    }
+
+    bool erase(const std::string_view key, const size_t hash)
+    {
+        const auto index = findIndex(key, hash);
+        if (index == npos) {
+            return false;
+        }
+        // A slot followed by an empty slot ends every probe sequence through it, so
+        // it can become empty again instead of a tombstone.
+        if (ctrl_[(index + 1) & mask_] == empty) {
+            ctrl_[index] = empty;
+        } else {
+            ctrl_[index] = tombstone;
+            ++tombstones_;
+        }
+        entries_[index] = Entry {};
+        --size_;
+        return true;
+    }
+
+    // Starts loading the slot a lookup of hash would probe first, so that the caches
+    // misses of a batch of lookups overlap instead of being paid one after another.
+    void prefetch(const size_t hash) const
+    {
+        if (!ctrl_.empty()) {
+            __builtin_prefetch(&ctrl_[hash & mask_]);
+            __builtin_prefetch(&entries_[hash & mask_]);
+        }
+    }
+
+    void reserve(const size_t numEntries)
+    {
+        auto newCapacity = capacity() == 0 ? minCapacity : capacity();
+        while (numEntries * 8 > newCapacity * 7) {
+            newCapacity *= 2;
+        }
+        if (newCapacity != capacity()) {
+            rehash(newCapacity);
+        }
+    }
+
+    template <typename F>
+    void forEach(F&& f) const
+    {
+        for (size_t i = 0; i < ctrl_.size(); ++i) {
+            if (ctrl_[i] & full) {
+                f(entries_[i].key_, entries_[i].value_);
+            }
+        }
+    }
+
+    // Calls f(key, value) for up to count entries, the first ones found from slot start
+    // on, to sample the map at random.
+    template <typename F>
+    void sample(const size_t start, const size_t count, F&& f) const
+    {
+        size_t found = 0;
+        for (size_t i = 0; i < ctrl_.size() && found < count && found < size_; ++i) {
+            const auto index = (start + i) & mask_;
+            if (ctrl_[index] & full) {
+                f(entries_[index].key_, entries_[index].value_);
+                ++found;
+            }
+        }
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return ctrl_.size(); }
+
+private:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    static constexpr size_t minCapacity = 16;
+    // Control bytes: 0 is an empty slot, 1 a deleted slot and a full slot keeps 7
+    // bits of the hash so most mismatching keys are skipped without a compare.
+    static constexpr uint8_t empty = 0;
+    static constexpr uint8_t tombstone = 1;
+    static constexpr uint8_t full = 0x80;
+
+    static uint8_t tagOf(const size_t hash)
+    {
+        return full | static_cast<uint8_t>(hash >> 57);
+    }
+
+    size_t findIndex(const std::string_view key, const size_t hash) const
+    {
+        if (size_ == 0) {
+            return npos;
+        }
+        const auto tag = tagOf(hash);
+        for (auto i = hash & mask_;; i = (i + 1) & mask_) {
+            const auto ctrl = ctrl_[i];
+            if (ctrl == empty) {
+                return npos;
+            }
+            if (ctrl == tag && entries_[i].key_ == key) {
+                return i;
+            }
+        }
+    }
+
+    void rehash(const size_t newCapacity)
+    {
+        auto oldCtrl = std::exchange(ctrl_, std::vector<uint8_t>(newCapacity, empty));
+        auto oldEntries = std::exchange(entries_, std::vector<Entry>(newCapacity));
+        mask_ = newCapacity - 1;
+        tombstones_ = 0;
+
+        for (size_t i = 0; i < oldCtrl.size(); ++i) {
+            if (!(oldCtrl[i] & full)) {
+                continue;
+            }
+            const auto h = hash(oldEntries[i].key_);
+            auto j = h & mask_;
+            while (ctrl_[j] != empty) {
+                j = (j + 1) & mask_;
+            }
+            ctrl_[j] = tagOf(h);
+            entries_[j] = std::move(oldEntries[i]);
+        }
+    }
+
+    std::vector<uint8_t> ctrl_ {};
+    std::vector<Entry> entries_ {};
+    size_t mask_ {};
+    size_t size_ {};
+    size_t tombstones_ {};
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <linux/io_uring.h>
+#include <memory>
+#include <span>
+#include <string>
+
+// An io_uring instance with its submission and completion queues mapped into the process,
+// set up with the raw system calls rather than through liburing. Not thread safe: one
+// reactor owns it.
+class IoUring {
+public:
+    // Sets up a ring with room for entries submissions, or returns why the kernel
+    // cannot, e.g. when io_uring is disabled. The ring starts disabled, so that the thread
+    // that calls enable becomes its only submitter: the kernel then runs the work of
+    // completions when that thread waits for them, rather than interrupting it (6.1).
+    static std::expected<std::unique_ptr<IoUring>, std::string> create(unsigned entries);
+    // Call from the thread that submits, before the first submission.
+    void enable();
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Whether the kernel implements the opcode, eg: IORING_OP_SEND.
+    bool supports(uint8_t opcode) const;
+
+    // A zeroed entry at the tail of the submission queue. When the queue is full the
+    // entries in it are submitted first.
+    io_uring_sqe& nextSqe();
+    // Submits the queued entries and waits until at least waitFor completions are
+    // ready. Returns 0 or a negative errno, eg: -EINTR.
+    int submitAndWait(unsigned waitFor);
+
+    // Calls f(cqe) for every completion ready and hands their slots back to the kernel.
+    // f may queue new submissions.
+    template <typename F>
+    void forEachCompletion(F&& f)
+    {
+        auto head = *cqHead_;
+        const auto tail = std::atomic_ref { *cqTail_ }.load(std::memory_order_acquire);
+        while (head != tail) {
+            f(static_cast<const io_uring_cqe&>(cqes_[head & cqMask_]));
+            ++head;
+        }
+        std::atomic_ref { *cqHead_ }.store(head, std::memory_order_release);
+    }
+
+    int fd() const { return fd_; }
+
+private:
+    IoUring() = default;
+
+    int fd_ { -1 };
+    bool disabled_ {};
+    void* ringMemory_ {};
+    size_t ringSize_ {};
+    io_uring_sqe* sqes_ {};
+    size_t sqesSize_ {};
+    unsigned sqEntries_ {};
+
+    unsigned* sqHead_ {};
+    unsigned* sqTail_ {};
+    unsigned sqMask_ {};
+    // The tail of the entries filled in but not handed to the kernel yet.
+    unsigned sqeTail_ {};
+
+    unsigned* cqHead_ {};
+    unsigned* cqTail_ {};
+    unsigned cqMask_ {};
+    io_uring_cqe* cqes_ {};
+
+    // Indexed by opcode, set for the ones the kernel implements.
+    std::array<bool, IORING_OP_LAST> supported_ {};
+};
+
+// Buffers the kernel picks from for receives that set IOSQE_BUFFER_SELECT with the group
+// id of the ring, so a receive only takes a buffer once data arrived instead of every
+// idle connection holding one. The completion carries the id of the buffer, which goes
+// back to the ring with recycle once its data was consumed.
+class BufferRing {
+public:
+    // count must be a power of two.
+    static std::expected<std::unique_ptr<BufferRing>, std::string> create(IoUring& ring, uint16_t groupId,
+        unsigned count, size_t bufferSize);
+    ~BufferRing();
+
+    BufferRing(const BufferRing&) = delete;
+    BufferRing& operator=(const BufferRing&) = delete;
+
+    uint16_t groupId() const { return groupId_; }
+    std::span<char> buffer(uint16_t id) { return { buffers_.get() + size_t { id } * bufferSize_, bufferSize_ }; }
+    // Makes the buffer available to the kernel again.
+    void recycle(uint16_t id);
+
+private:
+    BufferRing(IoUring& ring, uint16_t groupId, unsigned count, size_t bufferSize);
+
+    IoUring& ring_;
+    const uint16_t groupId_ {};
+    const unsigned count_ {};
+    const size_t bufferSize_ {};
+    // The ring, as an array: in C++ the bufs member of io_uring_buf_ring is preceded by
+    // an empty struct and sits 8 bytes off.
+    io_uring_buf* entries_ {};
+    size_t entriesSize_ {};
+    std::unique_ptr<char[]> buffers_ {};
+    uint16_t tail_ {};
+};
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+enum class LogLevel : uint8_t {
+    Debug,
+    Info,
+    Warning,
+    Error
+};
+
+// Levels below this are compiled out, arguments and all. Build with
+// -DCCREDIS_LOG_LEVEL=0 to keep the debug logs, which trace every request.
+#ifndef CCREDIS_LOG_LEVEL
+#define CCREDIS_LOG_LEVEL 1
+#endif
+
+// The name of level in the configuration, eg: warning
+std::string_view logLevelName(LogLevel level);
+
+// One line being formatted, truncated at maxLength. Formats integers and floating point
+// numbers with std::to_chars and copies strings, so formatting does not allocate.
+class LogLine {
+public:
+    static constexpr size_t maxLength = 1024;
+
+    template <typename T>
+    void append(const T& arg)
+    {
+        if constexpr (std::same_as<T, bool>) {
+            append(std::string_view { arg ? "true" : "false" });
+        } else if constexpr (std::same_as<T, char>) {
+            append(std::string_view { &arg, 1 });
+        } else if constexpr (std::integral<T> || std::floating_point<T>) {
+            const auto [end, ec] = std::to_chars(data_.data() + size_, data_.data() + data_.size(), arg);
+            size_ = ec == std::errc() ? static_cast<size_t>(end - data_.data()) : size_;
+        } else {
+            const std::string_view str { arg };
+            const auto length = std::min(str.size(), data_.size() - size_);
+            str.copy(data_.data() + size_, length);
+            size_ += length;
+        }
+    }
+    std::string_view view() const { return { data_.data(), size_ }; }
+
+private:
+    // Left uninitialized, only the part before size_ is read.
+    std::array<char, maxLength> data_;
+    size_t size_ {};
+};
+
+// The lines one thread logs, on their way to the writer: a ring of bytes with one
+// producer and one consumer, which only share the two positions.
+class LogRing {
+public:
+    static constexpr size_t capacity = 64 * 1024;
+
+    // Returns false, dropping the line, when the writer is that far behind.
+    bool push(LogLevel level, std::string_view line);
+    // Calls f(level, line) for every line pushed so far.
+    template <typename F>
+    void drain(F&& f);
+    bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_relaxed); }
+
+private:
+    struct Header {
+        uint32_t length_;
+        LogLevel level_;
+    };
+
+    void copyIn(size_t position, const void* data, size_t length);
+    void copyOut(size_t position, void* data, size_t length) const;
+
+    // Both only grow; their difference is the number of bytes in the ring.
+    alignas(64) std::atomic<size_t> head_ {};
+    alignas(64) std::atomic<size_t> tail_ {};
+    alignas(64) std::array<char, capacity> data_ {};
+    std::string line_ {};
+};
+
+// Writes what every thread logs from a thread of its own, so logging costs the threads
+// that serve requests a copy into their ring and never a syscall or a lock. Lines at
+// warning and above go to stderr, the others to stdout.
+class Logger {
+public:
+    static Logger& instance();
+
+    static bool enabled(const LogLevel level) { return level >= level_.load(std::memory_order_relaxed); }
+    static void setLevel(const LogLevel level) { level_.store(level, std::memory_order_relaxed); }
+
+    template <typename... Args>
+    void log(const LogLevel level, const Args&... args)
+    {
+        LogLine line;
+        (line.append(args), ...);
+        push(level, line.view());
+    }
+    // Writes everything logged so far before returning.
+    void flush();
+    // Lines dropped because the ring of their thread was full.
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    Logger();
+
+    void push(LogLevel level, std::string_view line);
+    void writeLoop();
+    // Writes out the rings; the caller holds writeMutex_.
+    void drainRings();
+
+    static inline std::atomic<LogLevel> level_ { LogLevel::Info };
+
+    std::atomic<uint64_t> dropped_ {};
+    std::mutex ringsMutex_ {};
+    // The rings of threads that have exited are written out and then removed.
+    std::vector<std::shared_ptr<LogRing>> rings_ {};
+    std::mutex writeMutex_ {};
+    uint64_t reportedDropped_ {};
+    std::string out_ {};
+    std::string err_ {};
+    std::mutex wakeMutex_ {};
+    std::condition_variable wake_ {};
+    bool urgent_ {};
+    std::thread writer_ {};
+};
+
+template <typename F>
+void LogRing::drain(F&& f)
+{
+    const auto head = head_.load(std::memory_order_acquire);
+    auto tail = tail_.load(std::memory_order_relaxed);
+    while (tail != head) {
+        Header header {};
+        copyOut(tail, &header, sizeof(header));
+        line_.resize(header.length_);
+        copyOut(tail + sizeof(header), line_.data(), header.length_);
+        f(header.level_, std::string_view { line_ });
+        tail += sizeof(header) + header.length_;
+    }
+    tail_.store(tail, std::memory_order_release);
+}
+
+#define CCREDIS_LOG(level, ...)                                                  \
+    do {                                                                         \
+        if constexpr (static_cast<int>(level) >= CCREDIS_LOG_LEVEL) {            \
+            if (Logger::enabled(level)) {                                        \
+                Logger::instance().log(level, __VA_ARGS__);                      \
+            }                                                                    \
+        }                                                                        \
+    } while (false)
+
+// Log the concatenation of the arguments, eg: LOG_INFO("Client connected. Fd= ", fd)
+// The arguments are not evaluated when the level is disabled.
+#define LOG_DEBUG(...) CCREDIS_LOG(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...) CCREDIS_LOG(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARNING(...) CCREDIS_LOG(LogLevel::Warning, __VA_ARGS__)
+#define LOG_ERROR(...) CCREDIS_LOG(LogLevel::Error, __VA_ARGS__)
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <span>
+#include <string>
+#include <sys/uio.h>
+#include <vector>
+
+// What is waiting to be sent to a client, in order. Replies are copied in, published
+// messages are shared with every other subscriber they go to and never copied.
+class OutputQueue {
+public:
+    // Queues the segments, leaving out the first skip bytes, which were already sent.
+    void append(std::span<const iovec> segments, size_t skip = 0);
+    void append(std::shared_ptr<const std::string> message);
+
+    bool empty() const { return size_ == 0; }
+    // Bytes queued.
+    size_t size() const { return size_; }
+
+    // The front of the queue as at most max segments for sendmsg. Valid until the queue
+    // is changed.
+    std::span<const iovec> segments(size_t max);
+    // Drops bytes from the front once they were sent.
+    void consume(size_t bytes);
+
+private:
+    // Copied replies are appended to the last chunk while it is not shared.
+    struct Chunk {
+        std::shared_ptr<const std::string> shared_ {};
+        std::string owned_ {};
+
+        const std::string& bytes() const { return shared_ ? *shared_ : owned_; }
+    };
+
+    std::deque<Chunk> chunks_ {};
+    // Bytes of the front chunk that were sent.
+    size_t offset_ {};
+    size_t size_ {};
+    std::vector<iovec> segments_ {};
+};
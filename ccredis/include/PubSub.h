@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Whether str matches a glob-style pattern as in PSUBSCRIBE: * matches any run of
+// characters, ? any one, [abc] and [a-z] one of a set, [^a] one not in it, and \ quotes
+// the next character.
+bool matchesPattern(std::string_view pattern, std::string_view str);
+
+// A published message on its way to the subscribers of one reactor, encoded once for
+// all of them.
+struct Publication {
+    // The channel it was published to, or for pattern subscribers the pattern it matched.
+    std::string target_ {};
+    bool pattern_ {};
+    std::shared_ptr<const std::string> frame_ {};
+};
+
+namespace detail {
+struct StringHash {
+    using is_transparent = void;
+    size_t operator()(const std::string_view str) const { return std::hash<std::string_view> {}(str); }
+};
+} // namespace detail
+
+// Which reactors have subscribers to which channels and patterns, and the messages
+// published to them. Thread safe. Every reactor keeps its own Subscriptions of which of
+// its clients subscribed to what, so publishing only hands a message to the reactors
+// with subscribers and each of them delivers it to its clients.
+class PubSub {
+public:
+    // A subscriber whose unsent messages and replies grow past outputLimit bytes is
+    // disconnected, so a slow one cannot take up unbounded memory.
+    explicit PubSub(size_t outputLimit)
+        : outputLimit_(outputLimit)
+    {
+    }
+
+    size_t outputLimit() const { return outputLimit_; }
+
+    // Adds a reactor and returns its index. wake is called from the publishing thread
+    // when the first message for the reactor arrives after it last took them.
+    size_t addReactor(std::function<void()> wake);
+
+    // A client of reactor subscribed to, or unsubscribed from, a channel or pattern it
+    // had not or had subscribed to. PUBLISH replies with the number of them.
+    void subscribe(size_t reactor, std::string_view target, bool pattern);
+    void unsubscribe(size_t reactor, std::string_view target, bool pattern);
+
+    // Queues the message for the reactors with subscribers to the channel or a pattern
+    // matching it, and returns the number of subscriptions it goes to. The reactor that
+    // publishes is not woken up; it takes its messages at the end of its batch.
+    size_t publish(size_t fromReactor, std::string_view channel, std::string_view message);
+    // The messages published for reactor since it last took them, oldest first.
+    std::vector<Publication> take(size_t reactor);
+
+private:
+    struct Inbox {
+        std::mutex mutex_ {};
+        std::vector<Publication> publications_ {};
+        // Set from the first message until the reactor takes them, so it is woken once.
+        std::atomic<bool> signaled_ {};
+        std::function<void()> wake_ {};
+    };
+    // Subscribed clients per reactor.
+    using Counts = std::vector<uint32_t>;
+    using Registry = std::unordered_map<std::string, Counts, detail::StringHash, std::equal_to<>>;
+
+    Registry& registry(const bool pattern) { return pattern ? patterns_ : channels_; }
+
+    const size_t outputLimit_ {};
+    mutable std::shared_mutex mutex_ {};
+    Registry channels_ {};
+    Registry patterns_ {};
+    // A deque so the inboxes never move.
+    std::deque<Inbox> inboxes_ {};
+};
+
+// The subscriptions of the clients of one reactor. Only that reactor uses it; it keeps
+// PubSub informed about which channels and patterns the reactor has subscribers for.
+class Subscriptions {
+public:
+    Subscriptions(PubSub& pubsub, size_t reactor)
+        : pubsub_(pubsub)
+        , reactor_(reactor)
+    {
+    }
+    ~Subscriptions();
+
+    Subscriptions(const Subscriptions&) = delete;
+    Subscriptions& operator=(const Subscriptions&) = delete;
+
+    PubSub& pubsub() { return pubsub_; }
+    size_t reactor() const { return reactor_; }
+
+    // Both return the number of channels and patterns the client is subscribed to after.
+    size_t subscribe(uint64_t client, std::string_view target, bool pattern);
+    size_t unsubscribe(uint64_t client, std::string_view target, bool pattern);
+    // The channels or patterns of the client, eg: for an UNSUBSCRIBE without arguments.
+    std::vector<std::string> targets(uint64_t client, bool pattern) const;
+    // Channels plus patterns the client is subscribed to.
+    size_t count(uint64_t client) const;
+    // Drops all subscriptions of a client that went away.
+    void remove(uint64_t client);
+
+    // The clients a publication goes to.
+    std::span<const uint64_t> subscribers(const Publication& publication) const;
+
+private:
+    struct Client {
+        std::vector<std::string> channels_ {};
+        std::vector<std::string> patterns_ {};
+    };
+    using Registry = std::unordered_map<std::string, std::vector<uint64_t>, detail::StringHash, std::equal_to<>>;
+
+    PubSub& pubsub_;
+    const size_t reactor_ {};
+    Registry channels_ {};
+    Registry patterns_ {};
+    std::unordered_map<uint64_t, Client> clients_ {};
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "CommandExecutor.h"
+#include "CommandHandler.h"
+#include "EventLoop.h"
+#include "OutputQueue.h"
+#include "ServerContext.h"
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// Per client state, owned by the reactor that accepted the client.
+struct Connection {
+    int fd_ {};
+    // Bytes received but not consumed yet. A frame split over several reads stays
+    // here until the rest of it arrives.
+    std::vector<char> readBuffer_ {};
+    size_t readLength_ {};
+    // Replies and published messages the socket did not take yet. They are sent when it
+    // becomes writable again, and later output queues behind them.
+    OutputQueue output_ {};
+    // Has published messages queued that are sent after all of them are delivered.
+    bool delivering_ {};
+    std::optional<CommandHandler::FollowerRequest> followerRequest_ {};
+};
+
+// An edge-triggered epoll event loop. The server runs one reactor per thread and
+// every reactor owns its own SO_REUSEPORT listener, so the kernel spreads new
+// connections across the reactors and a client stays on one thread for its lifetime.
+class Reactor : public EventLoop {
+public:
+    Reactor(int listener, const ServerContext& context);
+    ~Reactor() override;
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    void run() override;
+
+private:
+    void acceptClients();
+    ClientState handleClient(Connection& connection);
+    ClientState handleInput(Connection& connection);
+    ClientState sendReplies(Connection& connection);
+    ClientState flushOutput(Connection& connection);
+    void onTimer();
+    // Queues the messages published since the last batch on the connections of their
+    // subscribers and sends them.
+    void deliverPublications();
+    void disconnect(int fd);
+    // Hands the connection over to replication, which sends the stream to it from now on.
+    void attachFollower(Connection& connection);
+
+    int listener_ {};
+    int epollFd_ {};
+    // Fires every tick to run the periodic work, e.g. the active key expiry.
+    int timerFd_ {};
+    // Signaled when messages were published for the subscribers of this reactor.
+    int wakeFd_ {};
+    CommandExecutor executor_;
+    std::unordered_map<int, Connection> connections_ {};
+};
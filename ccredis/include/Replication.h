@@ -0,0 +1,195 @@
+#pragma once
+
+#include "Database.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class AppendOnlyFile;
+
+// The last bytes of the replication stream, in a ring buffer. Offsets count the bytes of
+// the stream since it started, so a follower that reconnects can tell where it stopped.
+// Not thread safe.
+class ReplicationBacklog {
+public:
+    explicit ReplicationBacklog(size_t capacity)
+        : buffer_(capacity)
+    {
+    }
+
+    // Overwrites the oldest bytes once the backlog is full.
+    void append(std::string_view bytes);
+    // Appends up to max bytes of the stream from offset on to out. Returns false if the
+    // bytes at offset were overwritten already or are not in the stream yet.
+    bool copy(uint64_t offset, size_t max, std::string& out) const;
+
+    // The offset of the oldest byte held, and the offset after the newest one.
+    uint64_t startOffset() const { return end_ - size_; }
+    uint64_t endOffset() const { return end_; }
+    size_t capacity() const { return buffer_.size(); }
+
+private:
+    std::vector<char> buffer_ {};
+    uint64_t end_ {};
+    size_t size_ {};
+};
+
+struct ReplicationStats {
+    size_t followers_ {};
+    size_t fullSyncs_ {};
+    size_t partialSyncs_ {};
+    // Followers disconnected because they fell behind the backlog.
+    size_t droppedFollowers_ {};
+};
+
+// The leader side of replication: every write of the Db is fed, encoded like in the
+// append only file, into the backlog, and every follower has a thread that sends the
+// backlog on from the offset it has reached. Writers only copy into the backlog, so a
+// slow follower never holds them up; one that falls further behind than the backlog is
+// disconnected and needs a full sync when it comes back.
+//
+// A full sync sends a snapshot, copied one shard at a time like BGSAVE, and then the
+// stream from the offset the first shard was copied at. The stream offset when every
+// shard was copied goes along with the snapshot, and the follower skips the writes to a
+// shard made before its copy: they are in the snapshot already, and a push applied twice
+// would duplicate its elements.
+class ReplicationLeader {
+public:
+    ReplicationLeader(std::shared_ptr<const Db> db, size_t backlogSize);
+    ~ReplicationLeader();
+
+    ReplicationLeader(const ReplicationLeader&) = delete;
+    ReplicationLeader& operator=(const ReplicationLeader&) = delete;
+
+    // Whether writes need to be fed, ie. a follower ever attached. Read under the shard
+    // lock of the write, which orders it with the start of a full sync.
+    bool streaming() const { return streaming_.load(std::memory_order_relaxed); }
+    // Thread safe. Call from the write hook with the encoded write, under the shard lock.
+    void feed(std::string_view command);
+
+    // Takes over fd, a connection that sent PSYNC replid offset, and serves it on a thread
+    // of its own. Resumes the stream at offset if it is still in the backlog of this
+    // stream, and starts with a full sync otherwise.
+    void attach(int fd, std::string replid, int64_t offset);
+    // Closes the connections to the followers. They reconnect and resume the stream.
+    void disconnectFollowers();
+    // Disconnects the followers and starts a new stream with a new id, for when the
+    // keyspace is replaced by a sync from another leader.
+    void reset();
+
+    std::string replid() const;
+    uint64_t offset() const;
+    ReplicationStats stats() const;
+
+private:
+    // Closes the connection once the thread serving it has returned.
+    struct Follower {
+        ~Follower();
+
+        int fd_ { -1 };
+        std::atomic<bool> done_ {};
+        std::jthread thread_ {};
+    };
+
+    void serve(std::stop_token stop, Follower& follower, std::string replid, int64_t offset);
+    // Starts the stream of follower with a full sync. Returns the offset the stream
+    // continues from, or nothing if the connection failed.
+    std::optional<uint64_t> fullSync(Follower& follower);
+
+    std::shared_ptr<const Db> db_ {};
+    const size_t backlogSize_ {};
+    std::atomic<bool> streaming_ {};
+
+    mutable std::mutex mutex_ {};
+    std::condition_variable_any fed_ {};
+    std::string replid_ {};
+    ReplicationBacklog backlog_ { 0 };
+    ReplicationStats stats_ {};
+    std::list<Follower> followers_ {};
+};
+
+// The follower side: a thread that connects to the leader, asks for the stream with
+// PSYNC and applies the writes it receives to the Db. After a disconnect it reconnects
+// and asks to resume from the offset it reached, so a short outage costs only the writes
+// made meanwhile.
+class ReplicationFollower {
+public:
+    ReplicationFollower(std::shared_ptr<Db> db, std::shared_ptr<AppendOnlyFile> aof, std::string host, std::string port);
+    ~ReplicationFollower();
+
+    ReplicationFollower(const ReplicationFollower&) = delete;
+    ReplicationFollower& operator=(const ReplicationFollower&) = delete;
+
+    const std::string& host() const { return host_; }
+    const std::string& port() const { return port_; }
+    bool linkUp() const { return linkUp_.load(); }
+    // The offset in the stream of the leader up to which the writes were applied.
+    uint64_t offset() const { return offset_.load(); }
+
+private:
+    void run(std::stop_token stop);
+    // Syncs over the connection and applies the stream until it fails.
+    void follow(std::stop_token stop, int fd);
+
+    std::shared_ptr<Db> db_ {};
+    std::shared_ptr<AppendOnlyFile> aof_ {};
+    const std::string host_ {};
+    const std::string port_ {};
+
+    // The stream followed, empty before the first sync, and the offsets every shard was
+    // copied at by the last full sync.
+    std::string replid_ {};
+    std::atomic<uint64_t> offset_ {};
+    std::array<uint64_t, Db::numShards> shardOffsets_ {};
+    std::atomic<bool> linkUp_ {};
+
+    // The connection, shut down to stop the thread while it waits on the socket.
+    std::mutex fdMutex_ {};
+    int fd_ { -1 };
+    // Declared last so it stops before the members it uses are destroyed.
+    std::jthread thread_ {};
+};
+
+// The replication state of a server: always a leader that followers may attach to, and
+// a follower of another server after REPLICAOF.
+class Replication {
+public:
+    Replication(std::shared_ptr<Db> db, std::shared_ptr<AppendOnlyFile> aof, size_t backlogSize);
+
+    ReplicationLeader& leader() { return leader_; }
+    const ReplicationLeader& leader() const { return leader_; }
+
+    // Thread safe. Starts following host:port, replacing the keyspace with its own.
+    void replicaOf(std::string host, std::string port);
+    // Thread safe. Stops following and keeps the keyspace as it is.
+    void promote();
+    bool isFollower() const { return following_.load(std::memory_order_relaxed); }
+
+    struct Link {
+        std::string host_ {};
+        std::string port_ {};
+        bool up_ {};
+        uint64_t offset_ {};
+    };
+    // The leader followed, nothing when this server is a leader.
+    std::optional<Link> link() const;
+
+private:
+    std::shared_ptr<Db> db_ {};
+    std::shared_ptr<AppendOnlyFile> aof_ {};
+    ReplicationLeader leader_;
+    std::atomic<bool> following_ {};
+    mutable std::mutex mutex_ {};
+    std::unique_ptr<ReplicationFollower> follower_ {};
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <iosfwd>
 #include <map>
 #include <optional>
@@ -24,4 +25,20 @@ struct RedisRespRes {
 
     friend bool operator==(const RedisRespRes& lhs, const RedisRespRes& rhs);
     friend std::ostream& operator<<(std::ostream& os, const RedisRespRes& resp);
-};
\ No newline at end of file
+};
+
+// One value of a decoded frame. An array or map token is followed by its elements, so a
+// whole frame decodes into a flat sequence of tokens instead of a tree of RedisRespRes.
+// Strings point into the input buffer and integers keep their digits in string_ as well.
+struct RespToken {
+    Prefix type_ {};
+    bool isNull_ {};
+    // Number of elements of an array, or of key/value pairs of a map.
+    uint32_t count_ {};
+    int64_t integer_ {};
+    std::string_view string_ {};
+};
+
+// Reused between frames. Clearing it keeps the capacity, so decoding does not allocate
+// once the arena has grown to the largest frame seen.
+using RespTokenArena = std::vector<RespToken>;
@@ -5,6 +5,7 @@
 #include <map>
 #include <optional>
 #include <ostream>
+#include <span>
 #include <string>
 #include <string_view>
 #include <utility>
@@ -13,12 +14,22 @@
 
 using PayloadT = std::variant<int, std::string_view>;
 struct RedisRespRes;
+struct RespToken;
 
 class RespDecoder {
 public:
     [[nodiscard]] static std::pair<size_t, RedisRespRes> decode(const std::string_view str);
 
+    // Returns the length of the first complete frame in str, or std::nullopt if more bytes
+    // are needed to complete it. Throws std::invalid_argument if the frame is malformed.
+    [[nodiscard]] static std::optional<size_t> frameLength(const std::string_view str);
+
+    // Decodes the first frame in str into tokens, replacing what the arena held before.
+    // Returns the frame length like frameLength. The tokens point into str.
+    [[nodiscard]] static std::optional<size_t> decodeFrame(const std::string_view str, std::vector<RespToken>& tokens);
+
     static std::vector<CommandVariant> convertToCommands(const RedisRespRes& rawCommands);
+    static CommandVariant convertToCommand(std::span<const RespToken> frame);
 
 private:
     void appendCRLF();
@@ -29,7 +40,8 @@ private:
     static std::pair<size_t, RedisRespRes> decodeBulkString(const std::string_view str);
     static std::pair<size_t, RedisRespRes> decodeArray(const std::string_view str);
     static std::pair<size_t, RedisRespRes> decodeMap(const std::string_view str);
+    static std::optional<size_t> decodeTokens(const std::string_view str, std::vector<RespToken>* tokens);
 
     static CommandVariant parseRawCommand(const std::string_view rawCommand);
-    static CommandVariant parseRawArrayCommands(const std::vector<RedisRespRes>& commandArray);
+    static CommandVariant parseRawArrayCommands(std::span<const RespToken> frame);
 };
\ No newline at end of file
@@ -1,30 +1,69 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <span>
+#include <string>
 #include <string_view>
+#include <sys/uio.h>
 #include <vector>
 
 class Db;
 
+// Encodes replies into a buffer that is reused between batches. Values that the encoder
+// can take ownership of and that are at least minReferencedSize long are not copied into
+// the buffer; the output refers to them in place and is sent as a list of segments with
+// one writev (sendmsg).
 class RespEncoder {
 public:
-    RespEncoder() = default;
+    static constexpr size_t minReferencedSize = 4 * 1024;
+
+    RespEncoder() { buffer.reserve(initialCapacity); }
     // RespEncoder(const std::shared_ptr<Db>& db) : db_(db) {}
     void appendSimpleString(const std::string_view str);
     void appendError(const std::string_view str);
     void appendInt(const std::string_view n);
+    void appendInt(const int64_t n);
     void appendBulkstring(const std::string_view str);
+    // Takes the value over, so that a large one can be sent from where it is.
+    void appendOwnedBulkstring(std::string&& str);
     void appendNull();
+    // The null array, e.g. the reply of an EXEC that failed.
+    void appendNullArray();
     void beginArray(const unsigned numElements);
     void beginMap(const unsigned numElements);
     void appendKV(const std::string_view key, const std::string_view val);
     void appendKV(const std::string_view key, const int val);
 
+    // The output as segments for writev: runs of the buffer interleaved with the values
+    // referred to in place. Valid until the next append or clear.
+    std::span<const iovec> segments();
+    // Length of the whole output.
+    size_t size() const { return buffer.size() + referencedBytes_; }
+    bool empty() const { return size() == 0; }
+
+    // The bytes encoded into the buffer, which is all of the output unless values were
+    // referred to in place.
     const std::vector<char>& getBuffer() const;
-    void clearBuffer() { buffer.clear(); }
+    void clearBuffer();
 
 private:
+    static constexpr size_t initialCapacity = 16 * 1024;
+    // A buffer that grew past this for a large batch is shrunk back when it is cleared.
+    static constexpr size_t maxRetainedCapacity = 1024 * 1024;
+
+    // A value that belongs in the output at offset_ of the buffer.
+    struct Reference {
+        size_t offset_ {};
+        std::string value_ {};
+    };
+
     void appendCRLF();
     void appendChars(const std::string_view str);
+    void appendHeader(const char prefix, const int64_t n);
     std::vector<char> buffer {};
-};
\ No newline at end of file
+    std::vector<Reference> references_ {};
+    size_t referencedBytes_ {};
+    std::vector<iovec> segments_ {};
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Commands.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct CommandSpec;
+
+// A script is a list of steps, each one a command with its arguments, separated by ; or
+// new lines. Arguments are separated by spaces; KEYS[n] and ARGV[n] stand for the n-th
+// key and argument given to EVAL, counting from 1. A step that starts with IF n runs
+// only if the reply of step n was true, and one that starts with UNLESS n only if it was
+// false; an error, a null, 0 and an empty array are false. For example
+//
+//   GET KEYS[1]; IF 1 INCR KEYS[2]; SET KEYS[3] ARGV[1]
+//
+// The script is compiled once: the commands are looked up and their arguments counted,
+// and steps without KEYS or ARGV are parsed up front, so running it only fills in the
+// keys and arguments and calls the parsers of the commands. It runs like a transaction,
+// under the locks of every shard its commands use, and replies with an array of the
+// reply of every step, null for those that did not run.
+class Script {
+public:
+    struct Guard {
+        // The index of the earlier step whose reply decides.
+        size_t step_ {};
+        // Whether the step runs when that reply is true or when it is false.
+        bool runsIfTrue_ {};
+    };
+
+    // Compiles source, failing if a step names an unknown command, one a script may not
+    // run or has the wrong number of arguments.
+    static std::expected<std::shared_ptr<const Script>, std::string> compile(std::string_view source);
+
+    const std::string& sha() const { return sha_; }
+    size_t size() const { return steps_.size(); }
+    const std::optional<Guard>& guard(const size_t step) const { return steps_[step].guard_; }
+
+    // Sets commands to those of the steps, KEYS and ARGV replaced by keys and args. They
+    // refer into the script, keys and args. Fails if the script uses more keys or
+    // arguments than given.
+    std::expected<void, std::string> instantiate(std::span<const std::string_view> keys, std::span<const std::string_view> args,
+        std::vector<CommandVariant>& commands) const;
+
+private:
+    struct Argument {
+        enum class Kind {
+            Literal,
+            Key,
+            Arg
+        };
+        Kind kind_ {};
+        std::string_view literal_ {};
+        // Of the key or argument, counting from 0.
+        size_t index_ {};
+    };
+    struct Step {
+        std::optional<Guard> guard_ {};
+        const CommandSpec* spec_ {};
+        // After the command name.
+        std::vector<Argument> arguments_ {};
+        // Set for a step without KEYS or ARGV.
+        std::optional<CommandVariant> command_ {};
+    };
+
+    Script() = default;
+
+    // The commands refer into the source, so a script does not move once compiled.
+    std::string source_ {};
+    std::string sha_ {};
+    std::vector<Step> steps_ {};
+    size_t numKeys_ {};
+    size_t numArgs_ {};
+};
+
+// The scripts that were loaded, by SHA1. Thread safe; shared by all reactors.
+class ScriptCache {
+public:
+    // The script of source, compiled and cached if it is not yet.
+    std::expected<std::shared_ptr<const Script>, std::string> load(std::string_view source);
+    // Null if no script has the SHA1.
+    std::shared_ptr<const Script> find(std::string_view sha) const;
+    void flush();
+
+private:
+    struct StringHash {
+        using is_transparent = void;
+        size_t operator()(const std::string_view str) const { return std::hash<std::string_view> {}(str); }
+    };
+
+    mutable std::shared_mutex mutex_ {};
+    std::unordered_map<std::string, std::shared_ptr<const Script>, StringHash, std::equal_to<>> scripts_ {};
+};
+
+// Whether a reply encoded at the start of bytes is true for IF and UNLESS.
+bool isTrueReply(std::string_view bytes);
@@ -1,42 +1,28 @@
 #pragma once
 
-#include "CommandHandler.h"
-#include "RespDecoder.h"
-#include "RespEncoder.h"
-#include <algorithm>
+#include "Config.h"
+#include "EventLoop.h"
+#include "ServerContext.h"
+
 #include <cassert>
 #include <memory>
 #include <string_view>
 #include <vector>
 
-struct pollfd;
-
-enum class ClientState {
-    Disconnected,
-    Connected
-};
-
-class RespDecoder;
-class RespEncoder;
-class Db;
-
 class RedisServer {
 public:
-    RedisServer(std::shared_ptr<Db>&& db)
-        : db_(std::move(db))
-    {
-        assert(db_);
-        commandHandler_ = CommandHandler { &respEncoder_, db_ };
-    }
+    // The context must hold a Db; the persistence members may be null.
+    RedisServer(ServerContext&& context, const ServerConfig& config = {});
 
+    // Starts one reactor per thread and blocks. The calling thread runs the first reactor.
     void start(std::string_view port);
 
 private:
-    ClientState handleClient(const int clientFd);
-    void handleInput(int clientFd, const std::string_view str);
-    std::vector<pollfd> fds_ {};
-    RespDecoder respDecoder_ {};
-    RespEncoder respEncoder_ {};
-    CommandHandler commandHandler_;
-    std::shared_ptr<Db> db_ {};
+    // A reactor on the configured backend, or on epoll when io_uring is not available.
+    std::unique_ptr<EventLoop> createReactor(int listener);
+
+    ServerContext context_ {};
+    unsigned numThreads_ {};
+    IoBackend ioBackend_ {};
+    std::vector<std::unique_ptr<EventLoop>> reactors_ {};
 };
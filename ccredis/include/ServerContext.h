@@ -0,0 +1,23 @@
+#pragma once
+
+#include <memory>
+
+class AppendOnlyFile;
+class CommandMetrics;
+class Db;
+class PubSub;
+class Replication;
+class ScriptCache;
+class Snapshotter;
+
+// What the reactors of a server share.
+struct ServerContext {
+    std::shared_ptr<Db> db_ {};
+    // Null when the feature is disabled.
+    std::shared_ptr<Snapshotter> snapshotter_ {};
+    std::shared_ptr<AppendOnlyFile> aof_ {};
+    std::shared_ptr<Replication> replication_ {};
+    std::shared_ptr<CommandMetrics> metrics_ {};
+    std::shared_ptr<PubSub> pubsub_ {};
+    std::shared_ptr<ScriptCache> scripts_ {};
+};
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// The SHA1 digest of data as 40 lower case hex digits, which is how EVALSHA addresses a
+// script, as in Redis.
+std::string sha1Hex(std::string_view data);
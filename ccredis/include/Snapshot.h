@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+class Db;
+
+// A snapshot is a binary dump of the keyspace, written to a temporary file that is
+// renamed over the old snapshot once complete, so a crash never leaves a torn file.
+//
+//   "CCRDB001"                                     magic and format version
+//   per key: u8 type, [i64 expire], u32 length, key, value
+//            type 0 is a string, 2 a hash, 4 a list and 6 a set; the odd types 1, 3,
+//            5 and 7 have the expire time in unix milliseconds
+//            a string value is u32 length, bytes
+//            a collection is u32 count, then count strings (count fields and values
+//            alternating for a hash), each u32 length, bytes
+//   u8 0xFF, u64 number of keys, u64 checksum of all bytes before the checksum
+//
+// Integers are stored little endian.
+
+// Writes a snapshot of db to path. Every shard is copied under its read lock and written
+// after the lock is released, so the snapshot is consistent per shard, not across shards.
+// Returns the number of keys written.
+std::expected<size_t, std::string> saveSnapshot(const Db& db, const std::string& path);
+
+// Loads the snapshot at path into db. Keys that expired while the server was down are
+// skipped. Returns the number of keys loaded, which is 0 when there is no snapshot.
+std::expected<size_t, std::string> loadSnapshot(Db& db, const std::string& path);
+
+// Encodes a snapshot of db in memory, byte for byte what saveSnapshot writes. Calls
+// shardCopied(shard) after the keys of each shard are copied, while its read lock is still
+// held, so a write to the shard is either in the snapshot or made after the call.
+std::string encodeSnapshot(const Db& db, const std::function<void(size_t shard)>& shardCopied = {});
+
+// Loads a snapshot encoded by encodeSnapshot into db, like loadSnapshot.
+std::expected<size_t, std::string> decodeSnapshot(Db& db, std::string_view bytes);
+
+// Runs SAVE and BGSAVE for the server. At most one save runs at a time.
+class Snapshotter {
+public:
+    Snapshotter(const std::shared_ptr<Db>& db, std::string path)
+        : db_(db)
+        , path_(std::move(path))
+    {
+    }
+
+    Snapshotter(const Snapshotter&) = delete;
+    Snapshotter& operator=(const Snapshotter&) = delete;
+
+    // Saves on the calling thread.
+    std::expected<size_t, std::string> save();
+    // Saves on a background thread. Returns false if a save is already running.
+    bool startBackgroundSave();
+
+    bool backgroundSaveInProgress() const { return inProgress_.load(); }
+    bool lastSaveSucceeded() const { return lastSaveOk_.load(); }
+    // Unix time in seconds of the last successful save, 0 if there was none.
+    int64_t lastSaveTime() const { return lastSaveTime_.load(); }
+
+private:
+    std::expected<size_t, std::string> saveAndRecord();
+
+    std::shared_ptr<Db> db_ {};
+    std::string path_ {};
+    // Set while any save runs, in the foreground or the background.
+    std::atomic<bool> saving_ {};
+    std::atomic<bool> inProgress_ {};
+    std::atomic<bool> lastSaveOk_ { true };
+    std::atomic<int64_t> lastSaveTime_ {};
+    std::mutex workerMutex_ {};
+    // Declared last so it is joined before the members it uses are destroyed.
+    std::jthread worker_ {};
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Commands.h"
+#include "Database.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// What a client started with MULTI or WATCH. Commands are queued without touching the
+// Db; EXEC checks the watched keys and runs the queue under the locks of every shard it
+// uses.
+struct Transaction {
+    // Set by MULTI; until EXEC or DISCARD the commands are queued instead of run.
+    bool queuing_ {};
+    // A command could not be queued, so EXEC discards the transaction.
+    bool aborted_ {};
+    // Copies of the frames the queued commands refer into, as the input of the
+    // connection is reused. A deque so they do not move.
+    std::deque<std::string> frames_ {};
+    std::vector<CommandVariant> commands_ {};
+    std::vector<std::pair<std::string, KeyVersion>> watched_ {};
+};
+
+// The transactions of the clients of one reactor. Only that reactor uses it.
+class Transactions {
+public:
+    // Null if the client has neither sent MULTI nor watches a key.
+    Transaction* find(uint64_t client);
+    Transaction& get(uint64_t client) { return clients_[client]; }
+    bool queuing(uint64_t client) const;
+    // Keeps a copy of a frame of the client for a command to be queued to refer to.
+    std::string_view store(uint64_t client, std::string_view frame);
+    // Ends the transaction of the client, handing it over for EXEC.
+    Transaction take(uint64_t client);
+    void remove(uint64_t client) { clients_.erase(client); }
+
+private:
+    std::unordered_map<uint64_t, Transaction> clients_ {};
+};
+
+// Whether a command is run right away while a transaction is queued: the commands that
+// control the transaction itself.
+bool controlsTransaction(const CommandVariant& command);
+// Whether the command at index of CommandVariant may be queued. Those that hand the
+// connection over, wait for other threads or lock shards of their own are not.
+bool allowedInTransaction(size_t index);
+inline bool allowedInTransaction(const CommandVariant& command)
+{
+    return allowedInTransaction(command.index());
+}
+// The shards the command uses, for EXEC to lock. Db::allShards for one whose keys are
+// not known up front, such as INFO which reads every shard.
+uint64_t shardsOf(const CommandVariant& command);
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "CommandExecutor.h"
+#include "CommandHandler.h"
+#include "EventLoop.h"
+#include "IoUring.h"
+#include "OutputQueue.h"
+#include "ServerContext.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <linux/time_types.h>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <sys/socket.h>
+#include <unordered_map>
+#include <vector>
+
+// Per client state of the io_uring reactor.
+struct UringConnection {
+    int fd_ {};
+    // Bytes of an incomplete frame, kept until the rest of it arrives.
+    std::vector<char> readBuffer_ {};
+    // Replies and published messages handed to the kernel, which owns them until the
+    // send completes.
+    OutputQueue sending_ {};
+    msghdr message_ {};
+    // Output collected while a send is in flight. It goes out with the next one.
+    OutputQueue pending_ {};
+    // Whether the multishot receive is armed; it ends with a completion without
+    // IORING_CQE_F_MORE.
+    bool receiving_ {};
+    // Queued for the sends at the end of the batch of completions.
+    bool flushQueued_ {};
+    // Closed once the replies are sent and no request refers to the connection anymore.
+    bool closing_ {};
+    std::optional<CommandHandler::FollowerRequest> followerRequest_ {};
+};
+
+// A reactor on io_uring, selected with --io-backend io_uring. Rather than a syscall per
+// accept, recv and send, a multishot accept keeps accepting and every client has a
+// multishot receive armed once, which takes a buffer from a ring of provided buffers
+// only when data arrives. Replies go out in one send per client and batch, and all
+// submissions of a batch of completions are made in the single io_uring_enter that waits
+// for the next batch. Like the epoll reactor, it owns its SO_REUSEPORT listener.
+class UringReactor : public EventLoop {
+public:
+    // Returns why the kernel cannot run the reactor, eg: io_uring disabled or older
+    // than 6.0, which lacks multishot receives; the server uses epoll then.
+    static std::expected<std::unique_ptr<UringReactor>, std::string> create(int listener, const ServerContext& context);
+    ~UringReactor() override;
+
+    UringReactor(const UringReactor&) = delete;
+    UringReactor& operator=(const UringReactor&) = delete;
+
+    void run() override;
+
+private:
+    // What a completion belongs to, in the top byte of its user data. The rest holds the
+    // id of the connection, which unlike the fd is never reused.
+    enum class Operation : uint8_t {
+        Accept = 1,
+        Receive,
+        Send,
+        Timeout,
+        Cancel,
+        Wake
+    };
+
+    UringReactor(int listener, const ServerContext& context, std::unique_ptr<IoUring> ring,
+        std::unique_ptr<BufferRing> buffers);
+
+    void armAccept();
+    void armReceive(uint64_t id, UringConnection& connection);
+    void armTimeout();
+    void armWake();
+    void startSend(uint64_t id, UringConnection& connection);
+
+    void handleCompletion(const io_uring_cqe& cqe);
+    void onAccept(const io_uring_cqe& cqe);
+    void onReceive(uint64_t id, const io_uring_cqe& cqe);
+    void onSend(uint64_t id, const io_uring_cqe& cqe);
+    // Executes what arrived and moves the replies over to the connection.
+    void handleInput(uint64_t id, UringConnection& connection, std::span<const char> data);
+    // Queues the messages published since the last batch on the connections of their
+    // subscribers, which send them with their replies.
+    void deliverPublications();
+    // Sends the replies collected during a batch, after they are durable.
+    void flushReplies();
+    void queueFlush(uint64_t id, UringConnection& connection);
+    // Stops receiving from the connection, which is closed once its sends completed.
+    void closeClient(uint64_t id, UringConnection& connection);
+    // Closes the connection, or hands it over to replication, once nothing is in flight.
+    void release(uint64_t id);
+
+    int listener_ {};
+    std::unique_ptr<IoUring> ring_ {};
+    std::unique_ptr<BufferRing> buffers_ {};
+    // Signaled when messages were published for the subscribers of this reactor.
+    int wakeFd_ {};
+    uint64_t wakeups_ {};
+    CommandExecutor executor_;
+    __kernel_timespec tick_ {};
+    uint64_t nextId_ { 1 };
+    std::unordered_map<uint64_t, UringConnection> connections_ {};
+    std::vector<uint64_t> flushQueue_ {};
+};
@@ -0,0 +1,476 @@
+#include "AppendOnlyFile.h"
+
+#include "Commands.h"
+#include "Database.h"
+#include "Log.h"
+#include "Resp.h"
+#include "RespDecoder.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <expected>
+#include <fcntl.h>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <variant>
+#include <vector>
+
+namespace {
+// Keys are handed to the Db in batches of this size while replaying.
+constexpr size_t replayBatchSize = 64 * 1024;
+
+std::unexpected<std::string> systemError(const std::string& what)
+{
+    return std::unexpected { what + ": " + std::strerror(errno) };
+}
+
+bool writeAll(const int fd, const std::string_view bytes)
+{
+    size_t written = 0;
+    while (written < bytes.size()) {
+        const auto n = write(fd, bytes.data() + written, bytes.size() - written);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+// Collections are rewritten in commands of at most this many elements.
+constexpr size_t rewriteChunkSize = 64;
+
+void appendBulk(std::string& out, const std::string_view str)
+{
+    char length[24];
+    const auto end = std::to_chars(std::begin(length), std::end(length), str.size()).ptr;
+    out += '$';
+    out.append(length, end);
+    out += "\r\n";
+    out.append(str);
+    out += "\r\n";
+}
+
+// SET key value [PXAT unix-milliseconds]
+void encodeSet(std::string& out, const KeyT key, const ValueType& value)
+{
+    out += value.expire_.has_value() ? "*5\r\n" : "*3\r\n";
+    appendBulk(out, "SET");
+    appendBulk(out, key);
+    ValueType::IntChars chars {};
+    appendBulk(out, value.view(chars));
+    if (value.expire_.has_value()) {
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            value.expire_->time_since_epoch())
+                            .count();
+        char digits[24];
+        const auto end = std::to_chars(std::begin(digits), std::end(digits), ms).ptr;
+        appendBulk(out, "PXAT");
+        appendBulk(out, { digits, end });
+    }
+}
+
+void encodeDel(std::string& out, const KeyT key)
+{
+    out += "*2\r\n";
+    appendBulk(out, "DEL");
+    appendBulk(out, key);
+}
+
+void appendArrayHeader(std::string& out, const size_t size)
+{
+    char length[24];
+    const auto end = std::to_chars(std::begin(length), std::end(length), size).ptr;
+    out += '*';
+    out.append(length, end);
+    out += "\r\n";
+}
+
+void encodeCommand(std::string& out, const std::span<const std::string_view> command)
+{
+    appendArrayHeader(out, command.size());
+    for (const auto arg : command) {
+        appendBulk(out, arg);
+    }
+}
+
+// Encodes the elements of a collection as name key element... commands of at most
+// rewriteChunkSize elements each. forEach(f) calls f with the arguments of one element.
+template <typename ForEach>
+void encodeChunked(std::string& out, const std::string_view name, const KeyT key, const size_t argsPerElement, const size_t size, ForEach&& forEach)
+{
+    size_t remaining = size;
+    size_t inChunk = 0;
+    const auto element = [&](const auto... args) {
+        if (inChunk == 0) {
+            appendArrayHeader(out, 2 + argsPerElement * std::min(remaining, rewriteChunkSize));
+            appendBulk(out, name);
+            appendBulk(out, key);
+        }
+        (appendBulk(out, args), ...);
+        --remaining;
+        inChunk = (inChunk + 1) % rewriteChunkSize;
+    };
+    forEach(element);
+}
+
+// The commands that recreate a key in a rewrite.
+void encodeValue(std::string& out, const KeyT key, const ValueType& value)
+{
+    if (const auto* hash = value.as<HashValue>()) {
+        encodeChunked(out, "HSET", key, 2, hash->size(), [hash](const auto& element) {
+            hash->forEach([&element](const std::string_view field, const std::string_view value) { element(field, value); });
+        });
+    } else if (const auto* list = value.as<ListValue>()) {
+        encodeChunked(out, "RPUSH", key, 1, list->size(), [list](const auto& element) { list->forEach(element); });
+    } else if (const auto* set = value.as<SetValue>()) {
+        encodeChunked(out, "SADD", key, 1, set->size(), [set](const auto& element) { set->forEach(element); });
+    } else {
+        encodeSet(out, key, value);
+    }
+}
+
+class MappedFile {
+public:
+    MappedFile(const void* data, const size_t size)
+        : data_(data)
+        , size_(size)
+    {
+    }
+    ~MappedFile() { munmap(const_cast<void*>(data_), size_); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view bytes() const { return { static_cast<const char*>(data_), size_ }; }
+
+private:
+    const void* data_ {};
+    size_t size_ {};
+};
+} // namespace
+
+void encodeWrite(std::string& out, const KeyT key, const ValueType* value, const std::span<const std::string_view> command)
+{
+    if (!command.empty()) {
+        encodeCommand(out, command);
+    } else if (value != nullptr) {
+        encodeSet(out, key, *value);
+    } else {
+        encodeDel(out, key);
+    }
+}
+
+bool applyWrite(Db& db, const CommandVariant& command)
+{
+    if (const auto* set = std::get_if<CommandSet>(&command)) {
+        if (set->expire.has_value()) {
+            db.set(set->key_, set->value_, set->expire.value());
+        } else {
+            db.set(set->key_, set->value_);
+        }
+    } else if (const auto* del = std::get_if<CommandDel>(&command)) {
+        db.removeMany(del->keys_);
+    } else if (const auto* hset = std::get_if<CommandHset>(&command)) {
+        db.hashSet(hset->key_, hset->fields_);
+    } else if (const auto* lpush = std::get_if<CommandLpush>(&command)) {
+        db.listPush(lpush->key_, lpush->values_, Db::ListEnd::Front);
+    } else if (const auto* rpush = std::get_if<CommandRpush>(&command)) {
+        db.listPush(rpush->key_, rpush->values_, Db::ListEnd::Back);
+    } else if (const auto* sadd = std::get_if<CommandSadd>(&command)) {
+        db.setAdd(sadd->key_, sadd->members_);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::expected<std::shared_ptr<AppendOnlyFile>, std::string>
+AppendOnlyFile::open(const std::string& path, const FsyncPolicy policy)
+{
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return systemError("open " + path);
+    }
+    struct stat info {};
+    if (fstat(fd, &info) == -1) {
+        const auto error = systemError("stat " + path);
+        close(fd);
+        return error;
+    }
+    return std::shared_ptr<AppendOnlyFile> { new AppendOnlyFile { path, fd, policy, static_cast<uint64_t>(info.st_size) } };
+}
+
+AppendOnlyFile::AppendOnlyFile(std::string path, const int fd, const FsyncPolicy policy, const uint64_t size)
+    : path_(std::move(path))
+    , policy_(policy)
+    , fd_(fd)
+    , size_(size)
+{
+    flusher_ = std::jthread { [this](std::stop_token stop) { flushLoop(stop); } };
+}
+
+AppendOnlyFile::~AppendOnlyFile()
+{
+    if (rewriter_.joinable()) {
+        rewriter_.join();
+    }
+    // The flusher writes out what is left before it returns.
+    flusher_.request_stop();
+    flusher_.join();
+    close(fd_);
+}
+
+void AppendOnlyFile::logWrite(const KeyT key, const ValueType* value, const std::span<const std::string_view> command)
+{
+    thread_local std::string encoded {};
+    encoded.clear();
+    encodeWrite(encoded, key, value, command);
+    append(key, encoded);
+}
+
+void AppendOnlyFile::append(const KeyT key, const std::string_view command)
+{
+    std::lock_guard lock { mutex_ };
+    const bool wasEmpty = buffer_.empty();
+    buffer_.append(command);
+    appendedOffset_ += command.size();
+    size_ += command.size();
+    // A write to a shard the rewrite has yet to copy reaches the new file with the copy.
+    if (rewriting_ && Db::shardOf(key) < rewrittenShards_) {
+        rewriteBuffer_.append(command);
+    }
+    // The flusher drains everything appended until it gets to run, so only the first
+    // append of a batch needs to wake it.
+    if (wasEmpty) {
+        appended_.notify_one();
+    }
+}
+
+void AppendOnlyFile::awaitFsync()
+{
+    if (policy_ != FsyncPolicy::Always) {
+        return;
+    }
+    std::unique_lock lock { mutex_ };
+    const auto target = appendedOffset_;
+    flushed_.wait(lock, [this, target]() { return syncedOffset_ >= target; });
+}
+
+void AppendOnlyFile::flushLoop(std::stop_token stop)
+{
+    using namespace std::chrono;
+    std::string batch {};
+    auto lastFsync = steady_clock::now();
+    uint64_t writtenOffset = 0;
+    uint64_t fsyncedOffset = 0;
+    while (true) {
+        {
+            std::unique_lock lock { mutex_ };
+            // Wakes up at least once a second for the everysec fsync.
+            appended_.wait_for(lock, stop, seconds { 1 }, [this]() { return !buffer_.empty(); });
+        }
+        const bool stopping = stop.stop_requested();
+
+        std::lock_guard fileLock { fileMutex_ };
+        {
+            std::lock_guard lock { mutex_ };
+            batch.swap(buffer_);
+            writtenOffset = appendedOffset_;
+        }
+        if (!batch.empty() && !writeAll(fd_, batch)) {
+            LOG_ERROR("write append only file: ", std::strerror(errno));
+        }
+        batch.clear();
+
+        const auto now = steady_clock::now();
+        const bool fsyncDue = policy_ == FsyncPolicy::Always
+            || (policy_ == FsyncPolicy::EverySecond && (now - lastFsync >= seconds { 1 } || stopping));
+        if (fsyncDue && fsyncedOffset < writtenOffset) {
+            if (fdatasync(fd_) == -1) {
+                LOG_ERROR("fdatasync append only file: ", std::strerror(errno));
+            }
+            fsyncedOffset = writtenOffset;
+            lastFsync = now;
+        }
+        {
+            std::lock_guard lock { mutex_ };
+            syncedOffset_ = std::max(syncedOffset_, writtenOffset);
+        }
+        flushed_.notify_all();
+
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+bool AppendOnlyFile::startRewrite(const std::shared_ptr<const Db>& db)
+{
+    {
+        std::lock_guard lock { mutex_ };
+        if (rewriting_) {
+            return false;
+        }
+        rewriting_ = true;
+        rewriteBuffer_.clear();
+        rewrittenShards_ = 0;
+    }
+    // The previous rewrite has finished; assigning joins it.
+    rewriter_ = std::jthread { [this, db]() { rewrite(db); } };
+    return true;
+}
+
+void AppendOnlyFile::rewrite(const std::shared_ptr<const Db>& db)
+{
+    const auto tmpPath = path_ + ".rewrite";
+    const int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    bool ok = fd != -1;
+    uint64_t size = 0;
+    std::string chunk {};
+    for (size_t shard = 0; shard < Db::numShards && ok; ++shard) {
+        chunk.clear();
+        // Moves the cursor while the shard is still locked, so every write to it is either
+        // in the copy or collected in rewriteBuffer_.
+        db->forEachInShard(
+            shard, [&chunk](const std::string_view key, const ValueType& value) { encodeValue(chunk, key, value); },
+            [this, shard]() {
+                std::lock_guard lock { mutex_ };
+                rewrittenShards_ = shard + 1;
+            });
+        ok = writeAll(fd, chunk);
+        size += chunk.size();
+    }
+    // Catch up with the writes made meanwhile without blocking the writers, so that
+    // little is left to copy under the locks.
+    if (ok) {
+        chunk.clear();
+        {
+            std::lock_guard lock { mutex_ };
+            chunk.swap(rewriteBuffer_);
+        }
+        ok = writeAll(fd, chunk);
+        size += chunk.size();
+    }
+
+    std::lock_guard fileLock { fileMutex_ };
+    std::lock_guard lock { mutex_ };
+    if (ok) {
+        ok = writeAll(fd, rewriteBuffer_) && fdatasync(fd) == 0 && rename(tmpPath.c_str(), path_.c_str()) == 0;
+        size += rewriteBuffer_.size();
+    }
+    if (ok) {
+        // Whatever is still buffered is in the new file already.
+        buffer_.clear();
+        syncedOffset_ = appendedOffset_;
+        close(fd_);
+        fd_ = fd;
+        size_ = size;
+        flushed_.notify_all();
+    } else {
+        LOG_ERROR("rewrite append only file: ", std::strerror(errno));
+        if (fd != -1) {
+            close(fd);
+            unlink(tmpPath.c_str());
+        }
+    }
+    rewriteBuffer_.clear();
+    lastRewriteOk_ = ok;
+    rewriting_ = false;
+}
+
+std::expected<ReplayStats, std::string> replayAppendOnlyFile(Db& db, const std::string& path)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd == -1) {
+        if (errno == ENOENT) {
+            return ReplayStats {};
+        }
+        return systemError("open " + path);
+    }
+    struct stat info {};
+    if (fstat(fd, &info) == -1) {
+        const auto error = systemError("stat " + path);
+        close(fd);
+        return error;
+    }
+    const auto size = static_cast<size_t>(info.st_size);
+    if (size == 0) {
+        close(fd);
+        return ReplayStats {};
+    }
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        const auto error = systemError("mmap " + path);
+        close(fd);
+        return error;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    const MappedFile file { data, size };
+    const auto input = file.bytes();
+
+    ReplayStats stats {};
+    RespTokenArena tokens {};
+    std::vector<BulkEntry> batch {};
+    batch.reserve(replayBatchSize);
+    size_t consumed = 0;
+    while (consumed < input.size()) {
+        std::optional<size_t> frameLength {};
+        try {
+            frameLength = RespDecoder::decodeFrame(input.substr(consumed), tokens);
+        } catch (const std::invalid_argument& e) {
+            close(fd);
+            return std::unexpected { path + " is corrupt at offset " + std::to_string(consumed) + ": " + e.what() };
+        }
+        if (!frameLength.has_value()) {
+            break;
+        }
+        const auto command = RespDecoder::convertToCommand(tokens);
+        if (const auto* set = std::get_if<CommandSet>(&command)) {
+            batch.push_back(BulkEntry { .key_ = set->key_, .value_ = set->value_, .expire_ = set->expire });
+        } else {
+            // The SETs before it have to be applied first.
+            db.insertBulk(batch);
+            batch.clear();
+            if (!applyWrite(db, command)) {
+                close(fd);
+                return std::unexpected { path + " has an unexpected command at offset " + std::to_string(consumed) };
+            }
+        }
+        if (batch.size() == replayBatchSize) {
+            db.insertBulk(batch);
+            batch.clear();
+        }
+        consumed += frameLength.value();
+        ++stats.commands_;
+    }
+    db.insertBulk(batch);
+
+    if (consumed < input.size()) {
+        // The server stopped in the middle of appending a command.
+        LOG_WARNING("Truncating ", input.size() - consumed, " bytes of an incomplete command at the end of ", path);
+        if (ftruncate(fd, static_cast<off_t>(consumed)) == -1) {
+            const auto error = systemError("truncate " + path);
+            close(fd);
+            return error;
+        }
+    }
+    close(fd);
+    stats.bytes_ = consumed;
+    stats.elapsed_ = std::chrono::steady_clock::now() - start;
+    return stats;
+}
@@ -0,0 +1,169 @@
+#include "CommandExecutor.h"
+
+#include "AppendOnlyFile.h"
+#include "CommandTable.h"
+#include "Commands.h"
+#include "Database.h"
+#include "Log.h"
+#include "PubSub.h"
+#include "Replication.h"
+#include "Transaction.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace {
+// Expiry heap entries every reactor may examine per tick. Bounds the time a tick can
+// take when many keys expire at the same moment; the rest is left for the next tick.
+constexpr size_t expireChecksPerTick = 1000;
+
+// What a client may send once it subscribed to something: more subscriptions, PING.
+// Unknown and malformed commands get their own error.
+bool allowedWhileSubscribed(const CommandVariant& command)
+{
+    return std::holds_alternative<CommandUnknown>(command) || std::holds_alternative<CommandInvalid>(command)
+        || std::holds_alternative<CommandSubscribe>(command) || std::holds_alternative<CommandUnsubscribe>(command)
+        || std::holds_alternative<CommandPsubscribe>(command) || std::holds_alternative<CommandPunsubscribe>(command)
+        || std::holds_alternative<CommandPing>(command);
+}
+} // namespace
+
+CommandExecutor::CommandExecutor(const ServerContext& context, std::function<void()> wake)
+    : subscriptions_(context.pubsub_ ? std::make_unique<Subscriptions>(*context.pubsub_, context.pubsub_->addReactor(std::move(wake))) : nullptr)
+    , commandHandler_(&respEncoder_, context, subscriptions_.get(), &transactions_)
+    , db_(context.db_)
+    , aof_(context.aof_)
+    , replication_(context.replication_)
+    , metrics_(context.metrics_)
+    , stats_(metrics_ ? &metrics_->addReactor() : nullptr)
+{
+}
+
+ClientState CommandExecutor::execute(const uint64_t client, const std::string_view input, size_t& consumed,
+    std::optional<CommandHandler::FollowerRequest>& followerRequest)
+{
+    consumed = 0;
+    commandHandler_.setClient(client);
+    try {
+        while (consumed < input.size()) {
+            const auto frameLength = respDecoder_.decodeFrame(input.substr(consumed), tokens_);
+            if (!frameLength.has_value()) {
+                break;
+            }
+            const auto command = respDecoder_.convertToCommand(tokens_);
+            if (subscriptions_ && !allowedWhileSubscribed(command) && subscriptions_->count(client) > 0) {
+                std::string error { "ERR Can't execute '" };
+                error.append(commandName(command.index())).append("': only (P)SUBSCRIBE / (P)UNSUBSCRIBE / PING are allowed in this context");
+                respEncoder_.appendError(error);
+            } else if (transactions_.queuing(client) && !controlsTransaction(command)) {
+                queue(client, command, input.substr(consumed, frameLength.value()));
+            } else if (stats_ != nullptr) {
+                const auto start = readTicks();
+                std::visit(commandHandler_, command);
+                record(command.index(), readTicks() - start);
+            } else {
+                std::visit(commandHandler_, command);
+            }
+            consumed += frameLength.value();
+            // The connection stops being a client; what it sent after PSYNC is dropped.
+            followerRequest = commandHandler_.takeFollowerRequest();
+            if (followerRequest.has_value()) {
+                return ClientState::Follower;
+            }
+        }
+    } catch (const std::invalid_argument& e) {
+        // We cannot find the start of the next frame after a malformed one.
+        LOG_INFO("Invalid argument: ", e.what());
+        respEncoder_.appendError("ERR Protocol error");
+        return ClientState::Disconnected;
+    }
+    return ClientState::Connected;
+}
+
+void CommandExecutor::record(const size_t command, const uint64_t ticks)
+{
+    stats_->record(command, ticks);
+    if (metrics_->isSlow(ticks)) {
+        metrics_->slowLog().add(tokens_, static_cast<uint64_t>(metrics_->toMicroseconds(ticks)));
+    }
+}
+
+void CommandExecutor::queue(const uint64_t client, const CommandVariant& command, const std::string_view frame)
+{
+    auto& transaction = transactions_.get(client);
+    if (std::holds_alternative<CommandUnknown>(command) || std::holds_alternative<CommandInvalid>(command)) {
+        std::visit(commandHandler_, command);
+        transaction.aborted_ = true;
+        return;
+    }
+    if (!allowedInTransaction(command)) {
+        respEncoder_.appendError("ERR Command not allowed inside a transaction");
+        transaction.aborted_ = true;
+        return;
+    }
+    // EXEC fails anyway, so there is no need to keep the command.
+    if (!transaction.aborted_) {
+        // The command refers into the input of the connection, which is reused, so it
+        // is decoded again from a copy of the frame.
+        static_cast<void>(respDecoder_.decodeFrame(transactions_.store(client, frame), tokens_));
+        transaction.commands_.push_back(respDecoder_.convertToCommand(tokens_));
+    }
+    respEncoder_.appendSimpleString("QUEUED");
+}
+
+void CommandExecutor::awaitDurability()
+{
+    if (aof_) {
+        aof_->awaitFsync();
+    }
+}
+
+void CommandExecutor::onTick()
+{
+    db_->expireCycle(expireChecksPerTick);
+}
+
+void CommandExecutor::attachFollower(const int fd, CommandHandler::FollowerRequest&& request)
+{
+    LOG_INFO("Client is a follower now. Fd= ", fd);
+    replication_->leader().attach(fd, std::move(request.replid_), request.offset_);
+}
+
+std::vector<Publication> CommandExecutor::takePublications()
+{
+    if (!subscriptions_) {
+        return {};
+    }
+    return subscriptions_->pubsub().take(subscriptions_->reactor());
+}
+
+std::span<const uint64_t> CommandExecutor::subscribers(const Publication& publication) const
+{
+    return subscriptions_->subscribers(publication);
+}
+
+size_t CommandExecutor::outputLimit(const uint64_t client) const
+{
+    if (subscriptions_ && subscriptions_->count(client) > 0) {
+        return subscriptions_->pubsub().outputLimit();
+    }
+    return maxOutputBufferSize;
+}
+
+void CommandExecutor::onDisconnect(const uint64_t client)
+{
+    if (subscriptions_) {
+        subscriptions_->remove(client);
+    }
+    transactions_.remove(client);
+}
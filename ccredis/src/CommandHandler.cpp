@@ -1,9 +1,56 @@
 #include "CommandHandler.h"
 
+#include "AppendOnlyFile.h"
+#include "CommandStats.h"
+#include "CommandTable.h"
 #include "Commands.h"
 #include "Database.h"
+#include "PubSub.h"
+#include "Replication.h"
 #include "RespEncoder.h"
+#include "Script.h"
+#include "Snapshot.h"
+#include "Transaction.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <optional>
+#include <span>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace {
+std::string toLower(const std::string_view name)
+{
+    std::string lower { name };
+    std::ranges::transform(lower, lower.begin(), [](const char c) { return static_cast<char>(c | 0x20); });
+    return lower;
+}
+
+// The indexes in CommandVariant of the named commands, of every command when names is
+// empty.
+std::vector<size_t> commandIndexes(const std::span<const std::string_view> names)
+{
+    std::vector<size_t> indexes {};
+    for (size_t i = 0; i < CommandStats::numCommands; ++i) {
+        const auto name = commandName(i);
+        if (!name.empty() && (names.empty() || std::ranges::any_of(names, [name](const std::string_view wanted) { return equalsIgnoreCase(wanted, name); }))) {
+            indexes.push_back(i);
+        }
+    }
+    return indexes;
+}
+} // namespace
 
 void CommandHandler::operator()(const CommandUnknown&)
 {
@@ -20,6 +67,14 @@ void CommandHandler::operator()(const CommandInvalid& cmd)
 }
 void CommandHandler::operator()(const CommandPing& cmd)
 {
+    // A subscribed client tells replies from messages by their shape, so PING replies
+    // with an array there, as in Redis.
+    if (subscriptions_ != nullptr && subscriptions_->count(client_) > 0) {
+        encoder_->beginArray(2);
+        encoder_->appendBulkstring("pong");
+        encoder_->appendBulkstring(cmd.value_);
+        return;
+    }
     if (cmd.value_.empty()) {
         encoder_->appendBulkstring("PONG");
         return;
@@ -44,6 +99,9 @@ void CommandHandler::operator()(const CommandHello& cmd)
 
 void CommandHandler::operator()(const CommandSet& cmd)
 {
+    if (!writable() || !freeMemory()) {
+        return;
+    }
     if (cmd.expire.has_value()) {
         db_->set(cmd.key_, cmd.value_, cmd.expire.value());
     } else {
@@ -54,39 +112,710 @@ void CommandHandler::operator()(const CommandSet& cmd)
 
 void CommandHandler::operator()(const CommandGet& cmd)
 {
-    const auto& value_ = db_->get(cmd.key_);
-    if (value_.has_value()) {
-        encoder_->appendBulkstring(value_.value());
+    // Only a string is copied out of the shard, so a GET on a collection costs no copy.
+    auto found = false;
+    auto value_ = db_->read(cmd.key_, [&found](const ValueType* value) -> std::optional<ValueType> {
+        found = value != nullptr;
+        if (value == nullptr || !value->isString()) {
+            return std::nullopt;
+        }
+        return *value;
+    });
+    if (!found) {
+        encoder_->appendNull();
+    } else if (!value_.has_value()) {
+        encoder_->appendError(Db::wrongTypeError);
+    } else if (value_->isInteger()) {
+        ValueType::IntChars chars {};
+        encoder_->appendBulkstring(value_->view(chars));
     } else {
-        encoder_->appendError("Key does not exist");
+        // The copy is ours, so a large value is sent from it in place.
+        encoder_->appendOwnedBulkstring(std::move(value_.value()).str());
     }
 }
+void CommandHandler::operator()(const CommandMget& cmd)
+{
+    encoder_->beginArray(cmd.keys_.size());
+    db_->getMany(cmd.keys_, [this](size_t, const ValueType* value) {
+        if (value == nullptr || !value->isString()) {
+            encoder_->appendNull();
+            return;
+        }
+        ValueType::IntChars chars {};
+        encoder_->appendBulkstring(value->view(chars));
+    });
+}
+void CommandHandler::operator()(const CommandMset& cmd)
+{
+    if (!writable() || !freeMemory()) {
+        return;
+    }
+    db_->setMany(cmd.entries_);
+    encoder_->appendSimpleString("OK");
+}
 void CommandHandler::operator()(const CommandExists& cmd)
 {
-    const auto& value_ = db_->get(cmd.key_);
-    if (value_.has_value()) {
-        encoder_->appendInt("1");
-    } else {
-        encoder_->appendInt("0");
+    encoder_->appendInt(static_cast<int64_t>(db_->countExisting(cmd.keys_)));
+}
+void CommandHandler::operator()(const CommandDel& cmd)
+{
+    if (!writable()) {
+        return;
     }
+    encoder_->appendInt(static_cast<int64_t>(db_->removeMany(cmd.keys_)));
 }
 
 void CommandHandler::operator()(const CommandIncr& cmd)
 {
-    auto value_ = db_->get(cmd.key_);
-    if (value_.has_value()) {
-        try {
-            int intVal = std::stoi(value_->value_);
-            intVal += 1;
-            value_->value_ = std::to_string(intVal);
-            db_->set(cmd.key_, value_.value());
-
-            encoder_->appendBulkstring("OK");
-        } catch (...) {
-            encoder_->appendError("Invalid value - cannot increment it");
+    incrementBy(cmd.key_, 1);
+}
+void CommandHandler::operator()(const CommandIncrBy& cmd)
+{
+    incrementBy(cmd.key_, cmd.increment_);
+}
+void CommandHandler::operator()(const CommandDecr& cmd)
+{
+    incrementBy(cmd.key_, -1);
+}
+void CommandHandler::operator()(const CommandDecrBy& cmd)
+{
+    if (cmd.decrement_ == std::numeric_limits<int64_t>::min()) {
+        encoder_->appendError("ERR decrement would overflow");
+        return;
+    }
+    incrementBy(cmd.key_, -cmd.decrement_);
+}
+void CommandHandler::incrementBy(const std::string_view key, const int64_t delta)
+{
+    if (!writable() || !freeMemory()) {
+        return;
+    }
+    const auto result = db_->incrementBy(key, delta);
+    if (result.has_value()) {
+        encoder_->appendInt(result.value());
+    } else {
+        encoder_->appendError(result.error());
+    }
+}
+void CommandHandler::operator()(const CommandHset& cmd)
+{
+    if (!writable() || !freeMemory()) {
+        return;
+    }
+    appendResult(db_->hashSet(cmd.key_, cmd.fields_));
+}
+void CommandHandler::operator()(const CommandHget& cmd)
+{
+    db_->read(cmd.key_, [this, &cmd](const ValueType* value) {
+        const auto* hash = value == nullptr ? nullptr : value->as<HashValue>();
+        if (value != nullptr && hash == nullptr) {
+            encoder_->appendError(Db::wrongTypeError);
+            return;
+        }
+        const auto field = hash == nullptr ? std::nullopt : hash->get(cmd.field_);
+        if (field.has_value()) {
+            encoder_->appendBulkstring(field.value());
+        } else {
+            encoder_->appendNull();
+        }
+    });
+}
+void CommandHandler::operator()(const CommandHgetall& cmd)
+{
+    db_->read(cmd.key_, [this](const ValueType* value) {
+        if (value == nullptr) {
+            encoder_->beginArray(0);
+            return;
+        }
+        const auto* hash = value->as<HashValue>();
+        if (hash == nullptr) {
+            encoder_->appendError(Db::wrongTypeError);
+            return;
+        }
+        // A flat array of fields and values, the RESP2 reply redis-cli expects.
+        encoder_->beginArray(2 * hash->size());
+        hash->forEach([this](const std::string_view field, const std::string_view value) {
+            encoder_->appendBulkstring(field);
+            encoder_->appendBulkstring(value);
+        });
+    });
+}
+void CommandHandler::operator()(const CommandLpush& cmd)
+{
+    if (!writable() || !freeMemory()) {
+        return;
+    }
+    appendResult(db_->listPush(cmd.key_, cmd.values_, Db::ListEnd::Front));
+}
+void CommandHandler::operator()(const CommandRpush& cmd)
+{
+    if (!writable() || !freeMemory()) {
+        return;
+    }
+    appendResult(db_->listPush(cmd.key_, cmd.values_, Db::ListEnd::Back));
+}
+void CommandHandler::operator()(const CommandLrange& cmd)
+{
+    db_->read(cmd.key_, [this, &cmd](const ValueType* value) {
+        const auto* list = value == nullptr ? nullptr : value->as<ListValue>();
+        if (value != nullptr && list == nullptr) {
+            encoder_->appendError(Db::wrongTypeError);
+            return;
+        }
+        // Negative indexes count from the end and the range is clamped to the list.
+        const auto length = static_cast<int64_t>(list == nullptr ? 0 : list->size());
+        const auto start = std::max<int64_t>(cmd.start_ < 0 ? cmd.start_ + length : cmd.start_, 0);
+        const auto stop = std::min<int64_t>(cmd.stop_ < 0 ? cmd.stop_ + length : cmd.stop_, length - 1);
+        if (start > stop) {
+            encoder_->beginArray(0);
+            return;
+        }
+        encoder_->beginArray(stop - start + 1);
+        list->forRange(start, stop, [this](const std::string_view element) { encoder_->appendBulkstring(element); });
+    });
+}
+void CommandHandler::operator()(const CommandSadd& cmd)
+{
+    if (!writable() || !freeMemory()) {
+        return;
+    }
+    appendResult(db_->setAdd(cmd.key_, cmd.members_));
+}
+void CommandHandler::operator()(const CommandSmembers& cmd)
+{
+    db_->read(cmd.key_, [this](const ValueType* value) {
+        if (value == nullptr) {
+            encoder_->beginArray(0);
+            return;
+        }
+        const auto* set = value->as<SetValue>();
+        if (set == nullptr) {
+            encoder_->appendError(Db::wrongTypeError);
+            return;
         }
+        encoder_->beginArray(set->size());
+        set->forEach([this](const std::string_view member) { encoder_->appendBulkstring(member); });
+    });
+}
+void CommandHandler::operator()(const CommandSismember& cmd)
+{
+    db_->read(cmd.key_, [this, &cmd](const ValueType* value) {
+        const auto* set = value == nullptr ? nullptr : value->as<SetValue>();
+        if (value != nullptr && set == nullptr) {
+            encoder_->appendError(Db::wrongTypeError);
+            return;
+        }
+        encoder_->appendInt(int64_t { set != nullptr && set->contains(cmd.member_) });
+    });
+}
+bool CommandHandler::writable()
+{
+    if (replication_ && replication_->isFollower()) {
+        encoder_->appendError("READONLY You can't write against a read only replica.");
+        return false;
+    }
+    return true;
+}
+bool CommandHandler::freeMemory()
+{
+    if (db_->freeMemoryIfNeeded()) {
+        return true;
+    }
+    encoder_->appendError("OOM command not allowed when used memory > 'maxmemory'.");
+    return false;
+}
+void CommandHandler::appendResult(const std::expected<size_t, std::string>& result)
+{
+    if (result.has_value()) {
+        encoder_->appendInt(static_cast<int64_t>(result.value()));
+    } else {
+        encoder_->appendError(result.error());
+    }
+}
+void CommandHandler::operator()(const CommandInfo& cmd)
+{
+    const auto wants = [&cmd](const std::string_view section) {
+        return cmd.section_.empty() || equalsIgnoreCase(cmd.section_, section);
+    };
+    const auto stats = db_->stats();
+    std::ostringstream info {};
+    if (wants("keyspace")) {
+        info << "# Keyspace\r\n"
+             << "keys:" << stats.keys_ << "\r\n";
+    }
+    if (wants("memory")) {
+        info << "# Memory\r\n"
+             << "used_memory:" << stats.usedMemory_ << "\r\n"
+             << "maxmemory:" << db_->maxMemory() << "\r\n"
+             << "maxmemory_policy:" << evictionPolicyName(db_->evictionPolicy()) << "\r\n";
+    }
+    if (wants("stats")) {
+        info << "# Stats\r\n"
+             << "expired_keys:" << stats.expiredKeys_ << "\r\n"
+             << "expired_reclaimed_bytes:" << stats.expiredBytes_ << "\r\n"
+             << "evicted_keys:" << stats.evictedKeys_ << "\r\n";
+    }
+    if (replication_ && wants("replication")) {
+        const auto& leader = replication_->leader();
+        const auto link = replication_->link();
+        const auto replicationStats = leader.stats();
+        info << "# Replication\r\n"
+             << "role:" << (link.has_value() ? "slave" : "master") << "\r\n";
+        if (link.has_value()) {
+            info << "master_host:" << link->host_ << "\r\n"
+                 << "master_port:" << link->port_ << "\r\n"
+                 << "master_link_status:" << (link->up_ ? "up" : "down") << "\r\n"
+                 << "slave_repl_offset:" << link->offset_ << "\r\n";
+        }
+        info << "connected_slaves:" << replicationStats.followers_ << "\r\n"
+             << "master_replid:" << leader.replid() << "\r\n"
+             << "master_repl_offset:" << leader.offset() << "\r\n"
+             << "sync_full:" << replicationStats.fullSyncs_ << "\r\n"
+             << "sync_partial_ok:" << replicationStats.partialSyncs_ << "\r\n"
+             << "repl_backlog_dropped_slaves:" << replicationStats.droppedFollowers_ << "\r\n";
+    }
+    if (snapshotter_ && wants("persistence")) {
+        info << "# Persistence\r\n"
+             << "rdb_bgsave_in_progress:" << snapshotter_->backgroundSaveInProgress() << "\r\n"
+             << "rdb_last_save_time:" << snapshotter_->lastSaveTime() << "\r\n"
+             << "rdb_last_bgsave_status:" << (snapshotter_->lastSaveSucceeded() ? "ok" : "err") << "\r\n"
+             << "aof_enabled:" << (aof_ != nullptr) << "\r\n";
+        if (aof_) {
+            info << "aof_rewrite_in_progress:" << aof_->rewriteInProgress() << "\r\n"
+                 << "aof_last_bgrewrite_status:" << (aof_->lastRewriteSucceeded() ? "ok" : "err") << "\r\n"
+                 << "aof_current_size:" << aof_->size() << "\r\n";
+        }
+    }
+    if (metrics_ && wants("commandstats")) {
+        info << "# Commandstats\r\n"
+             << std::fixed << std::setprecision(2);
+        for (const auto index : commandIndexes({})) {
+            const auto summary = metrics_->summary(index);
+            if (summary.calls_ == 0) {
+                continue;
+            }
+            const auto usec = metrics_->toMicroseconds(summary.ticks_);
+            info << "cmdstat_" << toLower(commandName(index)) << ":calls=" << summary.calls_
+                 << ",usec=" << static_cast<uint64_t>(usec)
+                 << ",usec_per_call=" << usec / static_cast<double>(summary.calls_) << "\r\n";
+        }
+    }
+    if (metrics_ && wants("latencystats")) {
+        info << "# Latencystats\r\n"
+             << std::fixed << std::setprecision(3);
+        for (const auto index : commandIndexes({})) {
+            const auto summary = metrics_->summary(index);
+            if (summary.calls_ == 0) {
+                continue;
+            }
+            const auto percentile = [&](const double fraction) { return metrics_->toMicroseconds(summary.percentile(fraction)); };
+            info << "latency_percentiles_usec_" << toLower(commandName(index)) << ":p50=" << percentile(0.5)
+                 << ",p99=" << percentile(0.99) << ",p99.9=" << percentile(0.999) << "\r\n";
+        }
+    }
+    encoder_->appendBulkstring(info.str());
+}
+
+void CommandHandler::operator()(const CommandSave&)
+{
+    if (!snapshotter_) {
+        encoder_->appendError("ERR persistence is disabled");
+        return;
+    }
+    const auto saved = snapshotter_->save();
+    if (!saved.has_value()) {
+        encoder_->appendError("ERR " + saved.error());
+        return;
+    }
+    encoder_->appendSimpleString("OK");
+}
+
+void CommandHandler::operator()(const CommandBgsave&)
+{
+    if (!snapshotter_) {
+        encoder_->appendError("ERR persistence is disabled");
+        return;
+    }
+    if (!snapshotter_->startBackgroundSave()) {
+        encoder_->appendError("ERR Background save already in progress");
+        return;
+    }
+    encoder_->appendSimpleString("Background saving started");
+}
 
+void CommandHandler::operator()(const CommandLastsave&)
+{
+    if (!snapshotter_) {
+        encoder_->appendError("ERR persistence is disabled");
+        return;
+    }
+    encoder_->appendInt(std::to_string(snapshotter_->lastSaveTime()));
+}
+
+void CommandHandler::operator()(const CommandBgrewriteaof&)
+{
+    if (!aof_) {
+        encoder_->appendError("ERR append only file is disabled");
+        return;
+    }
+    if (!aof_->startRewrite(db_)) {
+        encoder_->appendError("ERR Background append only file rewriting already in progress");
+        return;
+    }
+    encoder_->appendSimpleString("Background append only file rewriting started");
+}
+
+void CommandHandler::operator()(const CommandReplicaof& cmd)
+{
+    if (!replication_) {
+        encoder_->appendError("ERR replication is disabled");
+        return;
+    }
+    if (cmd.host_.empty()) {
+        replication_->promote();
     } else {
-        encoder_->appendError("Key does not exist");
+        replication_->replicaOf(std::string { cmd.host_ }, std::string { cmd.port_ });
+    }
+    encoder_->appendSimpleString("OK");
+}
+
+void CommandHandler::operator()(const CommandPsync& cmd)
+{
+    if (!replication_) {
+        encoder_->appendError("ERR replication is disabled");
+        return;
+    }
+    // Followers of followers would have to start over whenever their leader does.
+    if (replication_->isFollower()) {
+        encoder_->appendError("ERR a follower does not take followers");
+        return;
+    }
+    followerRequest_ = FollowerRequest { .replid_ = std::string { cmd.replid_ }, .offset_ = cmd.offset_ };
+}
+
+void CommandHandler::operator()(const CommandSlowlog& cmd)
+{
+    if (!metrics_) {
+        encoder_->appendError("ERR command stats are disabled");
+        return;
+    }
+    auto& slowLog = metrics_->slowLog();
+    switch (cmd.subcommand_) {
+    case CommandSlowlog::Subcommand::Get: {
+        // Each entry is its id, unix time, duration in microseconds and arguments.
+        const auto entries = slowLog.newest(cmd.count_);
+        encoder_->beginArray(entries.size());
+        for (const auto& entry : entries) {
+            encoder_->beginArray(4);
+            encoder_->appendInt(static_cast<int64_t>(entry.id_));
+            encoder_->appendInt(entry.time_);
+            encoder_->appendInt(static_cast<int64_t>(entry.microseconds_));
+            encoder_->beginArray(entry.args_.size());
+            for (const auto& arg : entry.args_) {
+                encoder_->appendBulkstring(arg);
+            }
+        }
+        break;
+    }
+    case CommandSlowlog::Subcommand::Len:
+        encoder_->appendInt(static_cast<int64_t>(slowLog.size()));
+        break;
+    case CommandSlowlog::Subcommand::Reset:
+        slowLog.reset();
+        encoder_->appendSimpleString("OK");
+        break;
+    }
+}
+
+void CommandHandler::operator()(const CommandLatency& cmd)
+{
+    if (!metrics_) {
+        encoder_->appendError("ERR command stats are disabled");
+        return;
+    }
+    std::vector<std::pair<size_t, CommandMetrics::Summary>> summaries {};
+    for (const auto index : commandIndexes(cmd.commands_)) {
+        auto summary = metrics_->summary(index);
+        if (summary.calls_ > 0) {
+            summaries.emplace_back(index, std::move(summary));
+        }
+    }
+    // A flat array of command names and their histograms, the RESP2 form of the map Redis
+    // replies with. The histogram counts the calls that completed within each power of
+    // two microseconds, cumulatively, leaving out the buckets no call fell in.
+    encoder_->beginArray(2 * summaries.size());
+    for (const auto& [index, summary] : summaries) {
+        std::map<uint64_t, uint64_t> buckets {};
+        for (size_t bucket = 0; bucket < summary.counts_.size(); ++bucket) {
+            if (summary.counts_[bucket] == 0) {
+                continue;
+            }
+            const auto usec = metrics_->toMicroseconds(LatencyHistogram::lowerBound(bucket));
+            buckets[std::bit_ceil(std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(usec))))] += summary.counts_[bucket];
+        }
+        encoder_->appendBulkstring(toLower(commandName(index)));
+        encoder_->beginArray(4);
+        encoder_->appendBulkstring("calls");
+        encoder_->appendInt(static_cast<int64_t>(summary.calls_));
+        encoder_->appendBulkstring("histogram_usec");
+        encoder_->beginArray(2 * buckets.size());
+        uint64_t cumulative = 0;
+        for (const auto& [usec, count] : buckets) {
+            cumulative += count;
+            encoder_->appendInt(static_cast<int64_t>(usec));
+            encoder_->appendInt(static_cast<int64_t>(cumulative));
+        }
+    }
+}
+
+void CommandHandler::subscribe(const std::span<const std::string_view> targets, const bool pattern)
+{
+    if (subscriptions_ == nullptr) {
+        encoder_->appendError("ERR pub/sub is disabled");
+        return;
+    }
+    for (const auto target : targets) {
+        const auto count = subscriptions_->subscribe(client_, target, pattern);
+        encoder_->beginArray(3);
+        encoder_->appendBulkstring(pattern ? "psubscribe" : "subscribe");
+        encoder_->appendBulkstring(target);
+        encoder_->appendInt(static_cast<int64_t>(count));
+    }
+}
+
+void CommandHandler::unsubscribe(const std::span<const std::string_view> targets, const bool pattern)
+{
+    if (subscriptions_ == nullptr) {
+        encoder_->appendError("ERR pub/sub is disabled");
+        return;
+    }
+    const auto kind = pattern ? "punsubscribe" : "unsubscribe";
+    const auto reply = [this, kind](const std::string_view target, const size_t count) {
+        encoder_->beginArray(3);
+        encoder_->appendBulkstring(kind);
+        encoder_->appendBulkstring(target);
+        encoder_->appendInt(static_cast<int64_t>(count));
+    };
+    if (!targets.empty()) {
+        for (const auto target : targets) {
+            reply(target, subscriptions_->unsubscribe(client_, target, pattern));
+        }
+        return;
+    }
+    // Without arguments from all of them, and a reply with a null one if there were none.
+    const auto subscribed = subscriptions_->targets(client_, pattern);
+    if (subscribed.empty()) {
+        encoder_->beginArray(3);
+        encoder_->appendBulkstring(kind);
+        encoder_->appendNull();
+        encoder_->appendInt(static_cast<int64_t>(subscriptions_->count(client_)));
+        return;
+    }
+    for (const auto& target : subscribed) {
+        reply(target, subscriptions_->unsubscribe(client_, target, pattern));
+    }
+}
+
+void CommandHandler::operator()(const CommandSubscribe& cmd)
+{
+    subscribe(cmd.channels_, false);
+}
+
+void CommandHandler::operator()(const CommandUnsubscribe& cmd)
+{
+    unsubscribe(cmd.channels_, false);
+}
+
+void CommandHandler::operator()(const CommandPsubscribe& cmd)
+{
+    subscribe(cmd.patterns_, true);
+}
+
+void CommandHandler::operator()(const CommandPunsubscribe& cmd)
+{
+    unsubscribe(cmd.patterns_, true);
+}
+
+void CommandHandler::operator()(const CommandPublish& cmd)
+{
+    if (subscriptions_ == nullptr) {
+        encoder_->appendError("ERR pub/sub is disabled");
+        return;
+    }
+    // The message is encoded once and shared by every subscriber it goes to; the
+    // reactors deliver it at the end of their batch.
+    const auto receivers = subscriptions_->pubsub().publish(subscriptions_->reactor(), cmd.channel_, cmd.message_);
+    encoder_->appendInt(static_cast<int64_t>(receivers));
+}
+
+void CommandHandler::operator()(const CommandMulti&)
+{
+    if (transactions_ == nullptr) {
+        encoder_->appendError("ERR transactions are disabled");
+        return;
+    }
+    auto& transaction = transactions_->get(client_);
+    if (transaction.queuing_) {
+        encoder_->appendError("ERR MULTI calls can not be nested");
+        return;
+    }
+    transaction.queuing_ = true;
+    encoder_->appendSimpleString("OK");
+}
+
+void CommandHandler::operator()(const CommandExec&)
+{
+    if (transactions_ == nullptr || !transactions_->queuing(client_)) {
+        encoder_->appendError("ERR EXEC without MULTI");
+        return;
+    }
+    // Whatever the outcome, the transaction ends and its keys are no longer watched.
+    const auto transaction = transactions_->take(client_);
+    if (transaction.aborted_) {
+        encoder_->appendError("EXECABORT Transaction discarded because of previous errors.");
+        return;
+    }
+    uint64_t shards = 0;
+    for (const auto& [key, version] : transaction.watched_) {
+        shards |= uint64_t { 1 } << Db::shardOf(key);
+    }
+    for (const auto& command : transaction.commands_) {
+        shards |= shardsOf(command);
+    }
+    // Eviction locks shards of its own, so it cannot run while the shards are held; a
+    // write that still does not fit fails with OOM inside the transaction.
+    db_->freeMemoryIfNeeded();
+    const auto locked = db_->lockShards(shards);
+    for (const auto& [key, version] : transaction.watched_) {
+        if (db_->version(key) != version) {
+            encoder_->appendNullArray();
+            return;
+        }
+    }
+    encoder_->beginArray(static_cast<unsigned>(transaction.commands_.size()));
+    for (const auto& command : transaction.commands_) {
+        std::visit(*this, command);
+    }
+}
+
+void CommandHandler::operator()(const CommandDiscard&)
+{
+    if (transactions_ == nullptr || !transactions_->queuing(client_)) {
+        encoder_->appendError("ERR DISCARD without MULTI");
+        return;
+    }
+    transactions_->remove(client_);
+    encoder_->appendSimpleString("OK");
+}
+
+void CommandHandler::operator()(const CommandWatch& cmd)
+{
+    if (transactions_ == nullptr) {
+        encoder_->appendError("ERR transactions are disabled");
+        return;
+    }
+    auto& transaction = transactions_->get(client_);
+    if (transaction.queuing_) {
+        encoder_->appendError("ERR WATCH inside MULTI is not allowed");
+        return;
+    }
+    for (const auto key : cmd.keys_) {
+        transaction.watched_.emplace_back(std::string { key }, db_->version(key));
+    }
+    encoder_->appendSimpleString("OK");
+}
+
+void CommandHandler::operator()(const CommandUnwatch&)
+{
+    // Queued after MULTI, it runs when EXEC has already ended the transaction.
+    if (transactions_ != nullptr) {
+        transactions_->remove(client_);
     }
-}
\ No newline at end of file
+    encoder_->appendSimpleString("OK");
+}
+
+void CommandHandler::operator()(const CommandEval& cmd)
+{
+    if (scripts_ == nullptr) {
+        encoder_->appendError("ERR scripting is disabled");
+        return;
+    }
+    const auto script = scripts_->load(cmd.script_);
+    if (!script.has_value()) {
+        encoder_->appendError(script.error());
+        return;
+    }
+    run(*script.value(), cmd.keys_, cmd.args_);
+}
+
+void CommandHandler::operator()(const CommandEvalsha& cmd)
+{
+    if (scripts_ == nullptr) {
+        encoder_->appendError("ERR scripting is disabled");
+        return;
+    }
+    const auto script = scripts_->find(cmd.sha_);
+    if (script == nullptr) {
+        encoder_->appendError("NOSCRIPT No matching script. Please use EVAL.");
+        return;
+    }
+    run(*script, cmd.keys_, cmd.args_);
+}
+
+void CommandHandler::operator()(const CommandScript& cmd)
+{
+    if (scripts_ == nullptr) {
+        encoder_->appendError("ERR scripting is disabled");
+        return;
+    }
+    switch (cmd.subcommand_) {
+    case CommandScript::Subcommand::Load:
+        if (const auto script = scripts_->load(cmd.args_[0]); script.has_value()) {
+            encoder_->appendBulkstring(script.value()->sha());
+        } else {
+            encoder_->appendError(script.error());
+        }
+        break;
+    case CommandScript::Subcommand::Exists:
+        encoder_->beginArray(static_cast<unsigned>(cmd.args_.size()));
+        for (const auto sha : cmd.args_) {
+            encoder_->appendInt(int64_t { scripts_->find(sha) != nullptr });
+        }
+        break;
+    case CommandScript::Subcommand::Flush:
+        scripts_->flush();
+        encoder_->appendSimpleString("OK");
+        break;
+    }
+}
+
+void CommandHandler::run(const Script& script, const std::span<const std::string_view> keys, const std::span<const std::string_view> args)
+{
+    thread_local std::vector<CommandVariant> commands {};
+    if (const auto instantiated = script.instantiate(keys, args, commands); !instantiated.has_value()) {
+        encoder_->appendError(instantiated.error());
+        return;
+    }
+    uint64_t shards = 0;
+    for (const auto& command : commands) {
+        shards |= shardsOf(command);
+    }
+    // Like EXEC, so no other client sees the script half done.
+    db_->freeMemoryIfNeeded();
+    const auto locked = db_->lockShards(shards);
+    encoder_->beginArray(static_cast<unsigned>(commands.size()));
+    thread_local std::vector<bool> replies {};
+    replies.assign(commands.size(), false);
+    for (size_t step = 0; step < commands.size(); ++step) {
+        const auto& guard = script.guard(step);
+        if (guard.has_value() && replies[guard->step_] != guard->runsIfTrue_) {
+            encoder_->appendNull();
+            continue;
+        }
+        // The reply starts in the buffer even when its value is referred to in place.
+        const auto start = encoder_->getBuffer().size();
+        std::visit(*this, commands[step]);
+        const auto& buffer = encoder_->getBuffer();
+        replies[step] = isTrueReply({ buffer.data() + start, buffer.size() - start });
+    }
+}
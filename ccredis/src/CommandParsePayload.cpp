@@ -1,12 +1,85 @@
 #include "CommandParsePayload.h"
+#include "CommandTable.h"
 #include "Commands.h"
 #include "Resp.h"
 
-#include <cassert>
 #include <charconv>
 #include <chrono>
+#include <cstdint>
 #include <expected>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+std::unexpected<CommandInvalid> invalid(std::string error)
+{
+    CommandInvalid invalidCmd {};
+    invalidCmd.errorString = std::move(error);
+    return std::unexpected { invalidCmd };
+}
+
+std::expected<std::string_view, CommandInvalid> parseKey(std::span<const RespToken> args)
+{
+    if (args.empty() || args[0].string_.empty()) {
+        return invalid("Missing key");
+    }
+    return args[0].string_;
+}
+
+std::expected<std::vector<std::string_view>, CommandInvalid> parseKeys(std::span<const RespToken> args)
+{
+    std::vector<std::string_view> keys {};
+    keys.reserve(args.size());
+    for (const auto& arg : args) {
+        if (arg.string_.empty()) {
+            return invalid("Missing key");
+        }
+        keys.push_back(arg.string_);
+    }
+    return keys;
+}
+
+std::vector<std::string_view> strings(std::span<const RespToken> args)
+{
+    std::vector<std::string_view> result {};
+    result.reserve(args.size());
+    for (const auto& arg : args) {
+        result.push_back(arg.string_);
+    }
+    return result;
+}
+
+std::expected<int64_t, CommandInvalid> parseIntegerArgument(const RespToken& arg)
+{
+    const auto value = parseCanonicalInteger(arg.string_);
+    if (!value.has_value()) {
+        return invalid("value is not an integer or out of range");
+    }
+    return value.value();
+}
+
+// Splits the numkeys [key ...] [arg ...] of EVAL and EVALSHA.
+std::expected<ParseSuccessful, CommandInvalid> parseKeysAndArgs(std::span<const RespToken> args,
+    std::vector<std::string_view>& keys, std::vector<std::string_view>& rest)
+{
+    const auto numKeys = parseIntegerArgument(args[0]);
+    if (!numKeys.has_value()) {
+        return std::unexpected { numKeys.error() };
+    }
+    if (numKeys.value() < 0) {
+        return invalid("Number of keys can't be negative");
+    }
+    if (static_cast<uint64_t>(numKeys.value()) > args.size() - 1) {
+        return invalid("Number of keys can't be greater than number of args");
+    }
+    const auto numKeysGiven = static_cast<size_t>(numKeys.value());
+    keys = strings(args.subspan(1, numKeysGiven));
+    rest = strings(args.subspan(1 + numKeysGiven));
+    return ParseSuccessful {};
+}
+} // namespace
 
 std::expected<ParseSuccessful, CommandInvalid>
 ParsePayload::operator()(CommandUnknown&)
@@ -21,121 +94,500 @@ ParsePayload::operator()(CommandInvalid&)
 std::expected<ParseSuccessful, CommandInvalid>
 ParsePayload::operator()(CommandPing& cmd)
 {
-    if (resp_.string_.has_value()) {
-        cmd.value_ = resp_.string_.value();
+    if (!args_.empty()) {
+        cmd.value_ = args_[0].string_;
     }
     return ParseSuccessful {};
 }
 std::expected<ParseSuccessful, CommandInvalid>
 ParsePayload::operator()(CommandHello& cmd)
 {
-    assert(resp_.string_.has_value()); // Version is passed as string in client
-    cmd.version_ = resp_.string_.value();
+    if (args_.empty()) {
+        return ParseSuccessful {};
+    }
+    cmd.version_ = args_[0].string_; // Version is passed as string in client
     if (cmd.version_.empty()) {
-        CommandInvalid invalidCmd {};
-        invalidCmd.errorString = "Missing version";
-        return std::unexpected { invalidCmd };
+        return invalid("Missing version");
     }
     return ParseSuccessful {};
 }
 std::expected<ParseSuccessful, CommandInvalid>
 ParsePayload::operator()(CommandSet& cmd)
 {
-    if (cmd.key_.empty()) {
-        if (resp_.string_.has_value()) {
-            cmd.key_ = resp_.string_.value();
-        } else if (resp_.integer_.has_value()) {
-            cmd.key_ = std::to_string(resp_.integer_.value());
-        }
-    } else if (cmd.value_.empty()) {
-        if (resp_.string_.has_value()) {
-            cmd.value_ = resp_.string_.value();
-        } else if (resp_.integer_.has_value()) {
-            cmd.value_ = std::to_string(resp_.integer_.value());
-        }
-    } else {
-        // Optional data, eg EX, PX
-        if (resp_.string_.has_value() && resp_.string_.value() == "EX") {
-            cmd.state_ = CommandState::WaitingForValue;
+    // SET key value [EX seconds | PX milliseconds | EXAT unix-seconds | PXAT unix-milliseconds]
+    const auto key = parseKey(args_);
+    if (!key.has_value()) {
+        return std::unexpected { key.error() };
+    }
+    cmd.key_ = key.value();
+    cmd.value_ = args_[1].string_;
+
+    for (size_t i = 2; i < args_.size(); ++i) {
+        const auto option = args_[i].string_;
+        if (equalsIgnoreCase(option, "EX")) {
             cmd.resolution_ = ExpireTimeResolution::Seconds;
-        } else if (resp_.string_.has_value() && resp_.string_.value() == "PX") {
-            cmd.state_ = CommandState::WaitingForValue;
+        } else if (equalsIgnoreCase(option, "PX")) {
             cmd.resolution_ = ExpireTimeResolution::Milliseconds;
-        } else if (resp_.string_.has_value() && cmd.state_ == CommandState::WaitingForValue) {
-
-            int time {};
-            const auto [_, ec] = std::from_chars(resp_.string_.value().begin(),
-                resp_.string_.value().end(), time);
-            if (ec != std::errc()) {
-                CommandInvalid invalidCmd {};
-                invalidCmd.errorString = "Invalid expiration time";
-                return std::unexpected { invalidCmd };
-            }
-            const auto now = std::chrono::duration_cast<std::chrono::seconds>(
-                std::chrono::system_clock::now().time_since_epoch());
-            std::chrono::time_point<std::chrono::system_clock,
-                std::chrono::milliseconds>
-                timeS { std::chrono::seconds { time } + now };
-            cmd.expire = timeS;
-            if (cmd.resolution_ == ExpireTimeResolution::Milliseconds) {
-                const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::system_clock::now().time_since_epoch());
-                std::chrono::time_point<std::chrono::system_clock,
-                    std::chrono::milliseconds>
-                    timeMs { std::chrono::milliseconds { time } + now };
-                cmd.expire = timeMs;
-            }
+        } else if (equalsIgnoreCase(option, "EXAT")) {
+            cmd.resolution_ = ExpireTimeResolution::Unix;
+        } else if (equalsIgnoreCase(option, "PXAT")) {
+            cmd.resolution_ = ExpireTimeResolution::UnixMilliseconds;
+        } else {
+            return invalid("Syntax error");
+        }
+        if (cmd.expire.has_value() || i + 1 == args_.size()) {
+            return invalid("Syntax error");
+        }
+
+        const auto timeStr = args_[++i].string_;
+        int64_t time {};
+        const auto [ptr, ec] = std::from_chars(timeStr.data(), timeStr.data() + timeStr.size(), time);
+        if (ec != std::errc() || ptr != timeStr.data() + timeStr.size() || time <= 0) {
+            return invalid("Invalid expiration time");
+        }
+
+        using namespace std::chrono;
+        switch (cmd.resolution_) {
+        case ExpireTimeResolution::Seconds:
+            cmd.expire = CommandSet::TimePoint { duration_cast<seconds>(system_clock::now().time_since_epoch()) + seconds { time } };
+            break;
+        case ExpireTimeResolution::Milliseconds:
+            cmd.expire = CommandSet::TimePoint { duration_cast<milliseconds>(system_clock::now().time_since_epoch()) + milliseconds { time } };
+            break;
+        case ExpireTimeResolution::Unix:
+            cmd.expire = CommandSet::TimePoint { seconds { time } };
+            break;
+        case ExpireTimeResolution::UnixMilliseconds:
+            cmd.expire = CommandSet::TimePoint { milliseconds { time } };
+            break;
         }
     }
-    cmd.state_ = CommandState::Done;
     return ParseSuccessful {};
 }
 std::expected<ParseSuccessful, CommandInvalid>
 ParsePayload::operator()(CommandGet& cmd)
 {
-    if (resp_.string_.has_value()) {
-        cmd.key_ = resp_.string_.value();
-    } else if (resp_.integer_.has_value()) {
-        cmd.key_ = std::to_string(resp_.integer_.value());
+    const auto key = parseKey(args_);
+    if (!key.has_value()) {
+        return std::unexpected { key.error() };
     }
+    cmd.key_ = key.value();
+    return ParseSuccessful {};
+}
 
-    if (cmd.key_.empty()) {
-        CommandInvalid invalidCmd {};
-        invalidCmd.errorString = "Missing key";
-        return std::unexpected { invalidCmd };
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandMget& cmd)
+{
+    auto keys = parseKeys(args_);
+    if (!keys.has_value()) {
+        return std::unexpected { keys.error() };
     }
+    cmd.keys_ = std::move(keys.value());
+    return ParseSuccessful {};
+}
 
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandMset& cmd)
+{
+    if (args_.size() % 2 != 0) {
+        return invalid("wrong number of arguments for 'MSET' command");
+    }
+    cmd.entries_.reserve(args_.size() / 2);
+    for (size_t i = 0; i < args_.size(); i += 2) {
+        if (args_[i].string_.empty()) {
+            return invalid("Missing key");
+        }
+        cmd.entries_.emplace_back(args_[i].string_, args_[i + 1].string_);
+    }
     return ParseSuccessful {};
 }
 
 std::expected<ParseSuccessful, CommandInvalid>
 ParsePayload::operator()(CommandExists& cmd)
 {
-    if (resp_.string_.has_value()) {
-        cmd.key_ = resp_.string_.value();
-    } else if (resp_.integer_.has_value()) {
-        cmd.key_ = std::to_string(resp_.integer_.value());
+    auto keys = parseKeys(args_);
+    if (!keys.has_value()) {
+        return std::unexpected { keys.error() };
     }
-    if (cmd.key_.empty()) {
-        CommandInvalid invalidCmd {};
-        invalidCmd.errorString = "Missing key";
-        return std::unexpected { invalidCmd };
+    cmd.keys_ = std::move(keys.value());
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandDel& cmd)
+{
+    auto keys = parseKeys(args_);
+    if (!keys.has_value()) {
+        return std::unexpected { keys.error() };
     }
+    cmd.keys_ = std::move(keys.value());
     return ParseSuccessful {};
 }
 
 std::expected<ParseSuccessful, CommandInvalid>
 ParsePayload::operator()(CommandIncr& cmd)
 {
-    if (resp_.string_.has_value()) {
-        cmd.key_ = resp_.string_.value();
-    } else if (resp_.integer_.has_value()) {
-        cmd.key_ = std::to_string(resp_.integer_.value());
+    const auto key = parseKey(args_);
+    if (!key.has_value()) {
+        return std::unexpected { key.error() };
+    }
+    cmd.key_ = key.value();
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandIncrBy& cmd)
+{
+    const auto key = parseKey(args_);
+    if (!key.has_value()) {
+        return std::unexpected { key.error() };
+    }
+    const auto increment = parseIntegerArgument(args_[1]);
+    if (!increment.has_value()) {
+        return std::unexpected { increment.error() };
+    }
+    cmd.key_ = key.value();
+    cmd.increment_ = increment.value();
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandDecr& cmd)
+{
+    const auto key = parseKey(args_);
+    if (!key.has_value()) {
+        return std::unexpected { key.error() };
+    }
+    cmd.key_ = key.value();
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandDecrBy& cmd)
+{
+    const auto key = parseKey(args_);
+    if (!key.has_value()) {
+        return std::unexpected { key.error() };
+    }
+    const auto decrement = parseIntegerArgument(args_[1]);
+    if (!decrement.has_value()) {
+        return std::unexpected { decrement.error() };
+    }
+    cmd.key_ = key.value();
+    cmd.decrement_ = decrement.value();
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandHset& cmd)
+{
+    const auto key = parseKey(args_);
+    if (!key.has_value()) {
+        return std::unexpected { key.error() };
+    }
+    if (args_.size() % 2 != 1) {
+        return invalid("wrong number of arguments for 'HSET' command");
+    }
+    cmd.key_ = key.value();
+    cmd.fields_.reserve(args_.size() / 2);
+    for (size_t i = 1; i < args_.size(); i += 2) {
+        cmd.fields_.emplace_back(args_[i].string_, args_[i + 1].string_);
+    }
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandHget& cmd)
+{
+    const auto key = parseKey(args_);
+    if (!key.has_value()) {
+        return std::unexpected { key.error() };
+    }
+    cmd.key_ = key.value();
+    cmd.field_ = args_[1].string_;
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandHgetall& cmd)
+{
+    const auto key = parseKey(args_);
+    if (!key.has_value()) {
+        return std::unexpected { key.error() };
+    }
+    cmd.key_ = key.value();
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandLpush& cmd)
+{
+    const auto key = parseKey(args_);
+    if (!key.has_value()) {
+        return std::unexpected { key.error() };
+    }
+    cmd.key_ = key.value();
+    cmd.values_ = strings(args_.subspan(1));
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandRpush& cmd)
+{
+    const auto key = parseKey(args_);
+    if (!key.has_value()) {
+        return std::unexpected { key.error() };
+    }
+    cmd.key_ = key.value();
+    cmd.values_ = strings(args_.subspan(1));
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandLrange& cmd)
+{
+    const auto key = parseKey(args_);
+    if (!key.has_value()) {
+        return std::unexpected { key.error() };
+    }
+    const auto start = parseIntegerArgument(args_[1]);
+    if (!start.has_value()) {
+        return std::unexpected { start.error() };
+    }
+    const auto stop = parseIntegerArgument(args_[2]);
+    if (!stop.has_value()) {
+        return std::unexpected { stop.error() };
+    }
+    cmd.key_ = key.value();
+    cmd.start_ = start.value();
+    cmd.stop_ = stop.value();
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandSadd& cmd)
+{
+    const auto key = parseKey(args_);
+    if (!key.has_value()) {
+        return std::unexpected { key.error() };
+    }
+    cmd.key_ = key.value();
+    cmd.members_ = strings(args_.subspan(1));
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandSmembers& cmd)
+{
+    const auto key = parseKey(args_);
+    if (!key.has_value()) {
+        return std::unexpected { key.error() };
+    }
+    cmd.key_ = key.value();
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandSismember& cmd)
+{
+    const auto key = parseKey(args_);
+    if (!key.has_value()) {
+        return std::unexpected { key.error() };
+    }
+    cmd.key_ = key.value();
+    cmd.member_ = args_[1].string_;
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandInfo& cmd)
+{
+    if (args_.size() > 1) {
+        return invalid("Syntax error");
+    }
+    if (!args_.empty()) {
+        cmd.section_ = args_[0].string_;
+    }
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandSave&)
+{
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandBgsave&)
+{
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandLastsave&)
+{
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandBgrewriteaof&)
+{
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandReplicaof& cmd)
+{
+    if (equalsIgnoreCase(args_[0].string_, "NO") && equalsIgnoreCase(args_[1].string_, "ONE")) {
+        return ParseSuccessful {};
+    }
+    if (args_[0].string_.empty() || args_[1].string_.empty()) {
+        return invalid("Missing host or port");
+    }
+    cmd.host_ = args_[0].string_;
+    cmd.port_ = args_[1].string_;
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandPsync& cmd)
+{
+    const auto offset = parseIntegerArgument(args_[1]);
+    if (!offset.has_value()) {
+        return std::unexpected { offset.error() };
+    }
+    cmd.replid_ = args_[0].string_;
+    cmd.offset_ = offset.value();
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandSlowlog& cmd)
+{
+    const auto subcommand = args_[0].string_;
+    if (equalsIgnoreCase(subcommand, "GET") && args_.size() <= 2) {
+        cmd.subcommand_ = CommandSlowlog::Subcommand::Get;
+        if (args_.size() == 2) {
+            const auto count = parseIntegerArgument(args_[1]);
+            if (!count.has_value()) {
+                return std::unexpected { count.error() };
+            }
+            cmd.count_ = count.value();
+        }
+    } else if (equalsIgnoreCase(subcommand, "LEN") && args_.size() == 1) {
+        cmd.subcommand_ = CommandSlowlog::Subcommand::Len;
+    } else if (equalsIgnoreCase(subcommand, "RESET") && args_.size() == 1) {
+        cmd.subcommand_ = CommandSlowlog::Subcommand::Reset;
+    } else {
+        return invalid("Unknown SLOWLOG subcommand or wrong number of arguments");
     }
-    if (cmd.key_.empty()) {
-        CommandInvalid invalidCmd {};
-        invalidCmd.errorString = "Missing key";
-        return std::unexpected { invalidCmd };
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandLatency& cmd)
+{
+    if (!equalsIgnoreCase(args_[0].string_, "HISTOGRAM")) {
+        return invalid("Unknown LATENCY subcommand");
     }
+    cmd.commands_ = strings(args_.subspan(1));
     return ParseSuccessful {};
-}
\ No newline at end of file
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandSubscribe& cmd)
+{
+    cmd.channels_ = strings(args_);
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandUnsubscribe& cmd)
+{
+    cmd.channels_ = strings(args_);
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandPsubscribe& cmd)
+{
+    cmd.patterns_ = strings(args_);
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandPunsubscribe& cmd)
+{
+    cmd.patterns_ = strings(args_);
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandPublish& cmd)
+{
+    cmd.channel_ = args_[0].string_;
+    cmd.message_ = args_[1].string_;
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandMulti&)
+{
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandExec&)
+{
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandDiscard&)
+{
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandWatch& cmd)
+{
+    cmd.keys_ = strings(args_);
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandUnwatch&)
+{
+    return ParseSuccessful {};
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandEval& cmd)
+{
+    cmd.script_ = args_[0].string_;
+    return parseKeysAndArgs(args_.subspan(1), cmd.keys_, cmd.args_);
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandEvalsha& cmd)
+{
+    cmd.sha_ = args_[0].string_;
+    return parseKeysAndArgs(args_.subspan(1), cmd.keys_, cmd.args_);
+}
+
+std::expected<ParseSuccessful, CommandInvalid>
+ParsePayload::operator()(CommandScript& cmd)
+{
+    const auto subcommand = args_[0].string_;
+    if (equalsIgnoreCase(subcommand, "LOAD") && args_.size() == 2) {
+        cmd.subcommand_ = CommandScript::Subcommand::Load;
+    } else if (equalsIgnoreCase(subcommand, "EXISTS") && args_.size() >= 2) {
+        cmd.subcommand_ = CommandScript::Subcommand::Exists;
+    } else if (equalsIgnoreCase(subcommand, "FLUSH") && args_.size() == 1) {
+        cmd.subcommand_ = CommandScript::Subcommand::Flush;
+    } else {
+        return invalid("Unknown SCRIPT subcommand or wrong number of arguments");
+    }
+    cmd.args_ = strings(args_.subspan(1));
+    return ParseSuccessful {};
+}
@@ -0,0 +1,126 @@
+#include "CommandStats.h"
+
+#include "Resp.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+double ticksPerMicrosecond()
+{
+    static const double rate = []() {
+        const auto start = std::chrono::steady_clock::now();
+        const auto startTicks = readTicks();
+        std::this_thread::sleep_for(std::chrono::milliseconds { 10 });
+        const auto ticks = readTicks() - startTicks;
+        const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        return static_cast<double>(ticks) / elapsed.count();
+    }();
+    return rate;
+}
+
+void SlowLog::add(const std::span<const RespToken> frame, const uint64_t microseconds)
+{
+    SlowLogEntry entry {};
+    entry.time_ = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    entry.microseconds_ = microseconds;
+    // An array of bulk strings, or an inline command in one string.
+    const auto args = !frame.empty() && frame[0].type_ == Prefix::ARRAY ? frame.subspan(1) : frame;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (i + 1 == maxArgs && args.size() > maxArgs) {
+            entry.args_.push_back("... (" + std::to_string(args.size() - i) + " more arguments)");
+            break;
+        }
+        const auto arg = args[i].string_;
+        if (arg.size() > maxArgLength) {
+            auto& truncated = entry.args_.emplace_back(arg.substr(0, maxArgLength));
+            truncated.append("... (").append(std::to_string(arg.size() - maxArgLength)).append(" more bytes)");
+        } else {
+            entry.args_.emplace_back(arg);
+        }
+    }
+
+    std::lock_guard lock { mutex_ };
+    entry.id_ = nextId_++;
+    entries_.push_front(std::move(entry));
+    while (entries_.size() > maxLength_) {
+        entries_.pop_back();
+    }
+}
+
+std::vector<SlowLogEntry> SlowLog::newest(const int64_t count) const
+{
+    std::lock_guard lock { mutex_ };
+    const auto n = count < 0 ? entries_.size() : std::min(entries_.size(), static_cast<size_t>(count));
+    return { entries_.begin(), entries_.begin() + static_cast<std::ptrdiff_t>(n) };
+}
+
+size_t SlowLog::size() const
+{
+    std::lock_guard lock { mutex_ };
+    return entries_.size();
+}
+
+void SlowLog::reset()
+{
+    std::lock_guard lock { mutex_ };
+    entries_.clear();
+}
+
+CommandMetrics::CommandMetrics(const int64_t slowerThanMicroseconds, const size_t slowLogLength)
+    : ticksPerMicrosecond_(ticksPerMicrosecond())
+    , slowThreshold_(slowerThanMicroseconds < 0
+              ? std::numeric_limits<uint64_t>::max()
+              : static_cast<uint64_t>(std::llround(static_cast<double>(slowerThanMicroseconds) * ticksPerMicrosecond_)))
+    , slowLog_(slowLogLength)
+{
+}
+
+CommandStats& CommandMetrics::addReactor()
+{
+    std::lock_guard lock { mutex_ };
+    return reactors_.emplace_back();
+}
+
+CommandMetrics::Summary CommandMetrics::summary(const size_t command) const
+{
+    Summary summary {};
+    summary.counts_.resize(LatencyHistogram::numBuckets);
+    std::lock_guard lock { mutex_ };
+    for (const auto& stats : reactors_) {
+        const auto& entry = stats.entry(command);
+        summary.calls_ += entry.calls_.load(std::memory_order_relaxed);
+        summary.ticks_ += entry.ticks_.load(std::memory_order_relaxed);
+        for (size_t bucket = 0; bucket < LatencyHistogram::numBuckets; ++bucket) {
+            summary.counts_[bucket] += entry.histogram_.count(bucket);
+        }
+    }
+    return summary;
+}
+
+uint64_t CommandMetrics::Summary::percentile(const double fraction) const
+{
+    uint64_t total = 0;
+    for (const auto count : counts_) {
+        total += count;
+    }
+    // The rank of the value, counting from 1.
+    const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(total))));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < counts_.size(); ++bucket) {
+        seen += counts_[bucket];
+        if (seen >= rank) {
+            return bucket + 1 < counts_.size() ? LatencyHistogram::lowerBound(bucket + 1) - 1
+                                               : LatencyHistogram::lowerBound(bucket);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include "Config.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+namespace {
+std::expected<unsigned, std::string> parseUnsigned(const std::string_view option, const std::string_view str)
+{
+    unsigned value {};
+    const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+    if (ec != std::errc() || ptr != str.data() + str.size()) {
+        return std::unexpected { "Invalid value for " + std::string { option } + ": " + std::string { str } };
+    }
+    return value;
+}
+
+std::expected<int64_t, std::string> parseSigned(const std::string_view option, const std::string_view str)
+{
+    int64_t value {};
+    const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+    if (ec != std::errc() || ptr != str.data() + str.size()) {
+        return std::unexpected { "Invalid value for " + std::string { option } + ": " + std::string { str } };
+    }
+    return value;
+}
+
+// A number of bytes with an optional unit, eg: 100mb
+std::expected<uint64_t, std::string> parseBytes(const std::string_view option, const std::string_view str)
+{
+    constexpr std::pair<std::string_view, uint64_t> units[] {
+        { "kb", uint64_t { 1 } << 10 }, { "mb", uint64_t { 1 } << 20 }, { "gb", uint64_t { 1 } << 30 }, { "b", 1 }
+    };
+    auto digits = str;
+    uint64_t multiplier = 1;
+    for (const auto& [suffix, bytes] : units) {
+        if (digits.size() > suffix.size() && digits.ends_with(suffix)) {
+            digits.remove_suffix(suffix.size());
+            multiplier = bytes;
+            break;
+        }
+    }
+    uint64_t value {};
+    const auto [ptr, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+    if (ec != std::errc() || ptr != digits.data() + digits.size() || __builtin_mul_overflow(value, multiplier, &value)) {
+        return std::unexpected { "Invalid value for " + std::string { option } + ": " + std::string { str } };
+    }
+    return value;
+}
+
+constexpr std::pair<std::string_view, EvictionPolicy> evictionPolicies[] {
+    { "noeviction", EvictionPolicy::NoEviction },
+    { "allkeys-lru", EvictionPolicy::AllKeysLru },
+    { "allkeys-lfu", EvictionPolicy::AllKeysLfu },
+    { "volatile-ttl", EvictionPolicy::VolatileTtl },
+};
+
+constexpr LogLevel logLevels[] { LogLevel::Debug, LogLevel::Info, LogLevel::Warning, LogLevel::Error };
+} // namespace
+
+std::string_view evictionPolicyName(const EvictionPolicy policy)
+{
+    for (const auto& [name, value] : evictionPolicies) {
+        if (value == policy) {
+            return name;
+        }
+    }
+    return {};
+}
+
+std::expected<ServerConfig, std::string> parseArgs(std::span<const char* const> args)
+{
+    ServerConfig config {};
+    // args[0] is the program name
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string_view option { args[i] };
+        if (i + 1 >= args.size()) {
+            return std::unexpected { "Missing value for " + std::string { option } };
+        }
+        const std::string_view value { args[++i] };
+
+        if (option == "--port") {
+            config.port_ = value;
+        } else if (option == "--threads") {
+            const auto threads = parseUnsigned(option, value);
+            if (!threads.has_value()) {
+                return std::unexpected { threads.error() };
+            }
+            if (threads.value() == 0) {
+                return std::unexpected { "--threads must be at least 1" };
+            }
+            config.threads_ = threads.value();
+        } else if (option == "--io-backend") {
+            if (value == "epoll") {
+                config.ioBackend_ = IoBackend::Epoll;
+            } else if (value == "io_uring") {
+                config.ioBackend_ = IoBackend::IoUring;
+            } else {
+                return std::unexpected { "--io-backend must be epoll or io_uring" };
+            }
+        } else if (option == "--dbfilename") {
+            config.dbFilename_ = value;
+        } else if (option == "--appendonly") {
+            if (value != "yes" && value != "no") {
+                return std::unexpected { "--appendonly must be yes or no" };
+            }
+            config.appendOnly_ = value == "yes";
+        } else if (option == "--appendfilename") {
+            config.appendFilename_ = value;
+        } else if (option == "--appendfsync") {
+            if (value == "always") {
+                config.appendFsync_ = FsyncPolicy::Always;
+            } else if (value == "everysec") {
+                config.appendFsync_ = FsyncPolicy::EverySecond;
+            } else if (value == "no") {
+                config.appendFsync_ = FsyncPolicy::No;
+            } else {
+                return std::unexpected { "--appendfsync must be always, everysec or no" };
+            }
+        } else if (option == "--maxmemory") {
+            const auto bytes = parseBytes(option, value);
+            if (!bytes.has_value()) {
+                return std::unexpected { bytes.error() };
+            }
+            config.maxMemory_ = bytes.value();
+        } else if (option == "--maxmemory-policy") {
+            const auto* policy = std::ranges::find(evictionPolicies, value, &std::pair<std::string_view, EvictionPolicy>::first);
+            if (policy == std::end(evictionPolicies)) {
+                return std::unexpected { "--maxmemory-policy must be noeviction, allkeys-lru, allkeys-lfu or volatile-ttl" };
+            }
+            config.maxMemoryPolicy_ = policy->second;
+        } else if (option == "--maxmemory-samples") {
+            const auto samples = parseUnsigned(option, value);
+            if (!samples.has_value()) {
+                return std::unexpected { samples.error() };
+            }
+            if (samples.value() == 0) {
+                return std::unexpected { "--maxmemory-samples must be at least 1" };
+            }
+            config.maxMemorySamples_ = samples.value();
+        } else if (option == "--replicaof") {
+            // "host port", as in the Redis configuration.
+            const auto space = value.find(' ');
+            if (space == std::string_view::npos || space == 0 || space + 1 == value.size()) {
+                return std::unexpected { "--replicaof must be \"<host> <port>\"" };
+            }
+            config.replicaOfHost_ = value.substr(0, space);
+            config.replicaOfPort_ = value.substr(space + 1);
+        } else if (option == "--repl-backlog-size") {
+            const auto bytes = parseBytes(option, value);
+            if (!bytes.has_value()) {
+                return std::unexpected { bytes.error() };
+            }
+            if (bytes.value() == 0) {
+                return std::unexpected { "--repl-backlog-size must be at least 1" };
+            }
+            config.replBacklogSize_ = bytes.value();
+        } else if (option == "--slowlog-log-slower-than") {
+            const auto microseconds = parseSigned(option, value);
+            if (!microseconds.has_value()) {
+                return std::unexpected { microseconds.error() };
+            }
+            config.slowlogSlowerThan_ = microseconds.value();
+        } else if (option == "--slowlog-max-len") {
+            const auto length = parseUnsigned(option, value);
+            if (!length.has_value()) {
+                return std::unexpected { length.error() };
+            }
+            config.slowlogMaxLen_ = length.value();
+        } else if (option == "--pubsub-output-limit") {
+            const auto bytes = parseBytes(option, value);
+            if (!bytes.has_value()) {
+                return std::unexpected { bytes.error() };
+            }
+            config.pubsubOutputLimit_ = bytes.value();
+        } else if (option == "--loglevel") {
+            const auto level = std::ranges::find_if(logLevels, [value](const LogLevel level) { return logLevelName(level) == value; });
+            if (level == std::end(logLevels)) {
+                return std::unexpected { "--loglevel must be debug, info, warning or error" };
+            }
+            config.logLevel_ = *level;
+        } else {
+            return std::unexpected { "Unknown option: " + std::string { option } };
+        }
+    }
+    return config;
+}
@@ -0,0 +1,203 @@
+#include "IoUring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <linux/io_uring.h>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+std::string errorString(const std::string& call, const int error)
+{
+    return call + ": " + std::strerror(error);
+}
+
+template <typename T>
+T* at(void* base, const uint32_t offset)
+{
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+} // namespace
+
+std::expected<std::unique_ptr<IoUring>, std::string> IoUring::create(const unsigned entries)
+{
+    std::unique_ptr<IoUring> ring { new IoUring() };
+    io_uring_params params {};
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED;
+    ring->fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (ring->fd_ == -1 && errno == EINVAL) {
+        // Older kernels run the completion work right away instead.
+        params = io_uring_params {};
+        ring->fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    }
+    if (ring->fd_ == -1) {
+        return std::unexpected { errorString("io_uring_setup", errno) };
+    }
+    ring->disabled_ = (params.flags & IORING_SETUP_R_DISABLED) != 0;
+    // Both queues share one mapping since 5.4; older kernels are not supported.
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0) {
+        return std::unexpected { std::string { "io_uring_setup: the kernel lacks IORING_FEAT_SINGLE_MMAP" } };
+    }
+
+    ring->ringSize_ = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    auto* memory = mmap(nullptr, ring->ringSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd_,
+        IORING_OFF_SQ_RING);
+    if (memory == MAP_FAILED) {
+        return std::unexpected { errorString("mmap", errno) };
+    }
+    ring->ringMemory_ = memory;
+    ring->sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    memory = mmap(nullptr, ring->sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd_,
+        IORING_OFF_SQES);
+    if (memory == MAP_FAILED) {
+        return std::unexpected { errorString("mmap", errno) };
+    }
+    ring->sqes_ = static_cast<io_uring_sqe*>(memory);
+
+    ring->sqEntries_ = params.sq_entries;
+    ring->sqHead_ = at<unsigned>(ring->ringMemory_, params.sq_off.head);
+    ring->sqTail_ = at<unsigned>(ring->ringMemory_, params.sq_off.tail);
+    ring->sqMask_ = *at<unsigned>(ring->ringMemory_, params.sq_off.ring_mask);
+    ring->sqeTail_ = *ring->sqTail_;
+    // Slot i of the queue always holds entry i, so entries are filled in place.
+    auto* array = at<unsigned>(ring->ringMemory_, params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; ++i) {
+        array[i] = i;
+    }
+    ring->cqHead_ = at<unsigned>(ring->ringMemory_, params.cq_off.head);
+    ring->cqTail_ = at<unsigned>(ring->ringMemory_, params.cq_off.tail);
+    ring->cqMask_ = *at<unsigned>(ring->ringMemory_, params.cq_off.ring_mask);
+    ring->cqes_ = at<io_uring_cqe>(ring->ringMemory_, params.cq_off.cqes);
+
+    // The probe reports the opcodes the kernel implements, but not the flags of an
+    // opcode such as multishot; callers infer those from newer opcodes.
+    std::vector<char> probeMemory(sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op));
+    auto* probe = reinterpret_cast<io_uring_probe*>(probeMemory.data());
+    if (syscall(__NR_io_uring_register, ring->fd_, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0) {
+        for (unsigned op = 0; op < probe->ops_len && op < IORING_OP_LAST; ++op) {
+            ring->supported_[op] = (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+        }
+    }
+    return ring;
+}
+
+IoUring::~IoUring()
+{
+    if (sqes_ != nullptr) {
+        munmap(sqes_, sqesSize_);
+    }
+    if (ringMemory_ != nullptr) {
+        munmap(ringMemory_, ringSize_);
+    }
+    if (fd_ != -1) {
+        close(fd_);
+    }
+}
+
+void IoUring::enable()
+{
+    if (disabled_) {
+        syscall(__NR_io_uring_register, fd_, IORING_REGISTER_ENABLE_RINGS, nullptr, 0);
+        disabled_ = false;
+    }
+}
+
+bool IoUring::supports(const uint8_t opcode) const
+{
+    return opcode < supported_.size() && supported_[opcode];
+}
+
+io_uring_sqe& IoUring::nextSqe()
+{
+    while (sqeTail_ - std::atomic_ref { *sqHead_ }.load(std::memory_order_acquire) >= sqEntries_) {
+        submitAndWait(0);
+    }
+    auto& sqe = sqes_[sqeTail_ & sqMask_];
+    sqe = io_uring_sqe {};
+    ++sqeTail_;
+    return sqe;
+}
+
+int IoUring::submitAndWait(const unsigned waitFor)
+{
+    std::atomic_ref { *sqTail_ }.store(sqeTail_, std::memory_order_release);
+    // The kernel takes at most what is queued, so counting from the head it consumed
+    // is right even after an interrupted call submitted part of the queue.
+    const auto queued = sqeTail_ - std::atomic_ref { *sqHead_ }.load(std::memory_order_acquire);
+    const auto flags = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0u;
+    if (syscall(__NR_io_uring_enter, fd_, queued, waitFor, flags, nullptr, 0) == -1) {
+        return -errno;
+    }
+    return 0;
+}
+
+BufferRing::BufferRing(IoUring& ring, const uint16_t groupId, const unsigned count, const size_t bufferSize)
+    : ring_(ring)
+    , groupId_(groupId)
+    , count_(count)
+    , bufferSize_(bufferSize)
+{
+}
+
+std::expected<std::unique_ptr<BufferRing>, std::string> BufferRing::create(IoUring& ring, const uint16_t groupId,
+    const unsigned count, const size_t bufferSize)
+{
+    std::unique_ptr<BufferRing> buffers { new BufferRing(ring, groupId, count, bufferSize) };
+    // The ring has to be page aligned, which mmap guarantees.
+    buffers->entriesSize_ = count * sizeof(io_uring_buf);
+    auto* memory = mmap(nullptr, buffers->entriesSize_, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (memory == MAP_FAILED) {
+        return std::unexpected { errorString("mmap", errno) };
+    }
+    buffers->entries_ = static_cast<io_uring_buf*>(memory);
+
+    io_uring_buf_reg registration {};
+    registration.ring_addr = reinterpret_cast<uint64_t>(buffers->entries_);
+    registration.ring_entries = count;
+    registration.bgid = groupId;
+    if (syscall(__NR_io_uring_register, ring.fd(), IORING_REGISTER_PBUF_RING, &registration, 1) == -1) {
+        const auto error = errno;
+        munmap(buffers->entries_, buffers->entriesSize_);
+        buffers->entries_ = nullptr;
+        return std::unexpected { errorString("IORING_REGISTER_PBUF_RING", error) };
+    }
+
+    buffers->buffers_ = std::make_unique_for_overwrite<char[]>(count * bufferSize);
+    for (unsigned id = 0; id < count; ++id) {
+        buffers->recycle(static_cast<uint16_t>(id));
+    }
+    return buffers;
+}
+
+BufferRing::~BufferRing()
+{
+    if (entries_ == nullptr) {
+        return;
+    }
+    io_uring_buf_reg registration {};
+    registration.bgid = groupId_;
+    syscall(__NR_io_uring_register, ring_.fd(), IORING_UNREGISTER_PBUF_RING, &registration, 1);
+    munmap(entries_, entriesSize_);
+}
+
+void BufferRing::recycle(const uint16_t id)
+{
+    // The tail overlays the reserved field of the first entry, so only the other fields
+    // of an entry are written.
+    auto& entry = entries_[tail_ & (count_ - 1)];
+    entry.addr = reinterpret_cast<uint64_t>(buffer(id).data());
+    entry.len = static_cast<uint32_t>(bufferSize_);
+    entry.bid = id;
+    ++tail_;
+    std::atomic_ref { entries_[0].resv }.store(tail_, std::memory_order_release);
+}
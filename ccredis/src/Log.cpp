@@ -0,0 +1,179 @@
+#include "Log.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+// How long the writer sleeps when nothing urgent was logged. Lines wait at most this
+// long before they are written.
+constexpr auto writeInterval = std::chrono::milliseconds { 10 };
+
+void writeAll(const int fd, const std::string_view data)
+{
+    size_t written = 0;
+    while (written < data.size()) {
+        const auto n = ::write(fd, data.data() + written, data.size() - written);
+        if (n <= 0) {
+            // Nowhere to report it.
+            return;
+        }
+        written += static_cast<size_t>(n);
+    }
+}
+} // namespace
+
+std::string_view logLevelName(const LogLevel level)
+{
+    switch (level) {
+    case LogLevel::Debug:
+        return "debug";
+    case LogLevel::Info:
+        return "info";
+    case LogLevel::Warning:
+        return "warning";
+    case LogLevel::Error:
+        return "error";
+    }
+    return {};
+}
+
+bool LogRing::push(const LogLevel level, const std::string_view line)
+{
+    const auto head = head_.load(std::memory_order_relaxed);
+    const auto tail = tail_.load(std::memory_order_acquire);
+    const auto length = sizeof(Header) + line.size();
+    if (capacity - (head - tail) < length) {
+        return false;
+    }
+    const Header header { .length_ = static_cast<uint32_t>(line.size()), .level_ = level };
+    copyIn(head, &header, sizeof(header));
+    copyIn(head + sizeof(header), line.data(), line.size());
+    head_.store(head + length, std::memory_order_release);
+    return true;
+}
+
+void LogRing::copyIn(const size_t position, const void* data, const size_t length)
+{
+    const auto offset = position % capacity;
+    const auto first = std::min(length, capacity - offset);
+    std::memcpy(data_.data() + offset, data, first);
+    std::memcpy(data_.data(), static_cast<const char*>(data) + first, length - first);
+}
+
+void LogRing::copyOut(const size_t position, void* data, const size_t length) const
+{
+    const auto offset = position % capacity;
+    const auto first = std::min(length, capacity - offset);
+    std::memcpy(data, data_.data() + offset, first);
+    std::memcpy(static_cast<char*>(data) + first, data_.data(), length - first);
+}
+
+Logger& Logger::instance()
+{
+    // Never destroyed: threads that outlive main may still log.
+    static Logger* logger = []() {
+        auto* created = new Logger();
+        std::atexit([]() { instance().flush(); });
+        return created;
+    }();
+    return *logger;
+}
+
+Logger::Logger()
+    : writer_([this]() { writeLoop(); })
+{
+}
+
+void Logger::push(const LogLevel level, const std::string_view line)
+{
+    thread_local const std::shared_ptr<LogRing> ring = [this]() {
+        auto created = std::make_shared<LogRing>();
+        std::lock_guard lock { ringsMutex_ };
+        rings_.push_back(created);
+        return created;
+    }();
+    if (!ring->push(level, line)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // Warnings and errors are rare and wanted right away.
+    if (level >= LogLevel::Warning) {
+        {
+            std::lock_guard lock { wakeMutex_ };
+            urgent_ = true;
+        }
+        wake_.notify_one();
+    }
+}
+
+void Logger::flush()
+{
+    std::lock_guard lock { writeMutex_ };
+    drainRings();
+}
+
+void Logger::writeLoop()
+{
+    for (;;) {
+        {
+            std::unique_lock lock { wakeMutex_ };
+            wake_.wait_for(lock, writeInterval, [this]() { return urgent_; });
+            urgent_ = false;
+        }
+        std::lock_guard lock { writeMutex_ };
+        drainRings();
+    }
+}
+
+void Logger::drainRings()
+{
+    std::vector<LogRing*> rings {};
+    {
+        std::lock_guard lock { ringsMutex_ };
+        for (const auto& ring : rings_) {
+            rings.push_back(ring.get());
+        }
+    }
+    // Rings are only removed below, by the thread that drains them.
+    for (auto* ring : rings) {
+        ring->drain([this](const LogLevel level, const std::string_view line) {
+            auto& out = level >= LogLevel::Warning ? err_ : out_;
+            switch (level) {
+            case LogLevel::Debug:
+                out.append("[DEBUG] ");
+                break;
+            case LogLevel::Info:
+                out.append("[INFO] ");
+                break;
+            case LogLevel::Warning:
+                out.append("[WARN] ");
+                break;
+            case LogLevel::Error:
+                out.append("[ERROR] ");
+                break;
+            }
+            out.append(line).append("\n");
+        });
+    }
+    const auto dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != reportedDropped_) {
+        err_.append("[WARN] Dropped ").append(std::to_string(dropped - reportedDropped_)).append(" log lines\n");
+        reportedDropped_ = dropped;
+    }
+    writeAll(STDOUT_FILENO, out_);
+    writeAll(STDERR_FILENO, err_);
+    out_.clear();
+    err_.clear();
+
+    // A ring only the logger refers to belongs to a thread that has exited, and nothing
+    // is pushed to it anymore.
+    std::lock_guard lock { ringsMutex_ };
+    std::erase_if(rings_, [](const std::shared_ptr<LogRing>& ring) { return ring.use_count() == 1 && ring->empty(); });
+}
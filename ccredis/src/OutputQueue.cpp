@@ -0,0 +1,61 @@
+#include "OutputQueue.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+#include <sys/uio.h>
+#include <utility>
+
+void OutputQueue::append(const std::span<const iovec> segments, size_t skip)
+{
+    for (const auto& segment : segments) {
+        const auto skipped = std::min(skip, segment.iov_len);
+        skip -= skipped;
+        if (skipped == segment.iov_len) {
+            continue;
+        }
+        if (chunks_.empty() || chunks_.back().shared_) {
+            chunks_.emplace_back();
+        }
+        chunks_.back().owned_.append(static_cast<const char*>(segment.iov_base) + skipped, segment.iov_len - skipped);
+        size_ += segment.iov_len - skipped;
+    }
+}
+
+void OutputQueue::append(std::shared_ptr<const std::string> message)
+{
+    size_ += message->size();
+    chunks_.push_back(Chunk { .shared_ = std::move(message), .owned_ = {} });
+}
+
+std::span<const iovec> OutputQueue::segments(const size_t max)
+{
+    segments_.clear();
+    auto offset = offset_;
+    for (const auto& chunk : chunks_) {
+        if (segments_.size() == max) {
+            break;
+        }
+        const auto& bytes = chunk.bytes();
+        segments_.push_back(iovec { .iov_base = const_cast<char*>(bytes.data()) + offset, .iov_len = bytes.size() - offset });
+        offset = 0;
+    }
+    return segments_;
+}
+
+void OutputQueue::consume(size_t bytes)
+{
+    size_ -= bytes;
+    while (bytes > 0) {
+        const auto left = chunks_.front().bytes().size() - offset_;
+        if (bytes < left) {
+            offset_ += bytes;
+            return;
+        }
+        bytes -= left;
+        offset_ = 0;
+        chunks_.pop_front();
+    }
+}
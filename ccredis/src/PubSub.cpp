@@ -0,0 +1,294 @@
+#include "PubSub.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+void appendBulkstring(std::string& frame, const std::string_view str)
+{
+    frame.append("$").append(std::to_string(str.size())).append("\r\n").append(str).append("\r\n");
+}
+
+// The message as a client subscribed to the channel receives it.
+std::shared_ptr<const std::string> encodeMessage(const std::string_view channel, const std::string_view message)
+{
+    auto frame = std::make_shared<std::string>();
+    frame->reserve(channel.size() + message.size() + 32);
+    frame->append("*3\r\n");
+    appendBulkstring(*frame, "message");
+    appendBulkstring(*frame, channel);
+    appendBulkstring(*frame, message);
+    return frame;
+}
+
+// The message as a client subscribed to a pattern matching the channel receives it.
+std::shared_ptr<const std::string> encodePatternMessage(const std::string_view pattern, const std::string_view channel, const std::string_view message)
+{
+    auto frame = std::make_shared<std::string>();
+    frame->reserve(pattern.size() + channel.size() + message.size() + 48);
+    frame->append("*4\r\n");
+    appendBulkstring(*frame, "pmessage");
+    appendBulkstring(*frame, pattern);
+    appendBulkstring(*frame, channel);
+    appendBulkstring(*frame, message);
+    return frame;
+}
+
+// Whether c is in the set that starts after the [ at the front of pattern, and where the
+// set ends. An unterminated set runs to the end of the pattern.
+bool matchesSet(std::string_view& pattern, const char c)
+{
+    pattern.remove_prefix(1);
+    const auto negated = !pattern.empty() && pattern.front() == '^';
+    if (negated) {
+        pattern.remove_prefix(1);
+    }
+    auto matched = false;
+    while (!pattern.empty() && pattern.front() != ']') {
+        if (pattern.front() == '\\' && pattern.size() >= 2) {
+            pattern.remove_prefix(1);
+            matched |= pattern.front() == c;
+        } else if (pattern.size() >= 3 && pattern[1] == '-' && pattern[2] != ']') {
+            const auto [low, high] = std::minmax(pattern[0], pattern[2]);
+            matched |= low <= c && c <= high;
+            pattern.remove_prefix(2);
+        } else {
+            matched |= pattern.front() == c;
+        }
+        pattern.remove_prefix(1);
+    }
+    if (!pattern.empty()) {
+        pattern.remove_prefix(1);
+    }
+    return matched != negated;
+}
+} // namespace
+
+bool matchesPattern(std::string_view pattern, std::string_view str)
+{
+    // Where to resume after the last *: it takes one more character on a mismatch.
+    std::string_view starPattern {};
+    std::string_view starStr {};
+    auto starred = false;
+    while (!str.empty()) {
+        auto rest = pattern;
+        auto matched = false;
+        if (!rest.empty()) {
+            switch (rest.front()) {
+            case '*':
+                pattern.remove_prefix(1);
+                starPattern = pattern;
+                starStr = str;
+                starred = true;
+                continue;
+            case '?':
+                rest.remove_prefix(1);
+                matched = true;
+                break;
+            case '[':
+                matched = matchesSet(rest, str.front());
+                break;
+            case '\\':
+                if (rest.size() >= 2) {
+                    rest.remove_prefix(1);
+                }
+                [[fallthrough]];
+            default:
+                matched = rest.front() == str.front();
+                rest.remove_prefix(1);
+                break;
+            }
+        }
+        if (matched) {
+            pattern = rest;
+            str.remove_prefix(1);
+        } else if (starred) {
+            starStr.remove_prefix(1);
+            pattern = starPattern;
+            str = starStr;
+        } else {
+            return false;
+        }
+    }
+    return pattern.find_first_not_of('*') == std::string_view::npos;
+}
+
+size_t PubSub::addReactor(std::function<void()> wake)
+{
+    std::unique_lock lock { mutex_ };
+    auto& inbox = inboxes_.emplace_back();
+    inbox.wake_ = std::move(wake);
+    for (auto* registry : { &channels_, &patterns_ }) {
+        for (auto& [target, counts] : *registry) {
+            counts.resize(inboxes_.size());
+        }
+    }
+    return inboxes_.size() - 1;
+}
+
+void PubSub::subscribe(const size_t reactor, const std::string_view target, const bool pattern)
+{
+    std::unique_lock lock { mutex_ };
+    auto& targets = registry(pattern);
+    auto found = targets.find(target);
+    if (found == targets.end()) {
+        found = targets.emplace(std::string { target }, Counts(inboxes_.size())).first;
+    }
+    ++found->second[reactor];
+}
+
+void PubSub::unsubscribe(const size_t reactor, const std::string_view target, const bool pattern)
+{
+    std::unique_lock lock { mutex_ };
+    auto& targets = registry(pattern);
+    const auto found = targets.find(target);
+    if (found == targets.end() || found->second[reactor] == 0) {
+        return;
+    }
+    --found->second[reactor];
+    if (std::ranges::all_of(found->second, [](const uint32_t count) { return count == 0; })) {
+        targets.erase(found);
+    }
+}
+
+size_t PubSub::publish(const size_t fromReactor, const std::string_view channel, const std::string_view message)
+{
+    // The frames to queue and the subscribers per reactor they go to.
+    std::vector<std::pair<Publication, const Counts*>> publications {};
+    size_t receivers = 0;
+    std::shared_lock lock { mutex_ };
+    if (const auto found = channels_.find(channel); found != channels_.end()) {
+        publications.emplace_back(Publication { .target_ = std::string { channel }, .pattern_ = false, .frame_ = encodeMessage(channel, message) }, &found->second);
+    }
+    for (const auto& [pattern, counts] : patterns_) {
+        if (matchesPattern(pattern, channel)) {
+            publications.emplace_back(Publication { .target_ = pattern, .pattern_ = true, .frame_ = encodePatternMessage(pattern, channel, message) }, &counts);
+        }
+    }
+    for (size_t reactor = 0; reactor < inboxes_.size(); ++reactor) {
+        auto& inbox = inboxes_[reactor];
+        auto queued = false;
+        {
+            std::lock_guard inboxLock { inbox.mutex_ };
+            for (const auto& [publication, counts] : publications) {
+                if ((*counts)[reactor] > 0) {
+                    receivers += (*counts)[reactor];
+                    inbox.publications_.push_back(publication);
+                    queued = true;
+                }
+            }
+        }
+        // Woken once until it takes what was queued; the publishing reactor takes its
+        // own at the end of its batch anyway.
+        if (queued && reactor != fromReactor && !inbox.signaled_.exchange(true, std::memory_order_acq_rel) && inbox.wake_) {
+            inbox.wake_();
+        }
+    }
+    return receivers;
+}
+
+std::vector<Publication> PubSub::take(const size_t reactor)
+{
+    std::shared_lock lock { mutex_ };
+    auto& inbox = inboxes_[reactor];
+    inbox.signaled_.store(false, std::memory_order_release);
+    std::lock_guard inboxLock { inbox.mutex_ };
+    return std::exchange(inbox.publications_, {});
+}
+
+Subscriptions::~Subscriptions()
+{
+    for (const auto& [target, clients] : channels_) {
+        for (size_t i = 0; i < clients.size(); ++i) {
+            pubsub_.unsubscribe(reactor_, target, false);
+        }
+    }
+    for (const auto& [target, clients] : patterns_) {
+        for (size_t i = 0; i < clients.size(); ++i) {
+            pubsub_.unsubscribe(reactor_, target, true);
+        }
+    }
+}
+
+size_t Subscriptions::subscribe(const uint64_t client, const std::string_view target, const bool pattern)
+{
+    auto& targets = pattern ? clients_[client].patterns_ : clients_[client].channels_;
+    if (std::ranges::find(targets, target) == targets.end()) {
+        targets.emplace_back(target);
+        auto& registry = pattern ? patterns_ : channels_;
+        auto found = registry.find(target);
+        if (found == registry.end()) {
+            found = registry.emplace(std::string { target }, std::vector<uint64_t> {}).first;
+        }
+        found->second.push_back(client);
+        pubsub_.subscribe(reactor_, target, pattern);
+    }
+    return count(client);
+}
+
+size_t Subscriptions::unsubscribe(const uint64_t client, const std::string_view target, const bool pattern)
+{
+    const auto found = clients_.find(client);
+    if (found == clients_.end()) {
+        return 0;
+    }
+    auto& targets = pattern ? found->second.patterns_ : found->second.channels_;
+    if (const auto subscribed = std::ranges::find(targets, target); subscribed != targets.end()) {
+        targets.erase(subscribed);
+        auto& registry = pattern ? patterns_ : channels_;
+        const auto clients = registry.find(target);
+        std::erase(clients->second, client);
+        if (clients->second.empty()) {
+            registry.erase(clients);
+        }
+        pubsub_.unsubscribe(reactor_, target, pattern);
+    }
+    const auto remaining = count(client);
+    if (remaining == 0) {
+        clients_.erase(found);
+    }
+    return remaining;
+}
+
+std::vector<std::string> Subscriptions::targets(const uint64_t client, const bool pattern) const
+{
+    const auto found = clients_.find(client);
+    if (found == clients_.end()) {
+        return {};
+    }
+    return pattern ? found->second.patterns_ : found->second.channels_;
+}
+
+size_t Subscriptions::count(const uint64_t client) const
+{
+    const auto found = clients_.find(client);
+    return found == clients_.end() ? 0 : found->second.channels_.size() + found->second.patterns_.size();
+}
+
+void Subscriptions::remove(const uint64_t client)
+{
+    for (const auto pattern : { false, true }) {
+        for (const auto& target : targets(client, pattern)) {
+            unsubscribe(client, target, pattern);
+        }
+    }
+}
+
+std::span<const uint64_t> Subscriptions::subscribers(const Publication& publication) const
+{
+    const auto& registry = publication.pattern_ ? patterns_ : channels_;
+    const auto found = registry.find(publication.target_);
+    if (found == registry.end()) {
+        return {};
+    }
+    return found->second;
+}
@@ -0,0 +1,372 @@
+#include "Reactor.h"
+
+#include "CommandExecutor.h"
+#include "Log.h"
+#include "RespEncoder.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <variant>
+#include <vector>
+
+namespace {
+// Sends the segments with as few sendmsg calls as the socket allows; sendmsg rather
+// than writev for MSG_NOSIGNAL. Returns the number of bytes the socket took, or nullopt
+// if the connection failed.
+std::optional<size_t> sendSegments(int clientFd, std::span<const iovec> segments)
+{
+    size_t total = 0;
+    while (!segments.empty()) {
+        msghdr message {};
+        message.msg_iov = const_cast<iovec*>(segments.data());
+        message.msg_iovlen = std::min<size_t>(segments.size(), IOV_MAX);
+        const auto n = sendmsg(clientFd, &message, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            LOG_ERROR("sendmsg: ", std::strerror(errno));
+            return std::nullopt;
+        }
+        total += n;
+        // Skip the segments that went out whole. A short write means the socket buffer
+        // is full; the caller queues the rest.
+        auto left = static_cast<size_t>(n);
+        size_t sent = 0;
+        while (sent < message.msg_iovlen && left >= segments[sent].iov_len) {
+            left -= segments[sent++].iov_len;
+        }
+        if (sent < message.msg_iovlen) {
+            break;
+        }
+        segments = segments.subspan(sent);
+    }
+    return total;
+}
+
+// Grow the read buffer when less than this is free before a recv.
+constexpr size_t minReadSize = 16 * 1024;
+
+void addToEpoll(int epollFd, int fd, uint32_t events)
+{
+    epoll_event event { .events = events, .data = { .fd = fd } };
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        LOG_ERROR("epoll_ctl: ", std::strerror(errno));
+        exit(1);
+    }
+}
+} // namespace
+
+Reactor::Reactor(int listener, const ServerContext& context)
+    : listener_(listener)
+    , epollFd_(epoll_create1(EPOLL_CLOEXEC))
+    , timerFd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC))
+    , wakeFd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    , executor_(context, [this]() {
+        constexpr uint64_t one = 1;
+        [[maybe_unused]] const auto n = write(wakeFd_, &one, sizeof one);
+    })
+{
+    if (epollFd_ == -1) {
+        LOG_ERROR("epoll_create1: ", std::strerror(errno));
+        exit(1);
+    }
+    if (timerFd_ == -1) {
+        LOG_ERROR("timerfd_create: ", std::strerror(errno));
+        exit(1);
+    }
+    if (wakeFd_ == -1) {
+        LOG_ERROR("eventfd: ", std::strerror(errno));
+        exit(1);
+    }
+    constexpr itimerspec tick { .it_interval = { .tv_sec = 0, .tv_nsec = CommandExecutor::tickIntervalNs },
+        .it_value = { .tv_sec = 0, .tv_nsec = CommandExecutor::tickIntervalNs } };
+    timerfd_settime(timerFd_, 0, &tick, nullptr);
+    addToEpoll(epollFd_, listener_, EPOLLIN | EPOLLET);
+    addToEpoll(epollFd_, timerFd_, EPOLLIN);
+    addToEpoll(epollFd_, wakeFd_, EPOLLIN);
+}
+
+Reactor::~Reactor()
+{
+    close(wakeFd_);
+    close(timerFd_);
+    close(epollFd_);
+    close(listener_);
+}
+
+// Executes every complete frame in the read buffer. Replies are collected in the
+// encoder and sent together once the socket has been drained.
+ClientState Reactor::handleInput(Connection& connection)
+{
+    size_t consumed = 0;
+    const auto state = executor_.execute(static_cast<uint64_t>(connection.fd_), { connection.readBuffer_.data(), connection.readLength_ },
+        consumed, connection.followerRequest_);
+    if (state == ClientState::Follower) {
+        return state;
+    }
+    // Keep the incomplete tail for the next read.
+    auto& buffer = connection.readBuffer_;
+    std::copy(buffer.begin() + consumed, buffer.begin() + connection.readLength_, buffer.begin());
+    connection.readLength_ -= consumed;
+    if (connection.readLength_ > CommandExecutor::maxQueryBufferSize) {
+        LOG_WARNING("Query buffer limit reached, closing client");
+        return ClientState::Disconnected;
+    }
+    return state;
+}
+
+ClientState Reactor::handleClient(Connection& connection)
+{
+    // Edge-triggered: we are only woken up once per batch of data, so keep reading
+    // until the socket is drained.
+    auto state = ClientState::Connected;
+    auto& buffer = connection.readBuffer_;
+    while (state == ClientState::Connected) {
+        if (buffer.size() - connection.readLength_ < minReadSize) {
+            buffer.resize(std::max(buffer.size() * 2, connection.readLength_ + minReadSize));
+        }
+        const auto n = recv(connection.fd_, buffer.data() + connection.readLength_,
+            buffer.size() - connection.readLength_, 0);
+        if (n == 0) {
+            // client closed the connection
+            LOG_INFO("Client disconnected");
+            state = ClientState::Disconnected;
+            break;
+        }
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_INFO("Received ", n, " . There is an error");
+            // Remove client.
+            state = ClientState::Disconnected;
+            break;
+        }
+        LOG_DEBUG("Received ", n, " amount of bytes");
+        connection.readLength_ += n;
+        state = handleInput(connection);
+    }
+
+    // All replies to the pipelined commands go out in one write, and with appendfsync
+    // always after the writes they acknowledge are on disk.
+    if (!executor_.encoder().empty()) {
+        executor_.awaitDurability();
+        if (sendReplies(connection) == ClientState::Disconnected) {
+            state = ClientState::Disconnected;
+        }
+    }
+    return state;
+}
+
+// Sends the replies collected in the encoder, large values straight from where the
+// encoder refers to them. Only what the socket does not take is copied, into the output
+// queue of the connection.
+ClientState Reactor::sendReplies(Connection& connection)
+{
+    auto& encoder = executor_.encoder();
+    const auto segments = encoder.segments();
+    size_t written = 0;
+    if (connection.output_.empty()) {
+        const auto sent = sendSegments(connection.fd_, segments);
+        if (!sent.has_value()) {
+            encoder.clearBuffer();
+            return ClientState::Disconnected;
+        }
+        written = sent.value();
+        LOG_DEBUG("Sent ", written, " amount of bytes.");
+    }
+    connection.output_.append(segments, written);
+    encoder.clearBuffer();
+    return flushOutput(connection);
+}
+
+ClientState Reactor::flushOutput(Connection& connection)
+{
+    auto& output = connection.output_;
+    while (!output.empty()) {
+        const auto segments = output.segments(IOV_MAX);
+        size_t length = 0;
+        for (const auto& segment : segments) {
+            length += segment.iov_len;
+        }
+        const auto sent = sendSegments(connection.fd_, segments);
+        if (!sent.has_value()) {
+            return ClientState::Disconnected;
+        }
+        output.consume(sent.value());
+        if (sent.value() < length) {
+            break;
+        }
+    }
+    if (output.size() > executor_.outputLimit(static_cast<uint64_t>(connection.fd_))) {
+        LOG_WARNING("Output buffer limit reached, closing client");
+        return ClientState::Disconnected;
+    }
+    return ClientState::Connected;
+}
+
+void Reactor::onTimer()
+{
+    uint64_t expirations {};
+    if (read(timerFd_, &expirations, sizeof expirations) != sizeof expirations) {
+        return;
+    }
+    executor_.onTick();
+}
+
+void Reactor::attachFollower(Connection& connection)
+{
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, connection.fd_, nullptr);
+    // The stream has to start right after the replies, which are rarely left unsent.
+    if (!connection.output_.empty()) {
+        LOG_INFO("Replies to a follower are still pending, closing it");
+        close(connection.fd_);
+        return;
+    }
+    executor_.attachFollower(connection.fd_, std::move(connection.followerRequest_.value()));
+}
+
+void Reactor::deliverPublications()
+{
+    const auto publications = executor_.takePublications();
+    if (publications.empty()) {
+        return;
+    }
+    // Everything is queued first and sent after, so a connection gets all its messages
+    // in one sendmsg, and one that is closed cannot change the subscribers meanwhile.
+    std::vector<int> touched {};
+    for (const auto& publication : publications) {
+        for (const auto client : executor_.subscribers(publication)) {
+            const auto connection = connections_.find(static_cast<int>(client));
+            if (connection == connections_.end()) {
+                continue;
+            }
+            auto& subscriber = connection->second;
+            // Past the limit it is closed below; nothing more is queued for it.
+            if (subscriber.output_.size() <= executor_.outputLimit(client)) {
+                subscriber.output_.append(publication.frame_);
+            }
+            if (!subscriber.delivering_) {
+                subscriber.delivering_ = true;
+                touched.push_back(subscriber.fd_);
+            }
+        }
+    }
+    for (const auto fd : touched) {
+        auto& connection = connections_.at(fd);
+        connection.delivering_ = false;
+        if (flushOutput(connection) == ClientState::Disconnected) {
+            disconnect(fd);
+        }
+    }
+}
+
+void Reactor::disconnect(const int fd)
+{
+    executor_.onDisconnect(static_cast<uint64_t>(fd));
+    // Closing the fd also removes it from the epoll set.
+    close(fd);
+    connections_.erase(fd);
+}
+
+void Reactor::acceptClients()
+{
+    while (true) {
+        const int clientFd = accept4(listener_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientFd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERROR("accept4: ", std::strerror(errno));
+            }
+            return;
+        }
+        constexpr int yes = 1;
+        setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof yes);
+        LOG_INFO("Client connected. Fd= ", clientFd);
+        connections_.emplace(clientFd, Connection { .fd_ = clientFd });
+        addToEpoll(epollFd_, clientFd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+    }
+}
+
+void Reactor::run()
+{
+    constexpr int maxEvents = 128;
+    std::array<epoll_event, maxEvents> events {};
+    while (true) {
+        const int numEvents = epoll_wait(epollFd_, events.data(), maxEvents, -1);
+        if (numEvents == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("epoll_wait: ", std::strerror(errno));
+            exit(1);
+        }
+
+        for (int i = 0; i < numEvents; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == listener_) {
+                acceptClients();
+                continue;
+            }
+            if (fd == timerFd_) {
+                onTimer();
+                continue;
+            }
+            if (fd == wakeFd_) {
+                // Published messages are delivered after the batch.
+                uint64_t wakeups {};
+                [[maybe_unused]] const auto n = read(wakeFd_, &wakeups, sizeof wakeups);
+                continue;
+            }
+            const auto connection = connections_.find(fd);
+            if (connection == connections_.end()) {
+                continue;
+            }
+            // Writable again: send the replies that were left over first, so they stay
+            // in front of the replies to new input.
+            auto state = ClientState::Connected;
+            if ((events[i].events & EPOLLOUT) != 0) {
+                state = flushOutput(connection->second);
+            }
+            if (state == ClientState::Connected && (events[i].events & ~EPOLLOUT) != 0) {
+                state = handleClient(connection->second);
+            }
+            if (state == ClientState::Follower) {
+                executor_.onDisconnect(static_cast<uint64_t>(fd));
+                attachFollower(connection->second);
+                connections_.erase(connection);
+            } else if (state == ClientState::Disconnected) {
+                disconnect(fd);
+            }
+        }
+        deliverPublications();
+    }
+}
@@ -0,0 +1,606 @@
+#include "Replication.h"
+
+#include "AppendOnlyFile.h"
+#include "Commands.h"
+#include "Database.h"
+#include "Log.h"
+#include "Resp.h"
+#include "RespDecoder.h"
+#include "Snapshot.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <netdb.h>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <utility>
+#include <variant>
+
+namespace {
+// Bytes of the stream a follower thread sends at a time.
+constexpr size_t maxSendChunk = 64 * 1024;
+// How often the thread of an idle follower checks that it is still connected.
+constexpr auto idleCheckInterval = std::chrono::seconds { 1 };
+// How long a follower waits before it reconnects to its leader.
+constexpr auto reconnectInterval = std::chrono::milliseconds { 100 };
+// How long a follower waits for the leader to accept its connection.
+constexpr timeval connectTimeout { .tv_sec = 1, .tv_usec = 0 };
+
+// 40 random hex digits, like the replication ids of Redis.
+std::string newReplid()
+{
+    std::random_device random {};
+    std::string id(40, '0');
+    for (auto& c : id) {
+        c = "0123456789abcdef"[random() % 16];
+    }
+    return id;
+}
+
+void putLittleEndian(std::string& out, uint64_t value)
+{
+    if constexpr (std::endian::native == std::endian::big) {
+        value = std::byteswap(value);
+    }
+    out.append(reinterpret_cast<const char*>(&value), sizeof value);
+}
+
+uint64_t getLittleEndian(const char* bytes)
+{
+    uint64_t value {};
+    std::memcpy(&value, bytes, sizeof value);
+    if constexpr (std::endian::native == std::endian::big) {
+        value = std::byteswap(value);
+    }
+    return value;
+}
+
+template <typename T>
+std::optional<T> parseNumber(const std::string_view str)
+{
+    T value {};
+    const auto [end, error] = std::from_chars(str.data(), str.data() + str.size(), value);
+    if (error != std::errc {} || end != str.data() + str.size()) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+bool sendAll(const int fd, const std::string_view bytes)
+{
+    size_t sent = 0;
+    while (sent < bytes.size()) {
+        const auto n = send(fd, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+int connectTo(const std::string& host, const std::string& port)
+{
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses {};
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (const auto* address = addresses; address != nullptr && fd == -1; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        // Bounds connect, so an unreachable leader does not hold up REPLICAOF NO ONE.
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &connectTimeout, sizeof connectTimeout);
+        if (connect(fd, address->ai_addr, address->ai_addrlen) == -1) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd != -1) {
+        constexpr int yes = 1;
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &yes, sizeof yes);
+    }
+    return fd;
+}
+
+// Buffered reads from a blocking socket.
+class SocketReader {
+public:
+    explicit SocketReader(const int fd)
+        : fd_(fd)
+    {
+    }
+
+    // Reads more bytes. Returns false when the connection is closed or failed.
+    bool fill()
+    {
+        constexpr size_t readSize = 64 * 1024;
+        if (start_ > 0 && start_ == buffer_.size()) {
+            buffer_.clear();
+            start_ = 0;
+        }
+        const auto size = buffer_.size();
+        buffer_.resize(size + readSize);
+        while (true) {
+            const auto n = recv(fd_, buffer_.data() + size, readSize, 0);
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            buffer_.resize(size + std::max<ssize_t>(n, 0));
+            return n > 0;
+        }
+    }
+
+    // A line without its CRLF.
+    std::optional<std::string> line()
+    {
+        while (true) {
+            const auto end = buffered().find("\r\n");
+            if (end != std::string_view::npos) {
+                std::string result { buffered().substr(0, end) };
+                consume(end + 2);
+                return result;
+            }
+            if (!fill()) {
+                return std::nullopt;
+            }
+        }
+    }
+
+    bool read(const size_t length, std::string& out)
+    {
+        out.clear();
+        out.reserve(length);
+        while (out.size() < length) {
+            if (buffered().empty() && !fill()) {
+                return false;
+            }
+            const auto n = std::min(length - out.size(), buffered().size());
+            out.append(buffered().substr(0, n));
+            consume(n);
+        }
+        return true;
+    }
+
+    std::string_view buffered() const { return std::string_view { buffer_ }.substr(start_); }
+
+    void consume(const size_t length)
+    {
+        start_ += length;
+        // Keep the buffer from growing with the stream.
+        if (start_ >= 1024 * 1024 || start_ == buffer_.size()) {
+            buffer_.erase(0, start_);
+            start_ = 0;
+        }
+    }
+
+private:
+    int fd_ {};
+    std::string buffer_ {};
+    size_t start_ {};
+};
+
+// The key a write of the stream is to; encodeWrite makes one command per key.
+std::optional<std::string_view> keyOf(const CommandVariant& command)
+{
+    if (const auto* set = std::get_if<CommandSet>(&command)) {
+        return set->key_;
+    }
+    if (const auto* del = std::get_if<CommandDel>(&command)) {
+        return del->keys_.front();
+    }
+    if (const auto* hset = std::get_if<CommandHset>(&command)) {
+        return hset->key_;
+    }
+    if (const auto* lpush = std::get_if<CommandLpush>(&command)) {
+        return lpush->key_;
+    }
+    if (const auto* rpush = std::get_if<CommandRpush>(&command)) {
+        return rpush->key_;
+    }
+    if (const auto* sadd = std::get_if<CommandSadd>(&command)) {
+        return sadd->key_;
+    }
+    return std::nullopt;
+}
+} // namespace
+
+void ReplicationBacklog::append(std::string_view bytes)
+{
+    end_ += bytes.size();
+    const auto capacity = buffer_.size();
+    if (capacity == 0) {
+        return;
+    }
+    // Only the last capacity bytes of a larger append survive it.
+    bytes = bytes.substr(bytes.size() - std::min(bytes.size(), capacity));
+    const auto position = (end_ - bytes.size()) % capacity;
+    const auto first = std::min(bytes.size(), capacity - position);
+    std::memcpy(buffer_.data() + position, bytes.data(), first);
+    std::memcpy(buffer_.data(), bytes.data() + first, bytes.size() - first);
+    size_ = std::min<uint64_t>(size_ + bytes.size(), capacity);
+}
+
+bool ReplicationBacklog::copy(const uint64_t offset, const size_t max, std::string& out) const
+{
+    if (offset < startOffset() || offset > end_) {
+        return false;
+    }
+    const auto length = static_cast<size_t>(std::min<uint64_t>(max, end_ - offset));
+    if (length == 0) {
+        return true;
+    }
+    const auto position = offset % buffer_.size();
+    const auto first = std::min(length, buffer_.size() - position);
+    out.append(buffer_.data() + position, first);
+    out.append(buffer_.data(), length - first);
+    return true;
+}
+
+ReplicationLeader::ReplicationLeader(std::shared_ptr<const Db> db, const size_t backlogSize)
+    : db_(std::move(db))
+    , backlogSize_(backlogSize)
+    , replid_(newReplid())
+{
+}
+
+ReplicationLeader::~ReplicationLeader()
+{
+    disconnectFollowers();
+}
+
+void ReplicationLeader::feed(const std::string_view command)
+{
+    {
+        std::lock_guard lock { mutex_ };
+        backlog_.append(command);
+    }
+    fed_.notify_all();
+}
+
+void ReplicationLeader::attach(const int fd, std::string replid, const int64_t offset)
+{
+    // The reactors use non-blocking sockets; the follower thread blocks on sends.
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    std::lock_guard lock { mutex_ };
+    // Their threads have returned, so removing them does not wait.
+    followers_.remove_if([](const Follower& follower) { return follower.done_.load(); });
+    auto& follower = followers_.emplace_back();
+    follower.fd_ = fd;
+    follower.thread_ = std::jthread { [this, &follower, replid = std::move(replid), offset](std::stop_token stop) {
+        serve(stop, follower, replid, offset);
+    } };
+}
+
+void ReplicationLeader::serve(std::stop_token stop, Follower& follower, const std::string replid, const int64_t offset)
+{
+    std::optional<uint64_t> next {};
+    {
+        std::lock_guard lock { mutex_ };
+        if (streaming_ && replid == replid_ && offset >= 0 && static_cast<uint64_t>(offset) >= backlog_.startOffset()
+            && static_cast<uint64_t>(offset) <= backlog_.endOffset()) {
+            next = offset;
+            ++stats_.partialSyncs_;
+        }
+    }
+    if (next.has_value()) {
+        LOG_INFO("Follower resumes the replication stream at offset ", offset);
+        if (!sendAll(follower.fd_, "+CONTINUE " + replid + "\r\n")) {
+            next.reset();
+        }
+    } else {
+        next = fullSync(follower);
+    }
+
+    std::string chunk {};
+    while (next.has_value()) {
+        {
+            std::unique_lock lock { mutex_ };
+            if (!fed_.wait_for(lock, stop, idleCheckInterval, [this, &next]() { return backlog_.endOffset() > next.value(); })) {
+                // Notice a follower that went away while there was nothing to send.
+                char byte {};
+                if (stop.stop_requested() || recv(follower.fd_, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0) {
+                    break;
+                }
+                continue;
+            }
+            chunk.clear();
+            if (!backlog_.copy(next.value(), maxSendChunk, chunk)) {
+                ++stats_.droppedFollowers_;
+                LOG_WARNING("Follower fell behind the replication backlog, disconnecting it");
+                break;
+            }
+        }
+        if (!sendAll(follower.fd_, chunk)) {
+            break;
+        }
+        next.value() += chunk.size();
+    }
+    LOG_INFO("Follower disconnected");
+    std::lock_guard lock { mutex_ };
+    follower.done_ = true;
+}
+
+std::optional<uint64_t> ReplicationLeader::fullSync(Follower& follower)
+{
+    std::string replid {};
+    {
+        std::lock_guard lock { mutex_ };
+        if (!streaming_) {
+            backlog_ = ReplicationBacklog { backlogSize_ };
+            streaming_ = true;
+        }
+        ++stats_.fullSyncs_;
+        replid = replid_;
+    }
+    std::array<uint64_t, Db::numShards> shardOffsets {};
+    const auto snapshot = encodeSnapshot(*db_, [this, &shardOffsets](const size_t shard) {
+        std::lock_guard lock { mutex_ };
+        shardOffsets[shard] = backlog_.endOffset();
+    });
+    LOG_INFO("Full sync of a follower with a snapshot of ", snapshot.size(), " bytes");
+
+    // +FULLRESYNC replid offset, then the payload as a bulk string without the CRLF after
+    // it, like Redis sends the RDB file: the offset every shard was copied at and the
+    // snapshot.
+    std::string header { "+FULLRESYNC " };
+    header.append(replid).append(" ").append(std::to_string(shardOffsets.front())).append("\r\n$");
+    header.append(std::to_string(sizeof shardOffsets + snapshot.size())).append("\r\n");
+    for (const auto offset : shardOffsets) {
+        putLittleEndian(header, offset);
+    }
+    if (!sendAll(follower.fd_, header) || !sendAll(follower.fd_, snapshot)) {
+        return std::nullopt;
+    }
+    return shardOffsets.front();
+}
+
+void ReplicationLeader::reset()
+{
+    disconnectFollowers();
+    std::lock_guard lock { mutex_ };
+    replid_ = newReplid();
+    backlog_ = ReplicationBacklog { 0 };
+    streaming_ = false;
+}
+
+void ReplicationLeader::disconnectFollowers()
+{
+    std::list<Follower> stopping {};
+    {
+        std::lock_guard lock { mutex_ };
+        for (auto& follower : followers_) {
+            follower.thread_.request_stop();
+            // Wakes a thread blocked on a send.
+            shutdown(follower.fd_, SHUT_RDWR);
+        }
+        stopping.splice(stopping.end(), followers_);
+    }
+    // The threads are joined as stopping goes out of scope, without the lock they take
+    // to return.
+}
+
+ReplicationLeader::Follower::~Follower()
+{
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    if (fd_ != -1) {
+        close(fd_);
+    }
+}
+
+std::string ReplicationLeader::replid() const
+{
+    std::lock_guard lock { mutex_ };
+    return replid_;
+}
+
+uint64_t ReplicationLeader::offset() const
+{
+    std::lock_guard lock { mutex_ };
+    return backlog_.endOffset();
+}
+
+ReplicationStats ReplicationLeader::stats() const
+{
+    std::lock_guard lock { mutex_ };
+    auto stats = stats_;
+    stats.followers_ = std::ranges::count_if(followers_, [](const Follower& follower) { return !follower.done_.load(); });
+    return stats;
+}
+
+ReplicationFollower::ReplicationFollower(std::shared_ptr<Db> db, std::shared_ptr<AppendOnlyFile> aof, std::string host, std::string port)
+    : db_(std::move(db))
+    , aof_(std::move(aof))
+    , host_(std::move(host))
+    , port_(std::move(port))
+{
+    thread_ = std::jthread { [this](std::stop_token stop) { run(stop); } };
+}
+
+ReplicationFollower::~ReplicationFollower()
+{
+    thread_.request_stop();
+    {
+        std::lock_guard lock { fdMutex_ };
+        if (fd_ != -1) {
+            shutdown(fd_, SHUT_RDWR);
+        }
+    }
+    thread_.join();
+}
+
+void ReplicationFollower::run(std::stop_token stop)
+{
+    std::mutex waitMutex {};
+    std::condition_variable_any wait {};
+    while (!stop.stop_requested()) {
+        const int fd = connectTo(host_, port_);
+        if (fd != -1) {
+            bool registered = false;
+            {
+                std::lock_guard lock { fdMutex_ };
+                registered = !stop.stop_requested();
+                fd_ = registered ? fd : -1;
+            }
+            if (registered) {
+                follow(stop, fd);
+                std::lock_guard lock { fdMutex_ };
+                fd_ = -1;
+            }
+            linkUp_ = false;
+            close(fd);
+        }
+        std::unique_lock lock { waitMutex };
+        wait.wait_for(lock, stop, reconnectInterval, []() { return false; });
+    }
+}
+
+void ReplicationFollower::follow(std::stop_token stop, const int fd)
+{
+    const auto replid = replid_.empty() ? std::string { "?" } : replid_;
+    const auto offset = std::to_string(replid_.empty() ? int64_t { -1 } : static_cast<int64_t>(offset_.load()));
+    const auto psync = "*3\r\n$5\r\nPSYNC\r\n$" + std::to_string(replid.size()) + "\r\n" + replid + "\r\n$"
+        + std::to_string(offset.size()) + "\r\n" + offset + "\r\n";
+    if (!sendAll(fd, psync)) {
+        return;
+    }
+    SocketReader reader { fd };
+    const auto reply = reader.line();
+    if (!reply.has_value()) {
+        return;
+    }
+    const auto fields = std::string_view { reply.value() };
+    if (fields.starts_with("+FULLRESYNC ")) {
+        const auto arguments = fields.substr(fields.find(' ') + 1);
+        const auto space = arguments.find(' ');
+        const auto startOffset = parseNumber<uint64_t>(arguments.substr(space + 1));
+        const auto header = reader.line().value_or("");
+        const auto length = parseNumber<size_t>(std::string_view { header }.substr(std::min<size_t>(1, header.size())));
+        std::string payload {};
+        if (space == std::string_view::npos || !startOffset.has_value() || !header.starts_with('$')
+            || length.value_or(0) < sizeof shardOffsets_ || !reader.read(length.value_or(0), payload)) {
+            LOG_WARNING("Full sync with ", host_, ":", port_, " failed");
+            return;
+        }
+        for (size_t shard = 0; shard < Db::numShards; ++shard) {
+            shardOffsets_[shard] = getLittleEndian(payload.data() + shard * sizeof(uint64_t));
+        }
+        db_->clear();
+        const auto loaded = decodeSnapshot(*db_, std::string_view { payload }.substr(sizeof shardOffsets_));
+        if (!loaded.has_value()) {
+            LOG_WARNING("Full sync with ", host_, ":", port_, " failed: ", loaded.error());
+            replid_.clear();
+            return;
+        }
+        replid_ = arguments.substr(0, space);
+        offset_ = startOffset.value();
+        LOG_INFO("Full sync with ", host_, ":", port_, " loaded ", loaded.value(), " keys");
+        // The log has to start over from the new keyspace.
+        if (aof_) {
+            aof_->startRewrite(db_);
+        }
+    } else if (fields.starts_with("+CONTINUE")) {
+        LOG_INFO("Resumed the replication stream of ", host_, ":", port_, " at offset ", offset_.load());
+    } else {
+        LOG_WARNING("Sync with ", host_, ":", port_, " refused: ", reply.value());
+        return;
+    }
+
+    linkUp_ = true;
+    RespTokenArena tokens {};
+    while (!stop.stop_requested()) {
+        const auto input = reader.buffered();
+        size_t consumed = 0;
+        try {
+            while (true) {
+                const auto frameLength = RespDecoder::decodeFrame(input.substr(consumed), tokens);
+                if (!frameLength.has_value()) {
+                    break;
+                }
+                const auto command = RespDecoder::convertToCommand(tokens);
+                const auto at = offset_.load();
+                // The writes made to a shard before the full sync copied it are in the
+                // snapshot already.
+                const auto key = keyOf(command);
+                if (key.has_value() && at >= shardOffsets_[Db::shardOf(key.value())]) {
+                    applyWrite(*db_, command);
+                }
+                consumed += frameLength.value();
+                offset_ = at + frameLength.value();
+            }
+        } catch (const std::invalid_argument& e) {
+            LOG_WARNING("Invalid replication stream: ", e.what());
+            // Whatever was applied so far does not tell where the stream went wrong.
+            replid_.clear();
+            return;
+        }
+        reader.consume(consumed);
+        if (!reader.fill()) {
+            return;
+        }
+    }
+}
+
+Replication::Replication(std::shared_ptr<Db> db, std::shared_ptr<AppendOnlyFile> aof, const size_t backlogSize)
+    : db_(std::move(db))
+    , aof_(std::move(aof))
+    , leader_(db_, backlogSize)
+{
+}
+
+void Replication::replicaOf(std::string host, std::string port)
+{
+    std::lock_guard lock { mutex_ };
+    follower_.reset();
+    // The keyspace is about to be replaced, so whoever follows this server has to start over.
+    leader_.reset();
+    following_ = true;
+    follower_ = std::make_unique<ReplicationFollower>(db_, aof_, std::move(host), std::move(port));
+}
+
+void Replication::promote()
+{
+    std::lock_guard lock { mutex_ };
+    if (!follower_) {
+        return;
+    }
+    follower_.reset();
+    following_ = false;
+    leader_.reset();
+}
+
+std::optional<Replication::Link> Replication::link() const
+{
+    std::lock_guard lock { mutex_ };
+    if (!follower_) {
+        return std::nullopt;
+    }
+    return Link { .host_ = follower_->host(), .port_ = follower_->port(), .up_ = follower_->linkUp(), .offset_ = follower_->offset() };
+}
@@ -1,20 +1,100 @@
 #include "RespDecoder.h"
 
 #include "CommandParsePayload.h"
+#include "CommandTable.h"
+#include "Log.h"
 #include "Resp.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <charconv>
+#include <cstdint>
 #include <expected>
 #include <iostream>
+#include <limits>
 #include <map>
-#include <ranges>
+#include <optional>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <variant>
 #include <vector>
 
+namespace {
+constexpr size_t maxNestingDepth = 32;
+constexpr int64_t maxAggregateLength = 1024 * 1024;
+
+int64_t parseInteger(std::string_view digits)
+{
+    // std::from_chars does not accept an explicit plus sign
+    if (!digits.empty() && digits.front() == '+') {
+        digits.remove_prefix(1);
+    }
+    int64_t value {};
+    const auto [ptr, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+    if (digits.empty() || ec != std::errc() || ptr != digits.data() + digits.size()) {
+        throw std::invalid_argument { "Invalid integer: " + std::string { digits } };
+    }
+    return value;
+}
+
+// Header lines are a few bytes long, where a plain loop beats calling into memchr.
+size_t findCRLF(const std::string_view str, size_t pos)
+{
+    for (; pos + 1 < str.size(); ++pos) {
+        if (str[pos] == '\r' && str[pos + 1] == '\n') {
+            return pos;
+        }
+    }
+    return std::string_view::npos;
+}
+
+constexpr size_t incomplete = std::string_view::npos;
+
+// Parses the length in a "$<n>\r\n", "*<n>\r\n" or "%<n>\r\n" header starting at pos and
+// returns the position of its CRLF, or incomplete if the line has not fully arrived.
+// Digits are accumulated while looking for the CRLF so the line is only read once.
+size_t parseLengthHeader(const std::string_view str, size_t pos, int64_t& length)
+{
+    ++pos; // prefix
+    const bool negative = pos < str.size() && str[pos] == '-';
+    if (negative) {
+        ++pos;
+    }
+    const auto digitsStart = pos;
+    length = 0;
+    for (; pos < str.size(); ++pos) {
+        const auto c = str[pos];
+        if (c >= '0' && c <= '9') {
+            length = length * 10 + (c - '0');
+            if (length > std::numeric_limits<int32_t>::max()) {
+                throw std::invalid_argument { "Length out of range" };
+            }
+            continue;
+        }
+        if (c != '\r' || pos == digitsStart) {
+            throw std::invalid_argument { "Invalid length: " + std::string { str.substr(digitsStart, pos - digitsStart + 1) } };
+        }
+        if (pos + 1 >= str.size()) {
+            return incomplete;
+        }
+        if (str[pos + 1] != '\n') {
+            throw std::invalid_argument { "Missing LF after CR" };
+        }
+        if (negative) {
+            if (length != 1) {
+                throw std::invalid_argument { "Invalid length: -" + std::to_string(length) };
+            }
+            length = -1;
+        }
+        return pos;
+    }
+    return incomplete;
+}
+} // namespace
+
 std::pair<size_t, RedisRespRes>
 RespDecoder::decodeSimpleString(const std::string_view str)
 {
@@ -80,8 +160,7 @@ RespDecoder::decodeInt(const std::string_view str)
         throw std::invalid_argument { "Missing CRLF in Simple String" };
     }
     std::string_view decodedInt = str.substr(1, crlfPos - 1);
-    // TODO: Verify value is integer with regex
-    return { crlfPos + 2, RedisRespRes { .integer_ = std::stoi(decodedInt.data()) } };
+    return { crlfPos + 2, RedisRespRes { .integer_ = static_cast<int>(parseInteger(decodedInt)) } };
 }
 
 std::pair<size_t, RedisRespRes>
@@ -122,7 +201,7 @@ RespDecoder::decodeMap(const std::string_view str)
         if (decodedKey.second.string_.has_value()) {
             key = decodedKey.second.string_.value();
         } else {
-            std::cout << "Expected key as string, got: " << decodedKey.second;
+            LOG_ERROR("Expected a string as map key");
             assert(false);
         }
         startPos += decodedKey.first;
@@ -155,57 +234,219 @@ RespDecoder::decode(const std::string_view str)
     return { -11, RedisRespRes {} };
 }
 
+std::optional<size_t> RespDecoder::frameLength(const std::string_view str)
+{
+    return decodeTokens(str, nullptr);
+}
+
+std::optional<size_t> RespDecoder::decodeFrame(const std::string_view str, RespTokenArena& tokens)
+{
+    tokens.clear();
+    return decodeTokens(str, &tokens);
+}
+
+namespace {
+// Splits an inline command (eg. PING typed into telnet) on spaces into an array of bulk strings.
+void decodeInline(const std::string_view line, RespTokenArena* tokens)
+{
+    if (tokens == nullptr) {
+        return;
+    }
+    const auto arrayIndex = tokens->size();
+    tokens->push_back(RespToken { .type_ = Prefix::ARRAY });
+    size_t pos = 0;
+    while (pos < line.size()) {
+        const auto wordStart = line.find_first_not_of(' ', pos);
+        if (wordStart == std::string_view::npos) {
+            break;
+        }
+        const auto wordEnd = std::min(line.find(' ', wordStart), line.size());
+        tokens->push_back(RespToken { .type_ = Prefix::BULK_STRING, .string_ = line.substr(wordStart, wordEnd - wordStart) });
+        ++(*tokens)[arrayIndex].count_;
+        pos = wordEnd;
+    }
+}
+} // namespace
+
+// Walks the frame without recursion. remaining[i] counts the elements still missing from
+// the i:th open array or map; a complete value closes every aggregate it was the last
+// element of. When tokens is null we only find the end of the frame.
+std::optional<size_t> RespDecoder::decodeTokens(const std::string_view str, RespTokenArena* tokens)
+{
+    std::array<int64_t, maxNestingDepth> remaining;
+    size_t depth = 0;
+    size_t pos = 0;
+    do {
+        if (pos >= str.size()) {
+            return std::nullopt;
+        }
+        const auto prefix = static_cast<Prefix>(str[pos]);
+        RespToken token { .type_ = prefix };
+        size_t next {};
+
+        switch (prefix) {
+        case Prefix::SIMPLE_STRING:
+        case Prefix::ERROR:
+        case Prefix::INTEGER: {
+            const auto crlfPos = findCRLF(str, pos);
+            if (crlfPos == incomplete) {
+                return std::nullopt;
+            }
+            token.string_ = str.substr(pos + 1, crlfPos - pos - 1);
+            if (prefix == Prefix::INTEGER) {
+                token.integer_ = parseInteger(token.string_);
+            }
+            next = crlfPos + 2;
+            break;
+        }
+        case Prefix::BULK_STRING: {
+            int64_t length {};
+            const auto crlfPos = parseLengthHeader(str, pos, length);
+            if (crlfPos == incomplete) {
+                return std::nullopt;
+            }
+            next = crlfPos + 2;
+            if (length == -1) {
+                token.isNull_ = true;
+                break;
+            }
+            const auto end = next + static_cast<size_t>(length);
+            if (str.size() < end + 2) {
+                return std::nullopt;
+            }
+            if (str[end] != '\r' || str[end + 1] != '\n') {
+                throw std::invalid_argument { "Bulk string is not terminated by CRLF" };
+            }
+            token.string_ = str.substr(next, length);
+            next = end + 2;
+            break;
+        }
+        case Prefix::ARRAY:
+        case Prefix::MAP: {
+            int64_t count {};
+            const auto crlfPos = parseLengthHeader(str, pos, count);
+            if (crlfPos == incomplete) {
+                return std::nullopt;
+            }
+            if (count > maxAggregateLength) {
+                throw std::invalid_argument { "Too many elements: " + std::to_string(count) };
+            }
+            next = crlfPos + 2;
+            if (count == -1) {
+                token.isNull_ = true;
+                break;
+            }
+            token.count_ = static_cast<uint32_t>(count);
+            if (count > 0) {
+                if (depth == maxNestingDepth) {
+                    throw std::invalid_argument { "Frame is nested too deep" };
+                }
+                remaining[depth++] = prefix == Prefix::MAP ? 2 * count : count;
+                if (tokens != nullptr) {
+                    tokens->push_back(token);
+                }
+                pos = next;
+                continue;
+            }
+            break;
+        }
+        default: {
+            if (depth > 0) {
+                throw std::invalid_argument { "Unknown prefix: " + std::string { str[pos] } };
+            }
+            const auto crlfPos = str.find("\r\n");
+            if (crlfPos == std::string_view::npos) {
+                return std::nullopt;
+            }
+            decodeInline(str.substr(0, crlfPos), tokens);
+            return crlfPos + 2;
+        }
+        }
+
+        if (tokens != nullptr) {
+            tokens->push_back(token);
+        }
+        pos = next;
+        while (depth > 0 && --remaining[depth - 1] == 0) {
+            --depth;
+        }
+    } while (depth > 0);
+    return pos;
+}
+
 CommandVariant RespDecoder::parseRawCommand(const std::string_view rawCommand)
 {
-    std::cout << "RawCommand: " << rawCommand << ".\n";
-    if (rawCommand == "PING") {
-        return CommandPing {};
-        // return Command { .kind_ = CommandKind::PING };
+    LOG_DEBUG("RawCommand: ", rawCommand, ".");
+    // An inline command without arguments, e.g. a bare PING.
+    const auto* spec = findCommand(rawCommand);
+    if (spec == nullptr || !spec->acceptsArgc(1)) {
+        return CommandUnknown {};
     }
-    // TODO Use std::expected??
-    return CommandUnknown {};
+    return spec->parse_({});
 }
 
-CommandVariant RespDecoder::parseRawArrayCommands(
-    const std::vector<RedisRespRes>& commandArray)
-{
-    // Command cmd {};
-    const auto rawKind = commandArray[0].string_;
-    CommandVariant cmd;
-    if (rawKind == "HELLO") {
-        cmd = CommandHello {};
-    } else if (rawKind == "SET") {
-        cmd = CommandSet {};
-    } else if (rawKind == "GET") {
-        cmd = CommandGet {};
-    } else if (rawKind == "PING") {
-        cmd = CommandPing {};
-    } else if (rawKind == "EXISTS") {
-        cmd = CommandExists {};
-    } else if (rawKind == "INCR") {
-        cmd = CommandIncr {};
-    } else {
-        cmd = CommandUnknown {};
+CommandVariant RespDecoder::parseRawArrayCommands(std::span<const RespToken> frame)
+{
+    // A command is one array of strings, so every token after the array header is an argument.
+    const auto args = frame.subspan(1);
+    if (args.size() != frame[0].count_) {
+        CommandInvalid invalidCmd {};
+        invalidCmd.errorString = "Nested arrays are not valid commands";
+        return invalidCmd;
     }
 
-    // TODO: Refactor so that ParsePayload takes the entire command array
-    for (const auto& rawCommand : commandArray | std::views::drop(1)) {
-        const std::expected<ParseSuccessful, CommandInvalid> result = std::visit(ParsePayload { rawCommand }, cmd);
-        if (!result.has_value()) {
-            return result.error();
-        }
+    const auto* spec = findCommand(args[0].string_);
+    if (spec == nullptr) {
+        return CommandUnknown {};
     }
+    if (!spec->acceptsArgc(args.size())) {
+        CommandInvalid invalidCmd {};
+        invalidCmd.errorString = "wrong number of arguments for '" + std::string { spec->name_ } + "' command";
+        return invalidCmd;
+    }
+    return spec->parse_(args.subspan(1));
+}
 
-    /*
-    Error handling: Easiest is to throw exceptions in case a command is not
-    properly constructed... But how fun is that. Not sure what the alternative
-    would be as long as I am using std::visit. If parsePayload takes the commit
-    variant and the entire command array, maybe we could use std::expected as
-    return type?
-    */
+CommandVariant RespDecoder::convertToCommand(std::span<const RespToken> frame)
+{
+    if (frame.empty()) {
+        return CommandUnknown {};
+    }
+    const auto& head = frame[0];
+    if (head.type_ == Prefix::ARRAY && head.count_ > 0) {
+        return parseRawArrayCommands(frame);
+    }
+    if (head.type_ == Prefix::SIMPLE_STRING || (head.type_ == Prefix::BULK_STRING && !head.isNull_)) {
+        return parseRawCommand(head.string_);
+    }
+    return CommandUnknown {};
+}
 
-    return cmd;
+namespace {
+void flatten(const RedisRespRes& value, RespTokenArena& tokens)
+{
+    if (value.array_.has_value()) {
+        tokens.push_back(RespToken { .type_ = Prefix::ARRAY, .count_ = static_cast<uint32_t>(value.array_->size()) });
+        for (const auto& element : value.array_.value()) {
+            flatten(element, tokens);
+        }
+    } else if (value.map_.has_value()) {
+        tokens.push_back(RespToken { .type_ = Prefix::MAP, .count_ = static_cast<uint32_t>(value.map_->size()) });
+        for (const auto& [key, element] : value.map_.value()) {
+            tokens.push_back(RespToken { .type_ = Prefix::BULK_STRING, .string_ = key });
+            flatten(element, tokens);
+        }
+    } else if (value.integer_.has_value()) {
+        tokens.push_back(RespToken { .type_ = Prefix::INTEGER, .integer_ = value.integer_.value() });
+    } else if (value.error_.has_value()) {
+        tokens.push_back(RespToken { .type_ = Prefix::ERROR, .string_ = value.error_.value() });
+    } else if (value.string_.has_value()) {
+        tokens.push_back(RespToken { .type_ = Prefix::BULK_STRING, .string_ = value.string_.value() });
+    } else {
+        tokens.push_back(RespToken { .type_ = Prefix::BULK_STRING, .isNull_ = true });
+    }
 }
+} // namespace
 
 std::vector<CommandVariant>
 RespDecoder::convertToCommands(const RedisRespRes& rawCommands)
@@ -213,10 +454,12 @@ RespDecoder::convertToCommands(const RedisRespRes& rawCommands)
     std::vector<CommandVariant> commands {};
     if (rawCommands.string_.has_value()) {
         commands.push_back(parseRawCommand(rawCommands.string_.value()));
-    } else if (rawCommands.array_.has_value()) {
-        commands.push_back(parseRawArrayCommands(rawCommands.array_.value()));
+    } else if (rawCommands.array_.has_value() && !rawCommands.array_->empty()) {
+        RespTokenArena tokens {};
+        flatten(rawCommands, tokens);
+        commands.push_back(parseRawArrayCommands(tokens));
     } else {
         commands.push_back(CommandUnknown {});
     }
     return commands;
-}
\ No newline at end of file
+}
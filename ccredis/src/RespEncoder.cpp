@@ -1,56 +1,78 @@
 #include "RespEncoder.h"
 #include "Resp.h"
 
+#include <charconv>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
 #include <string_view>
+#include <sys/uio.h>
+#include <vector>
 
 void RespEncoder::appendChars(const std::string_view str)
 {
-    for (const auto c : str) {
-        buffer.push_back(c);
-    }
+    buffer.insert(buffer.end(), str.begin(), str.end());
 }
 
-void RespEncoder::RespEncoder::appendCRLF()
+void RespEncoder::appendCRLF()
 {
-    buffer.push_back('\r');
-    buffer.push_back('\n');
+    appendChars("\r\n");
+}
+
+// <prefix><n>\r\n, the header of integers, bulk strings and aggregates.
+void RespEncoder::appendHeader(const char prefix, const int64_t n)
+{
+    char header[24];
+    header[0] = prefix;
+    auto* end = std::to_chars(header + 1, header + sizeof header - 2, n).ptr;
+    *end++ = '\r';
+    *end++ = '\n';
+    appendChars({ header, end });
 }
 
 void RespEncoder::appendSimpleString(const std::string_view str)
 {
-    buffer.push_back(static_cast<char>(Prefix::SIMPLE_STRING));
-    for (const auto& c : str) {
-        if (c == '\r' || c == '\n') {
-            throw std::invalid_argument("String must not contain CR or LF!");
-        }
-        buffer.push_back(static_cast<char>(c));
+    if (str.find_first_of("\r\n") != std::string_view::npos) {
+        throw std::invalid_argument("String must not contain CR or LF!");
     }
+    buffer.push_back(static_cast<char>(Prefix::SIMPLE_STRING));
+    appendChars(str);
     appendCRLF();
 }
 
 void RespEncoder::appendBulkstring(const std::string_view str)
 {
-    buffer.push_back(static_cast<char>(Prefix::BULK_STRING));
-    buffer.push_back(char(str.length()) + '0');
-    appendCRLF();
-    // TODO: Should probably do something like buf.writeu8() or writeu32() to handle wide chars
+    appendHeader(static_cast<char>(Prefix::BULK_STRING), static_cast<int64_t>(str.length()));
     appendChars(str);
     appendCRLF();
 }
 
-void RespEncoder::appendNull()
+void RespEncoder::appendOwnedBulkstring(std::string&& str)
 {
-    buffer.push_back(static_cast<char>(Prefix::BULK_STRING));
-    buffer.push_back(-1);
+    if (str.size() < minReferencedSize) {
+        appendBulkstring(std::string_view { str });
+        return;
+    }
+    appendHeader(static_cast<char>(Prefix::BULK_STRING), static_cast<int64_t>(str.length()));
+    referencedBytes_ += str.size();
+    references_.push_back(Reference { .offset_ = buffer.size(), .value_ = std::move(str) });
     appendCRLF();
 }
 
+void RespEncoder::appendNull()
+{
+    appendChars("$-1\r\n");
+}
+
+void RespEncoder::appendNullArray()
+{
+    appendChars("*-1\r\n");
+}
+
 void RespEncoder::appendError(const std::string_view str)
 {
     buffer.push_back(static_cast<char>(Prefix::ERROR));
-    for (const auto& c : str) {
-        buffer.push_back(static_cast<char>(c));
-    }
+    appendChars(str);
     appendCRLF();
 }
 
@@ -61,18 +83,19 @@ void RespEncoder::appendInt(const std::string_view n)
     appendCRLF();
 }
 
+void RespEncoder::appendInt(const int64_t n)
+{
+    appendHeader(static_cast<char>(Prefix::INTEGER), n);
+}
+
 void RespEncoder::beginArray(const unsigned numElements)
 {
-    buffer.push_back(static_cast<char>(Prefix::ARRAY));
-    buffer.push_back(char(numElements) + '0');
-    appendCRLF();
+    appendHeader(static_cast<char>(Prefix::ARRAY), numElements);
 }
 
 void RespEncoder::beginMap(const unsigned numElements)
 {
-    buffer.push_back(static_cast<char>(Prefix::MAP));
-    buffer.push_back(char(numElements) + '0');
-    appendCRLF();
+    appendHeader(static_cast<char>(Prefix::MAP), numElements);
 }
 
 void RespEncoder::appendKV(const std::string_view key, const std::string_view val)
@@ -83,7 +106,35 @@ void RespEncoder::appendKV(const std::string_view key, const std::string_view va
 void RespEncoder::appendKV(const std::string_view key, const int val)
 {
     appendBulkstring(key);
-    appendInt(std::to_string(val));
+    appendInt(int64_t { val });
+}
+
+std::span<const iovec> RespEncoder::segments()
+{
+    segments_.clear();
+    size_t pos = 0;
+    for (const auto& reference : references_) {
+        if (reference.offset_ > pos) {
+            segments_.push_back(iovec { .iov_base = buffer.data() + pos, .iov_len = reference.offset_ - pos });
+        }
+        segments_.push_back(iovec { .iov_base = const_cast<char*>(reference.value_.data()), .iov_len = reference.value_.size() });
+        pos = reference.offset_;
+    }
+    if (buffer.size() > pos) {
+        segments_.push_back(iovec { .iov_base = buffer.data() + pos, .iov_len = buffer.size() - pos });
+    }
+    return segments_;
+}
+
+void RespEncoder::clearBuffer()
+{
+    buffer.clear();
+    if (buffer.capacity() > maxRetainedCapacity) {
+        buffer.shrink_to_fit();
+        buffer.reserve(initialCapacity);
+    }
+    references_.clear();
+    referencedBytes_ = 0;
 }
 
-const std::vector<char>& RespEncoder::getBuffer() const { return buffer; }
\ No newline at end of file
+const std::vector<char>& RespEncoder::getBuffer() const { return buffer; }
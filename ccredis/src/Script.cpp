@@ -0,0 +1,223 @@
+#include "Script.h"
+
+#include "CommandTable.h"
+#include "Commands.h"
+#include "Resp.h"
+#include "Sha1.h"
+#include "Transaction.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace {
+template <typename Cmd, typename... Cmds>
+constexpr bool isOneOf = (std::is_same_v<Cmd, Cmds> || ...);
+
+// A script runs like a transaction, so it runs what a transaction may queue, and
+// nothing that controls a transaction.
+template <typename... Cmds>
+constexpr std::array<bool, sizeof...(Cmds)> controlling(const std::variant<Cmds...>*)
+{
+    return { isOneOf<Cmds, CommandMulti, CommandExec, CommandDiscard, CommandWatch, CommandUnwatch>... };
+}
+constexpr auto controllingCommands = controlling(static_cast<const CommandVariant*>(nullptr));
+
+std::vector<std::string_view> split(std::string_view str, const std::string_view separators)
+{
+    std::vector<std::string_view> parts {};
+    while (!str.empty()) {
+        const auto end = std::min(str.find_first_of(separators), str.size());
+        if (end > 0) {
+            parts.push_back(str.substr(0, end));
+        }
+        str.remove_prefix(std::min(end + 1, str.size()));
+    }
+    return parts;
+}
+
+// The n of KEYS[n] or ARGV[n], counting from 1.
+std::optional<size_t> placeholderIndex(const std::string_view token, const std::string_view name)
+{
+    if (!token.starts_with(name) || token.size() <= name.size() + 2 || token[name.size()] != '[' || !token.ends_with(']')) {
+        return std::nullopt;
+    }
+    const auto digits = token.substr(name.size() + 1, token.size() - name.size() - 2);
+    size_t index = 0;
+    const auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), index);
+    if (error != std::errc {} || end != digits.data() + digits.size() || index == 0) {
+        return std::nullopt;
+    }
+    return index;
+}
+
+std::string stepError(const size_t step, const std::string_view error)
+{
+    std::string message { "ERR Error compiling script: step " };
+    message.append(std::to_string(step + 1)).append(": ").append(error);
+    return message;
+}
+
+// The command of spec with the arguments args, already counted.
+CommandVariant parseStep(const CommandSpec& spec, const std::span<const std::string_view> args)
+{
+    thread_local RespTokenArena tokens {};
+    tokens.clear();
+    for (const auto arg : args) {
+        tokens.push_back(RespToken { .type_ = Prefix::BULK_STRING, .string_ = arg });
+    }
+    return spec.parse_(tokens);
+}
+} // namespace
+
+std::expected<std::shared_ptr<const Script>, std::string> Script::compile(const std::string_view source)
+{
+    std::shared_ptr<Script> script { new Script {} };
+    script->source_ = source;
+    script->sha_ = sha1Hex(source);
+    for (const auto line : split(script->source_, ";\n")) {
+        auto words = split(line, " \t\r");
+        if (words.empty()) {
+            continue;
+        }
+        const auto index = script->steps_.size();
+        Step step {};
+        std::span<const std::string_view> command { words };
+        if (equalsIgnoreCase(command.front(), "IF") || equalsIgnoreCase(command.front(), "UNLESS")) {
+            size_t guard = 0;
+            const auto number = command.size() > 1 ? command[1] : std::string_view {};
+            const auto [end, error] = std::from_chars(number.data(), number.data() + number.size(), guard);
+            if (error != std::errc {} || end != number.data() + number.size() || guard == 0 || guard > index) {
+                return std::unexpected { stepError(index, "IF and UNLESS need the number of an earlier step") };
+            }
+            step.guard_ = Guard { .step_ = guard - 1, .runsIfTrue_ = equalsIgnoreCase(command.front(), "IF") };
+            command = command.subspan(2);
+        }
+        if (command.empty()) {
+            return std::unexpected { stepError(index, "missing command") };
+        }
+        const auto* spec = findCommand(command.front());
+        if (spec == nullptr) {
+            std::string error { "unknown command '" };
+            error.append(command.front()).append("'");
+            return std::unexpected { stepError(index, error) };
+        }
+        if (!allowedInTransaction(spec->index_) || controllingCommands[spec->index_]) {
+            std::string error { "'" };
+            error.append(spec->name_).append("' is not allowed in scripts");
+            return std::unexpected { stepError(index, error) };
+        }
+        if (!spec->acceptsArgc(command.size())) {
+            std::string error { "wrong number of arguments for '" };
+            error.append(spec->name_).append("'");
+            return std::unexpected { stepError(index, error) };
+        }
+
+        step.spec_ = spec;
+        auto literal = true;
+        for (const auto token : command.subspan(1)) {
+            Argument argument { .kind_ = Argument::Kind::Literal, .literal_ = token, .index_ = 0 };
+            if (const auto key = placeholderIndex(token, "KEYS"); key.has_value()) {
+                argument = Argument { .kind_ = Argument::Kind::Key, .literal_ = {}, .index_ = key.value() - 1 };
+                script->numKeys_ = std::max(script->numKeys_, key.value());
+            } else if (const auto arg = placeholderIndex(token, "ARGV"); arg.has_value()) {
+                argument = Argument { .kind_ = Argument::Kind::Arg, .literal_ = {}, .index_ = arg.value() - 1 };
+                script->numArgs_ = std::max(script->numArgs_, arg.value());
+            }
+            literal = literal && argument.kind_ == Argument::Kind::Literal;
+            step.arguments_.push_back(argument);
+        }
+        if (literal) {
+            step.command_ = parseStep(*spec, command.subspan(1));
+            if (const auto* invalid = std::get_if<CommandInvalid>(&*step.command_)) {
+                return std::unexpected { stepError(index, invalid->errorString.empty() ? "invalid arguments" : invalid->errorString) };
+            }
+        }
+        script->steps_.push_back(std::move(step));
+    }
+    if (script->steps_.empty()) {
+        return std::unexpected { "ERR Error compiling script: no steps" };
+    }
+    return script;
+}
+
+std::expected<void, std::string> Script::instantiate(const std::span<const std::string_view> keys,
+    const std::span<const std::string_view> args, std::vector<CommandVariant>& commands) const
+{
+    if (keys.size() < numKeys_ || args.size() < numArgs_) {
+        std::string error { "ERR the script uses " };
+        error.append(std::to_string(numKeys_)).append(" keys and ").append(std::to_string(numArgs_)).append(" arguments");
+        return std::unexpected { std::move(error) };
+    }
+    commands.clear();
+    thread_local std::vector<std::string_view> tokens {};
+    for (const auto& step : steps_) {
+        if (step.command_.has_value()) {
+            commands.push_back(step.command_.value());
+            continue;
+        }
+        tokens.clear();
+        for (const auto& argument : step.arguments_) {
+            switch (argument.kind_) {
+            case Argument::Kind::Literal:
+                tokens.push_back(argument.literal_);
+                break;
+            case Argument::Kind::Key:
+                tokens.push_back(keys[argument.index_]);
+                break;
+            case Argument::Kind::Arg:
+                tokens.push_back(args[argument.index_]);
+                break;
+            }
+        }
+        commands.push_back(parseStep(*step.spec_, tokens));
+    }
+    return {};
+}
+
+std::expected<std::shared_ptr<const Script>, std::string> ScriptCache::load(const std::string_view source)
+{
+    const auto sha = sha1Hex(source);
+    if (auto script = find(sha)) {
+        return script;
+    }
+    auto script = Script::compile(source);
+    if (!script.has_value()) {
+        return script;
+    }
+    std::unique_lock lock { mutex_ };
+    return scripts_.try_emplace(sha, std::move(script.value())).first->second;
+}
+
+std::shared_ptr<const Script> ScriptCache::find(const std::string_view sha) const
+{
+    std::shared_lock lock { mutex_ };
+    const auto found = scripts_.find(sha);
+    return found == scripts_.end() ? nullptr : found->second;
+}
+
+void ScriptCache::flush()
+{
+    std::unique_lock lock { mutex_ };
+    scripts_.clear();
+}
+
+bool isTrueReply(const std::string_view bytes)
+{
+    return !bytes.empty() && bytes.front() != '-' && !bytes.starts_with("$-1\r\n") && !bytes.starts_with("*-1\r\n")
+        && !bytes.starts_with(":0\r\n") && !bytes.starts_with("*0\r\n");
+}
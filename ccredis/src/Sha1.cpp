@@ -0,0 +1,91 @@
+#include "Sha1.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace {
+constexpr size_t blockSize = 64;
+
+uint32_t loadBigEndian(const unsigned char* bytes)
+{
+    return uint32_t { bytes[0] } << 24 | uint32_t { bytes[1] } << 16 | uint32_t { bytes[2] } << 8 | uint32_t { bytes[3] };
+}
+
+void processBlock(std::array<uint32_t, 5>& state, const unsigned char* block)
+{
+    std::array<uint32_t, 80> w {};
+    for (size_t i = 0; i < 16; ++i) {
+        w[i] = loadBigEndian(block + 4 * i);
+    }
+    for (size_t i = 16; i < 80; ++i) {
+        w[i] = std::rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    auto [a, b, c, d, e] = state;
+    for (size_t i = 0; i < 80; ++i) {
+        uint32_t f = 0;
+        uint32_t k = 0;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        const auto temp = std::rotl(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = std::rotl(b, 30);
+        b = a;
+        a = temp;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+} // namespace
+
+std::string sha1Hex(const std::string_view data)
+{
+    std::array<uint32_t, 5> state { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+    size_t offset = 0;
+    for (; offset + blockSize <= data.size(); offset += blockSize) {
+        processBlock(state, bytes + offset);
+    }
+    // The rest, a 1 bit, zeros and the length in bits fill one or two more blocks.
+    std::array<unsigned char, 2 * blockSize> tail {};
+    const auto rest = data.size() - offset;
+    std::copy(bytes + offset, bytes + data.size(), tail.begin());
+    tail[rest] = 0x80;
+    const auto tailSize = rest + 9 <= blockSize ? blockSize : 2 * blockSize;
+    const auto bits = static_cast<uint64_t>(data.size()) * 8;
+    for (size_t i = 0; i < 8; ++i) {
+        tail[tailSize - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+    for (size_t block = 0; block < tailSize; block += blockSize) {
+        processBlock(state, tail.data() + block);
+    }
+
+    static constexpr std::string_view digits = "0123456789abcdef";
+    std::string hex {};
+    hex.reserve(40);
+    for (const auto word : state) {
+        for (int shift = 28; shift >= 0; shift -= 4) {
+            hex.push_back(digits[(word >> shift) & 0xF]);
+        }
+    }
+    return hex;
+}
@@ -0,0 +1,533 @@
+#include "Snapshot.h"
+
+#include "Database.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <expected>
+#include <fcntl.h>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+constexpr std::string_view magic = "CCRDB001";
+// The low bit of a type is set when the record has an expire time.
+constexpr uint8_t typeString = 0;
+constexpr uint8_t typeHash = 2;
+constexpr uint8_t typeList = 4;
+constexpr uint8_t typeSet = 6;
+constexpr uint8_t withExpire = 1;
+constexpr uint8_t typeEnd = 0xFF;
+// Footer after the end marker: number of keys and checksum.
+constexpr size_t footerSize = 2 * sizeof(uint64_t);
+// Keys are handed to the Db in batches of this size while loading.
+constexpr size_t loadBatchSize = 64 * 1024;
+
+template <typename T>
+T toLittleEndian(T value)
+{
+    if constexpr (std::endian::native == std::endian::big) {
+        return std::byteswap(value);
+    }
+    return value;
+}
+
+std::unexpected<std::string> systemError(const std::string& what)
+{
+    return std::unexpected { what + ": " + std::strerror(errno) };
+}
+
+// Mixes eight bytes at a time, which keeps verifying a large snapshot cheap next to
+// inserting its keys. It detects corruption, it is not meant to resist tampering.
+class Checksum {
+public:
+    void update(const std::string_view bytes)
+    {
+        size_t i = 0;
+        if (tailLength_ != 0) {
+            i = std::min(sizeof(uint64_t) - tailLength_, bytes.size());
+            std::memcpy(tail_ + tailLength_, bytes.data(), i);
+            tailLength_ += i;
+            if (tailLength_ < sizeof(uint64_t)) {
+                length_ += bytes.size();
+                return;
+            }
+            mix(load(tail_));
+            tailLength_ = 0;
+        }
+        for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t)) {
+            mix(load(bytes.data() + i));
+        }
+        tailLength_ = bytes.size() - i;
+        std::memcpy(tail_, bytes.data() + i, tailLength_);
+        length_ += bytes.size();
+    }
+
+    uint64_t value() const
+    {
+        auto copy = *this;
+        if (copy.tailLength_ != 0) {
+            uint64_t word {};
+            std::memcpy(&word, copy.tail_, copy.tailLength_);
+            copy.mix(toLittleEndian(word));
+        }
+        copy.mix(copy.length_);
+        return copy.state_ ^ (copy.state_ >> 32);
+    }
+
+private:
+    static uint64_t load(const char* bytes)
+    {
+        uint64_t word {};
+        std::memcpy(&word, bytes, sizeof word);
+        return toLittleEndian(word);
+    }
+
+    void mix(const uint64_t word)
+    {
+        state_ = std::rotl(state_ ^ word, 29) * 0x9E3779B97F4A7C15ull;
+    }
+
+    uint64_t state_ { 0xCBF29CE484222325ull };
+    uint64_t length_ {};
+    char tail_[sizeof(uint64_t)] {};
+    size_t tailLength_ {};
+};
+
+template <typename T>
+void put(std::string& out, const T value)
+{
+    const auto stored = toLittleEndian(value);
+    out.append(reinterpret_cast<const char*>(&stored), sizeof stored);
+}
+
+void putString(std::string& out, const std::string_view str)
+{
+    put(out, static_cast<uint32_t>(str.size()));
+    out.append(str);
+}
+
+class FileWriter {
+public:
+    explicit FileWriter(const int fd)
+        : fd_(fd)
+    {
+    }
+
+    bool write(const std::string_view bytes)
+    {
+        checksum_.update(bytes);
+        size_t written = 0;
+        while (written < bytes.size()) {
+            const auto n = ::write(fd_, bytes.data() + written, bytes.size() - written);
+            if (n == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            written += n;
+        }
+        return true;
+    }
+
+    uint64_t checksum() const { return checksum_.value(); }
+
+private:
+    int fd_ {};
+    Checksum checksum_ {};
+};
+
+class StringWriter {
+public:
+    explicit StringWriter(std::string& out)
+        : out_(out)
+    {
+    }
+
+    bool write(const std::string_view bytes)
+    {
+        checksum_.update(bytes);
+        out_.append(bytes);
+        return true;
+    }
+
+    uint64_t checksum() const { return checksum_.value(); }
+
+private:
+    std::string& out_;
+    Checksum checksum_ {};
+};
+
+// Reads the fields of a mapped snapshot. Every read checks the bounds, so a corrupt
+// file is reported instead of read past its end.
+class Reader {
+public:
+    explicit Reader(const std::string_view bytes)
+        : bytes_(bytes)
+    {
+    }
+
+    template <typename T>
+    bool read(T& value)
+    {
+        if (bytes_.size() - pos_ < sizeof value) {
+            return false;
+        }
+        std::memcpy(&value, bytes_.data() + pos_, sizeof value);
+        value = toLittleEndian(value);
+        pos_ += sizeof value;
+        return true;
+    }
+
+    bool readString(std::string_view& str)
+    {
+        uint32_t length {};
+        if (!read(length) || bytes_.size() - pos_ < length) {
+            return false;
+        }
+        str = bytes_.substr(pos_, length);
+        pos_ += length;
+        return true;
+    }
+
+    size_t position() const { return pos_; }
+
+private:
+    std::string_view bytes_ {};
+    size_t pos_ {};
+};
+
+class MappedFile {
+public:
+    MappedFile(const void* data, const size_t size)
+        : data_(data)
+        , size_(size)
+    {
+    }
+    ~MappedFile() { munmap(const_cast<void*>(data_), size_); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view bytes() const { return { static_cast<const char*>(data_), size_ }; }
+
+private:
+    const void* data_ {};
+    size_t size_ {};
+};
+
+int64_t unixMillis(const TimePoint time)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+}
+
+uint8_t typeOf(const ValueType& value)
+{
+    if (value.as<HashValue>() != nullptr) {
+        return typeHash;
+    }
+    if (value.as<ListValue>() != nullptr) {
+        return typeList;
+    }
+    if (value.as<SetValue>() != nullptr) {
+        return typeSet;
+    }
+    return typeString;
+}
+
+// The value of a record: a string, or the number of elements of a collection followed by
+// its strings (field and value for a hash).
+void putValue(std::string& buffer, const ValueType& value)
+{
+    const auto putStringView = [&buffer](const std::string_view str) { putString(buffer, str); };
+    if (const auto* hash = value.as<HashValue>()) {
+        put(buffer, static_cast<uint32_t>(hash->size()));
+        hash->forEach([&putStringView](const std::string_view field, const std::string_view value) {
+            putStringView(field);
+            putStringView(value);
+        });
+    } else if (const auto* list = value.as<ListValue>()) {
+        put(buffer, static_cast<uint32_t>(list->size()));
+        list->forEach(putStringView);
+    } else if (const auto* set = value.as<SetValue>()) {
+        put(buffer, static_cast<uint32_t>(set->size()));
+        set->forEach(putStringView);
+    } else {
+        ValueType::IntChars chars {};
+        putString(buffer, value.view(chars));
+    }
+}
+
+// Reads the elements of a collection record into value. Returns false on a corrupt record.
+bool readCollection(Reader& reader, const uint8_t type, ValueType& value)
+{
+    uint32_t count {};
+    if (!reader.read(count)) {
+        return false;
+    }
+    std::string_view first {};
+    std::string_view second {};
+    if (type == typeHash) {
+        auto& hash = value.emplace<HashValue>();
+        for (uint32_t i = 0; i < count; ++i) {
+            if (!reader.readString(first) || !reader.readString(second)) {
+                return false;
+            }
+            hash.set(first, second);
+        }
+    } else if (type == typeList) {
+        auto& list = value.emplace<ListValue>();
+        for (uint32_t i = 0; i < count; ++i) {
+            if (!reader.readString(first)) {
+                return false;
+            }
+            list.pushBack(first);
+        }
+    } else {
+        auto& set = value.emplace<SetValue>();
+        for (uint32_t i = 0; i < count; ++i) {
+            if (!reader.readString(first)) {
+                return false;
+            }
+            set.add(first);
+        }
+    }
+    return true;
+}
+
+// Writes the snapshot of db through writer, calling shardCopied(shard) once the keys of
+// every shard are copied, while its lock is still held. Returns false if a write failed.
+template <typename Writer, typename ShardCopied>
+bool writeSnapshot(const Db& db, Writer& writer, uint64_t& numKeys, ShardCopied&& shardCopied)
+{
+    bool ok = writer.write(magic);
+    std::string buffer {};
+    for (size_t shard = 0; shard < Db::numShards && ok; ++shard) {
+        buffer.clear();
+        db.forEachInShard(
+            shard,
+            [&buffer, &numKeys](const std::string_view key, const ValueType& value) {
+                if (value.expire_.has_value()) {
+                    put(buffer, static_cast<uint8_t>(typeOf(value) | withExpire));
+                    put(buffer, unixMillis(value.expire_.value()));
+                } else {
+                    put(buffer, typeOf(value));
+                }
+                putString(buffer, key);
+                putValue(buffer, value);
+                ++numKeys;
+            },
+            [&shardCopied, shard]() { shardCopied(shard); });
+        ok = writer.write(buffer);
+    }
+
+    buffer.clear();
+    put(buffer, typeEnd);
+    put(buffer, numKeys);
+    ok = ok && writer.write(buffer);
+    buffer.clear();
+    put(buffer, writer.checksum());
+    return ok && writer.write(buffer);
+}
+
+// Loads the snapshot in bytes; name is what errors call it.
+std::expected<size_t, std::string> loadSnapshotBytes(Db& db, const std::string_view bytes, const std::string& name)
+{
+    const auto size = bytes.size();
+    if (size < magic.size() + 1 + footerSize) {
+        return std::unexpected { name + " is too short to be a snapshot" };
+    }
+    if (!bytes.starts_with(magic)) {
+        return std::unexpected { name + " is not a snapshot or has an unsupported version" };
+    }
+    const auto body = bytes.substr(0, size - sizeof(uint64_t));
+    Checksum checksum {};
+    checksum.update(body);
+    uint64_t expected {};
+    Reader { bytes.substr(body.size()) }.read(expected);
+    if (checksum.value() != expected) {
+        return std::unexpected { name + " is corrupt: checksum mismatch" };
+    }
+
+    // The key count in the footer sizes the tables up front. A record takes at least
+    // nine bytes, which bounds the count should the footer be wrong.
+    uint64_t numKeys {};
+    Reader { bytes.substr(body.size() - sizeof(uint64_t)) }.read(numKeys);
+    db.reserve(db.size() + std::min<uint64_t>(numKeys, size / 9));
+
+    const auto now = unixMillis(std::chrono::system_clock::now());
+    Reader reader { body.substr(magic.size()) };
+    std::vector<BulkEntry> batch {};
+    batch.reserve(loadBatchSize);
+    size_t numLoaded = 0;
+    uint64_t numRead = 0;
+    while (true) {
+        uint8_t type {};
+        if (!reader.read(type)) {
+            return std::unexpected { name + " is corrupt: missing end marker" };
+        }
+        if (type == typeEnd) {
+            break;
+        }
+        const uint8_t baseType = type & ~withExpire;
+        BulkEntry entry {};
+        int64_t expire {};
+        // Collections are built here and set one by one; strings go in the batch.
+        ValueType collection {};
+        if (baseType > typeSet
+            || ((type & withExpire) != 0 && !reader.read(expire))
+            || !reader.readString(entry.key_)
+            || (baseType == typeString ? !reader.readString(entry.value_) : !readCollection(reader, baseType, collection))) {
+            return std::unexpected { name + " is corrupt at offset " + std::to_string(magic.size() + reader.position()) };
+        }
+        ++numRead;
+        if ((type & withExpire) != 0) {
+            if (expire <= now) {
+                continue;
+            }
+            entry.expire_ = TimePoint { std::chrono::milliseconds { expire } };
+        }
+        if (baseType != typeString) {
+            collection.expire_ = entry.expire_;
+            db.set(entry.key_, std::move(collection));
+            ++numLoaded;
+            continue;
+        }
+        batch.push_back(entry);
+        if (batch.size() == loadBatchSize) {
+            db.insertBulk(batch);
+            numLoaded += batch.size();
+            batch.clear();
+        }
+    }
+    if (!reader.read(numKeys) || numKeys != numRead) {
+        return std::unexpected { name + " is corrupt: key count mismatch" };
+    }
+    db.insertBulk(batch);
+    return numLoaded + batch.size();
+}
+} // namespace
+
+std::expected<size_t, std::string> saveSnapshot(const Db& db, const std::string& path)
+{
+    const auto tmpPath = path + ".tmp";
+    const int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return systemError("open " + tmpPath);
+    }
+
+    FileWriter writer { fd };
+    uint64_t numKeys = 0;
+    const bool ok = writeSnapshot(db, writer, numKeys, [](size_t) {}) && fsync(fd) == 0;
+
+    if (!ok) {
+        const auto error = systemError("write " + tmpPath);
+        close(fd);
+        unlink(tmpPath.c_str());
+        return error;
+    }
+    close(fd);
+    if (rename(tmpPath.c_str(), path.c_str()) == -1) {
+        const auto error = systemError("rename " + tmpPath);
+        unlink(tmpPath.c_str());
+        return error;
+    }
+    return numKeys;
+}
+
+std::expected<size_t, std::string> loadSnapshot(Db& db, const std::string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        return systemError("open " + path);
+    }
+    struct stat info {};
+    if (fstat(fd, &info) == -1) {
+        const auto error = systemError("stat " + path);
+        close(fd);
+        return error;
+    }
+    const auto size = static_cast<size_t>(info.st_size);
+    if (size < magic.size() + 1 + footerSize) {
+        close(fd);
+        return std::unexpected { path + " is too short to be a snapshot" };
+    }
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return systemError("mmap " + path);
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    const MappedFile file { data, size };
+    return loadSnapshotBytes(db, file.bytes(), path);
+}
+
+std::string encodeSnapshot(const Db& db, const std::function<void(size_t shard)>& shardCopied)
+{
+    std::string out {};
+    StringWriter writer { out };
+    uint64_t numKeys = 0;
+    writeSnapshot(db, writer, numKeys, [&shardCopied](const size_t shard) {
+        if (shardCopied) {
+            shardCopied(shard);
+        }
+    });
+    return out;
+}
+
+std::expected<size_t, std::string> decodeSnapshot(Db& db, const std::string_view bytes)
+{
+    return loadSnapshotBytes(db, bytes, "snapshot");
+}
+
+std::expected<size_t, std::string> Snapshotter::save()
+{
+    if (saving_.exchange(true)) {
+        return std::unexpected { "Background save already in progress" };
+    }
+    auto result = saveAndRecord();
+    saving_ = false;
+    return result;
+}
+
+bool Snapshotter::startBackgroundSave()
+{
+    if (saving_.exchange(true)) {
+        return false;
+    }
+    inProgress_ = true;
+    std::lock_guard lock { workerMutex_ };
+    // The previous worker has finished its save; assigning joins it.
+    worker_ = std::jthread { [this]() {
+        saveAndRecord();
+        saving_ = false;
+        inProgress_ = false;
+    } };
+    return true;
+}
+
+std::expected<size_t, std::string> Snapshotter::saveAndRecord()
+{
+    auto result = saveSnapshot(*db_, path_);
+    lastSaveOk_ = result.has_value();
+    if (result.has_value()) {
+        lastSaveTime_ = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+                            .count();
+    }
+    return result;
+}
@@ -0,0 +1,93 @@
+#include "Transaction.h"
+
+#include "Commands.h"
+#include "Database.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace {
+template <typename Cmd, typename... Cmds>
+constexpr bool isOneOf = (std::is_same_v<Cmd, Cmds> || ...);
+
+uint64_t shardOf(const KeyT key)
+{
+    return uint64_t { 1 } << Db::shardOf(key);
+}
+
+// Commands that hand the connection over, wait for other threads or lock shards of
+// their own are not queued.
+template <typename... Cmds>
+constexpr std::array<bool, sizeof...(Cmds)> queueable(const std::variant<Cmds...>*)
+{
+    return { !isOneOf<Cmds, CommandSave, CommandBgsave, CommandBgrewriteaof, CommandReplicaof, CommandPsync,
+        CommandSubscribe, CommandUnsubscribe, CommandPsubscribe, CommandPunsubscribe, CommandEval, CommandEvalsha>... };
+}
+constexpr auto queueableCommands = queueable(static_cast<const CommandVariant*>(nullptr));
+
+template <typename Cmd>
+uint64_t shardsOfCommand(const Cmd& cmd)
+{
+    uint64_t mask = 0;
+    if constexpr (requires { cmd.key_; }) {
+        mask = shardOf(cmd.key_);
+    } else if constexpr (requires { cmd.keys_; }) {
+        for (const auto key : cmd.keys_) {
+            mask |= shardOf(key);
+        }
+    } else if constexpr (std::is_same_v<Cmd, CommandMset>) {
+        for (const auto& entry : cmd.entries_) {
+            mask |= shardOf(entry.first);
+        }
+    } else if constexpr (!isOneOf<Cmd, CommandUnknown, CommandInvalid, CommandPing, CommandHello, CommandLastsave,
+                             CommandSlowlog, CommandLatency, CommandPublish, CommandUnwatch, CommandScript>) {
+        mask = Db::allShards;
+    }
+    return mask;
+}
+} // namespace
+
+Transaction* Transactions::find(const uint64_t client)
+{
+    const auto found = clients_.find(client);
+    return found == clients_.end() ? nullptr : &found->second;
+}
+
+bool Transactions::queuing(const uint64_t client) const
+{
+    const auto found = clients_.find(client);
+    return found != clients_.end() && found->second.queuing_;
+}
+
+std::string_view Transactions::store(const uint64_t client, const std::string_view frame)
+{
+    return clients_[client].frames_.emplace_back(frame);
+}
+
+Transaction Transactions::take(const uint64_t client)
+{
+    auto node = clients_.extract(client);
+    return node.empty() ? Transaction {} : std::move(node.mapped());
+}
+
+bool controlsTransaction(const CommandVariant& command)
+{
+    return std::holds_alternative<CommandMulti>(command) || std::holds_alternative<CommandExec>(command)
+        || std::holds_alternative<CommandDiscard>(command) || std::holds_alternative<CommandWatch>(command);
+}
+
+bool allowedInTransaction(const size_t index)
+{
+    return queueableCommands[index];
+}
+
+uint64_t shardsOf(const CommandVariant& command)
+{
+    return std::visit([](const auto& cmd) { return shardsOfCommand(cmd); }, command);
+}
@@ -0,0 +1,431 @@
+#include "UringReactor.h"
+
+#include "CommandExecutor.h"
+#include "IoUring.h"
+#include "Log.h"
+#include "RespEncoder.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <expected>
+#include <linux/io_uring.h>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+// Submission slots of the ring. A batch that queues more submits the first ones early.
+constexpr unsigned ringEntries = 1024;
+// Receives pick from this many buffers of receiveBufferSize. A buffer goes back to the
+// ring as soon as the frames in it were executed, so they only run out when more
+// receives than this complete in one batch; the receives are re-armed then.
+constexpr unsigned numReceiveBuffers = 256;
+constexpr size_t receiveBufferSize = 16 * 1024;
+constexpr uint16_t receiveBufferGroup = 0;
+
+constexpr int operationShift = 56;
+} // namespace
+
+std::expected<std::unique_ptr<UringReactor>, std::string> UringReactor::create(const int listener,
+    const ServerContext& context)
+{
+    auto ring = IoUring::create(ringEntries);
+    if (!ring.has_value()) {
+        return std::unexpected { ring.error() };
+    }
+    // Multishot receives came in 6.0 together with IORING_OP_SEND_ZC, and only the
+    // opcodes can be probed.
+    for (const auto opcode : { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_READ,
+             IORING_OP_TIMEOUT, IORING_OP_ASYNC_CANCEL, IORING_OP_SEND_ZC }) {
+        if (!ring.value()->supports(opcode)) {
+            return std::unexpected { "io_uring: the kernel lacks opcode " + std::to_string(opcode) + ", 6.0 or later is needed" };
+        }
+    }
+    auto buffers = BufferRing::create(*ring.value(), receiveBufferGroup, numReceiveBuffers, receiveBufferSize);
+    if (!buffers.has_value()) {
+        return std::unexpected { buffers.error() };
+    }
+    return std::unique_ptr<UringReactor> { new UringReactor(listener, context, std::move(ring.value()),
+        std::move(buffers.value())) };
+}
+
+UringReactor::UringReactor(const int listener, const ServerContext& context, std::unique_ptr<IoUring> ring,
+    std::unique_ptr<BufferRing> buffers)
+    : listener_(listener)
+    , ring_(std::move(ring))
+    , buffers_(std::move(buffers))
+    , wakeFd_(eventfd(0, EFD_CLOEXEC))
+    , executor_(context, [this]() {
+        constexpr uint64_t one = 1;
+        [[maybe_unused]] const auto n = write(wakeFd_, &one, sizeof one);
+    })
+    , tick_ { .tv_sec = 0, .tv_nsec = CommandExecutor::tickIntervalNs }
+{
+    if (wakeFd_ == -1) {
+        LOG_ERROR("eventfd: ", std::strerror(errno));
+        exit(1);
+    }
+}
+
+UringReactor::~UringReactor()
+{
+    // The buffers are unregistered from the ring before it goes away.
+    buffers_.reset();
+    ring_.reset();
+    for (const auto& [id, connection] : connections_) {
+        close(connection.fd_);
+    }
+    close(wakeFd_);
+    close(listener_);
+}
+
+void UringReactor::armAccept()
+{
+    auto& sqe = ring_->nextSqe();
+    sqe.opcode = IORING_OP_ACCEPT;
+    sqe.fd = listener_;
+    sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+    // Blocking sockets: io_uring never blocks on them, and replication expects one.
+    sqe.accept_flags = SOCK_CLOEXEC;
+    sqe.user_data = uint64_t { static_cast<uint8_t>(Operation::Accept) } << operationShift;
+}
+
+void UringReactor::armReceive(const uint64_t id, UringConnection& connection)
+{
+    auto& sqe = ring_->nextSqe();
+    sqe.opcode = IORING_OP_RECV;
+    sqe.fd = connection.fd_;
+    sqe.ioprio = IORING_RECV_MULTISHOT;
+    sqe.flags = IOSQE_BUFFER_SELECT;
+    sqe.buf_group = buffers_->groupId();
+    sqe.user_data = uint64_t { static_cast<uint8_t>(Operation::Receive) } << operationShift | id;
+    connection.receiving_ = true;
+}
+
+void UringReactor::armTimeout()
+{
+    auto& sqe = ring_->nextSqe();
+    sqe.opcode = IORING_OP_TIMEOUT;
+    sqe.fd = -1;
+    sqe.addr = reinterpret_cast<uint64_t>(&tick_);
+    sqe.len = 1;
+    sqe.user_data = uint64_t { static_cast<uint8_t>(Operation::Timeout) } << operationShift;
+}
+
+// The eventfd other reactors signal after publishing to subscribers of this one. Counted
+// rather than a semaphore, so one read takes all wakeups.
+void UringReactor::armWake()
+{
+    auto& sqe = ring_->nextSqe();
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = wakeFd_;
+    sqe.addr = reinterpret_cast<uint64_t>(&wakeups_);
+    sqe.len = sizeof wakeups_;
+    sqe.user_data = uint64_t { static_cast<uint8_t>(Operation::Wake) } << operationShift;
+}
+
+// MSG_WAITALL makes the kernel retry a short send until all of it went out, so a client
+// has at most one send in flight and replies cannot overtake each other. Published
+// messages go out from the buffers all their subscribers share, as segments of one
+// sendmsg.
+void UringReactor::startSend(const uint64_t id, UringConnection& connection)
+{
+    const auto segments = connection.sending_.segments(IOV_MAX);
+    connection.message_ = msghdr {};
+    connection.message_.msg_iov = const_cast<iovec*>(segments.data());
+    connection.message_.msg_iovlen = segments.size();
+    auto& sqe = ring_->nextSqe();
+    sqe.opcode = IORING_OP_SENDMSG;
+    sqe.fd = connection.fd_;
+    sqe.addr = reinterpret_cast<uint64_t>(&connection.message_);
+    sqe.len = 1;
+    sqe.msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe.user_data = uint64_t { static_cast<uint8_t>(Operation::Send) } << operationShift | id;
+}
+
+void UringReactor::handleCompletion(const io_uring_cqe& cqe)
+{
+    const auto id = cqe.user_data & ((uint64_t { 1 } << operationShift) - 1);
+    switch (static_cast<Operation>(cqe.user_data >> operationShift)) {
+    case Operation::Accept:
+        onAccept(cqe);
+        break;
+    case Operation::Receive:
+        onReceive(id, cqe);
+        break;
+    case Operation::Send:
+        onSend(id, cqe);
+        break;
+    case Operation::Timeout:
+        executor_.onTick();
+        armTimeout();
+        break;
+    case Operation::Cancel:
+        break;
+    case Operation::Wake:
+        // Published messages are delivered after the batch.
+        armWake();
+        break;
+    }
+}
+
+void UringReactor::onAccept(const io_uring_cqe& cqe)
+{
+    if (cqe.res >= 0) {
+        const int clientFd = cqe.res;
+        constexpr int yes = 1;
+        setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof yes);
+        LOG_INFO("Client connected. Fd= ", clientFd);
+        const auto id = nextId_++;
+        auto& connection = connections_.emplace(id, UringConnection { .fd_ = clientFd }).first->second;
+        armReceive(id, connection);
+    } else {
+        LOG_ERROR("accept: ", std::strerror(-cqe.res));
+    }
+    if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+        armAccept();
+    }
+}
+
+void UringReactor::onReceive(const uint64_t id, const io_uring_cqe& cqe)
+{
+    const auto connection = connections_.find(id);
+    if ((cqe.flags & IORING_CQE_F_BUFFER) != 0) {
+        const auto bufferId = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        if (connection != connections_.end() && cqe.res > 0) {
+            LOG_DEBUG("Received ", cqe.res, " amount of bytes");
+            handleInput(id, connection->second, buffers_->buffer(bufferId).first(cqe.res));
+        }
+        buffers_->recycle(bufferId);
+    }
+    if (connection == connections_.end() || (cqe.flags & IORING_CQE_F_MORE) != 0) {
+        return;
+    }
+
+    auto& client = connection->second;
+    client.receiving_ = false;
+    if (!client.closing_) {
+        // The kernel ended the receive, eg. because it ran out of buffers; arm it again
+        // now that they were handed back.
+        if (cqe.res > 0 || cqe.res == -ENOBUFS) {
+            armReceive(id, client);
+            return;
+        }
+        if (cqe.res == 0) {
+            LOG_INFO("Client disconnected");
+        } else {
+            LOG_INFO("Received ", cqe.res, " . There is an error");
+        }
+        // Nobody reads the replies anymore; fail the send in flight rather than wait for it.
+        client.pending_ = {};
+        if (!client.sending_.empty()) {
+            shutdown(client.fd_, SHUT_RDWR);
+        }
+        client.closing_ = true;
+    }
+    release(id);
+}
+
+void UringReactor::onSend(const uint64_t id, const io_uring_cqe& cqe)
+{
+    const auto connection = connections_.find(id);
+    if (connection == connections_.end()) {
+        return;
+    }
+    auto& client = connection->second;
+    if (cqe.res < 0) {
+        LOG_ERROR("send: ", std::strerror(-cqe.res));
+        client.sending_ = {};
+        client.pending_ = {};
+        client.closing_ = true;
+        release(id);
+        return;
+    }
+    LOG_DEBUG("Sent ", cqe.res, " amount of bytes.");
+    // More segments than one sendmsg takes are sent in several.
+    client.sending_.consume(static_cast<size_t>(cqe.res));
+    if (!client.sending_.empty()) {
+        startSend(id, client);
+        return;
+    }
+    // Replies collected meanwhile go out at the end of the batch, after the ones
+    // collected in this batch are durable.
+    if (!client.pending_.empty()) {
+        queueFlush(id, client);
+        return;
+    }
+    release(id);
+}
+
+void UringReactor::handleInput(const uint64_t id, UringConnection& connection, const std::span<const char> data)
+{
+    // Input after PSYNC or a fatal error is dropped.
+    if (connection.closing_) {
+        return;
+    }
+    // Frames that arrived whole are executed from the provided buffer; only a tail that
+    // is not a complete frame is copied.
+    auto& buffer = connection.readBuffer_;
+    const bool buffered = !buffer.empty();
+    if (buffered) {
+        buffer.insert(buffer.end(), data.begin(), data.end());
+    }
+    const std::string_view input = buffered ? std::string_view { buffer.data(), buffer.size() }
+                                            : std::string_view { data.data(), data.size() };
+    size_t consumed = 0;
+    auto state = executor_.execute(id, input, consumed, connection.followerRequest_);
+    if (state != ClientState::Follower) {
+        if (buffered) {
+            buffer.erase(buffer.begin(), buffer.begin() + consumed);
+        } else {
+            buffer.assign(input.begin() + consumed, input.end());
+        }
+        if (buffer.size() > CommandExecutor::maxQueryBufferSize) {
+            LOG_WARNING("Query buffer limit reached, closing client");
+            state = ClientState::Disconnected;
+        }
+    }
+
+    auto& encoder = executor_.encoder();
+    connection.pending_.append(encoder.segments());
+    encoder.clearBuffer();
+    if (connection.sending_.size() + connection.pending_.size() > executor_.outputLimit(id)) {
+        LOG_WARNING("Output buffer limit reached, closing client");
+        connection.pending_ = {};
+        state = ClientState::Disconnected;
+    }
+    if (!connection.pending_.empty()) {
+        queueFlush(id, connection);
+    }
+
+    if (state == ClientState::Connected) {
+        return;
+    }
+    // The replies so far still go out.
+    closeClient(id, connection);
+}
+
+void UringReactor::queueFlush(const uint64_t id, UringConnection& connection)
+{
+    if (!connection.flushQueued_) {
+        connection.flushQueued_ = true;
+        flushQueue_.push_back(id);
+    }
+}
+
+// The receive is cancelled so that nothing reads from the socket once it is closed or
+// belongs to replication.
+void UringReactor::closeClient(const uint64_t id, UringConnection& connection)
+{
+    connection.closing_ = true;
+    if (connection.receiving_) {
+        auto& sqe = ring_->nextSqe();
+        sqe.opcode = IORING_OP_ASYNC_CANCEL;
+        sqe.fd = -1;
+        sqe.addr = uint64_t { static_cast<uint8_t>(Operation::Receive) } << operationShift | id;
+        sqe.user_data = uint64_t { static_cast<uint8_t>(Operation::Cancel) } << operationShift | id;
+    }
+}
+
+void UringReactor::deliverPublications()
+{
+    // Released after the loop, which iterates the subscribers releasing changes.
+    std::vector<uint64_t> released {};
+    for (const auto& publication : executor_.takePublications()) {
+        for (const auto id : executor_.subscribers(publication)) {
+            const auto connection = connections_.find(id);
+            if (connection == connections_.end() || connection->second.closing_) {
+                continue;
+            }
+            auto& client = connection->second;
+            if (client.sending_.size() + client.pending_.size() > executor_.outputLimit(id)) {
+                // The subscriber does not keep up. Failing the send in flight ends the
+                // receive too, and the connection is released.
+                LOG_WARNING("Output buffer limit reached, closing client");
+                client.pending_ = {};
+                if (!client.sending_.empty()) {
+                    shutdown(client.fd_, SHUT_RDWR);
+                }
+                closeClient(id, client);
+                if (!client.receiving_ && client.sending_.empty()) {
+                    released.push_back(id);
+                }
+                continue;
+            }
+            client.pending_.append(publication.frame_);
+            queueFlush(id, client);
+        }
+    }
+    for (const auto id : released) {
+        release(id);
+    }
+}
+
+void UringReactor::flushReplies()
+{
+    if (flushQueue_.empty()) {
+        return;
+    }
+    // With appendfsync always, one wait covers the replies of every client in the batch.
+    executor_.awaitDurability();
+    for (const auto id : std::exchange(flushQueue_, {})) {
+        const auto connection = connections_.find(id);
+        if (connection == connections_.end()) {
+            continue;
+        }
+        auto& client = connection->second;
+        client.flushQueued_ = false;
+        if (client.sending_.empty() && !client.pending_.empty()) {
+            std::swap(client.sending_, client.pending_);
+            startSend(id, client);
+        }
+    }
+}
+
+void UringReactor::release(const uint64_t id)
+{
+    const auto connection = connections_.find(id);
+    auto& client = connection->second;
+    if (!client.closing_ || client.receiving_ || !client.sending_.empty() || !client.pending_.empty()) {
+        return;
+    }
+    executor_.onDisconnect(id);
+    if (client.followerRequest_.has_value()) {
+        executor_.attachFollower(client.fd_, std::move(client.followerRequest_.value()));
+    } else {
+        close(client.fd_);
+    }
+    connections_.erase(connection);
+}
+
+void UringReactor::run()
+{
+    ring_->enable();
+    armAccept();
+    armTimeout();
+    armWake();
+    while (true) {
+        const auto result = ring_->submitAndWait(1);
+        // EBUSY: completions overflowed the queue and are reaped below.
+        if (result < 0 && result != -EINTR && result != -EBUSY) {
+            LOG_ERROR("io_uring_enter: ", std::strerror(-result));
+            exit(1);
+        }
+        ring_->forEachCompletion([this](const io_uring_cqe& cqe) { handleCompletion(cqe); });
+        deliverPublications();
+        flushReplies();
+    }
+}
@@ -0,0 +1,117 @@
+#include "AppendOnlyFile.h"
+#include "CommandStats.h"
+#include "Config.h"
+#include "Database.h"
+#include "Log.h"
+#include "PubSub.h"
+#include "Replication.h"
+#include "Script.h"
+#include "Server.h"
+#include "ServerContext.h"
+#include "Snapshot.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+
+namespace {
+// Rebuilds the keyspace from the append only file when it is enabled and exists, and
+// from the snapshot otherwise. Returns whether the append only file was replayed.
+std::expected<bool, std::string> loadKeyspace(Db& db, const ServerConfig& config)
+{
+    if (config.appendOnly_) {
+        const auto replayed = replayAppendOnlyFile(db, config.appendFilename_);
+        if (!replayed.has_value()) {
+            return std::unexpected { "Could not replay append only file: " + replayed.error() };
+        }
+        if (replayed->bytes_ > 0) {
+            const auto seconds = std::chrono::duration<double>(replayed->elapsed_).count();
+            LOG_INFO("Replayed ", replayed->commands_, " commands (", replayed->bytes_, " bytes) from ",
+                config.appendFilename_, " in ", static_cast<uint64_t>(seconds * 1000), " ms, ",
+                static_cast<size_t>(replayed->commands_ / seconds), " commands/s");
+            return true;
+        }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto loaded = loadSnapshot(db, config.dbFilename_);
+    if (!loaded.has_value()) {
+        return std::unexpected { "Could not load snapshot: " + loaded.error() };
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    LOG_INFO("Loaded ", loaded.value(), " keys from ", config.dbFilename_, " in ", elapsed.count(), " ms");
+    return false;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const auto config = parseArgs(std::span<const char* const> { argv, static_cast<size_t>(argc) });
+    if (!config.has_value()) {
+        std::cerr << config.error() << "\n";
+        std::cerr << "Usage: server [--port <port>] [--threads <n>] [--io-backend epoll|io_uring] [--dbfilename <path>]\n"
+                     "              [--appendonly yes|no] [--appendfilename <path>] [--appendfsync always|everysec|no]\n"
+                     "              [--maxmemory <bytes>] [--maxmemory-samples <n>]\n"
+                     "              [--maxmemory-policy noeviction|allkeys-lru|allkeys-lfu|volatile-ttl]\n"
+                     "              [--replicaof \"<host> <port>\"] [--repl-backlog-size <bytes>]\n"
+                     "              [--slowlog-log-slower-than <usec>] [--slowlog-max-len <n>]\n"
+                     "              [--pubsub-output-limit <bytes>] [--loglevel debug|info|warning|error]\n";
+        return 1;
+    }
+    Logger::setLevel(config->logLevel_);
+
+    ServerContext context { .db_ = std::make_shared<Db>() };
+    context.metrics_ = std::make_shared<CommandMetrics>(config->slowlogSlowerThan_, config->slowlogMaxLen_);
+    context.pubsub_ = std::make_shared<PubSub>(config->pubsubOutputLimit_);
+    context.scripts_ = std::make_shared<ScriptCache>();
+    context.db_->setMaxMemory(config->maxMemory_, config->maxMemoryPolicy_, config->maxMemorySamples_);
+    const auto replayed = loadKeyspace(*context.db_, config.value());
+    if (!replayed.has_value()) {
+        std::cerr << replayed.error() << "\n";
+        return 1;
+    }
+    context.snapshotter_ = std::make_shared<Snapshotter>(context.db_, config->dbFilename_);
+
+    if (config->appendOnly_) {
+        auto aof = AppendOnlyFile::open(config->appendFilename_, config->appendFsync_);
+        if (!aof.has_value()) {
+            std::cerr << "Could not open append only file: " << aof.error() << "\n";
+            return 1;
+        }
+        context.aof_ = std::move(aof.value());
+        // Keys loaded from a snapshot are not in the log yet.
+        if (!replayed.value() && context.db_->size() > 0) {
+            context.aof_->startRewrite(context.db_);
+        }
+    }
+
+    // Every write is encoded once for the log and the followers.
+    context.replication_ = std::make_shared<Replication>(context.db_, context.aof_, config->replBacklogSize_);
+    context.db_->setWriteHook([aof = context.aof_, replication = context.replication_](const KeyT key, const ValueType* value, const std::span<const std::string_view> command) {
+        auto& leader = replication->leader();
+        const bool streaming = leader.streaming();
+        if (!aof && !streaming) {
+            return;
+        }
+        thread_local std::string encoded {};
+        encoded.clear();
+        encodeWrite(encoded, key, value, command);
+        if (aof) {
+            aof->append(key, encoded);
+        }
+        if (streaming) {
+            leader.feed(encoded);
+        }
+    });
+    if (!config->replicaOfHost_.empty()) {
+        context.replication_->replicaOf(config->replicaOfHost_, config->replicaOfPort_);
+    }
+
+    RedisServer server { std::move(context), config.value() };
+    server.start(config->port_);
+}
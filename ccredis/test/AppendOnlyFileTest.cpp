@@ -0,0 +1,228 @@
+#include "AppendOnlyFile.h"
+#include "Database.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+class AppendOnlyFileTest : public testing::Test {
+protected:
+    void SetUp() override
+    {
+        std::remove(path.c_str());
+    }
+    void TearDown() override
+    {
+        std::remove(path.c_str());
+    }
+
+    std::shared_ptr<AppendOnlyFile> openLog(std::shared_ptr<Db>& db, const FsyncPolicy policy = FsyncPolicy::Always)
+    {
+        auto aof = AppendOnlyFile::open(path, policy).value();
+        db->setWriteHook([aof](const KeyT key, const ValueType* value, const std::span<const std::string_view> command) {
+            aof->logWrite(key, value, command);
+        });
+        return aof;
+    }
+
+    std::string readFile() const
+    {
+        std::ifstream file { path, std::ios::binary };
+        std::stringstream contents {};
+        contents << file.rdbuf();
+        return contents.str();
+    }
+
+    // One file per test, as ctest may run them in parallel.
+    const std::string path { testing::TempDir() + "append_only_file_test_"
+        + testing::UnitTest::GetInstance()->current_test_info()->name() + ".aof" };
+};
+
+TEST_F(AppendOnlyFileTest, LogAndReplay)
+{
+    const auto expire = std::chrono::time_point_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now() + std::chrono::hours { 1 });
+    {
+        auto db = std::make_shared<Db>();
+        auto aof = openLog(db);
+        db->set("key", "value");
+        db->set("key", "other");
+        db->set("ttl", "value", expire);
+        db->set("binary", std::string_view { "a\0\r\nb", 5 });
+        aof->awaitFsync();
+        db->setWriteHook({});
+    }
+    EXPECT_EQ("*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$5\r\nvalue\r\n", readFile().substr(0, 33));
+
+    Db replayed {};
+    const auto stats = replayAppendOnlyFile(replayed, path);
+    ASSERT_TRUE(stats.has_value());
+    EXPECT_EQ(4, stats->commands_);
+    EXPECT_EQ(readFile().size(), stats->bytes_);
+    EXPECT_EQ(3, replayed.size());
+    EXPECT_EQ(ValueType { "other" }, replayed.get("key").value());
+    EXPECT_EQ(expire, replayed.get("ttl").value().expire_);
+    EXPECT_EQ(ValueType { std::string_view("a\0\r\nb", 5) }, replayed.get("binary").value());
+}
+
+TEST_F(AppendOnlyFileTest, DeletesAreReplayed)
+{
+    {
+        auto db = std::make_shared<Db>();
+        auto aof = openLog(db);
+        db->set("kept", "value");
+        db->set("deleted", "value");
+        const std::vector<KeyT> keys { "deleted", "missing" };
+        db->removeMany(keys);
+        db->set("recreated", "old");
+        db->removeMany(std::vector<KeyT> { "recreated" });
+        db->set("recreated", "new");
+        aof->awaitFsync();
+        db->setWriteHook({});
+    }
+    Db replayed {};
+    EXPECT_EQ(6, replayAppendOnlyFile(replayed, path)->commands_);
+    EXPECT_EQ(2, replayed.size());
+    EXPECT_FALSE(replayed.get("deleted").has_value());
+    EXPECT_EQ(ValueType { "new" }, replayed.get("recreated").value());
+}
+
+TEST_F(AppendOnlyFileTest, CollectionsAreReplayed)
+{
+    const std::vector<std::pair<std::string_view, std::string_view>> fields { { "f1", "v1" }, { "f2", "v2" } };
+    const std::vector<std::string_view> values { "a", "b" };
+    ValueType expected {};
+    {
+        auto db = std::make_shared<Db>();
+        auto aof = openLog(db);
+        db->hashSet("hash", fields);
+        db->listPush("list", values, Db::ListEnd::Back);
+        db->listPush("list", values, Db::ListEnd::Front);
+        db->setAdd("set", values);
+        db->set("string", "value");
+        db->removeMany(std::vector<KeyT> { "string" });
+        db->listPush("string", values, Db::ListEnd::Back);
+        aof->awaitFsync();
+        db->setWriteHook({});
+        expected = db->get("list").value();
+    }
+    Db replayed {};
+    EXPECT_EQ(7, replayAppendOnlyFile(replayed, path)->commands_);
+    EXPECT_EQ(4, replayed.size());
+    EXPECT_EQ(expected, replayed.get("list").value());
+    EXPECT_EQ("v2", replayed.get("hash")->as<HashValue>()->get("f2").value());
+    EXPECT_TRUE(replayed.get("set")->as<SetValue>()->contains("b"));
+    EXPECT_EQ(2, replayed.get("string")->as<ListValue>()->size());
+}
+
+TEST_F(AppendOnlyFileTest, EverySecondFlushesOnClose)
+{
+    {
+        auto db = std::make_shared<Db>();
+        auto aof = openLog(db, FsyncPolicy::EverySecond);
+        db->set("key", "value");
+        db->setWriteHook({});
+    }
+    Db replayed {};
+    EXPECT_EQ(1, replayAppendOnlyFile(replayed, path)->commands_);
+}
+
+TEST_F(AppendOnlyFileTest, IncompleteCommandIsTruncated)
+{
+    const std::string complete { "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$1\r\nv\r\n" };
+    {
+        std::ofstream file { path, std::ios::binary };
+        file << complete << "*3\r\n$3\r\nSET\r\n$1\r\nk";
+    }
+    Db replayed {};
+    const auto stats = replayAppendOnlyFile(replayed, path);
+    ASSERT_TRUE(stats.has_value());
+    EXPECT_EQ(1, stats->commands_);
+    EXPECT_EQ(complete, readFile());
+}
+
+TEST_F(AppendOnlyFileTest, CorruptFileIsRejected)
+{
+    {
+        std::ofstream file { path, std::ios::binary };
+        file << "*3\r\n$3\r\nSET\r\n$x\r\n";
+    }
+    Db replayed {};
+    EXPECT_FALSE(replayAppendOnlyFile(replayed, path).has_value());
+}
+
+TEST_F(AppendOnlyFileTest, MissingFileReplaysNothing)
+{
+    Db replayed {};
+    EXPECT_EQ(0, replayAppendOnlyFile(replayed, path)->commands_);
+}
+
+TEST_F(AppendOnlyFileTest, RewriteCompactsTheLog)
+{
+    auto db = std::make_shared<Db>();
+    auto aof = openLog(db);
+    for (int i = 0; i < 1000; ++i) {
+        db->set("counter", std::to_string(i));
+    }
+    aof->awaitFsync();
+    const auto before = aof->size();
+
+    ASSERT_TRUE(aof->startRewrite(db));
+    while (aof->rewriteInProgress()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds { 1 });
+    }
+    EXPECT_TRUE(aof->lastRewriteSucceeded());
+    EXPECT_LT(aof->size(), before);
+
+    // Writes after the rewrite go to the new file.
+    db->set("after", "rewrite");
+    aof->awaitFsync();
+    EXPECT_EQ(readFile().size(), aof->size());
+
+    Db replayed {};
+    EXPECT_EQ(2, replayAppendOnlyFile(replayed, path)->commands_);
+    EXPECT_EQ(ValueType { "999" }, replayed.get("counter").value());
+    EXPECT_EQ(ValueType { "rewrite" }, replayed.get("after").value());
+    db->setWriteHook({});
+}
+
+TEST_F(AppendOnlyFileTest, RewriteDoesNotRepeatPushes)
+{
+    auto db = std::make_shared<Db>();
+    auto aof = openLog(db);
+    std::vector<std::string> elements {};
+    for (int i = 0; i < 200; ++i) {
+        elements.push_back(std::to_string(i));
+    }
+    const std::vector<std::string_view> values { elements.begin(), elements.end() };
+    db->listPush("list", values, Db::ListEnd::Back);
+    db->setAdd("set", values);
+
+    // Pushes racing with the rewrite must end up in the new file exactly once.
+    ASSERT_TRUE(aof->startRewrite(db));
+    const std::vector<std::string_view> one { "x" };
+    size_t pushed = 0;
+    while (aof->rewriteInProgress()) {
+        db->listPush("list", one, Db::ListEnd::Front);
+        ++pushed;
+    }
+    EXPECT_TRUE(aof->lastRewriteSucceeded());
+    aof->awaitFsync();
+
+    Db replayed {};
+    ASSERT_TRUE(replayAppendOnlyFile(replayed, path).has_value());
+    EXPECT_EQ(db->get("list").value(), replayed.get("list").value());
+    EXPECT_EQ(200 + pushed, replayed.get("list")->as<ListValue>()->size());
+    EXPECT_EQ(200, replayed.get("set")->as<SetValue>()->size());
+    db->setWriteHook({});
+}
@@ -0,0 +1,117 @@
+#include "Collections.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+std::vector<std::string> elements(const PackedList& list)
+{
+    return { list.begin(), list.end() };
+}
+
+std::vector<std::string> range(const ListValue& list, const size_t start, const size_t stop)
+{
+    std::vector<std::string> result {};
+    list.forRange(start, stop, [&result](const std::string_view element) { result.emplace_back(element); });
+    return result;
+}
+} // namespace
+
+TEST(PackedListTest, PushAndReplace)
+{
+    PackedList list {};
+    EXPECT_TRUE(list.empty());
+    EXPECT_EQ(list.begin(), list.end());
+
+    const std::string large(300, 'x');
+    list.pushBack("b");
+    list.pushFront("a");
+    list.pushBack(large);
+    list.pushBack("");
+    EXPECT_EQ(4, list.size());
+    EXPECT_EQ((std::vector<std::string> { "a", "b", large, "" }), elements(list));
+
+    // The length of the replaced element takes a different number of bytes.
+    list.replace(std::next(list.begin()), large);
+    list.replace(std::next(list.begin(), 2), "c");
+    EXPECT_EQ((std::vector<std::string> { "a", large, "c", "" }), elements(list));
+    EXPECT_EQ(sizeof(uint32_t) + 3 * PackedList::entrySize(1) + PackedList::entrySize(large.size()) - 1, list.bytes());
+}
+
+TEST(HashValueTest, ConvertsToATableWhenLarge)
+{
+    HashValue hash {};
+    for (size_t i = 0; i < maxPackedEntries; ++i) {
+        EXPECT_TRUE(hash.set("field:" + std::to_string(i), std::to_string(i)));
+    }
+    EXPECT_FALSE(hash.set("field:7", "seven"));
+    EXPECT_TRUE(hash.isPacked());
+    const HashValue packed = hash;
+
+    EXPECT_TRUE(hash.set("one more", "value"));
+    EXPECT_FALSE(hash.isPacked());
+    EXPECT_EQ(maxPackedEntries + 1, hash.size());
+    EXPECT_EQ("seven", hash.get("field:7").value());
+    EXPECT_EQ("value", hash.get("one more").value());
+    EXPECT_FALSE(hash.get("missing").has_value());
+    EXPECT_NE(packed, hash);
+
+    HashValue copy {};
+    copy = hash;
+    EXPECT_EQ(hash, copy);
+}
+
+TEST(HashValueTest, ConvertsToATableForLongStrings)
+{
+    HashValue hash {};
+    hash.set("field", "value");
+    hash.set("long", std::string(maxPackedStringSize + 1, 'x'));
+    EXPECT_FALSE(hash.isPacked());
+    EXPECT_EQ(2, hash.size());
+    EXPECT_EQ("value", hash.get("field").value());
+}
+
+TEST(SetValueTest, ConvertsToATableWhenLarge)
+{
+    SetValue set {};
+    for (size_t i = 0; i <= maxPackedEntries; ++i) {
+        EXPECT_TRUE(set.isPacked());
+        EXPECT_TRUE(set.add(std::to_string(i)));
+        EXPECT_FALSE(set.add(std::to_string(i)));
+    }
+    EXPECT_FALSE(set.isPacked());
+    EXPECT_EQ(maxPackedEntries + 1, set.size());
+    EXPECT_TRUE(set.contains("0"));
+    EXPECT_FALSE(set.contains("missing"));
+
+    size_t members = 0;
+    set.forEach([&members](const std::string_view) { ++members; });
+    EXPECT_EQ(set.size(), members);
+}
+
+TEST(ListValueTest, ConvertsToAQuicklistWhenLarge)
+{
+    ListValue list {};
+    const std::string element(100, 'x');
+    size_t pushed = 0;
+    while (list.isPacked()) {
+        list.pushBack(element + std::to_string(pushed++));
+    }
+    for (int i = 0; i < 1000; ++i) {
+        list.pushFront(std::to_string(i));
+        list.pushBack(element + std::to_string(pushed++));
+    }
+    EXPECT_EQ(pushed + 1000, list.size());
+
+    EXPECT_EQ((std::vector<std::string> { "999", "998" }), range(list, 0, 1));
+    EXPECT_EQ((std::vector<std::string> { "0", element + "0", element + "1" }), range(list, 999, 1001));
+    EXPECT_EQ(std::vector<std::string> { element + std::to_string(pushed - 1) }, range(list, list.size() - 1, list.size() - 1));
+
+    const ListValue copy = list;
+    EXPECT_EQ(list, copy);
+    list.pushBack("x");
+    EXPECT_NE(list, copy);
+}
@@ -0,0 +1,122 @@
+#include "CommandHandler.h"
+#include "CommandStats.h"
+#include "Database.h"
+#include "Resp.h"
+#include "RespDecoder.h"
+#include "RespEncoder.h"
+#include "ServerContext.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+// Runs request buffers through what a reactor does with them: decode every frame,
+// execute it and encode the replies.
+namespace {
+constexpr int numKeys = 1'000'000;
+constexpr int keysPerRequest = 100;
+
+void appendBulk(std::string& out, const std::string_view str)
+{
+    out.append("$").append(std::to_string(str.size())).append("\r\n").append(str).append("\r\n");
+}
+
+std::string key(const int i)
+{
+    std::string result { "user:session:" };
+    result.append(std::to_string(i));
+    return result;
+}
+
+const std::shared_ptr<Db>& populated()
+{
+    static const auto db = []() {
+        auto db = std::make_shared<Db>();
+        db->reserve(numKeys);
+        for (int i = 0; i < numKeys; ++i) {
+            db->set(key(i), "some value");
+        }
+        return db;
+    }();
+    return db;
+}
+
+// Requests for keysPerRequest keys spread over the keyspace, so most lookups miss the cache.
+std::vector<std::string> requests(const bool batched)
+{
+    std::vector<std::string> result {};
+    for (int r = 0; r < 1000; ++r) {
+        std::string request {};
+        if (batched) {
+            request.append("*").append(std::to_string(keysPerRequest + 1)).append("\r\n");
+            appendBulk(request, "MGET");
+        }
+        for (int k = 0; k < keysPerRequest; ++k) {
+            if (!batched) {
+                request.append("*2\r\n");
+                appendBulk(request, "GET");
+            }
+            appendBulk(request, key((r * 7919 + k * 104729) % numKeys));
+        }
+        result.push_back(std::move(request));
+    }
+    return result;
+}
+
+void run(benchmark::State& state, const bool batched)
+{
+    const auto requests_ = requests(batched);
+    RespEncoder encoder {};
+    CommandHandler handler { &encoder, ServerContext { .db_ = populated() } };
+    RespTokenArena tokens {};
+    size_t i = 0;
+    for (auto _ : state) {
+        std::string_view input { requests_[i++ % requests_.size()] };
+        while (!input.empty()) {
+            const auto length = RespDecoder::decodeFrame(input, tokens);
+            std::visit(handler, RespDecoder::convertToCommand(tokens));
+            input.remove_prefix(length.value());
+        }
+        benchmark::DoNotOptimize(encoder.segments().data());
+        encoder.clearBuffer();
+    }
+    state.SetItemsProcessed(state.iterations() * keysPerRequest);
+}
+
+// One MGET of 100 keys.
+void BM_Mget(benchmark::State& state)
+{
+    run(state, true);
+}
+
+// 100 GETs pipelined in one request, what a client does without MGET.
+void BM_PipelinedGets(benchmark::State& state)
+{
+    run(state, false);
+}
+
+// What timing every command adds to it: two reads of the clock and recording the ticks
+// in the histogram of the command.
+void BM_TimeCommand(benchmark::State& state)
+{
+    CommandMetrics metrics { 10000, 128 };
+    auto& stats = metrics.addReactor();
+    const auto command = CommandVariant { CommandGet {} }.index();
+    for (auto _ : state) {
+        const auto start = readTicks();
+        const auto ticks = readTicks() - start;
+        stats.record(command, ticks);
+        benchmark::DoNotOptimize(metrics.isSlow(ticks));
+    }
+}
+} // namespace
+
+BENCHMARK(BM_Mget);
+BENCHMARK(BM_PipelinedGets);
+BENCHMARK(BM_TimeCommand);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,175 @@
+#include "CommandHandler.h"
+#include "CommandStats.h"
+#include "CommandTable.h"
+#include "Commands.h"
+#include "Database.h"
+#include "Resp.h"
+#include "RespDecoder.h"
+#include "RespEncoder.h"
+#include "ServerContext.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <variant>
+
+#include <gtest/gtest.h>
+
+namespace {
+constexpr size_t getIndex = CommandVariant { CommandGet {} }.index();
+constexpr size_t setIndex = CommandVariant { CommandSet {} }.index();
+
+std::string bulk(const std::string_view str)
+{
+    std::string result { "$" };
+    result.append(std::to_string(str.size())).append("\r\n").append(str).append("\r\n");
+    return result;
+}
+
+class CommandStatsTest : public ::testing::Test {
+protected:
+    // Decodes a request and runs it through the handler, returning the reply.
+    std::string execute(const std::string_view request)
+    {
+        encoder_.clearBuffer();
+        EXPECT_TRUE(RespDecoder::decodeFrame(request, tokens_).has_value());
+        std::visit(handler_, RespDecoder::convertToCommand(tokens_));
+        const auto& buffer = encoder_.getBuffer();
+        return { buffer.begin(), buffer.end() };
+    }
+
+    std::shared_ptr<Db> db_ { std::make_shared<Db>() };
+    std::shared_ptr<CommandMetrics> metrics_ { std::make_shared<CommandMetrics>(0, 2) };
+    RespEncoder encoder_ {};
+    CommandHandler handler_ { &encoder_, ServerContext { .db_ = db_, .metrics_ = metrics_ } };
+    RespTokenArena tokens_ {};
+};
+} // namespace
+
+TEST(LatencyHistogramTest, BucketBounds)
+{
+    for (uint64_t value = 0; value < 16; ++value) {
+        EXPECT_EQ(value, LatencyHistogram::bucketOf(value));
+        EXPECT_EQ(value, LatencyHistogram::lowerBound(value));
+    }
+    // Every bucket starts where the one before ends and is at most 1/16 of its values wide.
+    for (size_t bucket = 1; bucket + 1 < LatencyHistogram::numBuckets; ++bucket) {
+        const auto lower = LatencyHistogram::lowerBound(bucket);
+        const auto upper = LatencyHistogram::lowerBound(bucket + 1) - 1;
+        ASSERT_EQ(bucket, LatencyHistogram::bucketOf(lower));
+        ASSERT_EQ(bucket, LatencyHistogram::bucketOf(upper));
+        ASSERT_LE(upper - lower, lower / 16);
+    }
+    EXPECT_EQ(LatencyHistogram::numBuckets - 1, LatencyHistogram::bucketOf(uint64_t { 1 } << LatencyHistogram::maxValueBits));
+    EXPECT_EQ(LatencyHistogram::numBuckets - 1, LatencyHistogram::bucketOf(UINT64_MAX));
+}
+
+TEST(LatencyHistogramTest, Percentiles)
+{
+    CommandMetrics metrics { -1, 0 };
+    auto& stats = metrics.addReactor();
+    for (uint64_t ticks = 1; ticks <= 1000; ++ticks) {
+        stats.record(getIndex, ticks);
+    }
+    // Summed over the reactors.
+    metrics.addReactor().record(getIndex, 1000);
+    const auto summary = metrics.summary(getIndex);
+    EXPECT_EQ(1001u, summary.calls_);
+    EXPECT_EQ(500500u + 1000u, summary.ticks_);
+    for (const auto& [fraction, exact] : { std::pair { 0.5, 501.0 }, std::pair { 0.99, 991.0 }, std::pair { 0.999, 1000.0 } }) {
+        const auto percentile = static_cast<double>(summary.percentile(fraction));
+        EXPECT_GE(percentile, exact);
+        EXPECT_LE(percentile, exact * 17 / 16);
+    }
+    EXPECT_EQ(0u, metrics.summary(setIndex).calls_);
+    EXPECT_FALSE(metrics.isSlow(UINT64_MAX - 1));
+}
+
+TEST(SlowLogTest, KeepsNewestEntries)
+{
+    SlowLog slowLog { 2 };
+    RespTokenArena tokens {};
+    for (const auto* request : { "*2\r\n$3\r\nGET\r\n$1\r\na\r\n", "*2\r\n$3\r\nGET\r\n$1\r\nb\r\n", "PING\r\n" }) {
+        ASSERT_TRUE(RespDecoder::decodeFrame(request, tokens).has_value());
+        slowLog.add(tokens, 20);
+    }
+    EXPECT_EQ(2u, slowLog.size());
+    const auto entries = slowLog.newest(-1);
+    ASSERT_EQ(2u, entries.size());
+    EXPECT_EQ(2u, entries[0].id_);
+    EXPECT_EQ(std::vector<std::string> { "PING" }, entries[0].args_);
+    EXPECT_EQ(1u, entries[1].id_);
+    EXPECT_EQ((std::vector<std::string> { "GET", "b" }), entries[1].args_);
+    EXPECT_EQ(20u, entries[1].microseconds_);
+    EXPECT_EQ(1u, slowLog.newest(1).size());
+    slowLog.reset();
+    EXPECT_EQ(0u, slowLog.size());
+}
+
+TEST(SlowLogTest, TruncatesArguments)
+{
+    SlowLog slowLog { 1 };
+    std::string request { "*40\r\n" };
+    request.append(bulk("DEL")).append(bulk(std::string(200, 'k')));
+    for (int i = 0; i < 38; ++i) {
+        request.append(bulk("key"));
+    }
+    RespTokenArena tokens {};
+    ASSERT_TRUE(RespDecoder::decodeFrame(request, tokens).has_value());
+    slowLog.add(tokens, 1);
+    const auto args = slowLog.newest(1)[0].args_;
+    ASSERT_EQ(SlowLog::maxArgs, args.size());
+    EXPECT_EQ(std::string(128, 'k') + "... (72 more bytes)", args[1]);
+    EXPECT_EQ("key", args[30]);
+    EXPECT_EQ("... (9 more arguments)", args[31]);
+}
+
+TEST_F(CommandStatsTest, Slowlog)
+{
+    ASSERT_TRUE(RespDecoder::decodeFrame("*3\r\n$3\r\nSET\r\n$1\r\na\r\n$1\r\n1\r\n", tokens_).has_value());
+    metrics_->slowLog().add(tokens_, 15000);
+    EXPECT_EQ(":1\r\n", execute("*2\r\n$7\r\nSLOWLOG\r\n$3\r\nLEN\r\n"));
+    const auto reply = execute("*2\r\n$7\r\nslowlog\r\n$3\r\nget\r\n");
+    EXPECT_TRUE(reply.starts_with("*1\r\n*4\r\n:0\r\n:")) << reply;
+    EXPECT_TRUE(reply.ends_with(":15000\r\n*3\r\n$3\r\nSET\r\n$1\r\na\r\n$1\r\n1\r\n")) << reply;
+    EXPECT_EQ("+OK\r\n", execute("*2\r\n$7\r\nSLOWLOG\r\n$5\r\nRESET\r\n"));
+    EXPECT_EQ("*0\r\n", execute("*3\r\n$7\r\nSLOWLOG\r\n$3\r\nGET\r\n$2\r\n-1\r\n"));
+    EXPECT_TRUE(execute("*2\r\n$7\r\nSLOWLOG\r\n$4\r\nDROP\r\n").starts_with("*2\r\n-"));
+}
+
+TEST_F(CommandStatsTest, CommandstatsAndHistogram)
+{
+    auto& stats = metrics_->addReactor();
+    stats.record(getIndex, 0);
+    stats.record(getIndex, 0);
+    stats.record(setIndex, 0);
+    const auto info = execute("*2\r\n$4\r\nINFO\r\n$12\r\ncommandstats\r\n");
+    EXPECT_NE(std::string::npos, info.find("cmdstat_get:calls=2,usec=0,usec_per_call=0.00\r\n")) << info;
+    EXPECT_NE(std::string::npos, info.find("cmdstat_set:calls=1,")) << info;
+    EXPECT_EQ(std::string::npos, info.find("cmdstat_ping")) << info;
+    EXPECT_EQ(std::string::npos, info.find("# Keyspace")) << info;
+    const auto latency = execute("*2\r\n$4\r\nINFO\r\n$12\r\nlatencystats\r\n");
+    EXPECT_NE(std::string::npos, latency.find("latency_percentiles_usec_get:p50=0.000,p99=0.000,p99.9=0.000\r\n")) << latency;
+
+    // Within a microsecond, cumulatively.
+    EXPECT_EQ("*2\r\n$3\r\nget\r\n*4\r\n$5\r\ncalls\r\n:2\r\n$14\r\nhistogram_usec\r\n*2\r\n:1\r\n:2\r\n",
+        execute("*3\r\n$7\r\nLATENCY\r\n$9\r\nHISTOGRAM\r\n$3\r\nGET\r\n"));
+    EXPECT_TRUE(execute("*2\r\n$7\r\nLATENCY\r\n$9\r\nHISTOGRAM\r\n").starts_with("*4\r\n"));
+    EXPECT_EQ("*0\r\n", execute("*3\r\n$7\r\nLATENCY\r\n$9\r\nHISTOGRAM\r\n$4\r\nPING\r\n"));
+    EXPECT_EQ("SLOWLOG", commandName(CommandVariant { CommandSlowlog {} }.index()));
+    EXPECT_TRUE(commandName(0).empty());
+}
+
+TEST_F(CommandStatsTest, GetDeletesExpiredKey)
+{
+    db_->set("key", "value", std::chrono::system_clock::now() - std::chrono::seconds { 1 });
+    EXPECT_EQ(1, db_->size());
+    EXPECT_EQ("$-1\r\n", execute("*2\r\n$3\r\nGET\r\n$3\r\nkey\r\n"));
+    EXPECT_EQ(0, db_->size());
+    EXPECT_EQ(1, db_->stats().expiredKeys_);
+    const auto info = execute("*2\r\n$4\r\nINFO\r\n$5\r\nstats\r\n");
+    EXPECT_NE(std::string::npos, info.find("expired_keys:1\r\n")) << info;
+}
@@ -0,0 +1,113 @@
+#include "Config.h"
+
+#include <array>
+
+#include <gtest/gtest.h>
+
+TEST(ConfigTest, Defaults)
+{
+    const std::array<const char*, 1> args { "server" };
+    const auto config = parseArgs(args);
+    ASSERT_TRUE(config.has_value());
+    EXPECT_EQ("6379", config->port_);
+    EXPECT_EQ(1, config->threads_);
+}
+
+TEST(ConfigTest, PortAndThreads)
+{
+    const std::array<const char*, 5> args { "server", "--port", "6380", "--threads", "8" };
+    const auto config = parseArgs(args);
+    ASSERT_TRUE(config.has_value());
+    EXPECT_EQ("6380", config->port_);
+    EXPECT_EQ(8, config->threads_);
+}
+
+TEST(ConfigTest, InvalidThreads)
+{
+    EXPECT_FALSE(parseArgs(std::array<const char*, 3> { "server", "--threads", "0" }).has_value());
+    EXPECT_FALSE(parseArgs(std::array<const char*, 3> { "server", "--threads", "four" }).has_value());
+    EXPECT_FALSE(parseArgs(std::array<const char*, 2> { "server", "--threads" }).has_value());
+}
+
+TEST(ConfigTest, IoBackend)
+{
+    EXPECT_EQ(IoBackend::Epoll, parseArgs(std::array<const char*, 1> { "server" })->ioBackend_);
+    EXPECT_EQ(IoBackend::IoUring, parseArgs(std::array<const char*, 3> { "server", "--io-backend", "io_uring" })->ioBackend_);
+    EXPECT_EQ(IoBackend::Epoll, parseArgs(std::array<const char*, 3> { "server", "--io-backend", "epoll" })->ioBackend_);
+    EXPECT_FALSE(parseArgs(std::array<const char*, 3> { "server", "--io-backend", "poll" }).has_value());
+}
+
+TEST(ConfigTest, UnknownOption)
+{
+    EXPECT_FALSE(parseArgs(std::array<const char*, 3> { "server", "--foo", "1" }).has_value());
+}
+
+TEST(ConfigTest, AppendOnly)
+{
+    const std::array<const char*, 7> args { "server", "--appendonly", "yes", "--appendfsync", "always",
+        "--appendfilename", "/tmp/log.aof" };
+    const auto config = parseArgs(args);
+    ASSERT_TRUE(config.has_value());
+    EXPECT_TRUE(config->appendOnly_);
+    EXPECT_EQ(FsyncPolicy::Always, config->appendFsync_);
+    EXPECT_EQ("/tmp/log.aof", config->appendFilename_);
+    EXPECT_FALSE(parseArgs(std::array<const char*, 3> { "server", "--appendfsync", "sometimes" }).has_value());
+    EXPECT_FALSE(parseArgs(std::array<const char*, 3> { "server", "--appendonly", "maybe" }).has_value());
+}
+
+TEST(ConfigTest, MaxMemory)
+{
+    const std::array<const char*, 7> args { "server", "--maxmemory", "100mb", "--maxmemory-policy", "allkeys-lfu",
+        "--maxmemory-samples", "10" };
+    const auto config = parseArgs(args);
+    ASSERT_TRUE(config.has_value());
+    EXPECT_EQ(100 * 1024 * 1024, config->maxMemory_);
+    EXPECT_EQ(EvictionPolicy::AllKeysLfu, config->maxMemoryPolicy_);
+    EXPECT_EQ("allkeys-lfu", evictionPolicyName(config->maxMemoryPolicy_));
+    EXPECT_EQ(10, config->maxMemorySamples_);
+    EXPECT_EQ(12345, parseArgs(std::array<const char*, 3> { "server", "--maxmemory", "12345" })->maxMemory_);
+    EXPECT_FALSE(parseArgs(std::array<const char*, 3> { "server", "--maxmemory", "mb" }).has_value());
+    EXPECT_FALSE(parseArgs(std::array<const char*, 3> { "server", "--maxmemory", "99999999999gb" }).has_value());
+    EXPECT_FALSE(parseArgs(std::array<const char*, 3> { "server", "--maxmemory-policy", "random" }).has_value());
+    EXPECT_FALSE(parseArgs(std::array<const char*, 3> { "server", "--maxmemory-samples", "0" }).has_value());
+}
+
+TEST(ConfigTest, Replication)
+{
+    const std::array<const char*, 5> args { "server", "--replicaof", "127.0.0.1 6380", "--repl-backlog-size", "4mb" };
+    const auto config = parseArgs(args);
+    ASSERT_TRUE(config.has_value());
+    EXPECT_EQ("127.0.0.1", config->replicaOfHost_);
+    EXPECT_EQ("6380", config->replicaOfPort_);
+    EXPECT_EQ(4 * 1024 * 1024, config->replBacklogSize_);
+    EXPECT_TRUE(parseArgs(std::array<const char*, 1> { "server" })->replicaOfHost_.empty());
+    EXPECT_FALSE(parseArgs(std::array<const char*, 3> { "server", "--replicaof", "127.0.0.1" }).has_value());
+    EXPECT_FALSE(parseArgs(std::array<const char*, 3> { "server", "--repl-backlog-size", "0" }).has_value());
+}
+
+TEST(ConfigTest, SlowLog)
+{
+    const std::array<const char*, 5> args { "server", "--slowlog-log-slower-than", "-1", "--slowlog-max-len", "16" };
+    const auto config = parseArgs(args);
+    ASSERT_TRUE(config.has_value());
+    EXPECT_EQ(-1, config->slowlogSlowerThan_);
+    EXPECT_EQ(16u, config->slowlogMaxLen_);
+    EXPECT_EQ(10000, parseArgs(std::array<const char*, 1> { "server" })->slowlogSlowerThan_);
+    EXPECT_FALSE(parseArgs(std::array<const char*, 3> { "server", "--slowlog-log-slower-than", "1ms" }).has_value());
+    EXPECT_FALSE(parseArgs(std::array<const char*, 3> { "server", "--slowlog-max-len", "-1" }).has_value());
+}
+
+TEST(ConfigTest, PubSubOutputLimit)
+{
+    EXPECT_EQ(uint64_t { 32 } << 20, parseArgs(std::array<const char*, 1> { "server" })->pubsubOutputLimit_);
+    EXPECT_EQ(uint64_t { 8 } << 20, parseArgs(std::array<const char*, 3> { "server", "--pubsub-output-limit", "8mb" })->pubsubOutputLimit_);
+    EXPECT_FALSE(parseArgs(std::array<const char*, 3> { "server", "--pubsub-output-limit", "-1" }).has_value());
+}
+
+TEST(ConfigTest, LogLevel)
+{
+    EXPECT_EQ(LogLevel::Info, parseArgs(std::array<const char*, 1> { "server" })->logLevel_);
+    EXPECT_EQ(LogLevel::Warning, parseArgs(std::array<const char*, 3> { "server", "--loglevel", "warning" })->logLevel_);
+    EXPECT_EQ("debug", logLevelName(LogLevel::Debug));
+    EXPECT_FALSE(parseArgs(std::array<const char*, 3> { "server", "--loglevel", "verbose" }).has_value());
+}
@@ -0,0 +1,225 @@
+#include "Database.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+// The keyspace as it was before sharding: one std::map behind one mutex, with a key
+// copy and two lookups on every get.
+class MapDb {
+public:
+    void set(const KeyT key, const std::string_view& value)
+    {
+        const auto key_ = std::string { key.data(), key.length() };
+        const auto val_ = ValueType { value };
+        std::lock_guard<std::mutex> lock { mutex_ };
+        map_[key_] = val_;
+    }
+    std::optional<ValueType> get(const KeyT& key)
+    {
+        const auto key_ = std::string { key.data(), key.length() };
+        std::lock_guard<std::mutex> lock { mutex_ };
+        if (map_.contains(key_)) {
+            return map_[key_];
+        }
+        return std::nullopt;
+    }
+
+private:
+    std::map<std::string, ValueType> map_ {};
+    std::mutex mutex_ {};
+};
+
+constexpr int numKeys = 100'000;
+
+const std::vector<std::string>& keys()
+{
+    static const auto keys = []() {
+        std::vector<std::string> result {};
+        result.reserve(numKeys);
+        for (int i = 0; i < numKeys; ++i) {
+            result.push_back("user:session:" + std::to_string(i));
+        }
+        return result;
+    }();
+    return keys;
+}
+
+template <typename DbT>
+DbT& populated()
+{
+    static DbT* db = []() {
+        auto* db = new DbT {};
+        for (const auto& key : keys()) {
+            db->set(key, "some value");
+        }
+        return db;
+    }();
+    return *db;
+}
+
+template <typename DbT>
+void BM_Get(benchmark::State& state)
+{
+    auto& db = populated<DbT>();
+    const auto& keys_ = keys();
+    size_t i = state.thread_index() * 7919;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db.get(keys_[i++ % numKeys]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <typename DbT>
+void BM_Set(benchmark::State& state)
+{
+    auto& db = populated<DbT>();
+    const auto& keys_ = keys();
+    size_t i = state.thread_index() * 7919;
+    for (auto _ : state) {
+        db.set(keys_[i++ % numKeys], "another value");
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+constexpr int numCounters = 1'000;
+
+const std::vector<std::string>& counters()
+{
+    static const auto counters = []() {
+        std::vector<std::string> result {};
+        for (int i = 0; i < numCounters; ++i) {
+            result.push_back("counter:" + std::to_string(i));
+        }
+        return result;
+    }();
+    return counters;
+}
+
+// INCR as the handler did it before values could be integers: copy the value out,
+// parse it, format it and store it with a second lookup.
+void BM_IncrGetSet(benchmark::State& state)
+{
+    Db db {};
+    const auto& keys_ = counters();
+    size_t i = 0;
+    for (auto _ : state) {
+        const auto& key = keys_[i++ % numCounters];
+        auto value = db.get(key).value_or(ValueType { "0" });
+        db.set(key, std::to_string(std::stoll(value.str()) + 1));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// INCR in place on the integer stored in the table.
+void BM_IncrementBy(benchmark::State& state)
+{
+    Db db {};
+    const auto& keys_ = counters();
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db.incrementBy(keys_[i++ % numCounters], 1));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Draws key indexes with a Zipfian distribution, the first keys being the most popular,
+// like the request streams of a cache (YCSB uses the same skew).
+class Zipfian {
+public:
+    Zipfian(const size_t n, const double skew)
+        : cdf_(n)
+    {
+        double sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += 1 / std::pow(static_cast<double>(i + 1), skew);
+            cdf_[i] = sum;
+        }
+        for (auto& p : cdf_) {
+            p /= sum;
+        }
+    }
+
+    size_t operator()(std::mt19937_64& random) const
+    {
+        const auto p = std::uniform_real_distribution<double> { 0, 1 }(random);
+        return std::min<size_t>(std::ranges::lower_bound(cdf_, p) - cdf_.begin(), cdf_.size() - 1);
+    }
+
+private:
+    std::vector<double> cdf_ {};
+};
+
+// A cache in front of a backend: GET, and SET on a miss, with room for a tenth of the
+// keys. Starts empty and reports the hit rate over 1M requests once the cache is warm.
+void BM_ZipfianHitRate(benchmark::State& state)
+{
+    const auto policy = static_cast<EvictionPolicy>(state.range(0));
+    const auto samples = static_cast<unsigned>(state.range(1));
+    const auto& keys_ = keys();
+    const Zipfian zipfian { keys_.size(), 0.99 };
+    const auto maxMemory = [&keys_]() {
+        Db db {};
+        for (size_t i = 0; i < keys_.size() / 10; ++i) {
+            db.set(keys_[i], ValueType { "some value" });
+        }
+        return db.usedMemory();
+    }();
+    size_t hits = 0;
+    size_t requests = 0;
+    for (auto _ : state) {
+        Db db {};
+        db.setMaxMemory(maxMemory, policy, samples);
+        std::mt19937_64 random { 42 };
+        const auto request = [&](const bool measure) {
+            const auto& key = keys_[zipfian(random)];
+            const bool hit = db.read(key, [](const ValueType* value) { return value != nullptr; });
+            if (!hit && db.freeMemoryIfNeeded()) {
+                db.set(key, ValueType { "some value" });
+            }
+            hits += measure && hit;
+            requests += measure;
+        };
+        for (int i = 0; i < 1'000'000; ++i) {
+            request(false);
+        }
+        for (int i = 0; i < 1'000'000; ++i) {
+            request(true);
+        }
+    }
+    state.counters["hit_rate"] = static_cast<double>(hits) / static_cast<double>(requests);
+    state.SetItemsProcessed(static_cast<int64_t>(2 * requests));
+}
+} // namespace
+
+BENCHMARK(BM_Get<MapDb>)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_Get<Db>)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_Set<MapDb>)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_Set<Db>)->ThreadRange(1, 8)->UseRealTime();
+// 1M INCRs spread over 1K hot keys.
+BENCHMARK(BM_IncrGetSet)->Iterations(1'000'000);
+BENCHMARK(BM_IncrementBy)->Iterations(1'000'000);
+// Policy (0 noeviction, which keeps the keys that came first, 1 allkeys-lru, 2 allkeys-lfu)
+// and keys sampled per eviction.
+BENCHMARK(BM_ZipfianHitRate)
+    ->ArgNames({ "policy", "samples" })
+    ->Args({ static_cast<int>(EvictionPolicy::NoEviction), 5 })
+    ->Args({ static_cast<int>(EvictionPolicy::AllKeysLru), 1 })
+    ->Args({ static_cast<int>(EvictionPolicy::AllKeysLru), 5 })
+    ->Args({ static_cast<int>(EvictionPolicy::AllKeysLru), 10 })
+    ->Args({ static_cast<int>(EvictionPolicy::AllKeysLfu), 5 })
+    ->Args({ static_cast<int>(EvictionPolicy::AllKeysLfu), 10 })
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -1,6 +1,13 @@
 #include "Database.h"
 
 #include <chrono>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -41,4 +48,321 @@ TEST_F(DbTest, TimeExpires) {
       now - std::chrono::milliseconds{100}};
   db.set("key", "value", expires);
   EXPECT_FALSE(db.get("key").has_value());
-}
\ No newline at end of file
+}
+
+TEST_F(DbTest, Overwrite) {
+  db.set("key", "value");
+  db.set("key", "other");
+  EXPECT_EQ(ValueType{"other"}, db.get("key").value());
+  EXPECT_EQ(1, db.size());
+}
+
+TEST_F(DbTest, ConcurrentWriters) {
+  constexpr int numThreads = 4;
+  constexpr int keysPerThread = 1000;
+  {
+    std::vector<std::jthread> writers{};
+    for (int t = 0; t < numThreads; ++t) {
+      writers.emplace_back([this, t]() {
+        for (int i = 0; i < keysPerThread; ++i) {
+          const auto key = std::to_string(t) + ":" + std::to_string(i);
+          db.set(key, key);
+        }
+      });
+    }
+  }
+  EXPECT_EQ(numThreads * keysPerThread, db.size());
+  EXPECT_EQ(ValueType{"3:999"}, db.get("3:999").value());
+}
+
+TEST_F(DbTest, ExpiredKeyIsRemovedOnAccess) {
+  db.set("key", "value", std::chrono::system_clock::now() - std::chrono::seconds{1});
+  EXPECT_EQ(1, db.size());
+  EXPECT_FALSE(db.get("key").has_value());
+  EXPECT_EQ(0, db.size());
+  EXPECT_EQ(1, db.stats().expiredKeys_);
+  EXPECT_EQ(8, db.stats().expiredBytes_);
+}
+
+TEST_F(DbTest, ExpireCycleRemovesDueKeys) {
+  const auto now = std::chrono::system_clock::now();
+  for (int i = 0; i < 100; ++i) {
+    db.set(std::to_string(i), "value", now + std::chrono::seconds{i < 60 ? -1 : 100});
+  }
+  db.set("persistent", "value");
+  EXPECT_EQ(60, db.expireCycle(1000, now));
+  EXPECT_EQ(41, db.size());
+  EXPECT_EQ(60, db.stats().expiredKeys_);
+  EXPECT_EQ(0, db.expireCycle(1000, now));
+}
+
+TEST_F(DbTest, ExpireCycleIsBounded) {
+  const auto past = std::chrono::system_clock::now() - std::chrono::seconds{1};
+  for (int i = 0; i < 100; ++i) {
+    db.set(std::to_string(i), "value", past);
+  }
+  EXPECT_EQ(10, db.expireCycle(10));
+  EXPECT_EQ(90, db.size());
+}
+
+TEST_F(DbTest, ExpireCycleSkipsOverwrittenKeys) {
+  const auto now = std::chrono::system_clock::now();
+  db.set("key", "value", now + std::chrono::seconds{1});
+  db.set("key", "other");
+  db.set("later", "value", now + std::chrono::seconds{1});
+  db.set("later", "value", now + std::chrono::seconds{100});
+  EXPECT_EQ(0, db.expireCycle(1000, now + std::chrono::seconds{2}));
+  EXPECT_EQ(2, db.size());
+  EXPECT_EQ(1, db.expireCycle(1000, now + std::chrono::seconds{101}));
+  EXPECT_FALSE(db.get("later").has_value());
+}
+
+TEST_F(DbTest, IntegersAreStoredAsIntegers) {
+  db.set("counter", "42");
+  db.set("padded", "042");
+  db.set("min", "-9223372036854775808");
+  db.set("overflow", "9223372036854775808");
+  EXPECT_TRUE(db.get("counter")->isInteger());
+  EXPECT_EQ("42", db.get("counter")->str());
+  EXPECT_FALSE(db.get("padded")->isInteger());
+  EXPECT_EQ("042", db.get("padded")->str());
+  EXPECT_TRUE(db.get("min")->isInteger());
+  EXPECT_FALSE(db.get("overflow")->isInteger());
+  EXPECT_EQ(ValueType{"42"}, db.get("counter").value());
+}
+
+TEST_F(DbTest, IncrementBy) {
+  EXPECT_EQ(1, db.incrementBy("counter", 1).value());
+  EXPECT_EQ(-9, db.incrementBy("counter", -10).value());
+  EXPECT_EQ("-9", db.get("counter")->str());
+
+  db.set("text", "abc");
+  EXPECT_FALSE(db.incrementBy("text", 1).has_value());
+  EXPECT_EQ("abc", db.get("text")->str());
+
+  db.set("max", std::to_string(std::numeric_limits<int64_t>::max()));
+  EXPECT_FALSE(db.incrementBy("max", 1).has_value());
+  EXPECT_EQ(std::numeric_limits<int64_t>::max(), db.get("max")->integer());
+}
+
+TEST_F(DbTest, IncrementByKeepsTheTtl) {
+  const auto now = std::chrono::system_clock::now();
+  db.set("counter", "1", now + std::chrono::seconds{100});
+  EXPECT_EQ(2, db.incrementBy("counter", 1).value());
+  EXPECT_EQ(now + std::chrono::seconds{100}, db.get("counter")->expire_);
+
+  db.set("expired", "100", now - std::chrono::seconds{1});
+  EXPECT_EQ(1, db.incrementBy("expired", 1).value());
+  EXPECT_FALSE(db.get("expired")->expire_.has_value());
+}
+
+TEST_F(DbTest, IncrementByCallsTheWriteHook) {
+  std::vector<std::string> written{};
+  db.setWriteHook([&written](const KeyT key, const ValueType* value,
+                             std::span<const std::string_view>) {
+    written.push_back(std::string{key} + "=" + value->str());
+  });
+  db.incrementBy("counter", 5);
+  EXPECT_FALSE(db.incrementBy("counter", std::numeric_limits<int64_t>::max()).has_value());
+  EXPECT_EQ(std::vector<std::string>{"counter=5"}, written);
+}
+
+TEST_F(DbTest, GetMany) {
+  const auto now = std::chrono::system_clock::now();
+  db.set("a", "1");
+  db.set("b", "two");
+  db.set("expired", "value", now - std::chrono::seconds{1});
+  const std::vector<KeyT> keys{"a", "missing", "b", "expired", "a"};
+  std::vector<std::string> values{};
+  db.getMany(keys, [&values](size_t index, const ValueType* value) {
+    EXPECT_EQ(values.size(), index);
+    values.push_back(value == nullptr ? "(nil)" : value->str());
+  });
+  EXPECT_EQ((std::vector<std::string>{"1", "(nil)", "two", "(nil)", "1"}), values);
+  EXPECT_EQ(2, db.size());
+  EXPECT_EQ(1, db.stats().expiredKeys_);
+  EXPECT_EQ(3, db.countExisting(keys));
+}
+
+TEST_F(DbTest, SetManyAndRemoveMany) {
+  std::vector<std::string> written{};
+  db.setWriteHook([&written](const KeyT key, const ValueType* value,
+                             std::span<const std::string_view>) {
+    written.push_back(std::string{key} + "=" + (value == nullptr ? "(deleted)" : value->str()));
+  });
+  db.set("ttl", "value", std::chrono::system_clock::now() + std::chrono::seconds{100});
+  written.clear();
+
+  std::vector<std::pair<KeyT, std::string_view>> entries{};
+  std::vector<std::string> keys{};
+  for (int i = 0; i < 100; ++i) {
+    keys.push_back("key:" + std::to_string(i));
+  }
+  for (const auto& key : keys) {
+    entries.emplace_back(key, key);
+  }
+  entries.emplace_back("ttl", "overwritten");
+  db.setMany(entries);
+  EXPECT_EQ(101, db.size());
+  EXPECT_EQ("key:42", db.get("key:42")->str());
+  EXPECT_FALSE(db.get("ttl")->expire_.has_value());
+  EXPECT_EQ(101, written.size());
+
+  written.clear();
+  const std::vector<KeyT> removed{"key:1", "key:2", "missing", "key:1"};
+  EXPECT_EQ(2, db.removeMany(removed));
+  EXPECT_EQ(99, db.size());
+  EXPECT_FALSE(db.get("key:1").has_value());
+  EXPECT_EQ((std::vector<std::string>{"key:1=(deleted)", "key:2=(deleted)"}), written);
+}
+
+TEST_F(DbTest, Collections) {
+  std::vector<std::string> logged{};
+  db.setWriteHook([&logged](const KeyT, const ValueType*,
+                            std::span<const std::string_view> command) {
+    std::string line{};
+    for (const auto arg : command) {
+      line.append(line.empty() ? "" : " ").append(arg);
+    }
+    logged.push_back(line);
+  });
+
+  const std::vector<std::pair<std::string_view, std::string_view>> fields{
+      {"f1", "v1"}, {"f2", "v2"}, {"f1", "v3"}};
+  EXPECT_EQ(2, db.hashSet("hash", fields).value());
+  db.read("hash", [](const ValueType* value) {
+    ASSERT_NE(nullptr, value->as<HashValue>());
+    EXPECT_EQ("v3", value->as<HashValue>()->get("f1").value());
+  });
+
+  const std::vector<std::string_view> values{"a", "b"};
+  EXPECT_EQ(2, db.listPush("list", values, Db::ListEnd::Back).value());
+  EXPECT_EQ(4, db.listPush("list", values, Db::ListEnd::Front).value());
+  EXPECT_EQ(2, db.setAdd("set", values).value());
+  EXPECT_EQ(0, db.setAdd("set", values).value());
+
+  EXPECT_EQ((std::vector<std::string>{"HSET hash f1 v1 f2 v2 f1 v3",
+                                      "RPUSH list a b", "LPUSH list a b",
+                                      "SADD set a b"}),
+            logged);
+}
+
+TEST_F(DbTest, CollectionsRejectTheWrongType) {
+  db.set("string", "value");
+  const std::vector<std::string_view> values{"a"};
+  EXPECT_EQ(Db::wrongTypeError, db.listPush("string", values, Db::ListEnd::Back).error());
+  EXPECT_EQ(1, db.setAdd("set", values).value());
+  EXPECT_EQ(Db::wrongTypeError, db.incrementBy("set", 1).error());
+  const std::vector<std::pair<std::string_view, std::string_view>> fields{{"f", "v"}};
+  EXPECT_EQ(Db::wrongTypeError, db.hashSet("set", fields).error());
+  EXPECT_EQ("value", db.get("string")->str());
+}
+
+TEST_F(DbTest, MemoryAccounting) {
+  EXPECT_EQ(0, db.usedMemory());
+  db.set("key", "value");
+  const auto small = db.usedMemory();
+  EXPECT_GT(small, 0);
+  db.set("key", std::string(1000, 'x'));
+  EXPECT_GT(db.usedMemory(), small + 1000);
+  db.set("key", "value");
+  db.incrementBy("counter", 1);
+  const std::vector<std::string_view> members{"a", "b"};
+  db.setAdd("set", members);
+  db.set("ttl", "value", std::chrono::system_clock::now() - std::chrono::seconds{1});
+  EXPECT_GT(db.usedMemory(), 3 * small);
+
+  db.removeMany(std::vector<KeyT>{"key", "counter", "set", "missing"});
+  db.expireCycle(10);
+  EXPECT_EQ(0, db.size());
+  EXPECT_EQ(0, db.usedMemory());
+  EXPECT_EQ(0, db.stats().usedMemory_);
+}
+
+TEST_F(DbTest, NoEvictionRefusesWrites) {
+  db.setMaxMemory(1, EvictionPolicy::NoEviction);
+  EXPECT_TRUE(db.freeMemoryIfNeeded());
+  db.set("key", "value");
+  EXPECT_FALSE(db.freeMemoryIfNeeded());
+  EXPECT_EQ(1, db.size());
+}
+
+TEST_F(DbTest, LruEvictsTheLeastRecentlyUsedKeys) {
+  db.setMaxMemory(0, EvictionPolicy::AllKeysLru, 10);
+  std::vector<std::string> hot{};
+  for (int i = 0; i < 100; ++i) {
+    hot.push_back("hot:" + std::to_string(i));
+    db.set(hot.back(), "value");
+    db.set("cold:" + std::to_string(i), "value");
+  }
+  db.setMaxMemory(db.usedMemory(), EvictionPolicy::AllKeysLru, 10);
+  std::this_thread::sleep_for(std::chrono::milliseconds{5});
+  for (const auto& key : hot) {
+    db.get(key);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds{5});
+
+  std::vector<KeyT> written{};
+  db.setWriteHook([&written](const KeyT key, const ValueType* value,
+                             std::span<const std::string_view>) {
+    if (value == nullptr) {
+      written.push_back(key);
+    }
+  });
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(db.freeMemoryIfNeeded());
+    db.set("new:" + std::to_string(i), "value");
+  }
+  db.setWriteHook({});
+
+  const auto evicted = db.stats().evictedKeys_;
+  EXPECT_GE(evicted, 99);
+  EXPECT_EQ(evicted, written.size());
+  std::vector<KeyT> hotKeys{hot.begin(), hot.end()};
+  // Random eviction would keep about 67 of them.
+  EXPECT_GE(db.countExisting(hotKeys), 80);
+}
+
+TEST_F(DbTest, LfuEvictsTheLeastFrequentlyUsedKeys) {
+  db.setMaxMemory(0, EvictionPolicy::AllKeysLfu, 10);
+  std::vector<std::string> hot{};
+  for (int i = 0; i < 100; ++i) {
+    hot.push_back("hot:" + std::to_string(i));
+    db.set(hot.back(), "value");
+    db.set("cold:" + std::to_string(i), "value");
+  }
+  db.setMaxMemory(db.usedMemory(), EvictionPolicy::AllKeysLfu, 10);
+  for (int round = 0; round < 20; ++round) {
+    for (const auto& key : hot) {
+      db.get(key);
+    }
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(db.freeMemoryIfNeeded());
+    db.set("new:" + std::to_string(i), "value");
+  }
+  std::vector<KeyT> hotKeys{hot.begin(), hot.end()};
+  // Random eviction would keep about 67 of them.
+  EXPECT_GE(db.countExisting(hotKeys), 80);
+}
+
+TEST_F(DbTest, VolatileTtlEvictsTheKeysThatExpireSoonest) {
+  const auto now = std::chrono::system_clock::now();
+  db.set("persistent", "value");
+  for (int i = 0; i < 10; ++i) {
+    db.set("ttl:" + std::to_string(i), "value", now + std::chrono::hours{1 + i});
+  }
+  const auto perKey = db.usedMemory() / 11;
+  // Samples every key with a TTL, so the choice is exact.
+  db.setMaxMemory(db.usedMemory() - perKey, EvictionPolicy::VolatileTtl, 10);
+  EXPECT_TRUE(db.freeMemoryIfNeeded());
+  EXPECT_FALSE(db.get("ttl:0").has_value());
+  EXPECT_TRUE(db.get("ttl:1").has_value());
+
+  // Only keys with a TTL are evicted.
+  db.setMaxMemory(1, EvictionPolicy::VolatileTtl);
+  EXPECT_FALSE(db.freeMemoryIfNeeded());
+  EXPECT_EQ(1, db.size());
+  EXPECT_TRUE(db.get("persistent").has_value());
+  EXPECT_EQ(10, db.stats().evictedKeys_);
+}
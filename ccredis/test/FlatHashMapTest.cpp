@@ -0,0 +1,129 @@
+#include "FlatHashMap.h"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+class FlatHashMapTest : public testing::Test {
+protected:
+    using Map = FlatHashMap<int>;
+
+    int* insert(const std::string_view key, const int value)
+    {
+        auto [stored, inserted] = map.tryEmplace(key, Map::hash(key));
+        *stored = value;
+        return stored;
+    }
+
+    const int* find(const std::string_view key) const { return map.find(key, Map::hash(key)); }
+
+    Map map {};
+};
+
+TEST_F(FlatHashMapTest, EmptyMap)
+{
+    EXPECT_EQ(nullptr, find("key"));
+    EXPECT_FALSE(map.erase("key", Map::hash("key")));
+    EXPECT_EQ(0, map.size());
+}
+
+TEST_F(FlatHashMapTest, InsertAndFind)
+{
+    insert("key", 1);
+    ASSERT_NE(nullptr, find("key"));
+    EXPECT_EQ(1, *find("key"));
+    EXPECT_EQ(nullptr, find("otherkey"));
+}
+
+TEST_F(FlatHashMapTest, TryEmplaceExisting)
+{
+    insert("key", 1);
+    const auto [stored, inserted] = map.tryEmplace("key", Map::hash("key"));
+    EXPECT_FALSE(inserted);
+    EXPECT_EQ(1, *stored);
+    EXPECT_EQ(1, map.size());
+}
+
+TEST_F(FlatHashMapTest, Erase)
+{
+    insert("key", 1);
+    EXPECT_TRUE(map.erase("key", Map::hash("key")));
+    EXPECT_EQ(nullptr, find("key"));
+    EXPECT_EQ(0, map.size());
+}
+
+TEST_F(FlatHashMapTest, GrowsAndKeepsAllKeys)
+{
+    constexpr int numKeys = 10000;
+    for (int i = 0; i < numKeys; ++i) {
+        insert("key:" + std::to_string(i), i);
+    }
+    EXPECT_EQ(numKeys, map.size());
+    for (int i = 0; i < numKeys; ++i) {
+        const auto* value = find("key:" + std::to_string(i));
+        ASSERT_NE(nullptr, value);
+        EXPECT_EQ(i, *value);
+    }
+}
+
+TEST_F(FlatHashMapTest, EraseHalfThenReinsert)
+{
+    constexpr int numKeys = 1000;
+    for (int i = 0; i < numKeys; ++i) {
+        insert("key:" + std::to_string(i), i);
+    }
+    for (int i = 0; i < numKeys; i += 2) {
+        EXPECT_TRUE(map.erase("key:" + std::to_string(i), Map::hash("key:" + std::to_string(i))));
+    }
+    EXPECT_EQ(numKeys / 2, map.size());
+    for (int i = 0; i < numKeys; ++i) {
+        EXPECT_EQ(i % 2 == 1, find("key:" + std::to_string(i)) != nullptr);
+    }
+    // Churn must reuse deleted slots rather than grow forever.
+    const auto capacity = map.capacity();
+    for (int round = 0; round < 10; ++round) {
+        for (int i = 0; i < numKeys; i += 2) {
+            insert("key:" + std::to_string(i), i);
+        }
+        for (int i = 0; i < numKeys; i += 2) {
+            map.erase("key:" + std::to_string(i), Map::hash("key:" + std::to_string(i)));
+        }
+    }
+    EXPECT_EQ(capacity, map.capacity());
+}
+
+TEST_F(FlatHashMapTest, ForEachVisitsEveryEntry)
+{
+    insert("a", 1);
+    insert("b", 2);
+    insert("c", 3);
+    int sum = 0;
+    map.forEach([&sum](const std::string&, const int value) { sum += value; });
+    EXPECT_EQ(6, sum);
+}
+
+TEST_F(FlatHashMapTest, SampleVisitsDistinctEntries)
+{
+    std::vector<std::string> sampled {};
+    map.sample(7, 5, [&sampled](const std::string& key, int) { sampled.push_back(key); });
+    EXPECT_TRUE(sampled.empty());
+
+    for (int i = 0; i < 100; ++i) {
+        insert("key:" + std::to_string(i), i);
+    }
+    for (const size_t start : { size_t { 0 }, size_t { 12345 }, map.capacity() - 1 }) {
+        sampled.clear();
+        map.sample(start, 5, [&sampled](const std::string& key, int) { sampled.push_back(key); });
+        std::ranges::sort(sampled);
+        EXPECT_EQ(5, sampled.size());
+        EXPECT_EQ(sampled.end(), std::ranges::adjacent_find(sampled));
+    }
+
+    // Never more than the map holds.
+    sampled.clear();
+    map.sample(0, 1000, [&sampled](const std::string& key, int) { sampled.push_back(key); });
+    EXPECT_EQ(100, sampled.size());
+}
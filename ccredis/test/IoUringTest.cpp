@@ -0,0 +1,102 @@
+#include "IoUring.h"
+
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+// A ring, or nothing when the kernel or sandbox does not allow io_uring.
+std::unique_ptr<IoUring> createRing()
+{
+    auto ring = IoUring::create(8);
+    if (!ring.has_value()) {
+        return nullptr;
+    }
+    ring.value()->enable();
+    return std::move(ring.value());
+}
+
+std::vector<io_uring_cqe> waitForCompletions(IoUring& ring, const unsigned count)
+{
+    std::vector<io_uring_cqe> completions {};
+    while (completions.size() < count) {
+        EXPECT_EQ(0, ring.submitAndWait(1));
+        ring.forEachCompletion([&](const io_uring_cqe& cqe) { completions.push_back(cqe); });
+    }
+    return completions;
+}
+} // namespace
+
+TEST(IoUringTest, CompletesSubmissions)
+{
+    const auto ring = createRing();
+    if (!ring) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+    ASSERT_TRUE(ring->supports(IORING_OP_NOP));
+    // More entries than the queue holds are submitted as it fills up.
+    for (uint64_t i = 0; i < 20; ++i) {
+        auto& sqe = ring->nextSqe();
+        sqe.opcode = IORING_OP_NOP;
+        sqe.user_data = i;
+    }
+    const auto completions = waitForCompletions(*ring, 20);
+    for (uint64_t i = 0; i < 20; ++i) {
+        EXPECT_EQ(i, completions[i].user_data);
+        EXPECT_EQ(0, completions[i].res);
+    }
+}
+
+TEST(IoUringTest, MultishotReceiveIntoProvidedBuffers)
+{
+    const auto ring = createRing();
+    if (!ring || !ring->supports(IORING_OP_SEND_ZC)) {
+        GTEST_SKIP() << "io_uring multishot receives are not available";
+    }
+    auto buffers = BufferRing::create(*ring, 3, 2, 8);
+    ASSERT_TRUE(buffers.has_value()) << buffers.error();
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+    auto& sqe = ring->nextSqe();
+    sqe.opcode = IORING_OP_RECV;
+    sqe.fd = fds[0];
+    sqe.ioprio = IORING_RECV_MULTISHOT;
+    sqe.flags = IOSQE_BUFFER_SELECT;
+    sqe.buf_group = buffers.value()->groupId();
+    sqe.user_data = 42;
+
+    std::string received {};
+    const auto receive = [&](const std::string_view data) {
+        ASSERT_EQ(static_cast<ssize_t>(data.size()), send(fds[1], data.data(), data.size(), 0));
+        for (const auto& cqe : waitForCompletions(*ring, 1)) {
+            EXPECT_EQ(42u, cqe.user_data);
+            ASSERT_GT(cqe.res, 0);
+            ASSERT_NE(0u, cqe.flags & IORING_CQE_F_BUFFER);
+            EXPECT_NE(0u, cqe.flags & IORING_CQE_F_MORE);
+            const auto id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            received.append(buffers.value()->buffer(id).data(), cqe.res);
+            buffers.value()->recycle(id);
+        }
+    };
+    // Recycled buffers are picked again, more times than the ring has buffers.
+    receive("PING");
+    receive("12345678");
+    receive("abc");
+    receive("xyz");
+    EXPECT_EQ("PING12345678abcxyz", received);
+
+    // The receive ends once the peer closes.
+    close(fds[1]);
+    const auto last = waitForCompletions(*ring, 1);
+    EXPECT_EQ(0, last[0].res);
+    EXPECT_EQ(0u, last[0].flags & IORING_CQE_F_MORE);
+    close(fds[0]);
+}
@@ -0,0 +1,97 @@
+#include "Log.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+std::vector<std::pair<LogLevel, std::string>> drain(LogRing& ring)
+{
+    std::vector<std::pair<LogLevel, std::string>> lines {};
+    ring.drain([&lines](const LogLevel level, const std::string_view line) { lines.emplace_back(level, line); });
+    return lines;
+}
+} // namespace
+
+TEST(LogTest, FormatsArguments)
+{
+    LogLine line;
+    const std::string host { "127.0.0.1" };
+    line.append("Connected to ");
+    line.append(host);
+    line.append(':');
+    line.append(6379);
+    line.append(std::string_view { ", lag " });
+    line.append(-1.5);
+    line.append(' ');
+    line.append(true);
+    line.append(' ');
+    line.append(uint64_t { 18446744073709551615u });
+    EXPECT_EQ("Connected to 127.0.0.1:6379, lag -1.5 true 18446744073709551615", line.view());
+}
+
+TEST(LogTest, TruncatesLongLines)
+{
+    LogLine line;
+    line.append(std::string(LogLine::maxLength - 2, 'a'));
+    line.append("bcd");
+    line.append(12345);
+    EXPECT_EQ(LogLine::maxLength, line.view().size());
+    EXPECT_TRUE(line.view().ends_with("abc"));
+}
+
+TEST(LogTest, RingKeepsLinesInOrderAcrossTheEnd)
+{
+    LogRing ring {};
+    EXPECT_TRUE(ring.empty());
+    const std::string line(1000, 'x');
+    // More bytes than the ring holds, so positions wrap around several times.
+    for (int i = 0; i < 200; ++i) {
+        ASSERT_TRUE(ring.push(LogLevel::Info, line + std::to_string(i)));
+        ASSERT_TRUE(ring.push(LogLevel::Warning, std::to_string(i)));
+        const auto lines = drain(ring);
+        ASSERT_EQ(2u, lines.size());
+        EXPECT_EQ(line + std::to_string(i), lines[0].second);
+        EXPECT_EQ(LogLevel::Warning, lines[1].first);
+        EXPECT_EQ(std::to_string(i), lines[1].second);
+    }
+    EXPECT_TRUE(ring.empty());
+}
+
+TEST(LogTest, FullRingDropsLines)
+{
+    LogRing ring {};
+    const std::string line(1000, 'x');
+    size_t pushed = 0;
+    while (ring.push(LogLevel::Info, line)) {
+        ++pushed;
+    }
+    EXPECT_EQ(LogRing::capacity / (line.size() + 8), pushed);
+    EXPECT_EQ(pushed, drain(ring).size());
+    EXPECT_TRUE(ring.push(LogLevel::Info, line));
+}
+
+TEST(LogTest, DisabledLevelsDoNotEvaluateArguments)
+{
+    int evaluated = 0;
+    const auto argument = [&evaluated]() {
+        ++evaluated;
+        return "argument";
+    };
+    Logger::setLevel(LogLevel::Error);
+    LOG_WARNING("Not logged: ", argument());
+    // Compiled out unless the build keeps debug logs.
+    Logger::setLevel(LogLevel::Debug);
+    LOG_DEBUG("Maybe logged: ", argument());
+    EXPECT_EQ(CCREDIS_LOG_LEVEL == 0 ? 1 : 0, evaluated);
+    Logger::setLevel(LogLevel::Info);
+    LOG_INFO("Logged by the test: ", argument());
+    EXPECT_EQ(CCREDIS_LOG_LEVEL == 0 ? 2 : 1, evaluated);
+    Logger::instance().flush();
+    EXPECT_EQ(0u, Logger::instance().dropped());
+}
@@ -0,0 +1,237 @@
+// Fan-out load generator for pub/sub. --subscribers connections subscribe to one
+// channel and a publisher keeps PUBLISHing to it, pipelined, staying at most --window
+// messages ahead of what the subscribers received so none of them hits the output
+// limit. Reports the messages published and delivered per second.
+//
+//   ulimit -n 20000
+//   ./server &
+//   ./pubsub_bench --port 6379 --subscribers 10000 --seconds 5 --size 32
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+struct BenchConfig {
+    std::string host { "127.0.0.1" };
+    int port { 6379 };
+    unsigned subscribers { 10000 };
+    unsigned seconds { 5 };
+    // Bytes of every message.
+    unsigned size { 32 };
+    // PUBLISH commands per write of the publisher.
+    unsigned pipeline { 16 };
+    // Messages the publisher may be ahead of the average subscriber.
+    unsigned window { 256 };
+    std::string channel { "bench" };
+};
+
+std::string bulk(const std::string_view str)
+{
+    std::string result { "$" };
+    result.append(std::to_string(str.size())).append("\r\n").append(str).append("\r\n");
+    return result;
+}
+
+// An array of bulk strings, eg: a command.
+std::string array(const std::vector<std::string_view>& elements)
+{
+    std::string result { "*" };
+    result.append(std::to_string(elements.size())).append("\r\n");
+    for (const auto element : elements) {
+        result.append(bulk(element));
+    }
+    return result;
+}
+
+int connectTo(const BenchConfig& config)
+{
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        perror("socket (raise ulimit -n?)");
+        exit(1);
+    }
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config.port);
+    inet_pton(AF_INET, config.host.c_str(), &addr.sin_addr);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == -1) {
+        perror("connect");
+        exit(1);
+    }
+    constexpr int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof yes);
+    return fd;
+}
+
+bool sendAll(int fd, std::string_view data)
+{
+    while (!data.empty()) {
+        const auto n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data.remove_prefix(n);
+    }
+    return true;
+}
+
+bool recvExactly(int fd, std::vector<char>& buf, size_t size)
+{
+    buf.resize(size);
+    size_t received = 0;
+    while (received < size) {
+        const auto n = recv(fd, buf.data() + received, size - received, 0);
+        if (n <= 0) {
+            return false;
+        }
+        received += n;
+    }
+    return true;
+}
+
+// Counts the bytes all subscribers receive; every message has the same length.
+void receiveMessages(const std::vector<int>& fds, const std::atomic<bool>& stop, std::atomic<uint64_t>& receivedBytes)
+{
+    const int epollFd = epoll_create1(0);
+    for (const auto fd : fds) {
+        epoll_event event { .events = EPOLLIN, .data = { .fd = fd } };
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+    std::array<epoll_event, 256> events {};
+    std::vector<char> buffer(64 * 1024);
+    while (!stop.load(std::memory_order_relaxed)) {
+        const int numEvents = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), 100);
+        uint64_t bytes = 0;
+        for (int i = 0; i < numEvents; ++i) {
+            const auto n = recv(events[i].data.fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+            if (n == 0) {
+                std::cerr << "A subscriber was disconnected\n";
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, events[i].data.fd, nullptr);
+            } else if (n > 0) {
+                bytes += static_cast<uint64_t>(n);
+            }
+        }
+        receivedBytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    close(epollFd);
+}
+
+unsigned toUnsigned(const std::string_view str)
+{
+    unsigned value {};
+    std::from_chars(str.data(), str.data() + str.size(), value);
+    return value;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    BenchConfig config {};
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string_view option { argv[i] };
+        const std::string_view value { argv[i + 1] };
+        if (option == "--host") {
+            config.host = value;
+        } else if (option == "--port") {
+            config.port = static_cast<int>(toUnsigned(value));
+        } else if (option == "--subscribers") {
+            config.subscribers = std::max(1u, toUnsigned(value));
+        } else if (option == "--seconds") {
+            config.seconds = toUnsigned(value);
+        } else if (option == "--size") {
+            config.size = toUnsigned(value);
+        } else if (option == "--pipeline") {
+            config.pipeline = std::max(1u, toUnsigned(value));
+        } else if (option == "--window") {
+            config.window = std::max(1u, toUnsigned(value));
+        } else if (option == "--channel") {
+            config.channel = value;
+        }
+    }
+
+    const std::string message(config.size, 'm');
+    const auto messageSize = array({ "message", config.channel, message }).size();
+    const auto subscribe = array({ "SUBSCRIBE", config.channel });
+    std::string subscribed { "*3\r\n" };
+    subscribed.append(bulk("subscribe")).append(bulk(config.channel)).append(":1\r\n");
+    std::vector<int> subscribers {};
+    std::vector<char> reply {};
+    for (unsigned i = 0; i < config.subscribers; ++i) {
+        const int fd = connectTo(config);
+        if (!sendAll(fd, subscribe) || !recvExactly(fd, reply, subscribed.size())) {
+            std::cerr << "Could not subscribe\n";
+            return 1;
+        }
+        subscribers.push_back(fd);
+    }
+
+    std::atomic<bool> stop { false };
+    std::atomic<uint64_t> receivedBytes { 0 };
+    std::jthread receiver { [&]() { receiveMessages(subscribers, stop, receivedBytes); } };
+
+    const int publisher = connectTo(config);
+    std::string batch {};
+    for (unsigned i = 0; i < config.pipeline; ++i) {
+        batch.append(array({ "PUBLISH", config.channel, message }));
+    }
+    std::string receivers { ":" };
+    receivers.append(std::to_string(config.subscribers)).append("\r\n");
+    uint64_t published = 0;
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + std::chrono::seconds { config.seconds };
+    while (std::chrono::steady_clock::now() < end) {
+        const auto delivered = receivedBytes.load(std::memory_order_relaxed) / messageSize;
+        if (published * config.subscribers > delivered + uint64_t { config.window } * config.subscribers) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (!sendAll(publisher, batch) || !recvExactly(publisher, reply, receivers.size() * config.pipeline)) {
+            std::cerr << "Connection lost\n";
+            return 1;
+        }
+        if (published == 0 && std::string_view { reply.data(), receivers.size() } != receivers) {
+            std::cerr << "PUBLISH reached " << std::string_view { reply.data(), receivers.size() - 2 }
+                      << " subscribers instead of " << config.subscribers << "\n";
+        }
+        published += config.pipeline;
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    // Let the messages in flight arrive.
+    const auto expected = published * config.subscribers;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds { 5 };
+    while (receivedBytes.load() / messageSize < expected && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds { 10 });
+    }
+    stop = true;
+    receiver.join();
+    const auto delivered = receivedBytes.load() / messageSize;
+
+    std::cout << "publish: " << static_cast<uint64_t>(published / elapsed.count()) << " messages per second to "
+              << config.subscribers << " subscribers (" << config.size << " bytes), "
+              << static_cast<uint64_t>(delivered / elapsed.count()) << " deliveries per second";
+    if (delivered != expected) {
+        std::cout << ", " << expected - std::min(expected, delivered) << " of " << expected << " not delivered";
+    }
+    std::cout << "\n";
+    close(publisher);
+    for (const auto fd : subscribers) {
+        close(fd);
+    }
+}
@@ -0,0 +1,202 @@
+#include "CommandExecutor.h"
+#include "Database.h"
+#include "OutputQueue.h"
+#include "PubSub.h"
+#include "ServerContext.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+std::string bytesOf(const std::span<const iovec> segments)
+{
+    std::string bytes {};
+    for (const auto& segment : segments) {
+        bytes.append(static_cast<const char*>(segment.iov_base), segment.iov_len);
+    }
+    return bytes;
+}
+
+std::string command(const std::vector<std::string_view>& args)
+{
+    std::string request { "*" };
+    request.append(std::to_string(args.size())).append("\r\n");
+    for (const auto arg : args) {
+        request.append("$").append(std::to_string(arg.size())).append("\r\n").append(arg).append("\r\n");
+    }
+    return request;
+}
+
+// Two reactors of one server, each with its executor.
+class PubSubTest : public ::testing::Test {
+protected:
+    std::string execute(CommandExecutor& executor, const uint64_t client, const std::vector<std::string_view>& args)
+    {
+        const auto request = command(args);
+        size_t consumed = 0;
+        std::optional<CommandHandler::FollowerRequest> followerRequest {};
+        EXPECT_EQ(ClientState::Connected, executor.execute(client, request, consumed, followerRequest));
+        EXPECT_EQ(request.size(), consumed);
+        auto& encoder = executor.encoder();
+        auto reply = bytesOf(encoder.segments());
+        encoder.clearBuffer();
+        return reply;
+    }
+
+    std::shared_ptr<PubSub> pubsub_ { std::make_shared<PubSub>(1024) };
+    ServerContext context_ { .db_ = std::make_shared<Db>(), .pubsub_ = pubsub_ };
+    int wakeups_ {};
+    CommandExecutor publisher_ { context_ };
+    CommandExecutor subscriber_ { context_, [this]() { ++wakeups_; } };
+};
+} // namespace
+
+TEST(OutputQueueTest, SharesMessagesBetweenCopiedReplies)
+{
+    OutputQueue queue {};
+    EXPECT_TRUE(queue.empty());
+    std::string reply { "+OK\r\n" };
+    const std::array<iovec, 2> replies { iovec { .iov_base = reply.data(), .iov_len = 3 }, iovec { .iov_base = reply.data() + 3, .iov_len = 2 } };
+    // The first two bytes were sent already.
+    queue.append(replies, 2);
+    const auto message = std::make_shared<const std::string>("message");
+    queue.append(message);
+    queue.append(replies);
+    EXPECT_EQ(3u + 7u + 5u, queue.size());
+    EXPECT_EQ(2, message.use_count());
+
+    const auto segments = queue.segments(8);
+    ASSERT_EQ(3u, segments.size());
+    EXPECT_EQ(message->data(), segments[1].iov_base);
+    EXPECT_EQ("K\r\nmessage+OK\r\n", bytesOf(segments));
+    EXPECT_EQ(1u, queue.segments(1).size());
+
+    queue.consume(5);
+    EXPECT_EQ("ssage+OK\r\n", bytesOf(queue.segments(8)));
+    queue.consume(5);
+    EXPECT_EQ(1, message.use_count());
+    EXPECT_EQ("+OK\r\n", bytesOf(queue.segments(8)));
+    queue.consume(5);
+    EXPECT_TRUE(queue.empty());
+    EXPECT_TRUE(queue.segments(8).empty());
+}
+
+TEST(PatternTest, MatchesGlobs)
+{
+    EXPECT_TRUE(matchesPattern("news", "news"));
+    EXPECT_FALSE(matchesPattern("news", "new"));
+    EXPECT_TRUE(matchesPattern("*", ""));
+    EXPECT_TRUE(matchesPattern("news.*", "news.sport"));
+    EXPECT_TRUE(matchesPattern("*.*.uk", "news.sport.uk"));
+    EXPECT_FALSE(matchesPattern("*.*.uk", "news.uk"));
+    EXPECT_TRUE(matchesPattern("h?llo", "hello"));
+    EXPECT_FALSE(matchesPattern("h?llo", "hllo"));
+    EXPECT_TRUE(matchesPattern("h[ae]llo", "hallo"));
+    EXPECT_FALSE(matchesPattern("h[ae]llo", "hillo"));
+    EXPECT_TRUE(matchesPattern("h[^e]llo", "hallo"));
+    EXPECT_FALSE(matchesPattern("h[^e]llo", "hello"));
+    EXPECT_TRUE(matchesPattern("h[a-c]llo", "hbllo"));
+    EXPECT_FALSE(matchesPattern("h[a-c]llo", "hdllo"));
+    EXPECT_TRUE(matchesPattern("h\\*llo", "h*llo"));
+    EXPECT_FALSE(matchesPattern("h\\*llo", "hello"));
+    EXPECT_TRUE(matchesPattern("a*b*c", "axxbyybzzc"));
+}
+
+TEST(PubSubRegistryTest, QueuesOneFrameForTheReactorsWithSubscribers)
+{
+    PubSub pubsub { 1024 };
+    int firstWakeups = 0;
+    int secondWakeups = 0;
+    const auto first = pubsub.addReactor([&firstWakeups]() { ++firstWakeups; });
+    const auto second = pubsub.addReactor([&secondWakeups]() { ++secondWakeups; });
+    Subscriptions firstClients { pubsub, first };
+    Subscriptions secondClients { pubsub, second };
+    EXPECT_EQ(1u, secondClients.subscribe(7, "news", false));
+    EXPECT_EQ(1u, secondClients.subscribe(8, "news", false));
+    EXPECT_EQ(1u, firstClients.subscribe(3, "n*", true));
+
+    EXPECT_EQ(3u, pubsub.publish(first, "news", "hi"));
+    EXPECT_EQ(3u, pubsub.publish(first, "news", "again"));
+    EXPECT_EQ(0u, pubsub.publish(first, "weather", "sunny"));
+    // Woken once until it takes the messages, and never by its own publishing.
+    EXPECT_EQ(0, firstWakeups);
+    EXPECT_EQ(1, secondWakeups);
+
+    const auto published = pubsub.take(second);
+    ASSERT_EQ(2u, published.size());
+    EXPECT_EQ("*3\r\n$7\r\nmessage\r\n$4\r\nnews\r\n$2\r\nhi\r\n", *published[0].frame_);
+    const auto subscribers = secondClients.subscribers(published[0]);
+    EXPECT_EQ((std::vector<uint64_t> { 7, 8 }), std::vector<uint64_t>(subscribers.begin(), subscribers.end()));
+    const auto matched = pubsub.take(first);
+    ASSERT_EQ(2u, matched.size());
+    EXPECT_TRUE(matched[0].pattern_);
+    EXPECT_EQ("*4\r\n$8\r\npmessage\r\n$2\r\nn*\r\n$4\r\nnews\r\n$2\r\nhi\r\n", *matched[0].frame_);
+
+    secondClients.remove(7);
+    EXPECT_EQ(0u, secondClients.unsubscribe(8, "news", false));
+    EXPECT_EQ(1u, pubsub.publish(first, "news", "hi"));
+    EXPECT_EQ(1, secondWakeups);
+}
+
+TEST_F(PubSubTest, SubscribeAndPublish)
+{
+    EXPECT_EQ("*3\r\n$9\r\nsubscribe\r\n$4\r\nnews\r\n:1\r\n*3\r\n$9\r\nsubscribe\r\n$7\r\nweather\r\n:2\r\n",
+        execute(subscriber_, 1, { "SUBSCRIBE", "news", "weather" }));
+    EXPECT_EQ("*3\r\n$10\r\npsubscribe\r\n$2\r\nn*\r\n:1\r\n", execute(subscriber_, 2, { "PSUBSCRIBE", "n*" }));
+    EXPECT_EQ(":2\r\n", execute(publisher_, 1, { "PUBLISH", "news", "hello" }));
+    EXPECT_EQ(1, wakeups_);
+    EXPECT_EQ(":0\r\n", execute(publisher_, 1, { "PUBLISH", "sport", "hello" }));
+
+    const auto published = subscriber_.takePublications();
+    ASSERT_EQ(2u, published.size());
+    EXPECT_EQ("*3\r\n$7\r\nmessage\r\n$4\r\nnews\r\n$5\r\nhello\r\n", *published[0].frame_);
+    EXPECT_EQ(1u, subscriber_.subscribers(published[0]).size());
+    EXPECT_EQ(2u, subscriber_.subscribers(published[1]).front());
+    EXPECT_TRUE(publisher_.takePublications().empty());
+}
+
+TEST_F(PubSubTest, SubscribedClientsOnlySubscribeAndPing)
+{
+    execute(subscriber_, 1, { "SUBSCRIBE", "news" });
+    EXPECT_EQ(1024u, subscriber_.outputLimit(1));
+    EXPECT_EQ(CommandExecutor::maxOutputBufferSize, subscriber_.outputLimit(2));
+    EXPECT_TRUE(execute(subscriber_, 1, { "GET", "key" }).starts_with("-ERR Can't execute 'GET'"));
+    EXPECT_EQ("*2\r\n$4\r\npong\r\n$0\r\n\r\n", execute(subscriber_, 1, { "PING" }));
+    // Other clients of the reactor are not affected.
+    EXPECT_EQ("$-1\r\n", execute(subscriber_, 2, { "GET", "key" }));
+
+    EXPECT_EQ("*3\r\n$11\r\nunsubscribe\r\n$4\r\nnews\r\n:0\r\n", execute(subscriber_, 1, { "UNSUBSCRIBE" }));
+    EXPECT_EQ("*3\r\n$11\r\nunsubscribe\r\n$-1\r\n:0\r\n", execute(subscriber_, 1, { "UNSUBSCRIBE" }));
+    EXPECT_EQ("$-1\r\n", execute(subscriber_, 1, { "GET", "key" }));
+}
+
+TEST_F(PubSubTest, DisconnectedClientsAreUnsubscribed)
+{
+    execute(subscriber_, 1, { "SUBSCRIBE", "news" });
+    execute(subscriber_, 2, { "PSUBSCRIBE", "*" });
+    EXPECT_EQ(":2\r\n", execute(publisher_, 1, { "PUBLISH", "news", "hello" }));
+    subscriber_.onDisconnect(1);
+    subscriber_.onDisconnect(2);
+    EXPECT_EQ(":0\r\n", execute(publisher_, 1, { "PUBLISH", "news", "hello" }));
+}
+
+TEST(PubSubDisabledTest, CommandsFail)
+{
+    CommandExecutor executor { ServerContext { .db_ = std::make_shared<Db>() } };
+    const std::string request { "*2\r\n$9\r\nSUBSCRIBE\r\n$4\r\nnews\r\n" };
+    size_t consumed = 0;
+    std::optional<CommandHandler::FollowerRequest> followerRequest {};
+    EXPECT_EQ(ClientState::Connected, executor.execute(1, request, consumed, followerRequest));
+    EXPECT_EQ("-ERR pub/sub is disabled\r\n", bytesOf(executor.encoder().segments()));
+    EXPECT_TRUE(executor.takePublications().empty());
+}
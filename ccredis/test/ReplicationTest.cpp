@@ -0,0 +1,254 @@
+#include "AppendOnlyFile.h"
+#include "CommandHandler.h"
+#include "Commands.h"
+#include "Database.h"
+#include "Replication.h"
+#include "Resp.h"
+#include "RespDecoder.h"
+#include "RespEncoder.h"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <netinet/in.h>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+// Polls until condition holds, for up to ten seconds.
+bool waitFor(const std::function<bool()>& condition)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds { 10 };
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds { 1 });
+    }
+    return true;
+}
+
+// A leader on a localhost port: a Db that feeds its writes to replication, and a thread
+// that accepts followers and hands them over after their PSYNC, like the reactor does.
+class Leader {
+public:
+    Leader()
+    {
+        db_->setWriteHook([this](const KeyT key, const ValueType* value, const std::span<const std::string_view> command) {
+            auto& leader = replication_->leader();
+            if (leader.streaming()) {
+                std::string encoded {};
+                encodeWrite(encoded, key, value, command);
+                leader.feed(encoded);
+            }
+        });
+        listener_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_in address { .sin_family = AF_INET, .sin_port = 0, .sin_addr = { htonl(INADDR_LOOPBACK) }, .sin_zero = {} };
+        socklen_t length = sizeof address;
+        bind(listener_, reinterpret_cast<sockaddr*>(&address), length);
+        listen(listener_, 16);
+        getsockname(listener_, reinterpret_cast<sockaddr*>(&address), &length);
+        port_ = std::to_string(ntohs(address.sin_port));
+        acceptor_ = std::jthread { [this]() { acceptFollowers(); } };
+    }
+    ~Leader()
+    {
+        shutdown(listener_, SHUT_RDWR);
+        acceptor_.join();
+        close(listener_);
+        replication_.reset();
+        db_->setWriteHook({});
+    }
+
+    Db& db() { return *db_; }
+    ReplicationLeader& leader() { return replication_->leader(); }
+    const std::string& port() const { return port_; }
+
+private:
+    void acceptFollowers()
+    {
+        while (true) {
+            const int fd = accept4(listener_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd == -1) {
+                return;
+            }
+            std::string input {};
+            RespTokenArena tokens {};
+            std::optional<size_t> frameLength {};
+            char buffer[256];
+            while (!frameLength.has_value()) {
+                const auto n = recv(fd, buffer, sizeof buffer, 0);
+                if (n <= 0) {
+                    break;
+                }
+                input.append(buffer, n);
+                frameLength = RespDecoder::decodeFrame(input, tokens);
+            }
+            const auto command = frameLength.has_value() ? RespDecoder::convertToCommand(tokens) : CommandVariant {};
+            if (const auto* psync = std::get_if<CommandPsync>(&command)) {
+                leader().attach(fd, std::string { psync->replid_ }, psync->offset_);
+            } else {
+                close(fd);
+            }
+        }
+    }
+
+    std::shared_ptr<Db> db_ { std::make_shared<Db>() };
+    std::shared_ptr<Replication> replication_ { std::make_shared<Replication>(db_, nullptr, 1024 * 1024) };
+    int listener_ {};
+    std::string port_ {};
+    std::jthread acceptor_ {};
+};
+
+class ReplicationTest : public testing::Test {
+protected:
+    // Waits until the follower applied everything the leader wrote.
+    static bool caughtUp(Leader& leader, const Replication& follower)
+    {
+        return waitFor([&]() {
+            const auto link = follower.link();
+            return link.has_value() && link->up_ && link->offset_ == leader.leader().offset();
+        });
+    }
+};
+} // namespace
+
+TEST(ReplicationBacklogTest, KeepsTheLastBytes)
+{
+    ReplicationBacklog backlog { 8 };
+    backlog.append("abcdef");
+    std::string out {};
+    EXPECT_TRUE(backlog.copy(0, 100, out));
+    EXPECT_EQ("abcdef", out);
+
+    backlog.append("ghij");
+    EXPECT_EQ(2, backlog.startOffset());
+    EXPECT_EQ(10, backlog.endOffset());
+    out.clear();
+    EXPECT_TRUE(backlog.copy(2, 100, out));
+    EXPECT_EQ("cdefghij", out);
+    out.clear();
+    EXPECT_TRUE(backlog.copy(7, 2, out));
+    EXPECT_EQ("hi", out);
+    EXPECT_FALSE(backlog.copy(1, 100, out));
+    EXPECT_FALSE(backlog.copy(11, 100, out));
+    out.clear();
+    EXPECT_TRUE(backlog.copy(10, 100, out));
+    EXPECT_TRUE(out.empty());
+
+    // Only the end of an append larger than the backlog is kept.
+    backlog.append("0123456789ABC");
+    EXPECT_EQ(15, backlog.startOffset());
+    EXPECT_TRUE(backlog.copy(15, 100, out));
+    EXPECT_EQ("56789ABC", out);
+}
+
+TEST_F(ReplicationTest, FollowerSyncsAndResumes)
+{
+    Leader leader {};
+    const std::vector<std::pair<std::string_view, std::string_view>> fields { { "f1", "v1" } };
+    const std::vector<std::string_view> values { "a", "b" };
+    const auto expire = std::chrono::time_point_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now() + std::chrono::hours { 1 });
+    leader.db().set("string", "value");
+    leader.db().set("ttl", "value", expire);
+    leader.db().hashSet("hash", fields);
+    leader.db().listPush("list", values, Db::ListEnd::Back);
+
+    auto db = std::make_shared<Db>();
+    db->set("stale", "value");
+    Replication follower { db, nullptr, 1024 * 1024 };
+    follower.replicaOf("127.0.0.1", leader.port());
+    ASSERT_TRUE(caughtUp(leader, follower));
+    EXPECT_FALSE(db->get("stale").has_value());
+    EXPECT_EQ(4, db->size());
+    EXPECT_EQ(expire, db->get("ttl")->expire_);
+    EXPECT_EQ(leader.db().get("list").value(), db->get("list").value());
+
+    // Writes after the sync arrive through the stream.
+    leader.db().set("string", "other");
+    leader.db().removeMany(std::vector<KeyT> { "ttl" });
+    leader.db().listPush("list", values, Db::ListEnd::Front);
+    leader.db().setAdd("set", values);
+    ASSERT_TRUE(caughtUp(leader, follower));
+    EXPECT_EQ(ValueType { "other" }, db->get("string").value());
+    EXPECT_FALSE(db->get("ttl").has_value());
+    EXPECT_EQ(leader.db().get("list").value(), db->get("list").value());
+    EXPECT_TRUE(db->get("set")->as<SetValue>()->contains("b"));
+
+    // After a disconnect the follower only gets the writes it missed.
+    leader.leader().disconnectFollowers();
+    leader.db().set("missed", "value");
+    ASSERT_TRUE(caughtUp(leader, follower));
+    EXPECT_EQ(ValueType { "value" }, db->get("missed").value());
+    EXPECT_EQ(1, leader.leader().stats().fullSyncs_);
+    EXPECT_EQ(1, leader.leader().stats().partialSyncs_);
+
+    // Once promoted it keeps its keys and stops following.
+    follower.promote();
+    EXPECT_FALSE(follower.isFollower());
+    EXPECT_FALSE(follower.link().has_value());
+    EXPECT_EQ(leader.db().size(), db->size());
+}
+
+TEST_F(ReplicationTest, PushesDuringTheFullSyncAreNotRepeated)
+{
+    Leader leader {};
+    std::vector<std::string> elements {};
+    for (int i = 0; i < 10000; ++i) {
+        elements.push_back(std::to_string(i));
+        leader.db().set("key:" + elements.back(), elements.back());
+    }
+    const std::vector<std::string_view> values { elements.begin(), elements.end() };
+    leader.db().listPush("list", values, Db::ListEnd::Back);
+
+    auto db = std::make_shared<Db>();
+    Replication follower { db, nullptr, 1024 * 1024 };
+    std::atomic<bool> syncing { true };
+    std::jthread pusher { [&]() {
+        const std::vector<std::string_view> one { "x" };
+        while (syncing) {
+            leader.db().listPush("list", one, Db::ListEnd::Front);
+        }
+    } };
+    follower.replicaOf("127.0.0.1", leader.port());
+    ASSERT_TRUE(waitFor([&]() { return follower.link()->up_; }));
+    syncing = false;
+    pusher.join();
+
+    ASSERT_TRUE(caughtUp(leader, follower));
+    EXPECT_EQ(leader.db().size(), db->size());
+    EXPECT_EQ(leader.db().get("list")->as<ListValue>()->size(), db->get("list")->as<ListValue>()->size());
+    EXPECT_EQ(leader.db().get("list").value(), db->get("list").value());
+}
+
+TEST_F(ReplicationTest, FollowerRefusesWrites)
+{
+    auto db = std::make_shared<Db>();
+    auto replication = std::make_shared<Replication>(db, nullptr, 1024);
+    // Nobody listens there; the follower keeps trying in the background.
+    replication->replicaOf("127.0.0.1", "1");
+    RespEncoder encoder {};
+    CommandHandler handler { &encoder, ServerContext { .db_ = db, .replication_ = replication } };
+    CommandSet set {};
+    set.key_ = "key";
+    set.value_ = "value";
+    CommandGet get {};
+    get.key_ = "key";
+    handler(set);
+    handler(get);
+    const auto& buffer = encoder.getBuffer();
+    EXPECT_EQ("-READONLY You can't write against a read only replica.\r\n$-1\r\n", std::string(buffer.begin(), buffer.end()));
+    EXPECT_FALSE(db->get("key").has_value());
+}
@@ -1,10 +1,14 @@
+#include "CommandTable.h"
 #include "Commands.h"
 #include "Resp.h"
 #include "RespDecoder.h"
 
 #include <chrono>
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <optional>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -77,7 +81,88 @@ TEST_F(RespCommandConverterTest, EXISTS)
             RedisRespRes { .string_ { "key" } } }
     };
     const auto commands = rh.convertToCommands(rawCommand);
-    EXPECT_EQ("key", std::get<CommandExists>(commands[0]).key_);
+    EXPECT_EQ(std::vector<std::string_view> { "key" }, std::get<CommandExists>(commands[0]).keys_);
+}
+
+TEST_F(RespCommandConverterTest, MultiKeyCommands)
+{
+    RedisRespRes mget {
+        .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "MGET" } },
+            RedisRespRes { .string_ { "a" } }, RedisRespRes { .string_ { "b" } } }
+    };
+    EXPECT_EQ((std::vector<std::string_view> { "a", "b" }), std::get<CommandMget>(rh.convertToCommands(mget)[0]).keys_);
+
+    RedisRespRes del {
+        .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "del" } },
+            RedisRespRes { .string_ { "a" } }, RedisRespRes { .string_ { "b" } }, RedisRespRes { .string_ { "c" } } }
+    };
+    EXPECT_EQ(3, std::get<CommandDel>(rh.convertToCommands(del)[0]).keys_.size());
+
+    RedisRespRes mset {
+        .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "MSET" } },
+            RedisRespRes { .string_ { "a" } }, RedisRespRes { .string_ { "1" } },
+            RedisRespRes { .string_ { "b" } }, RedisRespRes { .string_ { "2" } } }
+    };
+    const auto msetCommands = rh.convertToCommands(mset);
+    const auto& entries = std::get<CommandMset>(msetCommands[0]).entries_;
+    ASSERT_EQ(2, entries.size());
+    EXPECT_EQ("b", entries[1].first);
+    EXPECT_EQ("2", entries[1].second);
+
+    RedisRespRes odd {
+        .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "MSET" } },
+            RedisRespRes { .string_ { "a" } }, RedisRespRes { .string_ { "1" } },
+            RedisRespRes { .string_ { "b" } } }
+    };
+    EXPECT_EQ("wrong number of arguments for 'MSET' command",
+        std::get<CommandInvalid>(rh.convertToCommands(odd)[0]).errorString);
+}
+
+TEST_F(RespCommandConverterTest, CollectionCommands)
+{
+    RedisRespRes hset {
+        .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "HSET" } },
+            RedisRespRes { .string_ { "h" } }, RedisRespRes { .string_ { "f" } }, RedisRespRes { .string_ { "v" } } }
+    };
+    const auto hsetCommands = rh.convertToCommands(hset);
+    const auto& fields = std::get<CommandHset>(hsetCommands[0]).fields_;
+    ASSERT_EQ(1, fields.size());
+    EXPECT_EQ("f", fields[0].first);
+    EXPECT_EQ("v", fields[0].second);
+
+    RedisRespRes oddHset {
+        .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "HSET" } },
+            RedisRespRes { .string_ { "h" } }, RedisRespRes { .string_ { "f" } }, RedisRespRes { .string_ { "v" } },
+            RedisRespRes { .string_ { "g" } } }
+    };
+    EXPECT_EQ("wrong number of arguments for 'HSET' command",
+        std::get<CommandInvalid>(rh.convertToCommands(oddHset)[0]).errorString);
+
+    RedisRespRes rpush {
+        .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "rpush" } },
+            RedisRespRes { .string_ { "l" } }, RedisRespRes { .string_ { "a" } }, RedisRespRes { .string_ { "b" } } }
+    };
+    EXPECT_EQ((std::vector<std::string_view> { "a", "b" }), std::get<CommandRpush>(rh.convertToCommands(rpush)[0]).values_);
+
+    RedisRespRes lrange {
+        .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "LRANGE" } },
+            RedisRespRes { .string_ { "l" } }, RedisRespRes { .string_ { "0" } }, RedisRespRes { .string_ { "-1" } } }
+    };
+    const auto range = std::get<CommandLrange>(rh.convertToCommands(lrange)[0]);
+    EXPECT_EQ(0, range.start_);
+    EXPECT_EQ(-1, range.stop_);
+
+    RedisRespRes badRange {
+        .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "LRANGE" } },
+            RedisRespRes { .string_ { "l" } }, RedisRespRes { .string_ { "zero" } }, RedisRespRes { .string_ { "-1" } } }
+    };
+    EXPECT_TRUE(std::holds_alternative<CommandInvalid>(rh.convertToCommands(badRange)[0]));
+
+    RedisRespRes sismember {
+        .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "SISMEMBER" } },
+            RedisRespRes { .string_ { "s" } }, RedisRespRes { .string_ { "m" } } }
+    };
+    EXPECT_EQ("m", std::get<CommandSismember>(rh.convertToCommands(sismember)[0]).member_);
 }
 
 TEST_F(RespCommandConverterTest, EXISTSInvalid)
@@ -141,4 +226,124 @@ TEST_F(RespCommandConverterTest, INCR)
     };
     const auto commands = rh.convertToCommands(rawCommand);
     EXPECT_EQ("key", std::get<CommandIncr>(commands[0]).key_);
-}
\ No newline at end of file
+}
+
+TEST_F(RespCommandConverterTest, INCRBYandDECRBY)
+{
+    RedisRespRes incrBy {
+        .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "INCRBY" } },
+            RedisRespRes { .string_ { "key" } }, RedisRespRes { .string_ { "-9223372036854775808" } } }
+    };
+    const auto incr = std::get<CommandIncrBy>(rh.convertToCommands(incrBy)[0]);
+    EXPECT_EQ("key", incr.key_);
+    EXPECT_EQ(std::numeric_limits<int64_t>::min(), incr.increment_);
+
+    RedisRespRes decrBy {
+        .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "decrby" } },
+            RedisRespRes { .string_ { "key" } }, RedisRespRes { .string_ { "5" } } }
+    };
+    EXPECT_EQ(5, std::get<CommandDecrBy>(rh.convertToCommands(decrBy)[0]).decrement_);
+
+    for (const auto* increment : { "1.5", "+1", "01", "9223372036854775808", "" }) {
+        RedisRespRes bad {
+            .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "INCRBY" } },
+                RedisRespRes { .string_ { "key" } }, RedisRespRes { .string_ { increment } } }
+        };
+        EXPECT_EQ("value is not an integer or out of range",
+            std::get<CommandInvalid>(rh.convertToCommands(bad)[0]).errorString)
+            << increment;
+    }
+}
+TEST_F(RespCommandConverterTest, CommandNamesIgnoreCase)
+{
+    RedisRespRes rawCommand {
+        .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "sEt" } },
+            RedisRespRes { .string_ { "key" } },
+            RedisRespRes { .string_ { "value" } } }
+    };
+    const auto commands = rh.convertToCommands(rawCommand);
+    EXPECT_EQ("key", std::get<CommandSet>(commands[0]).key_);
+
+    RedisRespRes ping { .string_ = "ping" };
+    EXPECT_NO_THROW(std::get<CommandPing>(rh.convertToCommands(ping)[0]));
+}
+
+TEST_F(RespCommandConverterTest, WrongNumberOfArguments)
+{
+    RedisRespRes rawCommand {
+        .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "GET" } },
+            RedisRespRes { .string_ { "key" } },
+            RedisRespRes { .string_ { "other" } } }
+    };
+    const auto commands = rh.convertToCommands(rawCommand);
+    EXPECT_EQ("wrong number of arguments for 'GET' command",
+        std::get<CommandInvalid>(commands[0]).errorString);
+
+    RedisRespRes set { .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "SET" } },
+                           RedisRespRes { .string_ { "key" } } } };
+    EXPECT_NO_THROW(std::get<CommandInvalid>(rh.convertToCommands(set)[0]));
+}
+
+TEST_F(RespCommandConverterTest, SETwithExSetsExpire)
+{
+    RedisRespRes rawCommand {
+        .array_ = std::vector<RedisRespRes> {
+            RedisRespRes { .string_ { "SET" } }, RedisRespRes { .string_ { "key" } },
+            RedisRespRes { .string_ { "value" } }, RedisRespRes { .string_ { "ex" } },
+            RedisRespRes { .string_ { "100" } } }
+    };
+    const auto commands = rh.convertToCommands(rawCommand);
+    const auto& set = std::get<CommandSet>(commands[0]);
+    ASSERT_TRUE(set.expire.has_value());
+    EXPECT_GT(set.expire.value(), std::chrono::system_clock::now() + std::chrono::seconds { 98 });
+}
+
+TEST_F(RespCommandConverterTest, SETwithPxat)
+{
+    RedisRespRes rawCommand {
+        .array_ = std::vector<RedisRespRes> {
+            RedisRespRes { .string_ { "SET" } }, RedisRespRes { .string_ { "key" } },
+            RedisRespRes { .string_ { "value" } }, RedisRespRes { .string_ { "PXAT" } },
+            RedisRespRes { .string_ { "1700000000123" } } }
+    };
+    const auto commands = rh.convertToCommands(rawCommand);
+    const CommandSet::TimePoint expected { std::chrono::milliseconds { 1700000000123 } };
+    EXPECT_EQ(expected, std::get<CommandSet>(commands[0]).expire);
+}
+
+TEST_F(RespCommandConverterTest, SETwithBadOptions)
+{
+    const auto makeSet = [](std::string_view option, std::string_view time) {
+        return RedisRespRes { .array_ = std::vector<RedisRespRes> {
+                                  RedisRespRes { .string_ { "SET" } }, RedisRespRes { .string_ { "key" } },
+                                  RedisRespRes { .string_ { "value" } }, RedisRespRes { .string_ { std::string { option } } },
+                                  RedisRespRes { .string_ { std::string { time } } } } };
+    };
+    EXPECT_EQ("Syntax error", std::get<CommandInvalid>(rh.convertToCommands(makeSet("XX", "1"))[0]).errorString);
+    EXPECT_EQ("Invalid expiration time", std::get<CommandInvalid>(rh.convertToCommands(makeSet("EX", "abc"))[0]).errorString);
+    EXPECT_EQ("Invalid expiration time", std::get<CommandInvalid>(rh.convertToCommands(makeSet("EX", "0"))[0]).errorString);
+}
+
+TEST_F(RespCommandConverterTest, FindCommand)
+{
+    for (const auto name : { "PING", "HELLO", "SET", "GET", "EXISTS", "INCR", "INFO" }) {
+        const auto* spec = findCommand(name);
+        ASSERT_NE(nullptr, spec) << name;
+        EXPECT_EQ(name, spec->name_);
+    }
+    EXPECT_EQ(nullptr, findCommand("SETX"));
+    EXPECT_EQ(nullptr, findCommand(""));
+    EXPECT_EQ("INCR", findCommand("incr")->name_);
+}
+
+TEST_F(RespCommandConverterTest, INFO)
+{
+    RedisRespRes all { .string_ = "info" };
+    EXPECT_TRUE(std::get<CommandInfo>(rh.convertToCommands(all)[0]).section_.empty());
+
+    RedisRespRes section {
+        .array_ = std::vector<RedisRespRes> { RedisRespRes { .string_ { "INFO" } },
+            RedisRespRes { .string_ { "stats" } } }
+    };
+    EXPECT_EQ("stats", std::get<CommandInfo>(rh.convertToCommands(section)[0]).section_);
+}
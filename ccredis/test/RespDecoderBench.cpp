@@ -0,0 +1,103 @@
+#include "CommandTable.h"
+#include "Resp.h"
+#include "RespDecoder.h"
+
+#include <array>
+#include <string>
+#include <string_view>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+constexpr std::string_view setFrame = "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$1\r\nv\r\n";
+
+// Frame -> tokens only.
+void BM_DecodeFrame(benchmark::State& state)
+{
+    RespTokenArena tokens {};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(RespDecoder::decodeFrame(setFrame, tokens));
+        benchmark::DoNotOptimize(tokens.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * setFrame.size());
+}
+
+// Frame -> tokens -> CommandSet, what a reactor does per command.
+void BM_DecodeFrameToCommand(benchmark::State& state)
+{
+    RespTokenArena tokens {};
+    for (auto _ : state) {
+        static_cast<void>(RespDecoder::decodeFrame(setFrame, tokens));
+        benchmark::DoNotOptimize(RespDecoder::convertToCommand(tokens));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// The tree decoder, for comparison.
+void BM_DecodeTreeToCommands(benchmark::State& state)
+{
+    for (auto _ : state) {
+        const auto raw = RespDecoder::decode(setFrame);
+        benchmark::DoNotOptimize(RespDecoder::convertToCommands(raw.second));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// A pipelined batch of frames in one buffer, as it arrives from redis-benchmark -P 16.
+void BM_DecodePipeline(benchmark::State& state)
+{
+    std::string batch {};
+    for (int i = 0; i < 16; ++i) {
+        batch += setFrame;
+    }
+    RespTokenArena tokens {};
+    for (auto _ : state) {
+        std::string_view input { batch };
+        while (!input.empty()) {
+            const auto length = RespDecoder::decodeFrame(input, tokens);
+            benchmark::DoNotOptimize(RespDecoder::convertToCommand(tokens));
+            input.remove_prefix(length.value());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 16);
+}
+
+constexpr std::array<std::string_view, 6> commandNames { "GET", "set", "Ping", "INCR", "exists", "UNKNOWN" };
+
+// Name lookup through the perfect hash table.
+void BM_FindCommand(benchmark::State& state)
+{
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(findCommand(commandNames[i++ % commandNames.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// A compare chain like the one the table replaced, made case insensitive, for comparison.
+// Its cost grows with the number of commands while findCommand stays constant.
+void BM_FindCommandChain(benchmark::State& state)
+{
+    constexpr std::array<std::string_view, 6> chain { "HELLO", "SET", "GET", "PING", "EXISTS", "INCR" };
+    size_t i = 0;
+    for (auto _ : state) {
+        const auto name = commandNames[i++ % commandNames.size()];
+        size_t found = 0;
+        while (found < chain.size() && !equalsIgnoreCase(chain[found], name)) {
+            ++found;
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+} // namespace
+
+BENCHMARK(BM_DecodeFrame);
+BENCHMARK(BM_DecodeFrameToCommand);
+BENCHMARK(BM_DecodeTreeToCommands);
+BENCHMARK(BM_DecodePipeline);
+BENCHMARK(BM_FindCommand);
+BENCHMARK(BM_FindCommandChain);
+
+BENCHMARK_MAIN();
@@ -2,6 +2,7 @@
 
 #include <optional>
 #include <stdexcept>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -119,4 +120,107 @@ TEST_F(RespDecoderTest, HelloHandshake)
     RedisRespRes redisRespHello = RedisRespRes { .string_ = "HELLO" };
     RedisRespRes redisRespArr = RedisRespRes { .array_ = std::vector<RedisRespRes> { redisRespHello, redisRespInt } };
     EXPECT_EQ(redisRespArr, rh.decode("*2\r\n$5\r\nHELLO\r\n:3\r\n\r\n").second);
-}
\ No newline at end of file
+}
+TEST_F(RespDecoderTest, FrameLengthComplete)
+{
+    EXPECT_EQ(5, rh.frameLength("+OK\r\n"));
+    EXPECT_EQ(10, rh.frameLength("$4\r\nping\r\n"));
+    EXPECT_EQ(5, rh.frameLength("$-1\r\n"));
+    EXPECT_EQ(22, rh.frameLength("*2\r\n$3\r\nGET\r\n$3\r\nkey\r\n"));
+}
+
+TEST_F(RespDecoderTest, FrameLengthIncomplete)
+{
+    EXPECT_FALSE(rh.frameLength("").has_value());
+    EXPECT_FALSE(rh.frameLength("+OK").has_value());
+    EXPECT_FALSE(rh.frameLength("$4\r\npi").has_value());
+    EXPECT_FALSE(rh.frameLength("*2\r\n$3\r\nGET\r\n").has_value());
+    EXPECT_FALSE(rh.frameLength("*2\r\n$3\r\nGET\r\n$3\r\nke").has_value());
+}
+
+TEST_F(RespDecoderTest, FrameLengthPipelined)
+{
+    constexpr std::string_view pipelined = "*1\r\n$4\r\nPING\r\n*2\r\n$3\r\nGET\r\n$3\r\nkey\r\n";
+    const auto first = rh.frameLength(pipelined);
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(14, first.value());
+    EXPECT_EQ(22, rh.frameLength(pipelined.substr(first.value())));
+}
+
+TEST_F(RespDecoderTest, FrameLengthLargeBulkString)
+{
+    const std::string value(4096, 'x');
+    const auto frame = "$4096\r\n" + value + "\r\n";
+    EXPECT_EQ(frame.size(), rh.frameLength(frame));
+    EXPECT_EQ(std::string_view { value }, rh.decode(frame).second.string_);
+}
+
+TEST_F(RespDecoderTest, FrameLengthMalformed)
+{
+    EXPECT_THROW(static_cast<void>(rh.frameLength("$abc\r\n")), std::invalid_argument);
+    EXPECT_THROW(static_cast<void>(rh.frameLength("$2\r\nabcd\r\n")), std::invalid_argument);
+    EXPECT_THROW(static_cast<void>(rh.frameLength("*-5\r\n")), std::invalid_argument);
+}
+
+TEST_F(RespDecoderTest, DecodeFrameIntoTokens)
+{
+    RespTokenArena tokens {};
+    constexpr std::string_view frame = "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n:42\r\n";
+    EXPECT_EQ(frame.size(), rh.decodeFrame(frame, tokens));
+    ASSERT_EQ(4, tokens.size());
+    EXPECT_EQ(Prefix::ARRAY, tokens[0].type_);
+    EXPECT_EQ(3, tokens[0].count_);
+    EXPECT_EQ("SET", tokens[1].string_);
+    EXPECT_EQ("k", tokens[2].string_);
+    EXPECT_EQ(Prefix::INTEGER, tokens[3].type_);
+    EXPECT_EQ(42, tokens[3].integer_);
+    EXPECT_EQ("42", tokens[3].string_);
+}
+
+TEST_F(RespDecoderTest, DecodeFrameReusesArena)
+{
+    RespTokenArena tokens {};
+    EXPECT_TRUE(rh.decodeFrame("*2\r\n$3\r\nGET\r\n$1\r\nk\r\n", tokens).has_value());
+    const auto capacity = tokens.capacity();
+    EXPECT_TRUE(rh.decodeFrame("*2\r\n$3\r\nGET\r\n$1\r\nj\r\n", tokens).has_value());
+    EXPECT_EQ(3, tokens.size());
+    EXPECT_EQ(capacity, tokens.capacity());
+    EXPECT_EQ("j", tokens[2].string_);
+}
+
+TEST_F(RespDecoderTest, DecodeFrameNested)
+{
+    RespTokenArena tokens {};
+    constexpr std::string_view frame = "*2\r\n*1\r\n:2\r\n$-1\r\n";
+    EXPECT_EQ(frame.size(), rh.decodeFrame(frame, tokens));
+    ASSERT_EQ(4, tokens.size());
+    EXPECT_EQ(1, tokens[1].count_);
+    EXPECT_EQ(2, tokens[2].integer_);
+    EXPECT_TRUE(tokens[3].isNull_);
+}
+
+TEST_F(RespDecoderTest, DecodeFrameIncompleteAndInvalid)
+{
+    RespTokenArena tokens {};
+    EXPECT_FALSE(rh.decodeFrame("*3\r\n$3\r\nSET\r\n$1\r\nk\r\n", tokens).has_value());
+    EXPECT_THROW(static_cast<void>(rh.decodeFrame(":12a\r\n", tokens)), std::invalid_argument);
+}
+
+TEST_F(RespDecoderTest, DecodeInlineCommand)
+{
+    RespTokenArena tokens {};
+    EXPECT_EQ(12, rh.decodeFrame("GET  mykey\r\n*1\r\n", tokens));
+    ASSERT_EQ(3, tokens.size());
+    EXPECT_EQ(2, tokens[0].count_);
+    EXPECT_EQ("GET", tokens[1].string_);
+    EXPECT_EQ("mykey", tokens[2].string_);
+}
+
+TEST_F(RespDecoderTest, DecodeFrameToCommand)
+{
+    RespTokenArena tokens {};
+    EXPECT_TRUE(rh.decodeFrame("*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$5\r\nvalue\r\n", tokens).has_value());
+    const auto command = rh.convertToCommand(tokens);
+    EXPECT_EQ("key", std::get<CommandSet>(command).key_);
+    EXPECT_EQ("value", std::get<CommandSet>(command).value_);
+}
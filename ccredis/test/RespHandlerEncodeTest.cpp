@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <stdexcept>
+#include <string>
 #include <string_view>
 #include <sys/types.h>
 #include <vector>
@@ -56,7 +57,7 @@ TEST_F(RespEncoderTest, BulkString)
 TEST_F(RespEncoderTest, null)
 {
     rh.appendNull();
-    std::vector<char> result { '$', static_cast<char>(-1) };
+    std::vector<char> result { '$', '-', '1' };
     appendCRLF(result);
     EXPECT_EQ(result, rh.getBuffer());
 }
@@ -153,4 +154,49 @@ TEST_F(RespEncoderTest, map)
     appendCRLF(result);
 
     EXPECT_EQ(result, rh.getBuffer());
-}
\ No newline at end of file
+}
+
+TEST_F(RespEncoderTest, MultiDigitLengths)
+{
+    const std::string value(1234, 'x');
+    rh.beginArray(12);
+    rh.appendBulkstring(value);
+    rh.appendInt(int64_t { -9876543210 });
+    std::vector<char> result {};
+    appendChars(result, "*12\r\n$1234\r\n");
+    appendChars(result, value);
+    appendCRLF(result);
+    appendChars(result, ":-9876543210\r\n");
+    EXPECT_EQ(result, rh.getBuffer());
+    EXPECT_EQ(result.size(), rh.size());
+}
+
+TEST_F(RespEncoderTest, SmallOwnedValueIsCopied)
+{
+    rh.appendOwnedBulkstring(std::string { "OK" });
+    EXPECT_EQ(1, rh.segments().size());
+    EXPECT_EQ(std::string_view { "$2\r\nOK\r\n" }, std::string_view(rh.getBuffer().data(), rh.getBuffer().size()));
+}
+
+TEST_F(RespEncoderTest, LargeOwnedValueIsReferenced)
+{
+    std::string value(RespEncoder::minReferencedSize, 'v');
+    const auto* data = value.data();
+    rh.appendSimpleString("OK");
+    rh.appendOwnedBulkstring(std::move(value));
+    rh.appendInt(int64_t { 1 });
+
+    const auto segments = rh.segments();
+    ASSERT_EQ(3, segments.size());
+    EXPECT_EQ(data, segments[1].iov_base);
+    std::string output {};
+    for (const auto& segment : segments) {
+        output.append(static_cast<const char*>(segment.iov_base), segment.iov_len);
+    }
+    EXPECT_EQ("+OK\r\n$4096\r\n" + std::string(RespEncoder::minReferencedSize, 'v') + "\r\n:1\r\n", output);
+    EXPECT_EQ(output.size(), rh.size());
+
+    rh.clearBuffer();
+    EXPECT_TRUE(rh.empty());
+    EXPECT_TRUE(rh.segments().empty());
+}
@@ -0,0 +1,127 @@
+#include "CommandExecutor.h"
+#include "Database.h"
+#include "Script.h"
+#include "ServerContext.h"
+#include "Sha1.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+std::string command(const std::vector<std::string_view>& args)
+{
+    std::string request { "*" };
+    request.append(std::to_string(args.size())).append("\r\n");
+    for (const auto arg : args) {
+        request.append("$").append(std::to_string(arg.size())).append("\r\n").append(arg).append("\r\n");
+    }
+    return request;
+}
+
+class ScriptTest : public ::testing::Test {
+protected:
+    std::string execute(const std::vector<std::string_view>& args)
+    {
+        const auto request = command(args);
+        size_t consumed = 0;
+        std::optional<CommandHandler::FollowerRequest> followerRequest {};
+        EXPECT_EQ(ClientState::Connected, executor_.execute(1, request, consumed, followerRequest));
+        std::string reply {};
+        for (const auto& segment : executor_.encoder().segments()) {
+            reply.append(static_cast<const char*>(segment.iov_base), segment.iov_len);
+        }
+        executor_.encoder().clearBuffer();
+        return reply;
+    }
+
+    CommandExecutor executor_ { ServerContext { .db_ = std::make_shared<Db>(), .scripts_ = std::make_shared<ScriptCache>() } };
+};
+
+constexpr std::string_view counterScript = "GET KEYS[1]; IF 1 INCR KEYS[2]\nSET KEYS[3] ARGV[1]";
+} // namespace
+
+TEST(Sha1Test, KnownDigests)
+{
+    EXPECT_EQ("da39a3ee5e6b4b0d3255bfef95601890afd80709", sha1Hex(""));
+    EXPECT_EQ("a9993e364706816aba3e25717850c26c9cd0d89d", sha1Hex("abc"));
+    EXPECT_EQ("84983e441c3bd26ebaae4aa1f95129e5e54670f1", sha1Hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"));
+    EXPECT_EQ("34aa973cd4c4daa4f61eeb2bdbad27316534016f", sha1Hex(std::string(1'000'000, 'a')));
+}
+
+TEST(ScriptCompileTest, RejectsBadSteps)
+{
+    EXPECT_TRUE(Script::compile(counterScript).has_value());
+    EXPECT_EQ(3u, Script::compile(counterScript).value()->size());
+    EXPECT_EQ("ERR Error compiling script: step 2: unknown command 'FOO'", Script::compile("GET a; FOO b").error());
+    EXPECT_EQ("ERR Error compiling script: step 1: wrong number of arguments for 'GET'", Script::compile("GET a b").error());
+    EXPECT_EQ("ERR Error compiling script: step 1: 'MULTI' is not allowed in scripts", Script::compile("MULTI").error());
+    EXPECT_EQ("ERR Error compiling script: step 1: 'EVAL' is not allowed in scripts", Script::compile("EVAL x 0").error());
+    EXPECT_EQ("ERR Error compiling script: step 1: IF and UNLESS need the number of an earlier step", Script::compile("IF 1 GET a").error());
+    EXPECT_FALSE(Script::compile("INCRBY a notanumber").has_value());
+    EXPECT_FALSE(Script::compile(" ; \n").has_value());
+}
+
+TEST(ScriptCompileTest, TrueReplies)
+{
+    EXPECT_TRUE(isTrueReply("+OK\r\n"));
+    EXPECT_TRUE(isTrueReply("$1\r\n0\r\n"));
+    EXPECT_TRUE(isTrueReply(":10\r\n"));
+    EXPECT_FALSE(isTrueReply(":0\r\n"));
+    EXPECT_FALSE(isTrueReply("$-1\r\n"));
+    EXPECT_FALSE(isTrueReply("*0\r\n"));
+    EXPECT_FALSE(isTrueReply("-ERR no\r\n"));
+}
+
+TEST_F(ScriptTest, EvalRunsTheSteps)
+{
+    // a is missing, so b is not incremented.
+    EXPECT_EQ("*3\r\n$-1\r\n$-1\r\n+OK\r\n", execute({ "EVAL", counterScript, "3", "a", "b", "c", "done" }));
+    EXPECT_EQ("$4\r\ndone\r\n", execute({ "GET", "c" }));
+    execute({ "SET", "a", "1" });
+    EXPECT_EQ("*3\r\n$1\r\n1\r\n:1\r\n+OK\r\n", execute({ "EVAL", counterScript, "3", "a", "b", "c", "again" }));
+    EXPECT_EQ("*2\r\n:1\r\n$-1\r\n", execute({ "EVAL", "EXISTS KEYS[1]; UNLESS 1 DEL KEYS[1]", "1", "a" }));
+}
+
+TEST_F(ScriptTest, EvalshaRunsALoadedScript)
+{
+    const auto sha = sha1Hex(counterScript);
+    EXPECT_EQ("*1\r\n:0\r\n", execute({ "SCRIPT", "EXISTS", sha }));
+    EXPECT_EQ("-NOSCRIPT No matching script. Please use EVAL.\r\n", execute({ "EVALSHA", sha, "0" }));
+    std::string loaded { "$40\r\n" };
+    loaded.append(sha).append("\r\n");
+    EXPECT_EQ(loaded, execute({ "SCRIPT", "LOAD", counterScript }));
+    EXPECT_EQ("*2\r\n:1\r\n:0\r\n", execute({ "SCRIPT", "EXISTS", sha, "ffff" }));
+
+    execute({ "SET", "a", "x" });
+    EXPECT_EQ("*3\r\n$1\r\nx\r\n:1\r\n+OK\r\n", execute({ "EVALSHA", sha, "3", "a", "b", "c", "v" }));
+    EXPECT_EQ("*3\r\n$1\r\nx\r\n:2\r\n+OK\r\n", execute({ "EVALSHA", sha, "3", "a", "b", "c", "v" }));
+    EXPECT_EQ("-ERR the script uses 3 keys and 1 arguments\r\n", execute({ "EVALSHA", sha, "1", "a" }));
+    EXPECT_TRUE(execute({ "EVALSHA", sha, "4", "a" }).starts_with("*2\r\n-Number of keys can't be greater"));
+
+    EXPECT_EQ("+OK\r\n", execute({ "SCRIPT", "FLUSH" }));
+    EXPECT_EQ("*1\r\n:0\r\n", execute({ "SCRIPT", "EXISTS", sha }));
+}
+
+TEST_F(ScriptTest, NotInTransactions)
+{
+    execute({ "MULTI" });
+    EXPECT_EQ("-ERR Command not allowed inside a transaction\r\n", execute({ "EVAL", "PING", "0" }));
+    execute({ "DISCARD" });
+}
+
+TEST(ScriptDisabledTest, CommandsFail)
+{
+    CommandExecutor executor { ServerContext { .db_ = std::make_shared<Db>() } };
+    const std::string request { "*3\r\n$4\r\nEVAL\r\n$4\r\nPING\r\n$1\r\n0\r\n" };
+    size_t consumed = 0;
+    std::optional<CommandHandler::FollowerRequest> followerRequest {};
+    EXPECT_EQ(ClientState::Connected, executor.execute(1, request, consumed, followerRequest));
+    EXPECT_EQ("-ERR scripting is disabled\r\n", std::string(executor.encoder().getBuffer().begin(), executor.encoder().getBuffer().end()));
+}
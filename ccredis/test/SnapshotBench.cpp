@@ -0,0 +1,89 @@
+#include "AppendOnlyFile.h"
+#include "Database.h"
+#include "Snapshot.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+const std::string path { "/tmp/snapshot_bench.ccrdb" };
+
+// Fills a Db with numKeys keys of 16 byte values, every tenth one with a TTL.
+std::unique_ptr<Db> populate(const size_t numKeys)
+{
+    auto db = std::make_unique<Db>();
+    const auto expire = std::chrono::system_clock::now() + std::chrono::hours { 1 };
+    std::vector<std::string> keys {};
+    std::vector<BulkEntry> batch {};
+    constexpr size_t batchSize = 64 * 1024;
+    for (size_t i = 0; i < numKeys; i += batchSize) {
+        keys.clear();
+        batch.clear();
+        for (size_t j = i; j < std::min(numKeys, i + batchSize); ++j) {
+            keys.push_back("key:" + std::to_string(j));
+        }
+        for (size_t j = 0; j < keys.size(); ++j) {
+            batch.push_back(BulkEntry { .key_ = keys[j], .value_ = "value-0123456789",
+                .expire_ = (i + j) % 10 == 0 ? std::optional { expire } : std::nullopt });
+        }
+        db->insertBulk(batch);
+    }
+    return db;
+}
+
+void BM_SaveSnapshot(benchmark::State& state)
+{
+    const auto db = populate(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(saveSnapshot(*db, path));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_LoadSnapshot(benchmark::State& state)
+{
+    saveSnapshot(*populate(state.range(0)), path).value();
+    for (auto _ : state) {
+        auto db = std::make_unique<Db>();
+        benchmark::DoNotOptimize(loadSnapshot(*db, path));
+        // Freeing the keyspace is not part of the load.
+        state.PauseTiming();
+        db.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    std::remove(path.c_str());
+}
+
+// Replays a log of one SET per key, as left by a rewrite, through the RespDecoder.
+void BM_ReplayAppendOnlyFile(benchmark::State& state)
+{
+    const std::string aofPath { "/tmp/snapshot_bench.aof" };
+    std::remove(aofPath.c_str());
+    {
+        auto db = std::shared_ptr<Db> { populate(state.range(0)) };
+        auto aof = AppendOnlyFile::open(aofPath, FsyncPolicy::No).value();
+        aof->startRewrite(db);
+    }
+    for (auto _ : state) {
+        auto db = std::make_unique<Db>();
+        benchmark::DoNotOptimize(replayAppendOnlyFile(*db, aofPath));
+        state.PauseTiming();
+        db.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    std::remove(aofPath.c_str());
+}
+} // namespace
+
+BENCHMARK(BM_SaveSnapshot)->Arg(1'000'000)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_LoadSnapshot)->Arg(1'000'000)->Arg(10'000'000)->Iterations(3)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_ReplayAppendOnlyFile)->Arg(1'000'000)->Iterations(3)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
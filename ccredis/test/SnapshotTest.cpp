@@ -0,0 +1,141 @@
+#include "Database.h"
+#include "Snapshot.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+class SnapshotTest : public testing::Test {
+protected:
+    void TearDown() override
+    {
+        std::remove(path.c_str());
+    }
+
+    // One file per test, as ctest may run them in parallel.
+    const std::string path { testing::TempDir() + "snapshot_test_"
+        + testing::UnitTest::GetInstance()->current_test_info()->name() + ".ccrdb" };
+    Db db {};
+};
+
+TEST_F(SnapshotTest, RoundTrip)
+{
+    const auto expire = std::chrono::time_point_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now() + std::chrono::hours { 1 });
+    db.set("key", "value");
+    db.set("binary", std::string_view { "a\0\r\nb", 5 });
+    db.set("empty", "");
+    db.set("ttl", "value", expire);
+    for (int i = 0; i < 1000; ++i) {
+        db.set(std::to_string(i), std::to_string(i * i));
+    }
+    ASSERT_EQ(1004, saveSnapshot(db, path).value());
+
+    Db loaded {};
+    ASSERT_EQ(1004, loadSnapshot(loaded, path).value());
+    EXPECT_EQ(1004, loaded.size());
+    EXPECT_EQ(ValueType { "value" }, loaded.get("key").value());
+    EXPECT_EQ(ValueType { std::string_view("a\0\r\nb", 5) }, loaded.get("binary").value());
+    EXPECT_EQ(ValueType { "" }, loaded.get("empty").value());
+    EXPECT_EQ(ValueType { "998001" }, loaded.get("999").value());
+    EXPECT_FALSE(loaded.get("key").value().expire_.has_value());
+    EXPECT_EQ(expire, loaded.get("ttl").value().expire_);
+}
+
+TEST_F(SnapshotTest, CollectionsRoundTrip)
+{
+    std::vector<std::string> elements {};
+    for (int i = 0; i < 1000; ++i) {
+        elements.push_back(std::to_string(i));
+    }
+    const std::vector<std::string_view> many { elements.begin(), elements.end() };
+    const std::vector<std::string_view> few { "a", std::string_view { "b\0c", 3 } };
+    const std::vector<std::pair<std::string_view, std::string_view>> fields { { "f1", "v1" }, { "f2", "" } };
+    db.hashSet("hash", fields);
+    db.listPush("packed list", few, Db::ListEnd::Back);
+    db.listPush("list", many, Db::ListEnd::Front);
+    db.setAdd("packed set", few);
+    db.setAdd("set", many);
+    db.set("string", "value");
+    ASSERT_EQ(6, saveSnapshot(db, path).value());
+
+    Db loaded {};
+    ASSERT_EQ(6, loadSnapshot(loaded, path).value());
+    for (const auto key : { "hash", "packed list", "list", "packed set", "set", "string" }) {
+        EXPECT_EQ(db.get(key).value(), loaded.get(key).value()) << key;
+    }
+    EXPECT_FALSE(loaded.get("set")->as<SetValue>()->isPacked());
+}
+
+TEST_F(SnapshotTest, ExpiredKeysAreNotLoaded)
+{
+    const auto now = std::chrono::system_clock::now();
+    db.set("soon", "value", now + std::chrono::milliseconds { 20 });
+    db.set("later", "value", now + std::chrono::hours { 1 });
+    ASSERT_EQ(2, saveSnapshot(db, path).value());
+    std::this_thread::sleep_for(std::chrono::milliseconds { 30 });
+
+    Db loaded {};
+    EXPECT_EQ(1, loadSnapshot(loaded, path).value());
+    EXPECT_FALSE(loaded.get("soon").has_value());
+    // The TTL still applies to the loaded keys.
+    EXPECT_EQ(1, loaded.expireCycle(10, now + std::chrono::hours { 2 }));
+}
+
+TEST_F(SnapshotTest, MissingFileLoadsNothing)
+{
+    EXPECT_EQ(0, loadSnapshot(db, path).value());
+}
+
+TEST_F(SnapshotTest, CorruptionIsDetected)
+{
+    db.set("key", "value");
+    ASSERT_TRUE(saveSnapshot(db, path).has_value());
+    {
+        std::fstream file { path, std::ios::in | std::ios::out | std::ios::binary };
+        file.seekp(12);
+        file.put('X');
+    }
+    Db loaded {};
+    const auto result = loadSnapshot(loaded, path);
+    ASSERT_FALSE(result.has_value());
+    EXPECT_NE(std::string::npos, result.error().find("checksum"));
+    EXPECT_EQ(0, loaded.size());
+}
+
+TEST_F(SnapshotTest, TruncatedFileIsRejected)
+{
+    db.set("key", "value");
+    ASSERT_TRUE(saveSnapshot(db, path).has_value());
+    {
+        std::ofstream file { path, std::ios::binary | std::ios::trunc };
+        file << "CCRDB001";
+    }
+    EXPECT_FALSE(loadSnapshot(db, path).has_value());
+}
+
+TEST_F(SnapshotTest, BackgroundSave)
+{
+    auto shared = std::make_shared<Db>();
+    shared->set("key", "value");
+    Snapshotter snapshotter { shared, path };
+    EXPECT_EQ(0, snapshotter.lastSaveTime());
+    ASSERT_TRUE(snapshotter.startBackgroundSave());
+    while (snapshotter.backgroundSaveInProgress()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds { 1 });
+    }
+    EXPECT_TRUE(snapshotter.lastSaveSucceeded());
+    EXPECT_NE(0, snapshotter.lastSaveTime());
+
+    Db loaded {};
+    EXPECT_EQ(1, loadSnapshot(loaded, path).value());
+    EXPECT_EQ(1, snapshotter.save().value());
+}
@@ -0,0 +1,192 @@
+// Closed-loop load generator for the server. Every client thread keeps one
+// connection, sends --pipeline requests, waits for all replies and repeats. The latency
+// percentiles are over these round trips.
+//
+//   ./server --threads 4 &
+//   ./throughput_bench --port 6379 --clients 64 --seconds 5 --command set
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+struct BenchConfig {
+    std::string host { "127.0.0.1" };
+    int port { 6379 };
+    unsigned clients { 50 };
+    unsigned seconds { 5 };
+    unsigned pipeline { 1 };
+    std::string command { "ping" };
+};
+
+struct Workload {
+    std::string request {};
+    size_t replySize {};
+};
+
+Workload makeWorkload(const std::string_view command)
+{
+    if (command == "set") {
+        return { "*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$5\r\nvalue\r\n", std::string_view { "+OK\r\n" }.size() };
+    }
+    if (command == "get") {
+        return { "*2\r\n$3\r\nGET\r\n$3\r\nkey\r\n", std::string_view { "$5\r\nvalue\r\n" }.size() };
+    }
+    return { "*1\r\n$4\r\nPING\r\n", std::string_view { "$4\r\nPONG\r\n" }.size() };
+}
+
+int connectTo(const BenchConfig& config)
+{
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config.port);
+    inet_pton(AF_INET, config.host.c_str(), &addr.sin_addr);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == -1) {
+        perror("connect");
+        exit(1);
+    }
+    constexpr int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof yes);
+    return fd;
+}
+
+bool sendAll(int fd, std::string_view data)
+{
+    while (!data.empty()) {
+        const auto n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data.remove_prefix(n);
+    }
+    return true;
+}
+
+bool recvExactly(int fd, std::vector<char>& buf, size_t size)
+{
+    buf.resize(size);
+    size_t received = 0;
+    while (received < size) {
+        const auto n = recv(fd, buf.data() + received, size - received, 0);
+        if (n <= 0) {
+            return false;
+        }
+        received += n;
+    }
+    return true;
+}
+
+// Round trip times of all clients, merged when a client finishes.
+struct Latencies {
+    std::mutex mutex {};
+    std::vector<std::chrono::nanoseconds> samples {};
+
+    void merge(const std::vector<std::chrono::nanoseconds>& clientSamples)
+    {
+        std::lock_guard lock { mutex };
+        samples.insert(samples.end(), clientSamples.begin(), clientSamples.end());
+    }
+
+    // In milliseconds, eg: percentile(0.99)
+    double percentile(const double fraction)
+    {
+        if (samples.empty()) {
+            return 0;
+        }
+        const auto index = std::min(samples.size() - 1, static_cast<size_t>(fraction * samples.size()));
+        std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+        return std::chrono::duration<double, std::milli>(samples[index]).count();
+    }
+};
+
+void runClient(const BenchConfig& config, const Workload& workload,
+    const std::atomic<bool>& stop, std::atomic<uint64_t>& completed, Latencies& latencies)
+{
+    const int fd = connectTo(config);
+    std::string batch {};
+    for (unsigned i = 0; i < config.pipeline; ++i) {
+        batch += workload.request;
+    }
+    std::vector<char> replies {};
+    std::vector<std::chrono::nanoseconds> samples {};
+    uint64_t done = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+        const auto start = std::chrono::steady_clock::now();
+        if (!sendAll(fd, batch) || !recvExactly(fd, replies, workload.replySize * config.pipeline)) {
+            std::cerr << "Connection lost\n";
+            break;
+        }
+        samples.push_back(std::chrono::steady_clock::now() - start);
+        done += config.pipeline;
+    }
+    completed += done;
+    latencies.merge(samples);
+    close(fd);
+}
+
+unsigned toUnsigned(const std::string_view str)
+{
+    unsigned value {};
+    std::from_chars(str.data(), str.data() + str.size(), value);
+    return value;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    BenchConfig config {};
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string_view option { argv[i] };
+        const std::string_view value { argv[i + 1] };
+        if (option == "--host") {
+            config.host = value;
+        } else if (option == "--port") {
+            config.port = static_cast<int>(toUnsigned(value));
+        } else if (option == "--clients") {
+            config.clients = toUnsigned(value);
+        } else if (option == "--seconds") {
+            config.seconds = toUnsigned(value);
+        } else if (option == "--pipeline") {
+            config.pipeline = toUnsigned(value);
+        } else if (option == "--command") {
+            config.command = value;
+        }
+    }
+
+    const auto workload = makeWorkload(config.command);
+    std::atomic<bool> stop { false };
+    std::atomic<uint64_t> completed { 0 };
+    Latencies latencies {};
+    std::vector<std::jthread> clients {};
+    for (unsigned i = 0; i < config.clients; ++i) {
+        clients.emplace_back([&]() { runClient(config, workload, stop, completed, latencies); });
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds { config.seconds });
+    stop = true;
+    clients.clear();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << config.command << ": " << static_cast<uint64_t>(completed.load() / elapsed.count())
+              << " requests per second (" << config.clients << " clients, pipeline "
+              << config.pipeline << "), " << std::fixed << std::setprecision(3)
+              << "p50=" << latencies.percentile(0.5) << " p99=" << latencies.percentile(0.99)
+              << " p999=" << latencies.percentile(0.999) << " msec\n";
+}
@@ -0,0 +1,186 @@
+#include "CommandExecutor.h"
+#include "Commands.h"
+#include "Database.h"
+#include "ServerContext.h"
+#include "Transaction.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+std::string command(const std::vector<std::string_view>& args)
+{
+    std::string request { "*" };
+    request.append(std::to_string(args.size())).append("\r\n");
+    for (const auto arg : args) {
+        request.append("$").append(std::to_string(arg.size())).append("\r\n").append(arg).append("\r\n");
+    }
+    return request;
+}
+
+// Two clients of one reactor.
+class TransactionTest : public ::testing::Test {
+protected:
+    std::string execute(const uint64_t client, const std::vector<std::string_view>& args)
+    {
+        // The input is gone after the call, like the reused input buffer of a connection.
+        auto request = std::make_unique<std::string>(command(args));
+        size_t consumed = 0;
+        std::optional<CommandHandler::FollowerRequest> followerRequest {};
+        EXPECT_EQ(ClientState::Connected, executor_.execute(client, *request, consumed, followerRequest));
+        EXPECT_EQ(request->size(), consumed);
+        request->assign(request->size(), 'x');
+        std::string reply {};
+        for (const auto& segment : executor_.encoder().segments()) {
+            reply.append(static_cast<const char*>(segment.iov_base), segment.iov_len);
+        }
+        executor_.encoder().clearBuffer();
+        return reply;
+    }
+
+    std::shared_ptr<Db> db_ { std::make_shared<Db>() };
+    CommandExecutor executor_ { ServerContext { .db_ = db_ } };
+};
+} // namespace
+
+TEST(KeyVersionTest, ChangesOnEveryWrite)
+{
+    Db db {};
+    const auto missing = db.version("key");
+    db.set("key", "1");
+    const auto created = db.version("key");
+    EXPECT_NE(missing, created);
+    EXPECT_EQ(created, db.version("key"));
+    EXPECT_TRUE(db.incrementBy("key", 1).has_value());
+    const auto incremented = db.version("key");
+    EXPECT_NE(created, incremented);
+
+    // Created and removed again since it was missing.
+    const auto gone = db.version("other");
+    db.set("other", "1");
+    const std::vector<KeyT> keys { "other" };
+    EXPECT_EQ(1u, db.removeMany(keys));
+    EXPECT_NE(gone, db.version("other"));
+}
+
+TEST(KeyVersionTest, LockedShardsAreNotLockedAgain)
+{
+    Db db {};
+    const std::vector<KeyT> keys { "a", "b", "c" };
+    {
+        const auto locked = db.lockShards(Db::allShards);
+        db.set("a", "1");
+        db.setMany(std::vector<std::pair<KeyT, std::string_view>> { { "b", "2" }, { "c", "3" } });
+        EXPECT_EQ(3u, db.countExisting(keys));
+        EXPECT_EQ(3u, db.size());
+    }
+    EXPECT_EQ(3u, db.removeMany(keys));
+}
+
+TEST(TransactionCommandTest, ShardsOfCommands)
+{
+    CommandGet get {};
+    get.key_ = "key";
+    EXPECT_EQ(uint64_t { 1 } << Db::shardOf("key"), shardsOf(get));
+    CommandDel del {};
+    del.keys_ = { "a", "b" };
+    EXPECT_EQ((uint64_t { 1 } << Db::shardOf("a")) | (uint64_t { 1 } << Db::shardOf("b")), shardsOf(del));
+    EXPECT_EQ(0u, shardsOf(CommandPing {}));
+    EXPECT_EQ(Db::allShards, shardsOf(CommandInfo {}));
+    EXPECT_FALSE(allowedInTransaction(CommandSave {}));
+    EXPECT_TRUE(controlsTransaction(CommandExec {}));
+    EXPECT_FALSE(controlsTransaction(CommandUnwatch {}));
+}
+
+TEST_F(TransactionTest, QueuesAndExecutes)
+{
+    EXPECT_EQ("+OK\r\n", execute(1, { "MULTI" }));
+    EXPECT_EQ("+QUEUED\r\n", execute(1, { "SET", "counter", "10" }));
+    EXPECT_EQ("+QUEUED\r\n", execute(1, { "INCRBY", "counter", "5" }));
+    EXPECT_EQ("+QUEUED\r\n", execute(1, { "MGET", "counter", "missing" }));
+    // Nothing ran yet, and other clients are not affected.
+    EXPECT_EQ("$-1\r\n", execute(2, { "GET", "counter" }));
+    EXPECT_EQ("*3\r\n+OK\r\n:15\r\n*2\r\n$2\r\n15\r\n$-1\r\n", execute(1, { "EXEC" }));
+    EXPECT_EQ("$2\r\n15\r\n", execute(2, { "GET", "counter" }));
+    EXPECT_EQ("-ERR EXEC without MULTI\r\n", execute(1, { "EXEC" }));
+}
+
+TEST_F(TransactionTest, Discard)
+{
+    EXPECT_EQ("-ERR DISCARD without MULTI\r\n", execute(1, { "DISCARD" }));
+    execute(1, { "MULTI" });
+    EXPECT_EQ("-ERR MULTI calls can not be nested\r\n", execute(1, { "MULTI" }));
+    execute(1, { "SET", "key", "value" });
+    EXPECT_EQ("+OK\r\n", execute(1, { "DISCARD" }));
+    EXPECT_EQ("$-1\r\n", execute(1, { "GET", "key" }));
+}
+
+TEST_F(TransactionTest, ErrorsWhileQueuingAbort)
+{
+    execute(1, { "MULTI" });
+    EXPECT_EQ("+QUEUED\r\n", execute(1, { "SET", "key", "value" }));
+    EXPECT_NE("+QUEUED\r\n", execute(1, { "GET" }));
+    EXPECT_EQ("-ERR Command not allowed inside a transaction\r\n", execute(1, { "SAVE" }));
+    EXPECT_EQ("-EXECABORT Transaction discarded because of previous errors.\r\n", execute(1, { "EXEC" }));
+    EXPECT_EQ("$-1\r\n", execute(1, { "GET", "key" }));
+
+    // Errors of queued commands as they run do not stop the others.
+    execute(1, { "SET", "text", "abc" });
+    execute(1, { "MULTI" });
+    execute(1, { "INCR", "text" });
+    execute(1, { "SET", "key", "value" });
+    EXPECT_EQ("*2\r\n-ERR value is not an integer or out of range\r\n+OK\r\n", execute(1, { "EXEC" }));
+}
+
+TEST_F(TransactionTest, WatchedKeyChanged)
+{
+    execute(1, { "SET", "balance", "100" });
+    EXPECT_EQ("+OK\r\n", execute(1, { "WATCH", "balance", "missing" }));
+    execute(1, { "MULTI" });
+    EXPECT_EQ("-ERR WATCH inside MULTI is not allowed\r\n", execute(1, { "WATCH", "other" }));
+    execute(1, { "DECRBY", "balance", "30" });
+    EXPECT_EQ(":150\r\n", execute(2, { "INCRBY", "balance", "50" }));
+    EXPECT_EQ("*-1\r\n", execute(1, { "EXEC" }));
+    EXPECT_EQ("$3\r\n150\r\n", execute(1, { "GET", "balance" }));
+
+    // The keys are no longer watched after EXEC, and not after UNWATCH either.
+    execute(1, { "WATCH", "balance" });
+    execute(1, { "UNWATCH" });
+    execute(2, { "SET", "balance", "0" });
+    execute(1, { "MULTI" });
+    execute(1, { "INCR", "balance" });
+    EXPECT_EQ("*1\r\n:1\r\n", execute(1, { "EXEC" }));
+}
+
+TEST_F(TransactionTest, WatchedKeyCreated)
+{
+    execute(1, { "WATCH", "lock" });
+    execute(2, { "SET", "lock", "held" });
+    execute(2, { "DEL", "lock" });
+    execute(1, { "MULTI" });
+    execute(1, { "SET", "lock", "mine" });
+    EXPECT_EQ("*-1\r\n", execute(1, { "EXEC" }));
+
+    execute(1, { "WATCH", "lock" });
+    execute(1, { "MULTI" });
+    execute(1, { "SET", "lock", "mine" });
+    EXPECT_EQ("*1\r\n+OK\r\n", execute(1, { "EXEC" }));
+}
+
+TEST_F(TransactionTest, DisconnectEndsTransaction)
+{
+    execute(1, { "MULTI" });
+    execute(1, { "SET", "key", "value" });
+    executor_.onDisconnect(1);
+    // A new connection may get the same id.
+    EXPECT_EQ("-ERR EXEC without MULTI\r\n", execute(1, { "EXEC" }));
+    EXPECT_EQ("$-1\r\n", execute(1, { "GET", "key" }));
+}